@@ -0,0 +1,175 @@
+#include "counter.h"
+
+#include <pthread.h>    // For pthread_mutex_t, pthread_mutex_lock, pthread_mutex_unlock
+#include <sched.h>      // For sched_yield
+#include <stdatomic.h>  // For _Atomic, atomic_fetch_add_explicit, atomic_exchange_explicit
+#include <stdlib.h>     // For aligned_alloc, calloc, free
+#include <string.h>     // For memset, strcmp
+
+#define CACHE_LINE 64
+#define SPINS_BEFORE_YIELD 1024  // A lock holder that was preempted will not come back while we spin
+
+// One thread's slot, alone on its cache line
+typedef struct {
+  // Sharded: the thread's share; combining: its posted add, 0 if none
+  _Alignas(CACHE_LINE) _Atomic long long value;
+} counter_slot_t;
+
+struct counter {
+  counter_kind_t kind;
+  unsigned int threads;
+  counter_slot_t *slots;  // Sharded and combining, one per thread
+  long long *taken;       // Combining: the adds the current combiner took from each slot
+  pthread_mutex_t mutex;
+  // The value and the lock that guards it share their own line: whoever holds one writes the other.
+  // The value is atomic, with relaxed loads and stores under the locks, since counter_read() may
+  // run at any time.
+  _Alignas(CACHE_LINE) _Atomic int locked;  // Spinlock and combining
+  _Atomic long long value;
+};
+
+static const char *kind_names[NUM_COUNTER_KINDS] = {"racy", "mutex", "spinlock", "atomic", "sharded", "combining"};
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Test-and-test-and-set: spin on a plain load, which stays in our cache until the holder's
+// release invalidates it, and only then try the exchange
+static void spin_lock(_Atomic int *lock) {
+  unsigned int spins = 0;
+  while (atomic_exchange_explicit(lock, 1, memory_order_acquire)) {
+    while (atomic_load_explicit(lock, memory_order_relaxed)) {
+      cpu_relax();
+      if (++spins % SPINS_BEFORE_YIELD == 0) sched_yield();
+    }
+  }
+}
+
+static void spin_unlock(_Atomic int *lock) { atomic_store_explicit(lock, 0, memory_order_release); }
+
+// Under a lock: nobody else writes the value meanwhile
+static void add_locked(counter_t *counter, long long delta) {
+  long long value = atomic_load_explicit(&counter->value, memory_order_relaxed);
+  atomic_store_explicit(&counter->value, value + delta, memory_order_relaxed);
+}
+
+// Post delta in our slot and wait until some combiner has applied it, becoming the combiner
+// ourselves whenever the lock is free. The combiner owns the value's line for a whole batch.
+static void combining_add(counter_t *counter, unsigned int thread, long long delta) {
+  _Atomic long long *request = &counter->slots[thread].value;
+  atomic_store_explicit(request, delta, memory_order_release);
+  unsigned int spins = 0;
+  while (atomic_load_explicit(request, memory_order_acquire) != 0) {
+    if (atomic_load_explicit(&counter->locked, memory_order_relaxed) ||
+        atomic_exchange_explicit(&counter->locked, 1, memory_order_acquire)) {
+      cpu_relax();
+      if (++spins % SPINS_BEFORE_YIELD == 0) sched_yield();
+      continue;
+    }
+    // Apply every posted add before clearing any slot, so that an add has been counted by the
+    // time its thread sees its slot cleared. Only a slot's owner posts and only the combiner
+    // clears, so what was taken is still there in the second pass.
+    long long sum = 0;
+    for (unsigned int i = 0; i < counter->threads; ++i) {
+      counter->taken[i] = atomic_load_explicit(&counter->slots[i].value, memory_order_acquire);
+      sum += counter->taken[i];
+    }
+    add_locked(counter, sum);
+    for (unsigned int i = 0; i < counter->threads; ++i) {
+      if (counter->taken[i] != 0) atomic_store_explicit(&counter->slots[i].value, 0, memory_order_release);
+    }
+    spin_unlock(&counter->locked);
+  }
+}
+
+counter_t *counter_create(counter_kind_t kind, unsigned int threads) {
+  counter_t *counter = aligned_alloc(CACHE_LINE, sizeof(counter_t));
+  if (counter == NULL) return NULL;
+  memset(counter, 0, sizeof(counter_t));
+  counter->kind = kind;
+  counter->threads = threads > 0 ? threads : 1;
+  pthread_mutex_init(&counter->mutex, NULL);
+  if (kind == COUNTER_SHARDED || kind == COUNTER_COMBINING) {
+    counter->slots = aligned_alloc(CACHE_LINE, counter->threads * sizeof(counter_slot_t));
+    counter->taken = calloc(counter->threads, sizeof(long long));
+    if (counter->slots == NULL || counter->taken == NULL) {
+      counter_destroy(counter);
+      return NULL;
+    }
+    memset(counter->slots, 0, counter->threads * sizeof(counter_slot_t));
+  }
+  return counter;
+}
+
+void counter_add(counter_t *counter, unsigned int thread, long long delta) {
+  switch (counter->kind) {
+    case COUNTER_RACY:
+      add_locked(counter, delta);  // Without the lock: two threads can load the same value
+      break;
+    case COUNTER_MUTEX:
+      pthread_mutex_lock(&counter->mutex);
+      add_locked(counter, delta);
+      pthread_mutex_unlock(&counter->mutex);
+      break;
+    case COUNTER_SPINLOCK:
+      spin_lock(&counter->locked);
+      add_locked(counter, delta);
+      spin_unlock(&counter->locked);
+      break;
+    case COUNTER_ATOMIC:
+      atomic_fetch_add_explicit(&counter->value, delta, memory_order_relaxed);
+      break;
+    case COUNTER_SHARDED:
+      // Atomic rather than load and store, so that threads past the slots can share one
+      atomic_fetch_add_explicit(&counter->slots[thread % counter->threads].value, delta, memory_order_relaxed);
+      break;
+    case COUNTER_COMBINING:
+      if (delta == 0) break;  // 0 marks an empty slot
+      if (thread < counter->threads) {
+        combining_add(counter, thread, delta);
+      } else {
+        spin_lock(&counter->locked);
+        add_locked(counter, delta);
+        spin_unlock(&counter->locked);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+long long counter_read(counter_t *counter) {
+  if (counter->kind != COUNTER_SHARDED) return atomic_load_explicit(&counter->value, memory_order_relaxed);
+  long long sum = 0;
+  for (unsigned int i = 0; i < counter->threads; ++i) {
+    sum += atomic_load_explicit(&counter->slots[i].value, memory_order_relaxed);
+  }
+  return sum;
+}
+
+void counter_destroy(counter_t *counter) {
+  if (counter == NULL) return;
+  pthread_mutex_destroy(&counter->mutex);
+  free(counter->slots);
+  free(counter->taken);
+  free(counter);
+}
+
+const char *counter_kind_name(counter_kind_t kind) {
+  return (unsigned int)kind < NUM_COUNTER_KINDS ? kind_names[kind] : "unknown";
+}
+
+int counter_kind_parse(const char *name, counter_kind_t *kind) {
+  for (int i = 0; i < NUM_COUNTER_KINDS; ++i) {
+    if (strcmp(name, kind_names[i]) == 0) {
+      *kind = (counter_kind_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,42 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+// A shared event counter behind one interface, in the implementations lab8-9_2 and lab10-11_1
+// compare and the ones that scale past them:
+//  - racy:      load, add, store, like lab8-9_2's counter++; loses updates under contention
+//  - mutex:     pthread_mutex_t around the add, like lab10-11_1
+//  - spinlock:  test-and-test-and-set lock around the add, yielding when it spins too long
+//  - atomic:    one atomic_fetch_add; every add still moves the cache line to the adding core
+//  - sharded:   one cache-line-padded slot per thread, summed by counter_read(): adds never share
+//               a line, reads cost one load per thread
+//  - combining: flat combining: threads post their add in their own slot, and whichever takes
+//               the lock applies every posted add at once, so the value's line moves once per batch
+
+typedef enum {
+  COUNTER_RACY,
+  COUNTER_MUTEX,
+  COUNTER_SPINLOCK,
+  COUNTER_ATOMIC,
+  COUNTER_SHARDED,
+  COUNTER_COMBINING,
+  NUM_COUNTER_KINDS
+} counter_kind_t;
+
+typedef struct counter counter_t;
+
+// threads is how many threads will add, each with its own index below it. NULL when out of memory.
+counter_t *counter_create(counter_kind_t kind, unsigned int threads);
+
+// Add delta on behalf of thread (0 .. threads - 1, distinct per thread). Indexes past threads are
+// still counted correctly, without the per-thread slot.
+void counter_add(counter_t *counter, unsigned int thread, long long delta);
+
+// The total of every add that has returned (racy: that has not been lost)
+long long counter_read(counter_t *counter);
+
+void counter_destroy(counter_t *counter);
+
+const char *counter_kind_name(counter_kind_t kind);
+int counter_kind_parse(const char *name, counter_kind_t *kind);
+
+#endif  // COUNTER_H
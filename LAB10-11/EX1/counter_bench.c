@@ -0,0 +1,147 @@
+// Contention benchmark for the counter implementations: 1, 2, 4, ... up to all online CPUs (or
+// --threads) each add 1 to one shared counter --ops times, all starting together. Reports the wall
+// time per add across all threads, the time a thread took per add of its own (with more threads
+// than CPUs, that includes waiting for a CPU), and whether the final value is threads * ops.
+#include <getopt.h>   // For getopt_long
+#include <pthread.h>  // For pthread_create, pthread_join, pthread_barrier_*
+#include <stdio.h>    // For printf, fprintf, perror
+#include <stdlib.h>   // For EXIT_SUCCESS, EXIT_FAILURE, atoi, atol, exit
+#include <time.h>     // For clock_gettime
+#include <unistd.h>   // For sysconf
+
+#include "counter.h"
+
+#define DEFAULT_OPS 1000000L  // Adds per thread
+#define MAX_THREADS 256
+
+typedef struct {
+  counter_t *counter;
+  pthread_barrier_t *start;
+  unsigned int thread;
+  long ops;
+  long long begin_ns;  // Past the barrier
+  long long end_ns;    // After the last add
+} worker_arg_t;
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void *worker(void *arg) {
+  worker_arg_t *worker_arg = arg;
+  pthread_barrier_wait(worker_arg->start);
+  worker_arg->begin_ns = now_ns();
+  for (long i = 0; i < worker_arg->ops; ++i) counter_add(worker_arg->counter, worker_arg->thread, 1);
+  worker_arg->end_ns = now_ns();
+  return NULL;
+}
+
+// Doubling thread counts, then the maximum itself when it is not a power of two
+int next_thread_count(int threads, int max_threads) {
+  if (threads < max_threads && threads * 2 > max_threads) return max_threads;
+  return threads * 2;
+}
+
+// One kind at one thread count; returns 0 when the final value is right
+int run(counter_kind_t kind, int threads, long ops) {
+  counter_t *counter = counter_create(kind, threads);
+  pthread_t tids[MAX_THREADS];
+  worker_arg_t args[MAX_THREADS];
+  pthread_barrier_t start;
+  if (counter == NULL) {
+    perror("counter_create failed");
+    return -1;
+  }
+
+  // Every worker starts its clock past the barrier; the run lasts from the first start to the last end
+  pthread_barrier_init(&start, NULL, threads + 1);
+  for (int i = 0; i < threads; ++i) {
+    args[i] = (worker_arg_t){counter, &start, (unsigned int)i, ops, 0, 0};
+    if (pthread_create(&tids[i], NULL, worker, &args[i]) != 0) {
+      fprintf(stderr, "Error creating thread %d\n", i);
+      exit(EXIT_FAILURE);  // The workers already created wait at the barrier for good
+    }
+  }
+  pthread_barrier_wait(&start);
+  for (int i = 0; i < threads; ++i) pthread_join(tids[i], NULL);
+  pthread_barrier_destroy(&start);
+  long long first = args[0].begin_ns, last = args[0].end_ns, busy = 0;
+  for (int i = 0; i < threads; ++i) {
+    if (args[i].begin_ns < first) first = args[i].begin_ns;
+    if (args[i].end_ns > last) last = args[i].end_ns;
+    busy += args[i].end_ns - args[i].begin_ns;
+  }
+  double elapsed = (double)(last - first);
+
+  long long expected = (long long)threads * ops;
+  long long value = counter_read(counter);
+  double total_ops = (double)threads * ops;
+  printf("%-10s %7d %12.0f %9.2f %13.2f %8.1f  ", counter_kind_name(kind), threads, total_ops, elapsed / total_ops,
+         busy / total_ops, total_ops / elapsed * 1e3);
+  if (value == expected) {
+    printf("ok\n");
+  } else {
+    printf("lost %lld of %lld\n", expected - value, expected);
+  }
+  counter_destroy(counter);
+  return value == expected ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"threads", required_argument, NULL, 't'},
+                                         {"ops", required_argument, NULL, 'n'},
+                                         {"kind", required_argument, NULL, 'k'},
+                                         {NULL, 0, NULL, 0}};
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = cpus > 0 ? (int)cpus : 1;
+  long ops = DEFAULT_OPS;
+  int only = -1;  // Every kind
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "t:n:k:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 't':
+        max_threads = atoi(optarg);
+        break;
+      case 'n':
+        ops = atol(optarg);
+        break;
+      case 'k': {
+        counter_kind_t kind;
+        if (counter_kind_parse(optarg, &kind) == -1) {
+          fprintf(stderr, "Unknown counter '%s': racy, mutex, spinlock, atomic, sharded or combining.\n", optarg);
+          return EXIT_FAILURE;
+        }
+        only = kind;
+        break;
+      }
+      default:
+        fprintf(stderr, "Usage: %s [--threads MAX] [--ops N] [--kind KIND]\n", argv[0]);
+        fprintf(stderr, "  kinds: racy mutex spinlock atomic sharded combining (default: all)\n");
+        return EXIT_FAILURE;
+    }
+  }
+  if (max_threads < 1 || max_threads > MAX_THREADS || ops < 1) {
+    fprintf(stderr, "Need 1-%d threads and at least one add per thread.\n", MAX_THREADS);
+    return EXIT_FAILURE;
+  }
+
+  printf("%ld online CPU(s), up to %d thread(s) x %ld adds\n", cpus, max_threads, ops);
+  printf("%-10s %7s %12s %9s %13s %8s  %s\n", "counter", "threads", "adds", "ns/add", "thread ns/add", "Madd/s",
+         "final value");
+  int wrong = 0;
+  for (int kind = 0; kind < NUM_COUNTER_KINDS; ++kind) {
+    if (only != -1 && kind != only) continue;
+    for (int threads = 1; threads <= max_threads; threads = next_thread_count(threads, max_threads)) {
+      if (run((counter_kind_t)kind, threads, ops) != 0 && kind != COUNTER_RACY) wrong = 1;
+    }
+  }
+  // The racy counter is expected to lose adds as soon as two threads contend; any other must not
+  if (wrong) {
+    printf("FAILED: a synchronized counter lost adds\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -1,12 +1,11 @@
 #include <errno.h>      // For errno
-#include <fcntl.h>      // For O_CREAT, O_RDWR, O_EXCL
+#include <fcntl.h>      // For O_CREAT, O_EXCL
 #include <semaphore.h>  // For sem_open, sem_close, sem_unlink, sem_wait, sem_post
 #include <stdio.h>      // For printf, fprintf, perror
 #include <stdlib.h>     // For EXIT_SUCCESS, EXIT_FAILURE, exit
-#include <sys/mman.h>   // For mmap, munmap
 #include <sys/time.h>   // For gettimeofday
 #include <sys/wait.h>   // For wait
-#include <unistd.h>     // For fork, getpid, close, ftruncate
+#include <unistd.h>     // For fork, getpid
 
 #include "shm_counter_common.h"
 
@@ -14,7 +13,7 @@ int main() {
   const int K = 10;
   const int N = 100000;
 
-  int shm_fd;
+  huge_shm_t shm;
   shared_data_t *shm_data;
   sem_t *semaphore;
   pid_t pids[K];
@@ -28,22 +27,10 @@ int main() {
 
   sem_unlink(SEM_NAME_NAMED_SEM);  // Clean up any previous semaphore instance
 
-  shm_fd = shm_open(SHM_NAME_NAMED_SEM, O_CREAT | O_RDWR, 0666);
-  if (shm_fd == -1) {
-    perror("shm_open failed");
-    return EXIT_FAILURE;
-  }
-  if (ftruncate(shm_fd, sizeof(shared_data_t)) == -1) {
-    perror("ftruncate failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME_NAMED_SEM);
-    return EXIT_FAILURE;
-  }
-  shm_data = (shared_data_t *)mmap(NULL, sizeof(shared_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-  if (shm_data == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME_NAMED_SEM);
+  // Prefaulted, so the first touch is not timed
+  shm_data = huge_shm_create_map(SHM_NAME_NAMED_SEM, sizeof(shared_data_t), SHM_COUNTER_FLAGS, &shm);
+  if (shm_data == NULL) {
+    perror("huge_shm_create_map failed");
     return EXIT_FAILURE;
   }
   shm_data->counter = 0;  // Initialize counter
@@ -52,9 +39,8 @@ int main() {
   semaphore = sem_open(SEM_NAME_NAMED_SEM, O_CREAT | O_EXCL, 0666, 1);  // Initial value 1
   if (semaphore == SEM_FAILED) {
     perror("sem_open failed");
-    munmap(shm_data, sizeof(shared_data_t));
-    close(shm_fd);
-    shm_unlink(SHM_NAME_NAMED_SEM);
+    huge_shm_unmap(&shm, shm_data);
+    huge_shm_unlink(SHM_NAME_NAMED_SEM);
     return EXIT_FAILURE;
   }
 
@@ -67,17 +53,15 @@ int main() {
       for (int j = 0; j < i; ++j) waitpid(pids[j], NULL, 0);
       sem_close(semaphore);
       sem_unlink(SEM_NAME_NAMED_SEM);
-      munmap(shm_data, sizeof(shared_data_t));
-      close(shm_fd);
-      shm_unlink(SHM_NAME_NAMED_SEM);
+      huge_shm_unmap(&shm, shm_data);
+      huge_shm_unlink(SHM_NAME_NAMED_SEM);
       return EXIT_FAILURE;
     } else if (pids[i] == 0) {
       // Child process
       sem_t *child_semaphore = sem_open(SEM_NAME_NAMED_SEM, 0);  // Open existing
       if (child_semaphore == SEM_FAILED) {
         perror("Child: sem_open failed");
-        munmap(shm_data, sizeof(shared_data_t));
-        close(shm_fd);
+        huge_shm_unmap(&shm, shm_data);
         exit(EXIT_FAILURE);
       }
       for (int j = 0; j < N; ++j) {
@@ -86,8 +70,7 @@ int main() {
         sem_post(child_semaphore);  // Release lock
       }
       sem_close(child_semaphore);  // Close semaphore descriptor in child
-      munmap(shm_data, sizeof(shared_data_t));
-      close(shm_fd);
+      huge_shm_unmap(&shm, shm_data);
       exit(EXIT_SUCCESS);  // Child exits
     }
   }
@@ -113,9 +96,8 @@ int main() {
 
   sem_close(semaphore);
   sem_unlink(SEM_NAME_NAMED_SEM);
-  munmap(shm_data, sizeof(shared_data_t));
-  close(shm_fd);
-  shm_unlink(SHM_NAME_NAMED_SEM);
+  huge_shm_unmap(&shm, shm_data);
+  huge_shm_unlink(SHM_NAME_NAMED_SEM);
 
   return EXIT_SUCCESS;
 }
@@ -1,11 +1,9 @@
 #include <errno.h>     // For errno
-#include <fcntl.h>     // For O_CREAT, O_RDWR
 #include <stdio.h>     // For printf, fprintf, perror
 #include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE, exit
-#include <sys/mman.h>  // For mmap, munmap
 #include <sys/time.h>  // For gettimeofday
 #include <sys/wait.h>  // For wait
-#include <unistd.h>    // For fork, getpid, close, ftruncate
+#include <unistd.h>    // For fork, getpid
 
 #include "shm_counter_common.h"
 
@@ -13,7 +11,7 @@ int main() {
   const int K = 10;
   const int N = 100000;
 
-  int shm_fd;
+  huge_shm_t shm;
   shared_data_t *shm_data;
   pid_t pids[K];
 
@@ -24,24 +22,10 @@ int main() {
   printf("--- Synchronized Counter (Processes + Shared Memory + Unnamed Semaphore) ---\n");
   printf("Expected final value: %lld\n", (long long)K * N);
 
-  shm_fd = shm_open(SHM_NAME_UNNAMED_SEM, O_CREAT | O_RDWR, 0666);
-  if (shm_fd == -1) {
-    perror("shm_open failed");
-    return EXIT_FAILURE;
-  }
-
-  if (ftruncate(shm_fd, sizeof(shared_data_t)) == -1) {
-    perror("ftruncate failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME_UNNAMED_SEM);
-    return EXIT_FAILURE;
-  }
-
-  shm_data = (shared_data_t *)mmap(NULL, sizeof(shared_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-  if (shm_data == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME_UNNAMED_SEM);
+  // Prefaulted, so the first touch is not timed
+  shm_data = huge_shm_create_map(SHM_NAME_UNNAMED_SEM, sizeof(shared_data_t), SHM_COUNTER_FLAGS, &shm);
+  if (shm_data == NULL) {
+    perror("huge_shm_create_map failed");
     return EXIT_FAILURE;
   }
 
@@ -51,9 +35,8 @@ int main() {
   // Initialize Anonymous semaphore initialized in shared memory
   if (sem_init(&(shm_data->mutex), 1, 1) == -1) {  // pshared = 1 for processes
     perror("sem_init failed");
-    munmap(shm_data, sizeof(shared_data_t));
-    close(shm_fd);
-    shm_unlink(SHM_NAME_UNNAMED_SEM);
+    huge_shm_unmap(&shm, shm_data);
+    huge_shm_unlink(SHM_NAME_UNNAMED_SEM);
     return EXIT_FAILURE;
   }
 
@@ -66,9 +49,8 @@ int main() {
       perror("fork failed");
       for (int j = 0; j < i; ++j) waitpid(pids[j], NULL, 0);
       sem_destroy(&(shm_data->mutex));  // Destroy semaphore on error before unmap
-      munmap(shm_data, sizeof(shared_data_t));
-      close(shm_fd);
-      shm_unlink(SHM_NAME_UNNAMED_SEM);
+      huge_shm_unmap(&shm, shm_data);
+      huge_shm_unlink(SHM_NAME_UNNAMED_SEM);
       return EXIT_FAILURE;
     } else if (pids[i] == 0) {
       // Child process inherits the mapped shared memory and thus the semaphore
@@ -78,8 +60,7 @@ int main() {
         sem_post(&(shm_data->mutex));  // Release lock
       }
       // Anonymous semaphores are not closed/unlinked by children; they are tied to SHM
-      munmap(shm_data, sizeof(shared_data_t));
-      close(shm_fd);
+      huge_shm_unmap(&shm, shm_data);
       exit(EXIT_SUCCESS);  // Child exits
     }
   }
@@ -105,9 +86,8 @@ int main() {
   printf("Execution time with unnamed semaphore: %.3f ms\n", elapsed_time_ms);
 
   sem_destroy(&(shm_data->mutex));  // Parent destroys the anonymous semaphore
-  munmap(shm_data, sizeof(shared_data_t));
-  close(shm_fd);
-  shm_unlink(SHM_NAME_UNNAMED_SEM);
+  huge_shm_unmap(&shm, shm_data);
+  huge_shm_unlink(SHM_NAME_UNNAMED_SEM);
 
   return EXIT_SUCCESS;
 }
@@ -1,10 +1,8 @@
-#include <fcntl.h>     // For O_CREAT, O_RDWR
 #include <stdio.h>     // For printf, fprintf, perror
 #include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE, exit
-#include <sys/mman.h>  // For mmap, munmap
 #include <sys/time.h>  // For gettimeofday
 #include <sys/wait.h>  // For wait
-#include <unistd.h>    // For fork, getpid, close, ftruncate
+#include <unistd.h>    // For fork, getpid
 
 #include "shm_counter_common.h"
 
@@ -12,7 +10,7 @@ int main() {
   const int K = 10;
   const int N = 100000;
 
-  int shm_fd;
+  huge_shm_t shm;
   shared_data_t *shm_data;
   pid_t pids[K];
 
@@ -21,24 +19,10 @@ int main() {
   printf("--- Unsynchronized Counter (Processes + Shared Memory) ---\n");
   printf("Expected final value: %lld\n", (long long)K * N);
 
-  shm_fd = shm_open(SHM_NAME_UNSYNCED, O_CREAT | O_RDWR, 0666);
-  if (shm_fd == -1) {
-    perror("shm_open failed");
-    return EXIT_FAILURE;
-  }
-
-  if (ftruncate(shm_fd, sizeof(shared_data_t)) == -1) {
-    perror("ftruncate failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME_UNSYNCED);
-    return EXIT_FAILURE;
-  }
-
-  shm_data = (shared_data_t *)mmap(0, sizeof(shared_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-  if (shm_data == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME_UNSYNCED);
+  // Prefaulted, so the first touch is not timed
+  shm_data = huge_shm_create_map(SHM_NAME_UNSYNCED, sizeof(shared_data_t), SHM_COUNTER_FLAGS, &shm);
+  if (shm_data == NULL) {
+    perror("huge_shm_create_map failed");
     return EXIT_FAILURE;
   }
 
@@ -53,17 +37,15 @@ int main() {
     if (pids[i] == -1) {
       perror("fork failed");
       for (int j = 0; j < i; ++j) waitpid(pids[j], NULL, 0);
-      munmap(shm_data, sizeof(shared_data_t));
-      close(shm_fd);
-      shm_unlink(SHM_NAME_UNSYNCED);
+      huge_shm_unmap(&shm, shm_data);
+      huge_shm_unlink(SHM_NAME_UNSYNCED);
       return EXIT_FAILURE;
     } else if (pids[i] == 0) {
       // Child process
       for (int j = 0; j < N; ++j) {
         shm_data->counter++;  // Unsynchronized access
       }
-      munmap(shm_data, sizeof(shared_data_t));
-      close(shm_fd);
+      huge_shm_unmap(&shm, shm_data);
       exit(EXIT_SUCCESS);  // Child exits
     }
   }
@@ -88,9 +70,8 @@ int main() {
   double elapsed_time_ms = (seconds * 1000.0) + (microseconds / 1000.0);
   printf("Execution time without semaphore: %.3f ms\n", elapsed_time_ms);
 
-  munmap(shm_data, sizeof(shared_data_t));
-  close(shm_fd);
-  shm_unlink(SHM_NAME_UNSYNCED);
+  huge_shm_unmap(&shm, shm_data);
+  huge_shm_unlink(SHM_NAME_UNSYNCED);
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,672 @@
+#define _GNU_SOURCE  // For F_SETPIPE_SZ, F_GETPIPE_SZ
+
+#include <arpa/inet.h>   // For htonl
+#include <errno.h>       // For errno, EINVAL, EMSGSIZE
+#include <fcntl.h>       // For fcntl, open, O_RDONLY, O_WRONLY
+#include <mqueue.h>      // For mq_open, mq_send, mq_receive, mq_close, mq_unlink
+#include <netinet/in.h>  // For sockaddr_in, INADDR_LOOPBACK
+#include <sched.h>       // For sched_yield
+#include <signal.h>      // For signal, kill, SIGPIPE, SIGKILL
+#include <stdatomic.h>   // For atomic_load_explicit, atomic_store_explicit
+#include <stdint.h>      // For uint64_t
+#include <stdio.h>       // For printf, fprintf, perror, fopen
+#include <stdlib.h>      // For EXIT_SUCCESS, EXIT_FAILURE, qsort, strtol
+#include <string.h>      // For memcpy, memset, strcmp
+#include <sys/mman.h>    // For mmap, munmap
+#include <sys/socket.h>  // For socketpair, socket, bind, connect, setsockopt
+#include <sys/stat.h>    // For mkfifo
+#include <sys/wait.h>    // For waitpid
+#include <time.h>        // For clock_gettime, CLOCK_MONOTONIC
+#include <unistd.h>      // For fork, pipe, read, write, close, getopt
+
+#define MIN_MSG_SIZE 8                    // Smallest message: just the send timestamp
+#define MAX_MSG_SIZE (1 << 20)            // 1 MiB
+#define DEFAULT_ITERATIONS 10000          // Messages per phase for small sizes
+#define MIN_ITERATIONS 64                 // Never measure fewer messages than this
+#define MAX_BYTES_PER_PHASE (64LL << 20)  // Caps iterations for large messages
+#define WINDOW_BYTES (256 * 1024)         // Throughput flow-control window
+#define WINDOW_MAX_MSGS 1024              // Upper bound on messages per window
+#define UDP_WINDOW_BYTES (64 * 1024)      // Smaller window so loopback UDP does not drop
+#define UDP_WINDOW_MAX_MSGS 32            // Small datagrams cost ~1 KiB of rcvbuf each
+#define UDP_MAX_PAYLOAD 65507             // Largest IPv4 UDP datagram payload
+#define UDP_RCVBUF_BYTES (4 << 20)        // Requested receive buffer (capped by rmem_max)
+#define RECV_TIMEOUT_SEC 2                // UDP receiver gives up after this (lost datagram)
+#define MQ_MAX_MSGS 10                    // Default fs.mqueue.msg_max for unprivileged users
+#define SHM_RING_CAPACITY (4 << 20)       // Shared-memory byte ring, must hold a 1 MiB message
+#define FIFO_PATH_FMT "/tmp/ipc_bench_fifo.%d"
+#define MQ_NAME_FMT "/ipc_bench_mq.%d"
+
+#define ROLE_SENDER 0
+#define ROLE_RECEIVER 1
+
+// Result of preparing a channel for a given message size
+#define PREPARE_OK 0
+#define PREPARE_UNSUPPORTED 1
+#define PREPARE_ERROR -1
+
+// Single-producer/single-consumer byte ring living in a MAP_SHARED mapping
+typedef struct {
+  _Alignas(64) _Atomic uint64_t head;  // Total bytes written by the sender
+  _Alignas(64) _Atomic uint64_t tail;  // Total bytes consumed by the receiver
+  _Alignas(64) char data[SHM_RING_CAPACITY];
+} shm_ring_t;
+
+// Written by the receiver, read by the sender once the child has exited
+typedef struct {
+  uint64_t throughput_end_ns;  // When the last throughput message arrived
+  uint64_t latencies_ns[];     // One-way latency of each latency-phase message
+} shared_stats_t;
+
+typedef struct bench bench_t;
+
+// One IPC primitive under test
+typedef struct {
+  const char *name;
+  int (*prepare)(bench_t *b);           // Before fork: create the channel
+  int (*attach)(bench_t *b, int role);  // After fork: keep only this side's end
+  int (*send)(bench_t *b, const char *buf, size_t len);
+  int (*recv)(bench_t *b, char *buf, size_t len);
+  void (*cleanup)(bench_t *b, int role);
+  int window_bytes;
+  int window_max_msgs;
+} transport_t;
+
+struct bench {
+  const transport_t *transport;
+  size_t msg_size;
+  int buffer_request;  // -b option: pipe size or socket buffer, 0 = kernel default
+  long buffer_bytes;   // Effective buffer size reported in the CSV
+  int fds[2];
+  mqd_t mq;
+  char path[64];
+  shm_ring_t *ring;
+};
+
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Loop until the whole buffer is written (pipes and stream sockets may write partially)
+int write_full(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+// Loop until the whole buffer is read; EOF before that is an error
+int read_full(int fd, char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = read(fd, buf, len);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (n == 0) return -1;
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+// ---------- Byte-stream file descriptors (pipe, FIFO, SOCK_STREAM) ----------
+
+int fd_send(bench_t *b, const char *buf, size_t len) { return write_full(b->fds[1], buf, len); }
+
+int fd_recv(bench_t *b, char *buf, size_t len) { return read_full(b->fds[0], buf, len); }
+
+int fd_attach(bench_t *b, int role) {
+  // Sender writes to fds[1], receiver reads from fds[0]
+  close(role == ROLE_SENDER ? b->fds[0] : b->fds[1]);
+  return 0;
+}
+
+void fd_cleanup(bench_t *b, int role) { close(role == ROLE_SENDER ? b->fds[1] : b->fds[0]); }
+
+void apply_pipe_size(bench_t *b, int fd) {
+  if (b->buffer_request > 0 && fcntl(fd, F_SETPIPE_SZ, b->buffer_request) == -1) {
+    perror("fcntl F_SETPIPE_SZ failed");
+  }
+  b->buffer_bytes = fcntl(fd, F_GETPIPE_SZ);
+}
+
+int pipe_prepare(bench_t *b) {
+  if (pipe(b->fds) == -1) {
+    perror("pipe");
+    return PREPARE_ERROR;
+  }
+  apply_pipe_size(b, b->fds[1]);
+  return PREPARE_OK;
+}
+
+int fifo_prepare(bench_t *b) {
+  snprintf(b->path, sizeof(b->path), FIFO_PATH_FMT, getpid());
+  unlink(b->path);
+  if (mkfifo(b->path, 0600) == -1) {
+    perror("mkfifo");
+    return PREPARE_ERROR;
+  }
+  return PREPARE_OK;
+}
+
+int fifo_attach(bench_t *b, int role) {
+  // open() blocks until the other side opens the FIFO too
+  if (role == ROLE_SENDER) {
+    b->fds[1] = open(b->path, O_WRONLY);
+    if (b->fds[1] == -1) {
+      perror("open fifo for writing");
+      return -1;
+    }
+    apply_pipe_size(b, b->fds[1]);
+  } else {
+    b->fds[0] = open(b->path, O_RDONLY);
+    if (b->fds[0] == -1) {
+      perror("open fifo for reading");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void fifo_cleanup(bench_t *b, int role) {
+  fd_cleanup(b, role);
+  if (role == ROLE_SENDER) {
+    unlink(b->path);
+  }
+}
+
+// ---------- AF_UNIX socketpair (SOCK_STREAM and SOCK_SEQPACKET) ----------
+
+int socketpair_prepare_type(bench_t *b, int type) {
+  if (socketpair(AF_UNIX, type, 0, b->fds) == -1) {
+    perror("socketpair");
+    return PREPARE_ERROR;
+  }
+  int sndbuf = b->buffer_request;
+  // A SEQPACKET message must fit in the send buffer in one piece
+  if (type == SOCK_SEQPACKET && sndbuf < (int)b->msg_size * 2) {
+    sndbuf = (int)b->msg_size * 2;
+  }
+  if (sndbuf > 0) {
+    setsockopt(b->fds[1], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    setsockopt(b->fds[0], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+  }
+  int effective = 0;
+  socklen_t optlen = sizeof(effective);
+  getsockopt(b->fds[1], SOL_SOCKET, SO_SNDBUF, &effective, &optlen);
+  b->buffer_bytes = effective;
+  return PREPARE_OK;
+}
+
+int stream_prepare(bench_t *b) { return socketpair_prepare_type(b, SOCK_STREAM); }
+
+int seqpacket_prepare(bench_t *b) { return socketpair_prepare_type(b, SOCK_SEQPACKET); }
+
+// Datagram-style send/recv: one call per message, shared by SEQPACKET and UDP
+int dgram_send(bench_t *b, const char *buf, size_t len) {
+  ssize_t n;
+  do {
+    n = send(b->fds[1], buf, len, 0);
+  } while (n == -1 && errno == EINTR);
+  if (n == -1 && errno == EMSGSIZE) {
+    fprintf(stderr, "%s: %zu-byte message exceeds the socket buffer\n", b->transport->name, len);
+  }
+  return n == (ssize_t)len ? 0 : -1;
+}
+
+int dgram_recv(bench_t *b, char *buf, size_t len) {
+  ssize_t n;
+  do {
+    n = recv(b->fds[0], buf, len, MSG_TRUNC);
+  } while (n == -1 && errno == EINTR);
+  return n == (ssize_t)len ? 0 : -1;
+}
+
+// ---------- POSIX message queue ----------
+
+int mq_bench_prepare(bench_t *b) {
+  struct mq_attr attr;
+  snprintf(b->path, sizeof(b->path), MQ_NAME_FMT, getpid());
+  mq_unlink(b->path);
+
+  // Halve mq_maxmsg until the queue fits RLIMIT_MSGQUEUE (EMFILE) for large messages
+  for (long maxmsg = MQ_MAX_MSGS; maxmsg >= 1; maxmsg /= 2) {
+    attr.mq_flags = 0;
+    attr.mq_maxmsg = maxmsg;
+    attr.mq_msgsize = (long)b->msg_size;
+    attr.mq_curmsgs = 0;
+    b->mq = mq_open(b->path, O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
+    if (b->mq != (mqd_t)-1) {
+      // Both processes keep the descriptor across fork(), so the name is no longer needed
+      mq_unlink(b->path);
+      b->buffer_bytes = maxmsg * (long)b->msg_size;
+      return PREPARE_OK;
+    }
+    if (errno != EMFILE && errno != ENOMEM) break;
+  }
+  if (errno == EINVAL || errno == EMFILE || errno == ENOMEM) {
+    // msgsize above fs.mqueue.msgsize_max or the queue does not fit RLIMIT_MSGQUEUE
+    return PREPARE_UNSUPPORTED;
+  }
+  perror("mq_open");
+  return PREPARE_ERROR;
+}
+
+int mq_bench_attach(bench_t *b, int role) {
+  (void)b;
+  (void)role;
+  return 0;
+}
+
+int mq_bench_send(bench_t *b, const char *buf, size_t len) {
+  while (mq_send(b->mq, buf, len, 1) == -1) {
+    if (errno != EINTR) return -1;
+  }
+  return 0;
+}
+
+int mq_bench_recv(bench_t *b, char *buf, size_t len) {
+  ssize_t n;
+  do {
+    n = mq_receive(b->mq, buf, len, NULL);
+  } while (n == -1 && errno == EINTR);
+  return n == (ssize_t)len ? 0 : -1;
+}
+
+void mq_bench_cleanup(bench_t *b, int role) {
+  (void)role;
+  mq_close(b->mq);
+}
+
+// ---------- Shared-memory SPSC byte ring ----------
+
+int shm_prepare(bench_t *b) {
+  b->ring = mmap(NULL, sizeof(shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (b->ring == MAP_FAILED) {
+    perror("mmap shm ring");
+    return PREPARE_ERROR;
+  }
+  atomic_store_explicit(&b->ring->head, 0, memory_order_relaxed);
+  atomic_store_explicit(&b->ring->tail, 0, memory_order_relaxed);
+  b->buffer_bytes = SHM_RING_CAPACITY;
+  return PREPARE_OK;
+}
+
+int shm_send(bench_t *b, const char *buf, size_t len) {
+  shm_ring_t *ring = b->ring;
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  while (len > 0) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t free_bytes = SHM_RING_CAPACITY - (size_t)(head - tail);
+    if (free_bytes == 0) {
+      sched_yield();  // Let the receiver run if we share a core
+      continue;
+    }
+    size_t offset = (size_t)(head % SHM_RING_CAPACITY);
+    size_t chunk = len < free_bytes ? len : free_bytes;
+    if (chunk > SHM_RING_CAPACITY - offset) chunk = SHM_RING_CAPACITY - offset;
+    memcpy(ring->data + offset, buf, chunk);
+    head += chunk;
+    buf += chunk;
+    len -= chunk;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+  }
+  return 0;
+}
+
+int shm_recv(bench_t *b, char *buf, size_t len) {
+  shm_ring_t *ring = b->ring;
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  while (len > 0) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t used = (size_t)(head - tail);
+    if (used == 0) {
+      sched_yield();
+      continue;
+    }
+    size_t offset = (size_t)(tail % SHM_RING_CAPACITY);
+    size_t chunk = len < used ? len : used;
+    if (chunk > SHM_RING_CAPACITY - offset) chunk = SHM_RING_CAPACITY - offset;
+    memcpy(buf, ring->data + offset, chunk);
+    tail += chunk;
+    buf += chunk;
+    len -= chunk;
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+  return 0;
+}
+
+int shm_attach(bench_t *b, int role) {
+  (void)b;
+  (void)role;
+  return 0;
+}
+
+void shm_cleanup(bench_t *b, int role) {
+  (void)role;
+  munmap(b->ring, sizeof(shm_ring_t));
+}
+
+// ---------- UDP over loopback ----------
+
+// Close whichever of the two sockets udp_prepare() got before it failed
+int udp_prepare_failed(bench_t *b, const char *what) {
+  perror(what);
+  if (b->fds[0] != -1) close(b->fds[0]);
+  if (b->fds[1] != -1) close(b->fds[1]);
+  return PREPARE_ERROR;
+}
+
+int udp_prepare(bench_t *b) {
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+
+  if (b->msg_size > UDP_MAX_PAYLOAD) {
+    return PREPARE_UNSUPPORTED;
+  }
+
+  b->fds[0] = socket(AF_INET, SOCK_DGRAM, 0);
+  b->fds[1] = socket(AF_INET, SOCK_DGRAM, 0);
+  if (b->fds[0] == -1 || b->fds[1] == -1) return udp_prepare_failed(b, "socket");
+
+  // Receiver binds to an ephemeral loopback port
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind(b->fds[0], (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      getsockname(b->fds[0], (struct sockaddr *)&addr, &addr_len) == -1) {
+    return udp_prepare_failed(b, "bind udp receiver");
+  }
+  // Sender is connected so plain send() can be used
+  if (connect(b->fds[1], (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    return udp_prepare_failed(b, "connect udp sender");
+  }
+
+  int rcvbuf = b->buffer_request > 0 ? b->buffer_request : UDP_RCVBUF_BYTES;
+  setsockopt(b->fds[0], SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  struct timeval timeout = {.tv_sec = RECV_TIMEOUT_SEC, .tv_usec = 0};
+  setsockopt(b->fds[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  int effective = 0;
+  socklen_t optlen = sizeof(effective);
+  getsockopt(b->fds[0], SOL_SOCKET, SO_RCVBUF, &effective, &optlen);
+  b->buffer_bytes = effective;
+  return PREPARE_OK;
+}
+
+const transport_t transports[] = {
+    {"pipe", pipe_prepare, fd_attach, fd_send, fd_recv, fd_cleanup, WINDOW_BYTES, WINDOW_MAX_MSGS},
+    {"fifo", fifo_prepare, fifo_attach, fd_send, fd_recv, fifo_cleanup, WINDOW_BYTES, WINDOW_MAX_MSGS},
+    {"unix_stream", stream_prepare, fd_attach, fd_send, fd_recv, fd_cleanup, WINDOW_BYTES, WINDOW_MAX_MSGS},
+    {"unix_seqpacket", seqpacket_prepare, fd_attach, dgram_send, dgram_recv, fd_cleanup, WINDOW_BYTES,
+     WINDOW_MAX_MSGS},
+    {"mqueue", mq_bench_prepare, mq_bench_attach, mq_bench_send, mq_bench_recv, mq_bench_cleanup, WINDOW_BYTES,
+     WINDOW_MAX_MSGS},
+    {"shm_ring", shm_prepare, shm_attach, shm_send, shm_recv, shm_cleanup, WINDOW_BYTES, WINDOW_MAX_MSGS},
+    {"udp_loopback", udp_prepare, fd_attach, dgram_send, dgram_recv, fd_cleanup, UDP_WINDOW_BYTES,
+     UDP_WINDOW_MAX_MSGS},
+};
+#define NUM_TRANSPORTS (int)(sizeof(transports) / sizeof(transports[0]))
+
+// ---------- Measurement ----------
+
+int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array
+uint64_t percentile(const uint64_t *sorted, long n, double p) {
+  long rank = (long)(p * (double)n + 0.999999);
+  if (rank < 1) rank = 1;
+  if (rank > n) rank = n;
+  return sorted[rank - 1];
+}
+
+long messages_per_window(const bench_t *b) {
+  long window = b->transport->window_bytes / (long)b->msg_size;
+  if (window > b->transport->window_max_msgs) window = b->transport->window_max_msgs;
+  return window < 1 ? 1 : window;
+}
+
+// Child side: receive both phases, record latencies, acknowledge over ack_fd
+void run_receiver(bench_t *b, shared_stats_t *stats, long iterations, int ack_fd) {
+  char *buf = malloc(b->msg_size);
+  char ack = 'A';
+  long window = messages_per_window(b);
+
+  if (buf == NULL || b->transport->attach(b, ROLE_RECEIVER) == -1) {
+    _exit(EXIT_FAILURE);
+  }
+
+  // Latency phase: one message in flight, ack each one
+  for (long i = 0; i < iterations; ++i) {
+    if (b->transport->recv(b, buf, b->msg_size) == -1) _exit(EXIT_FAILURE);
+    uint64_t received = now_ns();
+    uint64_t sent;
+    memcpy(&sent, buf, sizeof(sent));
+    stats->latencies_ns[i] = received - sent;
+    if (write_full(ack_fd, &ack, 1) == -1) _exit(EXIT_FAILURE);
+  }
+
+  // Throughput phase: ack once per window so the sender can keep two windows in flight
+  for (long i = 0; i < iterations; ++i) {
+    if (b->transport->recv(b, buf, b->msg_size) == -1) _exit(EXIT_FAILURE);
+    if ((i + 1) % window == 0 || i == iterations - 1) {
+      if (i == iterations - 1) stats->throughput_end_ns = now_ns();
+      if (write_full(ack_fd, &ack, 1) == -1) _exit(EXIT_FAILURE);
+    }
+  }
+
+  b->transport->cleanup(b, ROLE_RECEIVER);
+  free(buf);
+  _exit(EXIT_SUCCESS);
+}
+
+// Parent side: drive both phases; returns 0 on success
+int run_sender(bench_t *b, long iterations, int ack_fd, uint64_t *throughput_start_ns) {
+  char *buf = calloc(1, b->msg_size);
+  char ack;
+  long window = messages_per_window(b);
+  int rc = -1;
+
+  if (buf == NULL || b->transport->attach(b, ROLE_SENDER) == -1) {
+    free(buf);
+    return -1;
+  }
+
+  for (long i = 0; i < iterations; ++i) {
+    uint64_t stamp = now_ns();
+    memcpy(buf, &stamp, sizeof(stamp));
+    if (b->transport->send(b, buf, b->msg_size) == -1 || read_full(ack_fd, &ack, 1) == -1) goto out;
+  }
+
+  *throughput_start_ns = now_ns();
+  long windows_sent = 0;
+  long acks_read = 0;
+  for (long i = 0; i < iterations; ++i) {
+    if (b->transport->send(b, buf, b->msg_size) == -1) goto out;
+    if ((i + 1) % window == 0 || i == iterations - 1) {
+      windows_sent++;
+      // Allow at most two unacknowledged windows
+      while (windows_sent - acks_read > 1) {
+        if (read_full(ack_fd, &ack, 1) == -1) goto out;
+        acks_read++;
+      }
+    }
+  }
+  while (acks_read < windows_sent) {
+    if (read_full(ack_fd, &ack, 1) == -1) goto out;
+    acks_read++;
+  }
+  rc = 0;
+
+out:
+  b->transport->cleanup(b, ROLE_SENDER);
+  free(buf);
+  return rc;
+}
+
+void print_csv_header(FILE *out) {
+  fprintf(out,
+          "transport,msg_size,buffer_bytes,iterations,lat_p50_ns,lat_p99_ns,lat_p999_ns,msgs_per_sec,mib_per_sec,"
+          "status\n");
+}
+
+void print_csv_row(FILE *out, const bench_t *b, long iterations, const uint64_t *p, double msgs_per_sec,
+                   const char *status) {
+  fprintf(out, "%s,%zu,%ld,%ld,%llu,%llu,%llu,%.0f,%.2f,%s\n", b->transport->name, b->msg_size, b->buffer_bytes,
+          iterations, (unsigned long long)p[0], (unsigned long long)p[1], (unsigned long long)p[2], msgs_per_sec,
+          msgs_per_sec * (double)b->msg_size / (1024.0 * 1024.0), status);
+  fflush(out);
+}
+
+// Benchmark one transport at one message size and emit one CSV row
+void run_one(FILE *out, const transport_t *transport, size_t msg_size, long max_iterations, int buffer_request) {
+  bench_t b;
+  uint64_t p[3] = {0, 0, 0};
+  memset(&b, 0, sizeof(b));
+  b.transport = transport;
+  b.msg_size = msg_size;
+  b.buffer_request = buffer_request;
+
+  long iterations = (long)(MAX_BYTES_PER_PHASE / (long long)msg_size);
+  if (iterations > max_iterations) iterations = max_iterations;
+  if (iterations < MIN_ITERATIONS) iterations = MIN_ITERATIONS;  // Only the byte cap gets here: -n is checked
+
+  int prepared = transport->prepare(&b);
+  if (prepared != PREPARE_OK) {
+    print_csv_row(out, &b, 0, p, 0.0, prepared == PREPARE_UNSUPPORTED ? "unsupported" : "error");
+    return;
+  }
+
+  size_t stats_size = sizeof(shared_stats_t) + (size_t)iterations * sizeof(uint64_t);
+  shared_stats_t *stats = mmap(NULL, stats_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  int ack_pipe[2];
+  if (stats == MAP_FAILED || pipe(ack_pipe) == -1) {
+    perror("mmap/pipe for benchmark bookkeeping");
+    exit(EXIT_FAILURE);
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(ack_pipe[0]);
+    run_receiver(&b, stats, iterations, ack_pipe[1]);
+  }
+  close(ack_pipe[1]);
+
+  uint64_t throughput_start_ns = 0;
+  int rc = run_sender(&b, iterations, ack_pipe[0], &throughput_start_ns);
+  if (rc == -1) {
+    kill(pid, SIGKILL);  // Receiver may be blocked on a channel we can no longer feed
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  close(ack_pipe[0]);
+
+  if (rc == 0 && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+    qsort(stats->latencies_ns, (size_t)iterations, sizeof(uint64_t), compare_u64);
+    p[0] = percentile(stats->latencies_ns, iterations, 0.50);
+    p[1] = percentile(stats->latencies_ns, iterations, 0.99);
+    p[2] = percentile(stats->latencies_ns, iterations, 0.999);
+    double seconds = (double)(stats->throughput_end_ns - throughput_start_ns) / 1e9;
+    print_csv_row(out, &b, iterations, p, (double)iterations / seconds, "ok");
+  } else {
+    print_csv_row(out, &b, iterations, p, 0.0, "failed");
+  }
+  munmap(stats, stats_size);
+}
+
+void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-t transport] [-s msg_size] [-n iterations] [-b buffer_bytes] [-o out.csv]\n", prog);
+  fprintf(stderr, "  -t  one of:");
+  for (int i = 0; i < NUM_TRANSPORTS; ++i) fprintf(stderr, " %s", transports[i].name);
+  fprintf(stderr, " (default: all)\n");
+  fprintf(stderr, "  -s  single message size in bytes (default: sweep %d B .. %d B, x4 steps)\n", MIN_MSG_SIZE,
+          MAX_MSG_SIZE);
+  fprintf(stderr, "  -n  max messages per phase, at least %d (default: %d)\n", MIN_ITERATIONS, DEFAULT_ITERATIONS);
+  fprintf(stderr, "  -b  pipe size (F_SETPIPE_SZ) or socket buffer size (default: kernel default)\n");
+  fprintf(stderr, "  -o  write CSV to this file instead of stdout\n");
+}
+
+int main(int argc, char *argv[]) {
+  const char *only_transport = NULL;
+  long msg_size = 0;
+  long iterations = DEFAULT_ITERATIONS;
+  int buffer_request = 0;
+  FILE *out = stdout;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:s:n:b:o:h")) != -1) {
+    switch (opt) {
+      case 't':
+        only_transport = optarg;
+        break;
+      case 's':
+        msg_size = strtol(optarg, NULL, 10);
+        break;
+      case 'n':
+        iterations = strtol(optarg, NULL, 10);
+        break;
+      case 'b':
+        buffer_request = (int)strtol(optarg, NULL, 10);
+        break;
+      case 'o':
+        out = fopen(optarg, "w");
+        if (out == NULL) {
+          perror("fopen");
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((msg_size != 0 && (msg_size < MIN_MSG_SIZE || msg_size > MAX_MSG_SIZE)) || iterations < MIN_ITERATIONS) {
+    fprintf(stderr, "Message size must be %d..%d bytes and iterations at least %d.\n", MIN_MSG_SIZE, MAX_MSG_SIZE,
+            MIN_ITERATIONS);
+    return EXIT_FAILURE;
+  }
+
+  // A receiver that dies mid-run must surface as a failed row, not kill the benchmark
+  signal(SIGPIPE, SIG_IGN);
+
+  int matched = 0;
+  print_csv_header(out);
+  for (int t = 0; t < NUM_TRANSPORTS; ++t) {
+    if (only_transport != NULL && strcmp(only_transport, transports[t].name) != 0) continue;
+    matched = 1;
+    if (msg_size != 0) {
+      run_one(out, &transports[t], (size_t)msg_size, iterations, buffer_request);
+      continue;
+    }
+    for (size_t size = MIN_MSG_SIZE; size <= MAX_MSG_SIZE; size *= 4) {
+      run_one(out, &transports[t], size, iterations, buffer_request);
+    }
+    // 8 * 4^k skips 1 MiB itself, which is the interesting upper bound
+    run_one(out, &transports[t], MAX_MSG_SIZE, iterations, buffer_request);
+  }
+
+  if (out != stdout) fclose(out);
+  if (!matched) {
+    fprintf(stderr, "Unknown transport '%s'.\n", only_transport);
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
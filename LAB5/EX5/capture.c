@@ -0,0 +1,377 @@
+#define _GNU_SOURCE  // For pipe2, splice, F_SETPIPE_SZ
+
+#include "capture.h"
+
+#include <errno.h>      // For errno, EAGAIN, EINTR, EINVAL, ENOBUFS
+#include <fcntl.h>      // For fcntl, splice, O_CLOEXEC, O_NONBLOCK, F_DUPFD_CLOEXEC
+#include <limits.h>     // For PATH_MAX
+#include <poll.h>       // For poll, POLLOUT
+#include <stdio.h>      // For perror, snprintf
+#include <stdlib.h>     // For calloc, malloc, free, mkstemp
+#include <string.h>     // For memcpy
+#include <sys/epoll.h>  // For epoll_create1, epoll_ctl, epoll_wait
+#include <sys/uio.h>    // For readv
+#include <sys/wait.h>   // For waitpid
+#include <unistd.h>     // For fork, dup2, execvp, close, pread, write
+
+#define MAX_CHUNKS_PER_ROUND 16  // Bound work per stream per poll so stdout cannot starve stderr
+
+typedef struct {
+  int fd;           // Non-blocking read end of the child's pipe, -1 once EOF was seen
+  int forward_fd;   // Forward target, -1 in retain mode
+  int use_splice;   // Cleared when splice() is unsupported for forward_fd (e.g. a tty)
+  int paused;       // Ring full without a spill dir: removed from epoll until capture_read
+  int blocked;      // Forward target full: out_watch is in epoll for EPOLLOUT instead of fd
+  int out_watch;    // Our own dup of forward_fd for epoll (both streams may forward to one fd), or -1
+  char *ring;       // Retained bytes (also the bounce buffer for non-splice forwarding)
+  size_t ring_cap;  // Capacity of ring
+  size_t head;      // Total bytes ever written into ring
+  size_t tail;      // Total bytes ever consumed from ring
+  const char *spill_dir;
+  int spill_fd;               // -1 until the ring overflowed into a file
+  char spill_path[PATH_MAX];  // Removed in capture_destroy
+  size_t spill_written;       // Bytes appended to the spill file
+  size_t spill_read;          // Bytes consumed from the spill file by capture_read
+  size_t total;               // Bytes received from the child on this stream
+} capture_stream_t;
+
+struct capture {
+  pid_t pid;
+  int epoll_fd;
+  capture_stream_t streams[CAPTURE_NUM_STREAMS];
+};
+
+static const char *stream_names[CAPTURE_NUM_STREAMS] = {"stdout", "stderr"};
+
+// A non-blocking fd that is full is waited on: the bytes are already out of the child's pipe
+static int write_full(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n == -1) {
+      struct pollfd writable = {.fd = fd, .events = POLLOUT};
+      if (errno == EAGAIN && poll(&writable, 1, -1) != -1) continue;
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static int watch_stream(capture_t *cap, int index) {
+  struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t)index};
+  return epoll_ctl(cap->epoll_fd, EPOLL_CTL_ADD, cap->streams[index].fd, &ev);
+}
+
+// Stop watching while paused: EPOLLHUP is reported even with no events requested
+static void pause_stream(capture_t *cap, capture_stream_t *s) {
+  epoll_ctl(cap->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+  s->paused = 1;
+}
+
+// The forward target is full: sleep until it takes data again instead of waking on the child's
+// pipe, which stays readable all along. 0 when parked, -1 when the target cannot be watched.
+static int block_stream(capture_t *cap, capture_stream_t *s, int index) {
+  struct epoll_event ev = {.events = EPOLLOUT, .data.u32 = (uint32_t)index};
+  if (s->out_watch == -1) s->out_watch = fcntl(s->forward_fd, F_DUPFD_CLOEXEC, 0);
+  if (s->out_watch == -1 || epoll_ctl(cap->epoll_fd, EPOLL_CTL_ADD, s->out_watch, &ev) == -1) return -1;
+  epoll_ctl(cap->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+  s->blocked = 1;
+  return 0;
+}
+
+static void unblock_stream(capture_t *cap, capture_stream_t *s, int index) {
+  epoll_ctl(cap->epoll_fd, EPOLL_CTL_DEL, s->out_watch, NULL);
+  s->blocked = 0;
+  watch_stream(cap, index);
+}
+
+static void close_stream(capture_t *cap, capture_stream_t *s) {
+  if (s->blocked) {
+    epoll_ctl(cap->epoll_fd, EPOLL_CTL_DEL, s->out_watch, NULL);
+    s->blocked = 0;
+  } else if (!s->paused) {
+    epoll_ctl(cap->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+  }
+  close(s->fd);
+  s->fd = -1;
+  s->paused = 0;
+}
+
+// Move the unread part of the ring into a new spill file; later data is spliced straight there
+static int start_spill(capture_stream_t *s, int index) {
+  snprintf(s->spill_path, sizeof(s->spill_path), "%s/capture_%s_XXXXXX", s->spill_dir, stream_names[index]);
+  s->spill_fd = mkstemp(s->spill_path);
+  if (s->spill_fd == -1) {
+    perror("mkstemp spill file");
+    s->spill_path[0] = '\0';
+    return -1;
+  }
+  while (s->tail < s->head) {
+    size_t offset = s->tail % s->ring_cap;
+    size_t chunk = s->head - s->tail;
+    if (chunk > s->ring_cap - offset) chunk = s->ring_cap - offset;
+    if (write_full(s->spill_fd, s->ring + offset, chunk) == -1) {
+      perror("write spill file");
+      return -1;
+    }
+    s->tail += chunk;
+    s->spill_written += chunk;
+  }
+  return 0;
+}
+
+// Forward mode: pipe -> forward_fd without touching user space. Returns bytes moved, 0 on EOF,
+// -1 with errno EAGAIN when the pipe is drained or forward_fd is full.
+static ssize_t forward_chunk(capture_stream_t *s) {
+  if (s->use_splice) {
+    ssize_t n = splice(s->fd, NULL, s->forward_fd, NULL, CAPTURE_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n != -1 || errno != EINVAL) {
+      return n;
+    }
+    // Target does not support splice (tty, O_APPEND file, ...): use the ring as a bounce buffer
+    s->use_splice = 0;
+  }
+  ssize_t n = read(s->fd, s->ring, s->ring_cap);
+  if (n > 0 && write_full(s->forward_fd, s->ring, (size_t)n) == -1) {
+    return -1;
+  }
+  return n;
+}
+
+// Retain mode: pipe -> ring, or pipe -> spill file once spilling. Returns like forward_chunk;
+// returns -1 with errno ENOBUFS when the ring is full and the stream has to be paused.
+static ssize_t retain_chunk(capture_stream_t *s, int index) {
+  if (s->spill_fd >= 0) {
+    ssize_t n = splice(s->fd, NULL, s->spill_fd, NULL, CAPTURE_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) s->spill_written += (size_t)n;
+    return n;
+  }
+
+  size_t free_bytes = s->ring_cap - (s->head - s->tail);
+  if (free_bytes == 0) {
+    if (s->spill_dir == NULL) {
+      errno = ENOBUFS;
+      return -1;
+    }
+    if (start_spill(s, index) == -1) return -1;
+    return retain_chunk(s, index);
+  }
+
+  // Fill up to the end of the ring and wrap into its start in one syscall
+  size_t offset = s->head % s->ring_cap;
+  size_t first = s->ring_cap - offset;
+  if (first > free_bytes) first = free_bytes;
+  struct iovec iov[2] = {{s->ring + offset, first}, {s->ring, free_bytes - first}};
+  ssize_t n = readv(s->fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+  if (n > 0) s->head += (size_t)n;
+  return n;
+}
+
+// The forward target has no room, as opposed to the child's pipe having no data
+static int target_full(const capture_stream_t *s) {
+  struct pollfd writable = {.fd = s->forward_fd, .events = POLLOUT};
+  return poll(&writable, 1, 0) == 0;
+}
+
+static void service_stream(capture_t *cap, int index) {
+  capture_stream_t *s = &cap->streams[index];
+  if (s->blocked) unblock_stream(cap, s, index);  // Woken by EPOLLOUT: the target has room again
+  for (int i = 0; i < MAX_CHUNKS_PER_ROUND && s->fd >= 0; ++i) {
+    ssize_t n = s->forward_fd >= 0 ? forward_chunk(s) : retain_chunk(s, index);
+    if (n > 0) {
+      s->total += (size_t)n;
+      continue;
+    }
+    if (n == 0) {
+      close_stream(cap, s);  // Child closed its end
+      return;
+    }
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN) {
+      // Drained for now, unless the target is what is full: then wait for it, or with poll() when
+      // epoll cannot watch it
+      if (s->forward_fd >= 0 && target_full(s) && block_stream(cap, s, index) == -1) {
+        struct pollfd writable = {.fd = s->forward_fd, .events = POLLOUT};
+        poll(&writable, 1, -1);
+      }
+      return;
+    }
+    if (errno == ENOBUFS) {
+      pause_stream(cap, s);  // Child blocks on its full pipe until capture_read frees space
+      return;
+    }
+    perror("capture: draining child stream failed");
+    close_stream(cap, s);
+    return;
+  }
+}
+
+capture_t *capture_spawn(char *const argv[], const capture_config_t *config) {
+  int pipes[CAPTURE_NUM_STREAMS][2];
+  capture_t *cap = calloc(1, sizeof(capture_t));
+  if (cap == NULL) {
+    perror("calloc");
+    return NULL;
+  }
+  for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+    cap->streams[i].fd = -1;
+    cap->streams[i].spill_fd = -1;
+    cap->streams[i].out_watch = -1;
+  }
+  cap->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (cap->epoll_fd == -1) {
+    perror("epoll_create1");
+    free(cap);
+    return NULL;
+  }
+
+  for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+    capture_stream_t *s = &cap->streams[i];
+    const capture_stream_config_t *sc = &config->streams[i];
+    s->forward_fd = sc->forward_fd;
+    s->use_splice = 1;
+    s->spill_dir = sc->spill_dir;
+    s->ring_cap = sc->mem_limit > 0 ? sc->mem_limit : CAPTURE_DEFAULT_MEM_LIMIT;
+    s->ring = malloc(s->ring_cap);
+    // O_CLOEXEC keeps the other stream's pipe from leaking into the child after exec
+    if (s->ring == NULL || pipe2(pipes[i], O_CLOEXEC) == -1) {
+      perror("capture: ring/pipe setup failed");
+      for (int j = 0; j < i; ++j) {
+        close(pipes[j][0]);
+        close(pipes[j][1]);
+      }
+      for (int j = 0; j < i; ++j) cap->streams[j].fd = -1;
+      capture_destroy(cap);
+      return NULL;
+    }
+    // Bigger pipes mean fewer wakeups per byte; failure just keeps the 64 KiB default
+    fcntl(pipes[i][1], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+    fcntl(pipes[i][0], F_SETFL, O_NONBLOCK);
+    s->fd = pipes[i][0];
+  }
+
+  cap->pid = fork();
+  if (cap->pid == -1) {
+    perror("fork");
+    for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) close(pipes[i][1]);
+    capture_destroy(cap);
+    return NULL;
+  }
+  if (cap->pid == 0) {
+    // Child: dup2 clears O_CLOEXEC on the new descriptors, the originals close on exec
+    if (dup2(pipes[CAPTURE_STDOUT][1], STDOUT_FILENO) == -1 || dup2(pipes[CAPTURE_STDERR][1], STDERR_FILENO) == -1) {
+      perror("dup2");
+      _exit(127);
+    }
+    execvp(argv[0], argv);
+    perror("execvp");
+    _exit(127);
+  }
+
+  for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+    close(pipes[i][1]);  // Parent only reads
+    if (watch_stream(cap, i) == -1) {
+      perror("epoll_ctl");
+    }
+  }
+  return cap;
+}
+
+int capture_poll(capture_t *cap, int timeout_ms) {
+  struct epoll_event events[CAPTURE_NUM_STREAMS];
+  int n = epoll_wait(cap->epoll_fd, events, CAPTURE_NUM_STREAMS, timeout_ms);
+  if (n == -1 && errno != EINTR) {
+    perror("epoll_wait");
+    return -1;
+  }
+  for (int i = 0; i < n; ++i) {
+    service_stream(cap, (int)events[i].data.u32);
+  }
+
+  int open_streams = 0;
+  for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+    if (cap->streams[i].fd >= 0) open_streams++;
+  }
+  return open_streams;
+}
+
+ssize_t capture_read(capture_t *cap, int stream, char *buf, size_t len) {
+  capture_stream_t *s = &cap->streams[stream];
+  size_t copied = 0;
+
+  while (copied < len && s->tail < s->head) {
+    size_t offset = s->tail % s->ring_cap;
+    size_t chunk = s->head - s->tail;
+    if (chunk > s->ring_cap - offset) chunk = s->ring_cap - offset;
+    if (chunk > len - copied) chunk = len - copied;
+    memcpy(buf + copied, s->ring + offset, chunk);
+    s->tail += chunk;
+    copied += chunk;
+  }
+  if (copied > 0) {
+    if (s->paused && s->fd >= 0) {
+      s->paused = 0;
+      watch_stream(cap, stream);
+    }
+    return (ssize_t)copied;
+  }
+
+  // Ring is empty: everything newer lives in the spill file
+  if (s->spill_fd >= 0 && s->spill_read < s->spill_written) {
+    ssize_t n = pread(s->spill_fd, buf, len, (off_t)s->spill_read);
+    if (n > 0) s->spill_read += (size_t)n;
+    return n;
+  }
+  return 0;
+}
+
+int capture_wait(capture_t *cap, int *status) {
+  while (1) {
+    int open_streams = 0;
+    int paused_streams = 0;
+    for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+      if (cap->streams[i].fd >= 0) open_streams++;
+      if (cap->streams[i].paused) paused_streams++;
+    }
+    if (open_streams == 0) break;
+    if (paused_streams == open_streams) {
+      errno = ENOBUFS;
+      return -1;
+    }
+    if (capture_poll(cap, -1) == -1) return -1;
+  }
+
+  while (waitpid(cap->pid, status, 0) == -1) {
+    if (errno != EINTR) {
+      perror("waitpid");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+size_t capture_total_bytes(const capture_t *cap, int stream) { return cap->streams[stream].total; }
+
+size_t capture_spilled_bytes(const capture_t *cap, int stream) { return cap->streams[stream].spill_written; }
+
+pid_t capture_pid(const capture_t *cap) { return cap->pid; }
+
+int capture_spill_fd(const capture_t *cap, int stream) { return cap->streams[stream].spill_fd; }
+
+void capture_destroy(capture_t *cap) {
+  if (cap == NULL) return;
+  for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+    capture_stream_t *s = &cap->streams[i];
+    if (s->fd >= 0) close(s->fd);
+    if (s->out_watch >= 0) close(s->out_watch);
+    if (s->spill_fd >= 0) {
+      close(s->spill_fd);
+      unlink(s->spill_path);
+    }
+    free(s->ring);
+  }
+  close(cap->epoll_fd);
+  free(cap);
+}
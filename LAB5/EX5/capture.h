@@ -0,0 +1,53 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>     // For size_t
+#include <sys/types.h>  // For pid_t, ssize_t
+
+#define CAPTURE_STDOUT 0
+#define CAPTURE_STDERR 1
+#define CAPTURE_NUM_STREAMS 2
+
+#define CAPTURE_DEFAULT_MEM_LIMIT (64 * 1024)  // Ring size per stream when none is given
+#define CAPTURE_PIPE_SIZE (1 << 20)            // Requested child pipe size (default pipe-max-size)
+
+// How one child stream (stdout or stderr) is handled
+typedef struct {
+  int forward_fd;         // >= 0: splice bytes straight to this fd, nothing is retained
+  size_t mem_limit;       // Ring capacity for retained bytes (0 = CAPTURE_DEFAULT_MEM_LIMIT)
+  const char *spill_dir;  // Ring full: move to a file in this dir; NULL = back-pressure the child
+} capture_stream_config_t;
+
+typedef struct {
+  capture_stream_config_t streams[CAPTURE_NUM_STREAMS];
+} capture_config_t;
+
+typedef struct capture capture_t;
+
+// Fork and exec argv[0] (PATH lookup) with stdout/stderr connected to capture pipes
+capture_t *capture_spawn(char *const argv[], const capture_config_t *config);
+
+// One epoll round: drain whatever is ready. Returns the number of streams still open, -1 on error.
+int capture_poll(capture_t *cap, int timeout_ms);
+
+// Consume retained bytes in order (ring first, then spill file). Frees ring space, which
+// resumes a back-pressured stream. Returns bytes copied, 0 when nothing is buffered.
+ssize_t capture_read(capture_t *cap, int stream, char *buf, size_t len);
+
+// Drive capture_poll until both streams hit EOF, then reap the child. Fails with ENOBUFS if
+// every open stream is stalled on a full ring with no spill dir (caller must capture_read).
+int capture_wait(capture_t *cap, int *status);
+
+// Statistics
+size_t capture_total_bytes(const capture_t *cap, int stream);
+size_t capture_spilled_bytes(const capture_t *cap, int stream);
+pid_t capture_pid(const capture_t *cap);
+
+// Descriptor of the spill file (-1 if the stream never spilled). Read it with capture_read
+// or hand it to sendfile() to forward the spilled part without a user-space copy.
+int capture_spill_fd(const capture_t *cap, int stream);
+
+// Close pipes, remove spill files and free the capture. Does not wait for the child.
+void capture_destroy(capture_t *cap);
+
+#endif  // CAPTURE_H
@@ -0,0 +1,128 @@
+#define _GNU_SOURCE  // For sendfile
+
+#include <stdio.h>         // For printf, fprintf, perror
+#include <stdlib.h>        // For EXIT_SUCCESS, EXIT_FAILURE, strtoul
+#include <sys/resource.h>  // For getrusage
+#include <sys/sendfile.h>  // For sendfile
+#include <sys/wait.h>      // For WIFEXITED, WEXITSTATUS
+#include <unistd.h>        // For getopt, write, STDOUT_FILENO
+
+#include "capture.h"
+
+// Parent CPU time in milliseconds (user + system)
+double cpu_time_ms(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+// Print everything retained for one stream: ring contents through a small buffer, the spilled
+// part with sendfile() so it never passes through user space
+void dump_stream(capture_t *cap, int stream, int out_fd) {
+  char buffer[BUFSIZ];
+  ssize_t n;
+  int spill_fd = capture_spill_fd(cap, stream);
+
+  if (spill_fd >= 0) {
+    off_t offset = 0;
+    size_t remaining = capture_spilled_bytes(cap, stream);
+    while (remaining > 0 && (n = sendfile(out_fd, spill_fd, &offset, remaining)) > 0) {
+      remaining -= (size_t)n;
+    }
+    return;
+  }
+  while ((n = capture_read(cap, stream, buffer, sizeof(buffer))) > 0) {
+    if (write(out_fd, buffer, (size_t)n) == -1) {
+      perror("write");
+      return;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  char *default_cmd[] = {"ls", "-l", NULL};
+  capture_config_t config;
+  int forward = 0;
+  int quiet = 0;
+  size_t mem_limit = CAPTURE_DEFAULT_MEM_LIMIT;
+  const char *spill_dir = "/tmp";
+  int status;
+  int opt;
+
+  // '+' stops option parsing at the command so its own flags are passed through
+  while ((opt = getopt(argc, argv, "+fqm:s:")) != -1) {
+    switch (opt) {
+      case 'f':
+        forward = 1;
+        break;
+      case 'q':
+        quiet = 1;
+        break;
+      case 'm':
+        mem_limit = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        spill_dir = optarg[0] == '\0' ? NULL : optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-f] [-q] [-m mem_limit] [-s spill_dir|''] [command [args...]]\n", argv[0]);
+        fprintf(stderr, "  -f  forward child output to our stdout/stderr with splice()\n");
+        fprintf(stderr, "  -q  retain output but do not print it afterwards\n");
+        fprintf(stderr, "  -m  ring size per stream in bytes (default %d)\n", CAPTURE_DEFAULT_MEM_LIMIT);
+        fprintf(stderr, "  -s  spill directory once the ring is full, '' for back-pressure only\n");
+        return EXIT_FAILURE;
+    }
+  }
+  char **cmd = optind < argc ? &argv[optind] : default_cmd;
+
+  for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+    config.streams[i].forward_fd = forward ? (i == CAPTURE_STDOUT ? STDOUT_FILENO : STDERR_FILENO) : -1;
+    config.streams[i].mem_limit = mem_limit;
+    config.streams[i].spill_dir = spill_dir;
+  }
+
+  double cpu_start = cpu_time_ms();
+  capture_t *cap = capture_spawn(cmd, &config);
+  if (cap == NULL) {
+    return EXIT_FAILURE;
+  }
+  fprintf(stderr, "Parent: capturing '%s' (PID %d) in %s mode...\n", cmd[0], capture_pid(cap),
+          forward ? "forward" : "retain");
+
+  if (capture_wait(cap, &status) == -1) {
+    // Only possible without a spill dir: drain the rings so the child can continue
+    char buffer[BUFSIZ];
+    fprintf(stderr, "Parent: ring full without spill dir, draining while the child runs.\n");
+    while (capture_poll(cap, 100) > 0) {
+      for (int i = 0; i < CAPTURE_NUM_STREAMS; ++i) {
+        ssize_t n;
+        while ((n = capture_read(cap, i, buffer, sizeof(buffer))) > 0) {
+          if (!quiet && write(i == CAPTURE_STDOUT ? STDOUT_FILENO : STDERR_FILENO, buffer, (size_t)n) == -1) {
+            perror("write");
+          }
+        }
+      }
+    }
+    capture_wait(cap, &status);
+  }
+  double cpu_used = cpu_time_ms() - cpu_start;
+
+  if (!forward && !quiet) {
+    dump_stream(cap, CAPTURE_STDOUT, STDOUT_FILENO);
+    dump_stream(cap, CAPTURE_STDERR, STDERR_FILENO);
+  }
+
+  fprintf(stderr, "Parent: stdout %zu bytes (%zu spilled), stderr %zu bytes (%zu spilled)\n",
+          capture_total_bytes(cap, CAPTURE_STDOUT), capture_spilled_bytes(cap, CAPTURE_STDOUT),
+          capture_total_bytes(cap, CAPTURE_STDERR), capture_spilled_bytes(cap, CAPTURE_STDERR));
+  fprintf(stderr, "Parent: CPU time spent capturing: %.3f ms\n", cpu_used);
+  if (WIFEXITED(status)) {
+    fprintf(stderr, "Child process exited normally with status %d.\n", WEXITSTATUS(status));
+  } else {
+    fprintf(stderr, "Child process did not exit normally.\n");
+  }
+
+  capture_destroy(cap);
+  return EXIT_SUCCESS;
+}
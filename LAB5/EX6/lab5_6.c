@@ -0,0 +1,92 @@
+#include <stdio.h>   // For printf, fprintf
+#include <stdlib.h>  // For EXIT_SUCCESS, EXIT_FAILURE, atoi, calloc
+#include <unistd.h>  // For getopt
+
+#include "pipeline.h"
+
+// Used when no pipelines are given on the command line
+char *default_specs[] = {
+    "seq 1 2000000 | gzip -1 | wc -c",
+    "seq 1 2000000 |1m sort -r | head -n 1",
+    "yes cos-lab | head -n 3000000 | tr a-z A-Z | wc -l",
+};
+
+// seq feeds two greps (fan-out, relayed by the executor); both greps write into the same
+// wc input pipe (fan-in), so wc counts lines containing a 7 plus lines containing a 3
+int build_dag_demo(pipeline_job_t *job) {
+  static char *source[] = {"seq", "1", "2000000", NULL};
+  static char *filter_a[] = {"grep", "7", NULL};
+  static char *filter_b[] = {"grep", "3", NULL};
+  static char *sink[] = {"wc", "-l", NULL};
+
+  pipeline_job_init(job, "seq -> {grep 7, grep 3} -> wc -l");
+  int s = pipeline_job_add_node(job, source, 0);
+  int a = pipeline_job_add_node(job, filter_a, 0);
+  int b = pipeline_job_add_node(job, filter_b, 0);
+  int w = pipeline_job_add_node(job, sink, 0);
+  if (pipeline_job_connect(job, s, a) == -1 || pipeline_job_connect(job, s, b) == -1 ||
+      pipeline_job_connect(job, a, w) == -1 || pipeline_job_connect(job, b, w) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  pipeline_exec_config_t config = {.max_parallel = 2, .default_pipe_size = 0, .sample_interval_ms = 0};
+  int dag_demo = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:p:i:D")) != -1) {
+    switch (opt) {
+      case 'j':
+        config.max_parallel = atoi(optarg);
+        break;
+      case 'p':
+        config.default_pipe_size = atoi(optarg);
+        break;
+      case 'i':
+        config.sample_interval_ms = atoi(optarg);
+        break;
+      case 'D':
+        dag_demo = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-j max_parallel] [-p pipe_size] [-i sample_ms] [-D] ['a | b |64k c' ...]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  char **specs = optind < argc ? &argv[optind] : default_specs;
+  int num_specs = optind < argc ? argc - optind : (int)(sizeof(default_specs) / sizeof(default_specs[0]));
+  int num_jobs = num_specs + dag_demo;
+  pipeline_job_t *jobs = calloc((size_t)num_jobs, sizeof(pipeline_job_t));
+  if (jobs == NULL) {
+    perror("calloc");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < num_specs; ++i) {
+    if (pipeline_job_parse(&jobs[i], specs[i]) == -1) {
+      fprintf(stderr, "Could not parse pipeline '%s'.\n", specs[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (dag_demo && build_dag_demo(&jobs[num_specs]) == -1) {
+    fprintf(stderr, "Could not build the DAG demo.\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("Running %d job(s), at most %d at a time...\n", num_jobs, config.max_parallel);
+  fflush(stdout);  // Stages inherit stdout; flush so our line comes first
+  int rc = pipeline_run(jobs, num_jobs, &config);
+
+  printf("\n");
+  for (int i = 0; i < num_jobs; ++i) {
+    pipeline_report(&jobs[i], stdout);
+    pipeline_job_free(&jobs[i]);
+  }
+  free(jobs);
+
+  return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
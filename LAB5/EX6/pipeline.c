@@ -0,0 +1,555 @@
+#define _GNU_SOURCE  // For pipe2, F_SETPIPE_SZ, F_GETPIPE_SZ
+
+#include "pipeline.h"
+
+#include <ctype.h>         // For isdigit, isspace
+#include <errno.h>         // For errno, EAGAIN, EINTR, EPIPE
+#include <fcntl.h>         // For fcntl, open, O_CLOEXEC, O_NONBLOCK
+#include <limits.h>        // For PIPE_BUF
+#include <signal.h>        // For sigaction, SIGPIPE
+#include <spawn.h>         // For posix_spawnp, posix_spawn_file_actions_*
+#include <stdlib.h>        // For malloc, calloc, free, strtol
+#include <string.h>        // For memset, strdup, strtok_r
+#include <sys/epoll.h>     // For epoll_create1, epoll_ctl, epoll_wait
+#include <sys/ioctl.h>     // For ioctl, FIONREAD
+#include <sys/resource.h>  // For struct rusage
+#include <sys/wait.h>      // For wait4, WNOHANG
+#include <time.h>          // For clock_gettime
+#include <unistd.h>        // For close, read, write
+
+extern char **environ;
+
+#define MAX_ARGS 64          // Arguments per stage accepted by pipeline_job_parse
+#define BUSY_THRESHOLD 50.0  // Percent of samples above which a stage counts as stalled
+
+void pipeline_job_init(pipeline_job_t *job, const char *name) {
+  memset(job, 0, sizeof(*job));
+  job->name = name;
+  job->in_fd = -1;
+  job->out_fd = -1;
+}
+
+int pipeline_job_add_node(pipeline_job_t *job, char **argv, int pipe_size) {
+  if (job->num_nodes == PIPELINE_MAX_NODES) {
+    return -1;
+  }
+  pipeline_node_t *node = &job->nodes[job->num_nodes];
+  memset(node, 0, sizeof(*node));
+  node->argv = argv;
+  node->pipe_size = pipe_size;
+  node->in_read = -1;
+  node->in_write = -1;
+  node->relay_read = -1;
+  return job->num_nodes++;
+}
+
+int pipeline_job_connect(pipeline_job_t *job, int from, int to) {
+  pipeline_node_t *node = &job->nodes[to];
+  if (from < 0 || from >= job->num_nodes || to < 0 || to >= job->num_nodes || from == to ||
+      node->num_upstream == PIPELINE_MAX_UPSTREAM) {
+    return -1;
+  }
+  node->upstream[node->num_upstream++] = from;
+  return 0;
+}
+
+// Parse "256k" / "1m" / "65536" at *s, advancing past it. It is only a size when whitespace
+// follows, so a command whose name starts with a digit ("2to3 file") is left alone: 0 then.
+static int parse_size(const char **s) {
+  char *end;
+  long value = strtol(*s, &end, 10);
+  if (*end == 'k' || *end == 'K') {
+    value *= 1024;
+    end++;
+  } else if (*end == 'm' || *end == 'M') {
+    value *= 1024 * 1024;
+    end++;
+  }
+  if (!isspace((unsigned char)*end)) return 0;
+  *s = end;
+  return (int)value;
+}
+
+int pipeline_job_parse(pipeline_job_t *job, const char *spec) {
+  char *copy = strdup(spec);
+  char *save_stage;
+  int prev = -1;
+
+  pipeline_job_init(job, spec);
+  for (char *stage = strtok_r(copy, "|", &save_stage); stage != NULL; stage = strtok_r(NULL, "|", &save_stage)) {
+    const char *cursor = stage;
+    int pipe_size = 0;
+    while (isspace((unsigned char)*cursor)) cursor++;
+    if (prev >= 0 && isdigit((unsigned char)*cursor)) {
+      pipe_size = parse_size(&cursor);
+    }
+
+    char **argv = calloc(MAX_ARGS + 1, sizeof(char *));
+    char *args = strdup(cursor);
+    char *save_arg;
+    int argc = 0;
+    int too_many = 0;
+    for (char *arg = strtok_r(args, " \t\n", &save_arg); arg != NULL && !too_many;
+         arg = strtok_r(NULL, " \t\n", &save_arg)) {
+      too_many = argc == MAX_ARGS;
+      if (!too_many) argv[argc++] = strdup(arg);
+    }
+    free(args);
+    if (too_many) fprintf(stderr, "pipeline: more than %d arguments in stage '%s'\n", MAX_ARGS, argv[0]);
+
+    int index = argc > 0 && !too_many ? pipeline_job_add_node(job, argv, pipe_size) : -1;
+    if (index == -1) {
+      for (int i = 0; i < argc; ++i) free(argv[i]);
+      free(argv);
+      free(copy);
+      pipeline_job_free(job);
+      return -1;
+    }
+    job->nodes[index].owns_argv = 1;
+    if (prev >= 0) pipeline_job_connect(job, prev, index);
+    prev = index;
+  }
+  free(copy);
+  return job->num_nodes > 0 ? 0 : -1;
+}
+
+void pipeline_job_free(pipeline_job_t *job) {
+  for (int i = 0; i < job->num_nodes; ++i) {
+    pipeline_node_t *node = &job->nodes[i];
+    if (node->owns_argv) {
+      for (char **arg = node->argv; *arg != NULL; ++arg) free(*arg);
+      free(node->argv);
+      node->owns_argv = 0;
+    }
+    free(node->relay_buf);
+    node->relay_buf = NULL;
+  }
+}
+
+static double elapsed_ms(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void set_events(int epoll_fd, int fd, unsigned int events) {
+  struct epoll_event ev = {.events = events, .data.fd = fd};
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void close_relay(pipeline_node_t *node, int epoll_fd) {
+  for (int t = 0; t < node->num_relay_targets; ++t) {
+    if (node->relay_targets[t] >= 0) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, node->relay_targets[t], NULL);
+      close(node->relay_targets[t]);
+      node->relay_targets[t] = -1;
+    }
+  }
+  if (node->relay_read >= 0) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, node->relay_read, NULL);
+    close(node->relay_read);
+    node->relay_read = -1;
+  }
+}
+
+// Copy the fan-out stage's stdout into every downstream pipe without blocking the executor.
+// A chunk is only replaced once every live downstream has taken all of it.
+static void service_relay(pipeline_node_t *node, int epoll_fd) {
+  while (node->relay_read >= 0) {
+    if (node->relay_len == 0) {
+      ssize_t n = read(node->relay_read, node->relay_buf, PIPELINE_RELAY_BUF);
+      if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+        close_relay(node, epoll_fd);  // Upstream finished: downstreams see EOF
+        return;
+      }
+      if (n == -1) {
+        set_events(epoll_fd, node->relay_read, EPOLLIN);
+        return;
+      }
+      node->relay_len = (size_t)n;
+      memset(node->relay_offsets, 0, sizeof(node->relay_offsets));
+    }
+
+    int pending = 0;
+    int live = 0;
+    for (int t = 0; t < node->num_relay_targets; ++t) {
+      int fd = node->relay_targets[t];
+      if (fd < 0) continue;
+      while (node->relay_offsets[t] < node->relay_len) {
+        ssize_t w = write(fd, node->relay_buf + node->relay_offsets[t], node->relay_len - node->relay_offsets[t]);
+        if (w > 0) {
+          node->relay_offsets[t] += (size_t)w;
+        } else if (w == -1 && errno == EINTR) {
+          continue;
+        } else {
+          break;
+        }
+      }
+      if (node->relay_offsets[t] < node->relay_len && errno == EAGAIN) {
+        pending = 1;
+        live++;
+        set_events(epoll_fd, fd, EPOLLOUT);
+      } else if (node->relay_offsets[t] < node->relay_len) {
+        // EPIPE: this downstream exited, keep feeding the others
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        close(fd);
+        node->relay_targets[t] = -1;
+      } else {
+        live++;
+        set_events(epoll_fd, fd, 0);
+      }
+    }
+    if (live == 0) {
+      close_relay(node, epoll_fd);  // Nobody left to feed: let upstream see EPIPE
+      return;
+    }
+    if (pending) {
+      set_events(epoll_fd, node->relay_read, 0);  // Back-pressure upstream until targets drain
+      return;
+    }
+    node->relay_len = 0;
+  }
+}
+
+static void set_pipe_size(int fd, int size) {
+  if (size > 0 && fcntl(fd, F_SETPIPE_SZ, size) == -1) {
+    perror("fcntl F_SETPIPE_SZ failed");
+  }
+}
+
+static int spawn_node(pipeline_node_t *node, int in_fd, int out_fd) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t default_signals;
+
+  posix_spawn_file_actions_init(&actions);
+  // Everything else the executor holds is O_CLOEXEC, so only stdin/stdout need wiring
+  if (in_fd >= 0) posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+  if (out_fd >= 0) posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+
+  // The executor ignores SIGPIPE; stages must still die on it like they would in a shell
+  posix_spawnattr_init(&attr);
+  sigemptyset(&default_signals);
+  sigaddset(&default_signals, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &default_signals);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+  int rc = posix_spawnp(&node->pid, node->argv[0], &actions, &attr, node->argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if (rc != 0) {
+    errno = rc;
+    perror(node->argv[0]);
+    node->pid = 0;
+    node->reaped = 1;
+    node->status = 127 << 8;
+    return -1;
+  }
+  return 0;
+}
+
+// Undo a partially set up job before any stage was spawned
+static void abort_job(pipeline_job_t *job, const int *relay_write, int epoll_fd) {
+  for (int i = 0; i < job->num_nodes; ++i) {
+    pipeline_node_t *node = &job->nodes[i];
+    if (node->in_read >= 0) close(node->in_read);
+    if (node->in_write >= 0) close(node->in_write);
+    if (relay_write[i] >= 0) close(relay_write[i]);
+    node->in_read = -1;
+    node->in_write = -1;
+    close_relay(node, epoll_fd);
+    node->reaped = 1;
+  }
+}
+
+static int start_job(pipeline_job_t *job, const pipeline_exec_config_t *config, int epoll_fd) {
+  int downstream[PIPELINE_MAX_NODES][PIPELINE_MAX_DOWNSTREAM];
+  int num_downstream[PIPELINE_MAX_NODES] = {0};
+  int relay_write[PIPELINE_MAX_NODES];
+
+  for (int i = 0; i < job->num_nodes; ++i) relay_write[i] = -1;
+  for (int d = 0; d < job->num_nodes; ++d) {
+    for (int k = 0; k < job->nodes[d].num_upstream; ++k) {
+      int u = job->nodes[d].upstream[k];
+      if (num_downstream[u] == PIPELINE_MAX_DOWNSTREAM) {
+        abort_job(job, relay_write, epoll_fd);
+        return -1;
+      }
+      downstream[u][num_downstream[u]++] = d;
+    }
+  }
+
+  // Input pipe for every stage that has upstreams; fan-in writers share it
+  for (int i = 0; i < job->num_nodes; ++i) {
+    pipeline_node_t *node = &job->nodes[i];
+    if (node->num_upstream == 0) continue;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+      perror("pipe2");
+      abort_job(job, relay_write, epoll_fd);
+      return -1;
+    }
+    set_pipe_size(fds[1], node->pipe_size > 0 ? node->pipe_size : config->default_pipe_size);
+    node->in_read = fds[0];
+    node->in_write = fds[1];
+    node->in_capacity = fcntl(fds[1], F_GETPIPE_SZ);
+  }
+
+  // Fan-out stages write into a relay pipe drained by the executor
+  for (int u = 0; u < job->num_nodes; ++u) {
+    pipeline_node_t *node = &job->nodes[u];
+    if (num_downstream[u] < 2) continue;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+      perror("pipe2");
+      abort_job(job, relay_write, epoll_fd);
+      return -1;
+    }
+    set_pipe_size(fds[1], config->default_pipe_size);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    node->relay_read = fds[0];
+    node->relay_capacity = fcntl(fds[1], F_GETPIPE_SZ);
+    relay_write[u] = fds[1];
+    node->relay_buf = malloc(PIPELINE_RELAY_BUF);
+    node->relay_len = 0;
+    node->num_relay_targets = num_downstream[u];
+    for (int t = 0; t < num_downstream[u]; ++t) {
+      // Reopening through /proc gives a separate open file description, so O_NONBLOCK here
+      // does not leak into the fan-in stages that share the same pipe
+      char path[64];
+      snprintf(path, sizeof(path), "/proc/self/fd/%d", job->nodes[downstream[u][t]].in_write);
+      node->relay_targets[t] = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+      if (node->relay_targets[t] == -1) {
+        perror("open relay target");
+        abort_job(job, relay_write, epoll_fd);
+        return -1;
+      }
+      struct epoll_event ev = {.events = 0, .data.fd = node->relay_targets[t]};
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, node->relay_targets[t], &ev);
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = node->relay_read};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, node->relay_read, &ev);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &job->start);
+  for (int i = 0; i < job->num_nodes; ++i) {
+    pipeline_node_t *node = &job->nodes[i];
+    int in_fd = node->num_upstream > 0 ? node->in_read : job->in_fd;
+    int out_fd = job->out_fd;
+    if (num_downstream[i] == 1) {
+      out_fd = job->nodes[downstream[i][0]].in_write;
+    } else if (num_downstream[i] > 1) {
+      out_fd = relay_write[i];
+    }
+    if (spawn_node(node, in_fd, out_fd) == -1 && node->in_read >= 0) {
+      close(node->in_read);  // Nobody will read this pipe: let writers get EPIPE
+      node->in_read = -1;
+    }
+  }
+
+  // Only the stages hold write ends now, so EOF propagates when they exit
+  for (int i = 0; i < job->num_nodes; ++i) {
+    if (job->nodes[i].in_write >= 0) {
+      close(job->nodes[i].in_write);
+      job->nodes[i].in_write = -1;
+    }
+    if (relay_write[i] >= 0) close(relay_write[i]);
+  }
+  job->running = 1;
+  return 0;
+}
+
+static void sample_job(pipeline_job_t *job) {
+  for (int i = 0; i < job->num_nodes; ++i) {
+    pipeline_node_t *node = &job->nodes[i];
+    int bytes;
+    if (node->reaped) continue;
+    if (node->in_read >= 0 && ioctl(node->in_read, FIONREAD, &bytes) == 0) {
+      node->samples++;
+      node->fill_sum += (double)bytes / node->in_capacity;
+      if (bytes == 0) node->empty_samples++;
+      if (bytes >= node->in_capacity - PIPE_BUF) node->full_samples++;
+    }
+    if (node->relay_read >= 0 && ioctl(node->relay_read, FIONREAD, &bytes) == 0) {
+      node->out_samples++;
+      if (bytes >= node->relay_capacity - PIPE_BUF) node->out_full_samples++;
+    }
+  }
+}
+
+static int job_finished(const pipeline_job_t *job) {
+  for (int i = 0; i < job->num_nodes; ++i) {
+    if (!job->nodes[i].reaped || job->nodes[i].relay_read >= 0) return 0;
+  }
+  return 1;
+}
+
+// Record exit status and CPU time of every exited stage. Only the stages' own PIDs are waited
+// for: any other child of the caller is left for the caller to reap.
+static void reap_children(pipeline_job_t *jobs, int num_jobs) {
+  int status;
+  struct rusage usage;
+
+  for (int j = 0; j < num_jobs; ++j) {
+    if (!jobs[j].running) continue;
+    for (int i = 0; i < jobs[j].num_nodes; ++i) {
+      pipeline_node_t *node = &jobs[j].nodes[i];
+      if (node->reaped || node->pid <= 0) continue;
+      pid_t pid = wait4(node->pid, &status, WNOHANG, &usage);
+      if (pid == 0 || (pid == -1 && errno == EINTR)) continue;  // Still running
+      if (pid == -1) {
+        perror("pipeline: wait4");  // Not our child after all: count it as gone
+        status = 0;
+        memset(&usage, 0, sizeof(usage));
+      }
+      node->status = status;
+      node->utime = usage.ru_utime;
+      node->stime = usage.ru_stime;
+      node->reaped = 1;
+      if (node->in_read >= 0) {
+        close(node->in_read);  // Upstream writers must now see EPIPE
+        node->in_read = -1;
+      }
+    }
+  }
+}
+
+int pipeline_run(pipeline_job_t *jobs, int num_jobs, const pipeline_exec_config_t *config) {
+  struct sigaction ignore = {.sa_handler = SIG_IGN};
+  struct sigaction old_pipe;
+  struct epoll_event events[16];
+  int max_parallel = config->max_parallel > 0 ? config->max_parallel : 1;
+  int interval_ms = config->sample_interval_ms > 0 ? config->sample_interval_ms : PIPELINE_DEFAULT_SAMPLE_MS;
+  int next = 0;
+  int running = 0;
+  int finished = 0;
+  int failures = 0;
+
+  // A relay writing into an exited stage must get EPIPE, not kill the executor
+  sigemptyset(&ignore.sa_mask);
+  sigaction(SIGPIPE, &ignore, &old_pipe);
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd == -1) {
+    perror("epoll_create1");
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    return -1;
+  }
+
+  struct timespec last_sample;
+  clock_gettime(CLOCK_MONOTONIC, &last_sample);
+  while (finished < num_jobs) {
+    while (running < max_parallel && next < num_jobs) {
+      pipeline_job_t *job = &jobs[next++];
+      if (start_job(job, config, epoll_fd) == -1) {
+        fprintf(stderr, "pipeline: could not start job '%s'\n", job->name);
+        job->done = 1;
+        failures++;
+        finished++;
+        continue;
+      }
+      running++;
+    }
+
+    if (epoll_wait(epoll_fd, events, 16, interval_ms) == -1 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    for (int j = 0; j < num_jobs; ++j) {
+      if (!jobs[j].running) continue;
+      for (int i = 0; i < jobs[j].num_nodes; ++i) service_relay(&jobs[j].nodes[i], epoll_fd);
+    }
+    reap_children(jobs, num_jobs);
+
+    int sample_now = elapsed_ms(&last_sample) >= interval_ms;
+    if (sample_now) clock_gettime(CLOCK_MONOTONIC, &last_sample);
+    for (int j = 0; j < num_jobs; ++j) {
+      if (!jobs[j].running) continue;
+      if (sample_now) sample_job(&jobs[j]);
+      if (job_finished(&jobs[j])) {
+        jobs[j].wall_ms = elapsed_ms(&jobs[j].start);
+        jobs[j].running = 0;
+        jobs[j].done = 1;
+        running--;
+        finished++;
+      }
+    }
+  }
+
+  close(epoll_fd);
+  sigaction(SIGPIPE, &old_pipe, NULL);
+  return failures > 0 ? -1 : 0;
+}
+
+static double percent(long part, long whole) { return whole > 0 ? 100.0 * (double)part / (double)whole : 0.0; }
+
+static double timeval_ms(struct timeval tv) { return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0; }
+
+void pipeline_report(const pipeline_job_t *job, FILE *out) {
+  int bottleneck = -1;
+  double bottleneck_cpu = -1.0;
+  int single_downstream[PIPELINE_MAX_NODES];
+  int num_downstream[PIPELINE_MAX_NODES] = {0};
+
+  for (int d = 0; d < job->num_nodes; ++d) {
+    for (int k = 0; k < job->nodes[d].num_upstream; ++k) {
+      int u = job->nodes[d].upstream[k];
+      single_downstream[u] = d;
+      num_downstream[u]++;
+    }
+  }
+
+  fprintf(out, "Job '%s': wall %.1f ms\n", job->name, job->wall_ms);
+  fprintf(out, "  %-2s %-24s %9s %9s %8s %8s %8s %8s  %-6s %s\n", "#", "command", "user_ms", "sys_ms", "in_fill",
+          "in_empty", "in_full", "out_full", "exit", "verdict");
+  for (int i = 0; i < job->num_nodes; ++i) {
+    const pipeline_node_t *node = &job->nodes[i];
+    double cpu = timeval_ms(node->utime) + timeval_ms(node->stime);
+    double in_empty = percent(node->empty_samples, node->samples);
+    double in_full = percent(node->full_samples, node->samples);
+    double out_full = 0.0;
+    if (num_downstream[i] == 1) {
+      const pipeline_node_t *down = &job->nodes[single_downstream[i]];
+      out_full = percent(down->full_samples, down->samples);
+    } else if (num_downstream[i] > 1) {
+      out_full = percent(node->out_full_samples, node->out_samples);
+    }
+
+    // A full output pipe means this stage waited on its consumer; an empty input pipe means
+    // it waited on its producer. A stage that did neither is doing the work everyone waits for.
+    const char *verdict = "busy";
+    if (out_full > BUSY_THRESHOLD) {
+      verdict = "stalled writing (downstream slower)";
+    } else if (node->num_upstream > 0 && in_empty > BUSY_THRESHOLD) {
+      verdict = "stalled reading (upstream slower)";
+    } else if (cpu > bottleneck_cpu) {
+      bottleneck = i;
+      bottleneck_cpu = cpu;
+    }
+
+    char command[25];
+    snprintf(command, sizeof(command), "%s%s%s", node->argv[0], node->argv[1] ? " " : "",
+             node->argv[1] ? node->argv[1] : "");
+    char exit_str[16];
+    if (WIFEXITED(node->status)) {
+      snprintf(exit_str, sizeof(exit_str), "%d", WEXITSTATUS(node->status));
+    } else {
+      snprintf(exit_str, sizeof(exit_str), "sig%d", WTERMSIG(node->status));
+    }
+    if (node->num_upstream > 0) {
+      fprintf(out, "  %-2d %-24s %9.1f %9.1f %7.0f%% %7.0f%% %7.0f%% %7.0f%%  %-6s %s\n", i, command,
+              timeval_ms(node->utime), timeval_ms(node->stime),
+              node->samples > 0 ? 100.0 * node->fill_sum / node->samples : 0.0, in_empty, in_full, out_full,
+              exit_str, verdict);
+    } else {
+      fprintf(out, "  %-2d %-24s %9.1f %9.1f %8s %8s %8s %7.0f%%  %-6s %s\n", i, command, timeval_ms(node->utime),
+              timeval_ms(node->stime), "-", "-", "-", out_full, exit_str, verdict);
+    }
+  }
+  if (bottleneck >= 0) {
+    fprintf(out, "  Bottleneck: stage %d '%s' (%.1f ms CPU, neighbours wait on it)\n", bottleneck,
+            job->nodes[bottleneck].argv[0], bottleneck_cpu);
+  } else {
+    fprintf(out, "  Bottleneck: none found (every stage spent most of its time waiting)\n");
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>      // For FILE
+#include <sys/time.h>   // For struct timeval
+#include <sys/types.h>  // For pid_t
+
+#define PIPELINE_MAX_NODES 32      // Stages per job
+#define PIPELINE_MAX_UPSTREAM 8    // Fan-in per stage
+#define PIPELINE_MAX_DOWNSTREAM 8  // Fan-out per stage
+#define PIPELINE_RELAY_BUF (64 * 1024)
+#define PIPELINE_DEFAULT_SAMPLE_MS 10
+
+// One external command in a job. A stage with several upstreams reads all of them from one
+// shared pipe (like `{ a; b; } | c`); a stage with several downstreams is relayed by the
+// executor into one pipe per downstream.
+typedef struct {
+  char **argv;    // NULL-terminated, argv[0] is looked up in PATH
+  int owns_argv;  // argv was allocated by pipeline_job_parse
+  int upstream[PIPELINE_MAX_UPSTREAM];
+  int num_upstream;  // 0 = stdin comes from job->in_fd
+  int pipe_size;     // F_SETPIPE_SZ for this stage's input pipe, 0 = executor default
+
+  // Results
+  pid_t pid;
+  int status;            // As returned by wait4
+  struct timeval utime;  // User CPU time of the stage (and its waited-for children)
+  struct timeval stime;  // System CPU time
+  long samples;          // Input-pipe occupancy samples taken while the stage ran
+  long empty_samples;    // Input pipe empty: the stage was waiting on upstream
+  long full_samples;     // Input pipe (nearly) full: upstream was blocked on this stage
+  double fill_sum;       // Sum of fill ratios for the average
+  long out_samples;      // Same for the fan-out relay pipe (only for relayed stages)
+  long out_full_samples;
+
+  // Executor bookkeeping
+  int in_read;      // Executor's copy of the input pipe read end, kept for FIONREAD sampling
+  int in_write;     // Input pipe write end (closed once all writers are spawned)
+  int in_capacity;  // F_GETPIPE_SZ of the input pipe
+  int relay_read;   // Read end of this stage's stdout when it fans out, else -1
+  int relay_capacity;
+  int relay_targets[PIPELINE_MAX_DOWNSTREAM];  // Non-blocking write ends into downstream pipes
+  size_t relay_offsets[PIPELINE_MAX_DOWNSTREAM];
+  int num_relay_targets;
+  char *relay_buf;
+  size_t relay_len;
+  int reaped;
+} pipeline_node_t;
+
+// A pipeline or DAG of stages executed as one unit
+typedef struct {
+  const char *name;
+  pipeline_node_t nodes[PIPELINE_MAX_NODES];
+  int num_nodes;
+  int in_fd;   // stdin of source stages, -1 = inherit
+  int out_fd;  // stdout of sink stages, -1 = inherit
+
+  // Results
+  double wall_ms;
+  int running;
+  int done;
+  struct timespec start;
+} pipeline_job_t;
+
+typedef struct {
+  int max_parallel;        // Jobs running at once (<= 0 means 1)
+  int default_pipe_size;   // F_SETPIPE_SZ for every stage without its own size, 0 = kernel default
+  int sample_interval_ms;  // Pipe occupancy sampling period, 0 = PIPELINE_DEFAULT_SAMPLE_MS
+} pipeline_exec_config_t;
+
+void pipeline_job_init(pipeline_job_t *job, const char *name);
+
+// Append a stage; returns its index or -1 when the job is full
+int pipeline_job_add_node(pipeline_job_t *job, char **argv, int pipe_size);
+
+// Feed stdout of stage `from` into stdin of stage `to`
+int pipeline_job_connect(pipeline_job_t *job, int from, int to);
+
+// Build a linear job from "cmd a | cmd b |256k cmd c". A size right after '|' (k/m suffix) and
+// followed by whitespace sets that stage's input pipe size. Arguments are split on whitespace, no quoting. -1 for an
+// empty stage, and with a message on stderr for a stage of more than 64 arguments.
+int pipeline_job_parse(pipeline_job_t *job, const char *spec);
+
+// Run all jobs to completion with at most config->max_parallel at a time
+int pipeline_run(pipeline_job_t *jobs, int num_jobs, const pipeline_exec_config_t *config);
+
+// Per-stage CPU time, pipe occupancy and a bottleneck verdict
+void pipeline_report(const pipeline_job_t *job, FILE *out);
+
+void pipeline_job_free(pipeline_job_t *job);
+
+#endif  // PIPELINE_H
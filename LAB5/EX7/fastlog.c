@@ -0,0 +1,318 @@
+#define _GNU_SOURCE  // For IOV_MAX
+
+#include "fastlog.h"
+
+#include <errno.h>      // For errno, EINTR
+#include <limits.h>     // For IOV_MAX
+#include <pthread.h>    // For pthread_create, pthread_join, pthread_key_*, pthread_mutex_*, pthread_cond_*
+#include <sched.h>      // For sched_yield
+#include <stdarg.h>     // For va_list
+#include <stdatomic.h>  // For atomic_*
+#include <stdio.h>      // For perror, vsnprintf
+#include <stdlib.h>     // For calloc, aligned_alloc, malloc, free
+#include <string.h>     // For memcpy, memset
+#include <sys/uio.h>    // For writev, struct iovec
+
+// Single-producer/single-consumer byte ring owned by one logging thread
+typedef struct fastlog_ring {
+  _Alignas(64) _Atomic size_t head;  // Bytes ever appended (producer)
+  _Alignas(64) _Atomic size_t tail;  // Bytes ever written out (writer thread)
+  _Alignas(64) struct fastlog_ring *next;
+  char *data;
+  size_t size;
+  _Atomic unsigned long long messages;
+  _Atomic unsigned long long waits;
+  _Atomic int dead;  // Its thread exited: freed by the writer once drained
+} fastlog_ring_t;
+
+struct fastlog {
+  int fd;
+  size_t ring_size;
+  pthread_key_t key;                // Each thread's ring for this logger
+  _Atomic(fastlog_ring_t *) rings;  // Every live thread's ring; the writer walks it without the lock
+  // Guards changes to the list, and the sleeps of the writer and of fastlog_flush()
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;   // Writer: a ring went from empty to non-empty, or stop
+  pthread_cond_t drained;  // Flushers: the writer released ring space
+  _Atomic int sleeping;    // The writer is waiting on wakeup, or about to
+  _Atomic int flushers;    // Threads in fastlog_flush(): while any, no ring is freed
+  _Atomic int stop;
+  _Atomic unsigned long long bytes;
+  _Atomic unsigned long long syscalls;
+  unsigned long long reaped_messages;  // Counters of the rings already freed, under the lock
+  unsigned long long reaped_waits;
+  pthread_t writer;
+};
+
+// A pending span of one ring collected for the current writev
+typedef struct {
+  fastlog_ring_t *ring;
+  size_t available;
+} pending_t;
+
+static void free_ring(fastlog_ring_t *ring) {
+  free(ring->data);
+  free(ring);
+}
+
+// Called with the lock held: unlink and free the rings of exited threads that are fully written.
+// Producers only push on the head, under the same lock, so the links are the writer's to change.
+static void reap_rings(fastlog_t *log) {
+  fastlog_ring_t *prev = NULL;
+  fastlog_ring_t *ring = atomic_load_explicit(&log->rings, memory_order_relaxed);
+  while (ring != NULL) {
+    fastlog_ring_t *next = ring->next;
+    if (atomic_load_explicit(&ring->dead, memory_order_acquire) &&
+        atomic_load_explicit(&ring->head, memory_order_relaxed) ==
+            atomic_load_explicit(&ring->tail, memory_order_relaxed)) {
+      if (prev == NULL) {
+        atomic_store_explicit(&log->rings, next, memory_order_release);
+      } else {
+        prev->next = next;
+      }
+      log->reaped_messages += atomic_load_explicit(&ring->messages, memory_order_relaxed);
+      log->reaped_waits += atomic_load_explicit(&ring->waits, memory_order_relaxed);
+      free_ring(ring);
+    } else {
+      prev = ring;
+    }
+    ring = next;
+  }
+}
+
+static int rings_empty(fastlog_t *log) {
+  for (fastlog_ring_t *ring = atomic_load_explicit(&log->rings, memory_order_acquire); ring != NULL;
+       ring = ring->next) {
+    if (atomic_load(&ring->head) != atomic_load_explicit(&ring->tail, memory_order_relaxed)) return 0;
+  }
+  return 1;
+}
+
+// Every ring empty: reap the dead ones and sleep until a producer or fastlog_destroy() signals.
+// Announcing the sleep and then looking at the heads once more pairs with the producers' store
+// of the head and load of sleeping (both sequentially consistent), so either the writer sees the
+// new line or the producer sees the writer asleep and signals it under the lock.
+static void writer_idle(fastlog_t *log) {
+  pthread_mutex_lock(&log->lock);
+  if (atomic_load_explicit(&log->flushers, memory_order_relaxed) == 0) reap_rings(log);
+  atomic_store(&log->sleeping, 1);
+  while (rings_empty(log) && !atomic_load(&log->stop)) pthread_cond_wait(&log->wakeup, &log->lock);
+  atomic_store_explicit(&log->sleeping, 0, memory_order_relaxed);
+  pthread_mutex_unlock(&log->lock);
+}
+
+static void *writer_main(void *arg) {
+  fastlog_t *log = arg;
+  struct iovec iov[IOV_MAX];
+  pending_t pending[IOV_MAX / 2];
+
+  while (1) {
+    int iovcnt = 0;
+    int npending = 0;
+    for (fastlog_ring_t *ring = atomic_load_explicit(&log->rings, memory_order_acquire);
+         ring != NULL && iovcnt + 2 <= IOV_MAX; ring = ring->next) {
+      size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+      size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+      if (head == tail) continue;
+      size_t offset = tail % ring->size;
+      size_t first = head - tail;
+      if (first > ring->size - offset) first = ring->size - offset;
+      iov[iovcnt].iov_base = ring->data + offset;
+      iov[iovcnt++].iov_len = first;
+      if (head - tail > first) {
+        iov[iovcnt].iov_base = ring->data;
+        iov[iovcnt++].iov_len = head - tail - first;
+      }
+      pending[npending].ring = ring;
+      pending[npending++].available = head - tail;
+    }
+
+    if (iovcnt == 0) {
+      if (atomic_load_explicit(&log->stop, memory_order_acquire)) break;
+      writer_idle(log);
+      continue;
+    }
+
+    ssize_t written = writev(log->fd, iov, iovcnt);
+    atomic_fetch_add_explicit(&log->syscalls, 1, memory_order_relaxed);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      perror("fastlog: writev failed, dropping pending lines");
+      written = 0;
+      for (int i = 0; i < npending; ++i) written += (ssize_t)pending[i].available;
+    } else {
+      atomic_fetch_add_explicit(&log->bytes, (unsigned long long)written, memory_order_relaxed);
+    }
+
+    // Release consumed space in ring order; a short write leaves the rest for the next pass
+    size_t remaining = (size_t)written;
+    for (int i = 0; i < npending && remaining > 0; ++i) {
+      size_t take = pending[i].available < remaining ? pending[i].available : remaining;
+      size_t tail = atomic_load_explicit(&pending[i].ring->tail, memory_order_relaxed);
+      atomic_store_explicit(&pending[i].ring->tail, tail + take, memory_order_release);
+      remaining -= take;
+    }
+    // Same pairing as for sleeping: a flusher counts itself in before it checks the tails
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&log->flushers) > 0) {
+      pthread_mutex_lock(&log->lock);
+      pthread_cond_broadcast(&log->drained);
+      pthread_mutex_unlock(&log->lock);
+    }
+  }
+  return NULL;
+}
+
+// Runs when a thread that logged exits: its ring can go once the writer has drained it
+static void ring_orphaned(void *value) {
+  fastlog_ring_t *ring = value;
+  atomic_store_explicit(&ring->dead, 1, memory_order_release);
+}
+
+fastlog_t *fastlog_create(int fd, size_t ring_size) {
+  fastlog_t *log = calloc(1, sizeof(fastlog_t));
+  if (log == NULL) {
+    perror("calloc");
+    return NULL;
+  }
+  log->fd = fd;
+  log->ring_size = ring_size > 0 ? ring_size : FASTLOG_DEFAULT_RING_SIZE;
+  atomic_init(&log->rings, NULL);
+  atomic_init(&log->sleeping, 0);
+  atomic_init(&log->flushers, 0);
+  atomic_init(&log->stop, 0);
+  int rc = pthread_key_create(&log->key, ring_orphaned);
+  if (rc != 0) {
+    fprintf(stderr, "fastlog: pthread_key_create failed: %d\n", rc);
+    free(log);
+    return NULL;
+  }
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_cond_init(&log->wakeup, NULL);
+  pthread_cond_init(&log->drained, NULL);
+
+  rc = pthread_create(&log->writer, NULL, writer_main, log);
+  if (rc != 0) {
+    fprintf(stderr, "fastlog: pthread_create failed: %d\n", rc);
+    pthread_key_delete(log->key);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->wakeup);
+    pthread_cond_destroy(&log->drained);
+    free(log);
+    return NULL;
+  }
+  return log;
+}
+
+// The calling thread's ring for this logger, registered on first use. Every thread has one ring
+// per logger, so switching between loggers neither reallocates nor reorders anything.
+static fastlog_ring_t *thread_ring(fastlog_t *log) {
+  fastlog_ring_t *ring = pthread_getspecific(log->key);
+  if (ring != NULL) {
+    return ring;
+  }
+  // aligned_alloc keeps head and tail on separate cache lines as declared
+  ring = aligned_alloc(64, sizeof(fastlog_ring_t));
+  if (ring != NULL) memset(ring, 0, sizeof(fastlog_ring_t));
+  if (ring == NULL || (ring->data = malloc(log->ring_size)) == NULL) {
+    perror("fastlog: ring allocation failed");
+    free(ring);
+    return NULL;
+  }
+  ring->size = log->ring_size;
+  if (pthread_setspecific(log->key, ring) != 0) {
+    perror("fastlog: pthread_setspecific failed");
+    free_ring(ring);
+    return NULL;
+  }
+  pthread_mutex_lock(&log->lock);
+  ring->next = atomic_load_explicit(&log->rings, memory_order_relaxed);
+  atomic_store_explicit(&log->rings, ring, memory_order_release);
+  pthread_mutex_unlock(&log->lock);
+  return ring;
+}
+
+void fastlog_write(fastlog_t *log, const char *msg, size_t len) {
+  fastlog_ring_t *ring = thread_ring(log);
+  if (ring == NULL) return;
+  if (len > ring->size) len = ring->size;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  while (ring->size - (head - atomic_load_explicit(&ring->tail, memory_order_acquire)) < len) {
+    atomic_fetch_add_explicit(&ring->waits, 1, memory_order_relaxed);
+    sched_yield();  // Ring full: wait for the writer rather than drop lines
+  }
+
+  size_t offset = head % ring->size;
+  size_t first = len < ring->size - offset ? len : ring->size - offset;
+  memcpy(ring->data + offset, msg, first);
+  memcpy(ring->data, msg + first, len - first);
+  atomic_fetch_add_explicit(&ring->messages, 1, memory_order_relaxed);
+  atomic_store(&ring->head, head + len);
+  // Only touches the lock when the writer went to sleep on empty rings
+  if (atomic_load(&log->sleeping)) {
+    pthread_mutex_lock(&log->lock);
+    pthread_cond_signal(&log->wakeup);
+    pthread_mutex_unlock(&log->lock);
+  }
+}
+
+void fastlog_printf(fastlog_t *log, const char *fmt, ...) {
+  char buffer[FASTLOG_MAX_MSG];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+  if (len < 0) return;
+  if ((size_t)len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+  fastlog_write(log, buffer, (size_t)len);
+}
+
+void fastlog_flush(fastlog_t *log) {
+  pthread_mutex_lock(&log->lock);
+  atomic_fetch_add(&log->flushers, 1);
+  for (fastlog_ring_t *ring = atomic_load_explicit(&log->rings, memory_order_acquire); ring != NULL;
+       ring = ring->next) {
+    size_t target = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while (atomic_load(&ring->tail) < target) pthread_cond_wait(&log->drained, &log->lock);
+  }
+  atomic_fetch_sub(&log->flushers, 1);
+  pthread_mutex_unlock(&log->lock);
+}
+
+void fastlog_get_stats(fastlog_t *log, fastlog_stats_t *stats) {
+  pthread_mutex_lock(&log->lock);
+  stats->messages = log->reaped_messages;
+  stats->producer_waits = log->reaped_waits;
+  for (fastlog_ring_t *ring = atomic_load_explicit(&log->rings, memory_order_acquire); ring != NULL;
+       ring = ring->next) {
+    stats->messages += atomic_load_explicit(&ring->messages, memory_order_relaxed);
+    stats->producer_waits += atomic_load_explicit(&ring->waits, memory_order_relaxed);
+  }
+  pthread_mutex_unlock(&log->lock);
+  stats->bytes = atomic_load_explicit(&log->bytes, memory_order_relaxed);
+  stats->syscalls = atomic_load_explicit(&log->syscalls, memory_order_relaxed);
+}
+
+void fastlog_destroy(fastlog_t *log) {
+  if (log == NULL) return;
+  // No destructor may run on a ring after this: threads still alive just lose their slot
+  pthread_key_delete(log->key);
+  fastlog_flush(log);
+  pthread_mutex_lock(&log->lock);
+  atomic_store_explicit(&log->stop, 1, memory_order_release);
+  pthread_cond_signal(&log->wakeup);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->writer, NULL);
+
+  fastlog_ring_t *ring = atomic_load_explicit(&log->rings, memory_order_acquire);
+  while (ring != NULL) {
+    fastlog_ring_t *next = ring->next;
+    free_ring(ring);
+    ring = next;
+  }
+  pthread_mutex_destroy(&log->lock);
+  pthread_cond_destroy(&log->wakeup);
+  pthread_cond_destroy(&log->drained);
+  free(log);
+}
@@ -0,0 +1,43 @@
+#ifndef FASTLOG_H
+#define FASTLOG_H
+
+#include <stddef.h>  // For size_t
+
+#define FASTLOG_DEFAULT_RING_SIZE (256 * 1024)  // Bytes buffered per producer thread
+#define FASTLOG_MAX_MSG 1024                    // Longest formatted message accepted by fastlog_printf
+
+// Each producer thread appends into its own single-producer ring with plain stores and one
+// store of the head index, so logging takes no lock and makes no syscall while the writer is
+// busy. A background thread gathers every ring's pending bytes into one writev() per pass.
+// Lines from one thread stay in order; lines from different threads interleave by pass.
+// With every ring empty the writer sleeps on a condition variable until the next append
+// signals it. A thread has one ring per logger, which the writer frees once the thread has
+// exited and the ring is drained.
+
+typedef struct fastlog fastlog_t;
+
+typedef struct {
+  unsigned long long messages;        // Messages accepted
+  unsigned long long bytes;           // Bytes written to the fd
+  unsigned long long syscalls;        // writev() calls made by the writer thread
+  unsigned long long producer_waits;  // Times a producer found its ring full and had to yield
+} fastlog_stats_t;
+
+// ring_size of 0 selects the default. The fd is not closed by fastlog_destroy.
+fastlog_t *fastlog_create(int fd, size_t ring_size);
+
+// Append one message (normally a whole line). Blocks only while the calling thread's ring is full.
+void fastlog_write(fastlog_t *log, const char *msg, size_t len);
+
+void fastlog_printf(fastlog_t *log, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Wait until everything logged before the call has been handed to the kernel
+void fastlog_flush(fastlog_t *log);
+
+void fastlog_get_stats(fastlog_t *log, fastlog_stats_t *stats);
+
+// Flush, stop the writer thread and free every per-thread ring. Threads must have stopped logging
+// to it, but need not have exited.
+void fastlog_destroy(fastlog_t *log);
+
+#endif  // FASTLOG_H
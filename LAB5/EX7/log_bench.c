@@ -0,0 +1,289 @@
+#define _GNU_SOURCE  // For fopencookie
+
+#include <fcntl.h>      // For open, O_WRONLY, O_CREAT, O_TRUNC
+#include <pthread.h>    // For pthread_create, pthread_join
+#include <stdatomic.h>  // For atomic_fetch_add
+#include <stdio.h>      // For printf, fprintf, snprintf, setvbuf, fopencookie
+#include <stdlib.h>     // For EXIT_SUCCESS, EXIT_FAILURE, atoi, atol, malloc
+#include <string.h>     // For strcmp, strlen
+#include <sys/uio.h>    // For writev, struct iovec
+#include <time.h>       // For clock_gettime
+#include <unistd.h>     // For write, dup, close, getopt
+
+#include "fastlog.h"
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_MESSAGES 200000  // Per thread
+#define WRITEV_BATCH 64          // Messages gathered per writev() in the writev mode
+#define STDIO_BUFFER (64 * 1024)
+#define MAX_LINE 128
+
+typedef enum {
+  MODE_WRITE,
+  MODE_WRITEV,
+  MODE_STDIO_FULL,
+  MODE_STDIO_LINE,
+  MODE_DUP_STDIO,
+  MODE_FASTLOG,
+  NUM_MODES
+} log_mode_t;
+
+const char *mode_names[NUM_MODES] = {"write", "writev", "stdio_full", "stdio_line", "dup_stdio", "fastlog"};
+
+// Shared by all threads of one run
+typedef struct {
+  log_mode_t mode;
+  int fd;
+  FILE *stream;
+  fastlog_t *log;
+  long messages;
+} run_t;
+
+typedef struct {
+  run_t *run;
+  int thread_id;
+} worker_arg_t;
+
+_Atomic unsigned long long syscall_count;
+
+// stdio writes through this cookie so each flush of the FILE buffer is counted
+ssize_t counting_write(void *cookie, const char *buf, size_t size) {
+  int fd = *(int *)cookie;
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = write(fd, buf + done, size - done);
+    atomic_fetch_add_explicit(&syscall_count, 1, memory_order_relaxed);
+    if (n <= 0) return done > 0 ? (ssize_t)done : -1;
+    done += (size_t)n;
+  }
+  return (ssize_t)size;
+}
+
+// Same payload in every mode: "T<thread> S<seq> ...padding...\n" (~80 bytes)
+int format_line(char *buf, int thread_id, long seq) {
+  return snprintf(buf, MAX_LINE, "T%d S%ld level=info component=bench msg=\"request handled\" latency_us=%ld\n",
+                  thread_id, seq, (seq * 37) % 1000);
+}
+
+// lab5_2's pattern per thread: write() on a dup()'d descriptor interleaved with fprintf() on an
+// fdopen() stream over the same descriptor. The stream buffers while write() goes straight to the
+// kernel, so the stream is flushed before every write() to keep the thread's lines in order.
+void dup_stdio_worker(run_t *run, int thread_id) {
+  char line[MAX_LINE];
+  int fd = dup(run->fd);
+  FILE *stream = fd == -1 ? NULL : fdopen(fd, "w");
+  int buffered = 0;  // fprintf()s since the last flush
+  if (stream == NULL) {
+    perror("dup_stdio: dup or fdopen");
+    if (fd != -1) close(fd);
+    return;
+  }
+  setvbuf(stream, NULL, _IOFBF, STDIO_BUFFER);
+
+  for (long seq = 0; seq < run->messages; ++seq) {
+    if (seq % 2 == 0) {
+      if (buffered) {
+        fflush(stream);
+        atomic_fetch_add_explicit(&syscall_count, 1, memory_order_relaxed);
+        buffered = 0;
+      }
+      int len = format_line(line, thread_id, seq);
+      write(fd, line, (size_t)len);
+      atomic_fetch_add_explicit(&syscall_count, 1, memory_order_relaxed);
+    } else {
+      fprintf(stream, "T%d S%ld level=info component=bench msg=\"request handled\" latency_us=%ld\n", thread_id, seq,
+              (seq * 37) % 1000);
+      buffered = 1;
+    }
+  }
+  if (buffered) atomic_fetch_add_explicit(&syscall_count, 1, memory_order_relaxed);
+  fclose(stream);  // Flushes, and closes the dup()'d descriptor
+}
+
+void *worker(void *arg) {
+  worker_arg_t *worker_arg = arg;
+  run_t *run = worker_arg->run;
+  char lines[WRITEV_BATCH][MAX_LINE];
+  struct iovec iov[WRITEV_BATCH];
+  int batched = 0;
+
+  if (run->mode == MODE_DUP_STDIO) {
+    dup_stdio_worker(run, worker_arg->thread_id);
+    return NULL;
+  }
+
+  for (long seq = 0; seq < run->messages; ++seq) {
+    switch (run->mode) {
+      case MODE_WRITE: {
+        int len = format_line(lines[0], worker_arg->thread_id, seq);
+        write(run->fd, lines[0], (size_t)len);
+        atomic_fetch_add_explicit(&syscall_count, 1, memory_order_relaxed);
+        break;
+      }
+      case MODE_WRITEV: {
+        int len = format_line(lines[batched], worker_arg->thread_id, seq);
+        iov[batched].iov_base = lines[batched];
+        iov[batched].iov_len = (size_t)len;
+        if (++batched == WRITEV_BATCH || seq == run->messages - 1) {
+          writev(run->fd, iov, batched);
+          atomic_fetch_add_explicit(&syscall_count, 1, memory_order_relaxed);
+          batched = 0;
+        }
+        break;
+      }
+      case MODE_STDIO_FULL:
+      case MODE_STDIO_LINE:
+        fprintf(run->stream, "T%d S%ld level=info component=bench msg=\"request handled\" latency_us=%ld\n",
+                worker_arg->thread_id, seq, (seq * 37) % 1000);
+        break;
+      case MODE_FASTLOG: {
+        int len = format_line(lines[0], worker_arg->thread_id, seq);
+        fastlog_write(run->log, lines[0], (size_t)len);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return NULL;
+}
+
+// Check that every thread's lines arrived complete and in sequence order
+int verify_output(const char *path, int num_threads, long messages) {
+  FILE *file = fopen(path, "r");
+  char line[MAX_LINE * 2];
+  long *next_seq = calloc((size_t)num_threads, sizeof(long));
+  long total = 0;
+  int ok = 1;
+
+  if (file == NULL || next_seq == NULL) {
+    perror("verify");
+    return 0;
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    int thread_id;
+    long seq;
+    if (sscanf(line, "T%d S%ld", &thread_id, &seq) != 2 || thread_id < 0 || thread_id >= num_threads ||
+        seq != next_seq[thread_id]) {
+      ok = 0;
+      break;
+    }
+    next_seq[thread_id]++;
+    total++;
+  }
+  if (total != (long)num_threads * messages) ok = 0;
+  fclose(file);
+  free(next_seq);
+  return ok;
+}
+
+double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int run_mode(log_mode_t mode, const char *path, int num_threads, long messages, int verify) {
+  pthread_t threads[num_threads];
+  worker_arg_t args[num_threads];
+  run_t run = {.mode = mode, .messages = messages, .stream = NULL, .log = NULL};
+  int cookie_fd;
+  fastlog_stats_t stats = {0};
+
+  run.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (run.fd == -1) {
+    perror("open output");
+    return -1;
+  }
+  atomic_store(&syscall_count, 0);
+
+  if (mode == MODE_STDIO_FULL || mode == MODE_STDIO_LINE) {
+    cookie_io_functions_t io = {.read = NULL, .write = counting_write, .seek = NULL, .close = NULL};
+    cookie_fd = run.fd;
+    run.stream = fopencookie(&cookie_fd, "w", io);
+    setvbuf(run.stream, NULL, mode == MODE_STDIO_FULL ? _IOFBF : _IOLBF, STDIO_BUFFER);
+  } else if (mode == MODE_FASTLOG) {
+    run.log = fastlog_create(run.fd, 0);
+  }
+
+  double start = now_sec();
+  for (int i = 0; i < num_threads; ++i) {
+    args[i].run = &run;
+    args[i].thread_id = i;
+    pthread_create(&threads[i], NULL, worker, &args[i]);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  // Time until the data is with the kernel, not just until the producers returned
+  if (run.stream != NULL) fclose(run.stream);
+  if (run.log != NULL) {
+    fastlog_flush(run.log);
+    fastlog_get_stats(run.log, &stats);
+    atomic_store(&syscall_count, stats.syscalls);
+    fastlog_destroy(run.log);
+  }
+  double elapsed = now_sec() - start;
+  close(run.fd);
+
+  long total = (long)num_threads * messages;
+  unsigned long long syscalls = atomic_load(&syscall_count);
+  const char *order = "-";
+  if (verify) order = verify_output(path, num_threads, messages) ? "ok" : "BROKEN";
+  printf("%-11s %7d %10ld %9.3f %12.0f %12llu %10.4f %8s\n", mode_names[mode], num_threads, total, elapsed,
+         total / elapsed, syscalls, (double)syscalls / total, order);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int num_threads = DEFAULT_THREADS;
+  long messages = DEFAULT_MESSAGES;
+  const char *path = "/dev/null";
+  int only_mode = -1;  // Every mode
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:n:o:m:")) != -1) {
+    switch (opt) {
+      case 't':
+        num_threads = atoi(optarg);
+        break;
+      case 'n':
+        messages = atol(optarg);
+        break;
+      case 'o':
+        path = optarg;
+        break;
+      case 'm':
+        only_mode = -1;
+        for (int m = 0; m < NUM_MODES; ++m) {
+          if (strcmp(optarg, mode_names[m]) == 0) only_mode = m;
+        }
+        if (only_mode == -1) {
+          fprintf(stderr, "Unknown mode '%s': write, writev, stdio_full, stdio_line, dup_stdio or fastlog.\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-t threads] [-n messages_per_thread] [-o output_file] [-m mode]\n", argv[0]);
+        fprintf(stderr, "  modes: write writev stdio_full stdio_line dup_stdio fastlog (default: all)\n");
+        fprintf(stderr, "  with -o <file> every run is read back to check per-thread line order\n");
+        return EXIT_FAILURE;
+    }
+  }
+  if (num_threads <= 0 || messages <= 0) {
+    fprintf(stderr, "Threads and messages must be positive.\n");
+    return EXIT_FAILURE;
+  }
+  int verify = strcmp(path, "/dev/null") != 0;
+
+  printf("Output: %s, %d thread(s) x %ld messages\n", path, num_threads, messages);
+  printf("%-11s %7s %10s %9s %12s %12s %10s %8s\n", "mode", "threads", "messages", "seconds", "msgs/s", "syscalls",
+         "sys/msg", "order");
+  fflush(stdout);
+  for (int m = 0; m < NUM_MODES; ++m) {
+    if (only_mode != -1 && m != only_mode) continue;
+    run_mode((log_mode_t)m, path, num_threads, messages, verify);
+  }
+
+  return EXIT_SUCCESS;
+}
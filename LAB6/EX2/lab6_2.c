@@ -5,23 +5,12 @@
 #include <stdlib.h>  // For EXIT_SUCCESS, EXIT_FAILURE
 #include <string.h>  // For strerror
 
+#include "mq_attributes.h"
+
 #define QUEUE_NAME "/my_test_mq"
 #define MAX_MSGS 5
 #define MAX_MSG_SIZE 1024
 
-void print_mq_attributes(mqd_t mq, const char *header) {
-  struct mq_attr attr;
-  if (mq_getattr(mq, &attr) == -1) {
-    perror("mq_getattr failed");
-    return;
-  }
-  printf("\n--- %s ---\n", header);
-  printf("  mq_flags:   %ld (0 = blocking, O_NONBLOCK = non-blocking)\n", attr.mq_flags);
-  printf("  mq_maxmsg:  %ld (Maximum # of messages on queue)\n", attr.mq_maxmsg);
-  printf("  mq_msgsize: %ld (Maximum message size in bytes)\n", attr.mq_msgsize);
-  printf("  mq_curmsgs: %ld (Number of messages currently in queue)\n", attr.mq_curmsgs);
-}
-
 int main(void) {
   mqd_t mq;
   struct mq_attr attr;
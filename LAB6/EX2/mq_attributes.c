@@ -0,0 +1,91 @@
+#include "mq_attributes.h"
+
+#include <stdio.h>         // For printf, perror, fopen, fscanf
+#include <sys/resource.h>  // For getrlimit, RLIMIT_MSGQUEUE
+
+#define MQUEUE_PROC_DIR "/proc/sys/fs/mqueue/"
+#define MSG_MSG_SIZE 48        // sizeof(struct msg_msg) on 64-bit
+#define MSG_MSGSEG_SIZE 8      // sizeof(struct msg_msgseg), the header of each further segment
+#define MSG_TREE_NODE_SIZE 48  // sizeof(struct posix_msg_tree_node), one per priority in use
+#define MQ_PRIO_LEVELS 32768   // MQ_PRIO_MAX
+#define KERNEL_PAGE_SIZE 4096
+
+void print_mq_attributes(mqd_t mq, const char *header) {
+  struct mq_attr attr;
+  if (mq_getattr(mq, &attr) == -1) {
+    perror("mq_getattr failed");
+    return;
+  }
+  printf("\n--- %s ---\n", header);
+  printf("  mq_flags:   %ld (0 = blocking, O_NONBLOCK = non-blocking)\n", attr.mq_flags);
+  printf("  mq_maxmsg:  %ld (Maximum # of messages on queue)\n", attr.mq_maxmsg);
+  printf("  mq_msgsize: %ld (Maximum message size in bytes)\n", attr.mq_msgsize);
+  printf("  mq_curmsgs: %ld (Number of messages currently in queue)\n", attr.mq_curmsgs);
+}
+
+static long read_proc_long(const char *name) {
+  char path[128];
+  long value = -1;
+  snprintf(path, sizeof(path), "%s%s", MQUEUE_PROC_DIR, name);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) return -1;
+  if (fscanf(file, "%ld", &value) != 1) value = -1;
+  fclose(file);
+  return value;
+}
+
+int read_mq_limits(mq_limits_t *limits) {
+  struct rlimit rl;
+  limits->msg_max = read_proc_long("msg_max");
+  limits->msgsize_max = read_proc_long("msgsize_max");
+  limits->msg_default = read_proc_long("msg_default");
+  limits->msgsize_default = read_proc_long("msgsize_default");
+  limits->queues_max = read_proc_long("queues_max");
+  limits->rlimit_bytes = -1;
+  if (getrlimit(RLIMIT_MSGQUEUE, &rl) == -1) {
+    perror("getrlimit RLIMIT_MSGQUEUE failed");
+    return -1;
+  }
+  if (rl.rlim_cur != RLIM_INFINITY) limits->rlimit_bytes = (long long)rl.rlim_cur;
+  return limits->msg_max == -1 ? -1 : 0;
+}
+
+void print_mq_limits(const mq_limits_t *limits) {
+  printf("\n--- System Limits ---\n");
+  printf("  fs.mqueue.msg_max:         %ld (mq_maxmsg ceiling without CAP_SYS_RESOURCE)\n", limits->msg_max);
+  printf("  fs.mqueue.msgsize_max:     %ld (mq_msgsize ceiling without CAP_SYS_RESOURCE)\n", limits->msgsize_max);
+  printf("  fs.mqueue.msg_default:     %ld\n", limits->msg_default);
+  printf("  fs.mqueue.msgsize_default: %ld\n", limits->msgsize_default);
+  printf("  fs.mqueue.queues_max:      %ld (queues system-wide)\n", limits->queues_max);
+  if (limits->rlimit_bytes >= 0) {
+    printf("  RLIMIT_MSGQUEUE:           %lld bytes (per user, summed over all its queues)\n", limits->rlimit_bytes);
+  } else {
+    printf("  RLIMIT_MSGQUEUE:           unlimited\n");
+  }
+}
+
+long long mq_rlimit_bytes(long maxmsg, long msgsize) {
+  long tree_nodes = maxmsg < MQ_PRIO_LEVELS ? maxmsg : MQ_PRIO_LEVELS;
+  return (long long)maxmsg * MSG_MSG_SIZE + (long long)tree_nodes * MSG_TREE_NODE_SIZE +
+         (long long)maxmsg * msgsize;
+}
+
+// The kmalloc size class an allocation of n bytes lands in
+static long kmalloc_size(long n) {
+  if (n <= 8) return 8;
+  if (n > 64 && n <= 96) return 96;
+  if (n > 128 && n <= 192) return 192;
+  long size = 8;
+  while (size < n) size <<= 1;
+  return size;
+}
+
+long long mq_full_queue_bytes(long maxmsg, long msgsize) {
+  long first = msgsize < KERNEL_PAGE_SIZE - MSG_MSG_SIZE ? msgsize : KERNEL_PAGE_SIZE - MSG_MSG_SIZE;
+  long long per_message = kmalloc_size(MSG_MSG_SIZE + first);
+  for (long left = msgsize - first; left > 0; left -= KERNEL_PAGE_SIZE - MSG_MSGSEG_SIZE) {
+    long chunk = left < KERNEL_PAGE_SIZE - MSG_MSGSEG_SIZE ? left : KERNEL_PAGE_SIZE - MSG_MSGSEG_SIZE;
+    per_message += kmalloc_size(MSG_MSGSEG_SIZE + chunk);
+  }
+  return per_message * maxmsg + kmalloc_size(MSG_TREE_NODE_SIZE);
+}
@@ -0,0 +1,30 @@
+#ifndef MQ_ATTRIBUTES_H
+#define MQ_ATTRIBUTES_H
+
+#include <mqueue.h>  // For mqd_t
+
+// System-wide mqueue limits (/proc/sys/fs/mqueue) and this process's RLIMIT_MSGQUEUE
+typedef struct {
+  long msg_max;            // Largest mq_maxmsg without CAP_SYS_RESOURCE
+  long msgsize_max;        // Largest mq_msgsize without CAP_SYS_RESOURCE
+  long msg_default;        // mq_maxmsg when mq_open gets no attributes
+  long msgsize_default;    // mq_msgsize when mq_open gets no attributes
+  long queues_max;         // Queues system-wide
+  long long rlimit_bytes;  // Per-user budget every queue is charged against (-1 = unlimited)
+} mq_limits_t;
+
+void print_mq_attributes(mqd_t mq, const char *header);
+
+// Fields that cannot be read are left at -1
+int read_mq_limits(mq_limits_t *limits);
+void print_mq_limits(const mq_limits_t *limits);
+
+// What mq_open charges against RLIMIT_MSGQUEUE for a queue: every message slot at full size plus
+// the kernel's per-message bookkeeping (ipc/mqueue.c, 64-bit sizes)
+long long mq_rlimit_bytes(long maxmsg, long msgsize);
+
+// Kernel memory a full queue actually holds: each message is a kmalloc'd struct msg_msg plus its
+// data, split into page-sized segments and rounded up to the slab size classes
+long long mq_full_queue_bytes(long maxmsg, long msgsize);
+
+#endif  // MQ_ATTRIBUTES_H
@@ -0,0 +1,406 @@
+// Capacity planner for POSIX message queues: measures send-to-receive latency and throughput over
+// a grid of mq_maxmsg, mq_msgsize and blocking/O_NONBLOCK settings, shows what each queue pins in
+// the kernel against the system limits, and recommends attributes for a target message rate.
+#include <errno.h>     // For errno, EAGAIN, EINTR
+#include <fcntl.h>     // For O_CREAT, O_EXCL, O_RDWR, O_NONBLOCK
+#include <getopt.h>    // For getopt_long
+#include <math.h>      // For ceil
+#include <mqueue.h>    // For mq_open, mq_send, mq_receive, mq_close, mq_unlink
+#include <sched.h>     // For sched_yield
+#include <stdio.h>     // For printf, perror
+#include <stdlib.h>    // For atol, atof, malloc, free, qsort, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>    // For memcpy, memset, strdup, strtok, strerror, strcmp
+#include <sys/wait.h>  // For waitpid
+#include <time.h>      // For clock_gettime
+#include <unistd.h>    // For fork, pipe, read, write, getpid, _exit
+
+#include "mq_attributes.h"
+
+#define PLANNER_QUEUE_PREFIX "/mq_planner."
+#define DEFAULT_MESSAGES 20000
+#define DEFAULT_MAXMSGS "1,4,10,64,256"
+#define DEFAULT_MSGSIZES "64,256,1024,4096,8192"
+#define DEFAULT_PAYLOAD 64    // Bytes the application sends per logical message
+#define DEFAULT_STALL_MS 100  // Consumer pause the queue must absorb without blocking the producer
+#define MAX_SETTINGS 16       // Values per --maxmsg / --msgsize list
+#define HEADROOM 1.25         // Recommend settings that sustain 25% more than the target rate
+
+// At the front of every message, so the receiver can time it
+typedef struct {
+  long long sent_ns;
+  long seq;
+} stamp_t;
+
+// What the receiving child reports back through a pipe
+typedef struct {
+  double p50_us;
+  double p99_us;
+  double max_us;
+  long spins;
+  long errors;
+} receiver_report_t;
+
+typedef struct {
+  long maxmsg;
+  long msgsize;
+  int nonblock;
+  int error;  // errno of mq_open, 0 when the run happened
+  double msgs_per_sec;
+  double send_us;  // Mean time inside mq_send, including waiting for room
+  receiver_report_t receiver;
+  long send_spins;  // EAGAIN retries of the sender in O_NONBLOCK mode
+} run_t;
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compare_ll(const void *a, const void *b) {
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+// "1,4,10" -> values; returns how many, -1 on a bad list
+int parse_list(const char *arg, long *values) {
+  char *copy = strdup(arg);
+  int count = 0;
+  for (char *token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+    if (count == MAX_SETTINGS || atol(token) <= 0) {
+      free(copy);
+      return -1;
+    }
+    values[count++] = atol(token);
+  }
+  free(copy);
+  return count;
+}
+
+// Child side: receive every message, spinning on EAGAIN in O_NONBLOCK mode, and report latency
+void receive_messages(mqd_t mq, long msgsize, long messages, int report_fd) {
+  receiver_report_t report;
+  char *buffer = malloc(msgsize);
+  long long *latency = malloc(messages * sizeof(long long));
+  long received = 0;
+
+  memset(&report, 0, sizeof(report));
+  if (buffer == NULL || latency == NULL) _exit(EXIT_FAILURE);
+  while (received < messages) {
+    ssize_t bytes = mq_receive(mq, buffer, msgsize, NULL);
+    if (bytes == -1) {
+      if (errno == EAGAIN) {
+        report.spins++;
+        sched_yield();  // On a busy or single CPU, give the sender a chance to run
+        continue;
+      }
+      if (errno == EINTR) continue;
+      report.errors++;
+      break;
+    }
+    stamp_t stamp;
+    memcpy(&stamp, buffer, sizeof(stamp));
+    latency[received++] = now_ns() - stamp.sent_ns;
+  }
+  if (received > 0) {
+    qsort(latency, received, sizeof(long long), compare_ll);
+    report.p50_us = latency[received / 2] / 1000.0;
+    report.p99_us = latency[(long)(received * 0.99)] / 1000.0;
+    report.max_us = latency[received - 1] / 1000.0;
+  }
+  if (write(report_fd, &report, sizeof(report)) != sizeof(report)) _exit(EXIT_FAILURE);
+  _exit(EXIT_SUCCESS);
+}
+
+// One grid point: a fresh queue, a forked receiver, `messages` full-size sends as fast as possible
+void run_benchmark(run_t *run, long messages) {
+  char name[64];
+  int fds[2];
+  struct mq_attr attr = {.mq_flags = 0, .mq_maxmsg = run->maxmsg, .mq_msgsize = run->msgsize, .mq_curmsgs = 0};
+
+  snprintf(name, sizeof(name), "%s%d", PLANNER_QUEUE_PREFIX, getpid());
+  mq_unlink(name);
+  mqd_t mq = mq_open(name, O_CREAT | O_EXCL | O_RDWR | (run->nonblock ? O_NONBLOCK : 0), 0600, &attr);
+  if (mq == (mqd_t)-1) {
+    run->error = errno;
+    return;
+  }
+  mq_unlink(name);  // The descriptor keeps it alive; nothing is left behind if we are killed
+  if (pipe(fds) == -1) {
+    run->error = errno;
+    mq_close(mq);
+    return;
+  }
+
+  pid_t child = fork();
+  if (child == -1) {
+    run->error = errno;
+    mq_close(mq);
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+  if (child == 0) {
+    close(fds[0]);
+    receive_messages(mq, run->msgsize, messages, fds[1]);
+  }
+  close(fds[1]);
+
+  // The receiver shares our open description, so it is O_NONBLOCK exactly when we are
+  char *buffer = calloc(1, run->msgsize);
+  long long in_send = 0;
+  long long start = now_ns();
+  for (long i = 0; i < messages && buffer != NULL; ++i) {
+    stamp_t stamp = {.seq = i};
+    while (1) {
+      long long before = now_ns();
+      stamp.sent_ns = before;
+      memcpy(buffer, &stamp, sizeof(stamp));
+      int rc = mq_send(mq, buffer, run->msgsize, 0);
+      in_send += now_ns() - before;
+      if (rc == 0) break;
+      if (errno == EAGAIN) {
+        run->send_spins++;
+        sched_yield();
+      } else if (errno != EINTR) {
+        perror("mq_send failed");
+        break;
+      }
+    }
+  }
+  if (read(fds[0], &run->receiver, sizeof(run->receiver)) != sizeof(run->receiver)) run->error = EIO;
+  double elapsed = (now_ns() - start) / 1e9;
+  waitpid(child, NULL, 0);
+  close(fds[0]);
+  free(buffer);
+  mq_close(mq);
+
+  run->msgs_per_sec = messages / elapsed;
+  run->send_us = in_send / 1000.0 / messages;
+}
+
+void print_run(const run_t *run) {
+  printf("%7ld %8ld  %-8s", run->maxmsg, run->msgsize, run->nonblock ? "nonblock" : "blocking");
+  if (run->error != 0) {
+    printf("  skipped: %s\n", strerror(run->error));
+    return;
+  }
+  printf(" %10.0f %8.1f %8.2f %9.1f %9.1f %9.1f %10lld %10lld\n", run->msgs_per_sec,
+         run->msgs_per_sec * run->msgsize / 1e6, run->send_us, run->receiver.p50_us, run->receiver.p99_us,
+         run->receiver.max_us, mq_rlimit_bytes(run->maxmsg, run->msgsize),
+         mq_full_queue_bytes(run->maxmsg, run->msgsize));
+}
+
+// The fastest measured run with this message size and mode at the shallowest queue: its latency is
+// the least queueing there is, close to the pure cost of a send and a wakeup
+const run_t *base_run(const run_t *runs, int num_runs, long msgsize, int nonblock) {
+  const run_t *base = NULL;
+  for (int i = 0; i < num_runs; ++i) {
+    const run_t *run = &runs[i];
+    if (run->error != 0 || run->msgsize != msgsize || run->nonblock != nonblock) continue;
+    if (base == NULL || run->maxmsg < base->maxmsg) base = run;
+  }
+  return base;
+}
+
+// Pick the smallest message size (least memory, least batching delay) whose measured throughput,
+// times the payloads it packs, covers the target with headroom. Blocking mode wins unless
+// O_NONBLOCK is clearly faster, since spinning on EAGAIN burns a CPU. The queue depth then follows
+// from how many messages arrive during a consumer stall.
+void recommend(const run_t *runs, int num_runs, const mq_limits_t *limits, double rate, long payload, long stall_ms,
+               int queues) {
+  const run_t *best = NULL;
+  double best_capacity = 0;
+
+  printf("\n--- Recommendation for %.0f msgs/s of %ld bytes, absorbing %ld ms stalls, %d queue(s) ---\n", rate,
+         payload, stall_ms, queues);
+  for (int i = 0; i < num_runs; ++i) {
+    const run_t *run = &runs[i];
+    if (run->error != 0 || run->msgsize < payload) continue;
+    double capacity = run->msgs_per_sec * (run->msgsize / payload);
+    if (capacity < rate * HEADROOM) continue;
+    if (best == NULL || run->msgsize < best->msgsize ||
+        (run->msgsize == best->msgsize && best->nonblock != run->nonblock &&
+         (run->nonblock ? capacity > best_capacity * HEADROOM : best_capacity < capacity * HEADROOM))) {
+      best = run;
+      best_capacity = capacity;
+    } else if (run->msgsize == best->msgsize && run->nonblock == best->nonblock && capacity > best_capacity) {
+      best_capacity = capacity;
+    }
+  }
+  if (best == NULL) {
+    printf("  No measured setting sustains %.0f msgs/s (x%.2f headroom) with %ld-byte payloads on this machine.\n",
+           rate, HEADROOM, payload);
+    printf("  Pack more payloads per message (a larger --msgsize) or spread the load over several queues.\n");
+    return;
+  }
+
+  long per_message = best->msgsize / payload;
+  double arrivals = rate / per_message;  // Messages per second once payloads are packed
+  long maxmsg = (long)ceil(arrivals * stall_ms / 1000.0);
+  if (maxmsg < 2) maxmsg = 2;  // One being received while the next is sent
+  long long rlimit_bytes = mq_rlimit_bytes(maxmsg, best->msgsize);
+  const run_t *base = base_run(runs, num_runs, best->msgsize, best->nonblock);
+
+  printf("  mq_msgsize %ld (%ld payload(s) per message), mq_maxmsg %ld, %s mode\n", best->msgsize, per_message,
+         maxmsg, best->nonblock ? "O_NONBLOCK" : "blocking");
+  printf("  Measured capacity %.0f payloads/s; expected latency at the target rate about %.1f us", best_capacity,
+         (base != NULL ? base->receiver.p50_us : 0) + (per_message > 1 ? per_message / rate * 1e6 : 0));
+  printf(per_message > 1 ? " (including the time to fill a message)\n" : "\n");
+  printf("  Kernel memory: %lld bytes charged to RLIMIT_MSGQUEUE, up to %lld bytes held when full\n", rlimit_bytes,
+         mq_full_queue_bytes(maxmsg, best->msgsize));
+  if (maxmsg > limits->msg_max) {
+    printf("  mq_maxmsg %ld exceeds fs.mqueue.msg_max %ld: raise it (sysctl fs.mqueue.msg_max=%ld) or run with\n"
+           "  CAP_SYS_RESOURCE; otherwise expect %ld ms stalls to block the producer after %.1f ms.\n",
+           maxmsg, limits->msg_max, maxmsg, stall_ms, limits->msg_max * 1000.0 / arrivals);
+  }
+  if (limits->rlimit_bytes >= 0) {
+    long long fits = limits->rlimit_bytes / rlimit_bytes;
+    printf("  RLIMIT_MSGQUEUE (%lld bytes) fits %lld such queue(s)%s\n", limits->rlimit_bytes, fits,
+           fits < queues ? ": raise it (ulimit -q) for the queues you need" : "");
+  }
+  if (limits->queues_max >= 0 && queues > limits->queues_max) {
+    printf("  %d queues exceed fs.mqueue.queues_max %ld\n", queues, limits->queues_max);
+  }
+
+  // Create the recommended queue once, as a check that the kernel accepts it
+  char name[64];
+  struct mq_attr attr = {.mq_flags = 0, .mq_maxmsg = maxmsg, .mq_msgsize = best->msgsize, .mq_curmsgs = 0};
+  snprintf(name, sizeof(name), "%s%d", PLANNER_QUEUE_PREFIX, getpid());
+  mqd_t mq = mq_open(name, O_CREAT | O_EXCL | O_RDWR | (best->nonblock ? O_NONBLOCK : 0), 0600, &attr);
+  if (mq == (mqd_t)-1) {
+    printf("  This process cannot create it as is: %s\n", strerror(errno));
+    return;
+  }
+  print_mq_attributes(mq, "Recommended Queue Attributes");
+  mq_close(mq);
+  mq_unlink(name);
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--messages N] [--maxmsg LIST] [--msgsize LIST] [--mode blocking|nonblock|both]\n"
+          "          [--rate MSGS_PER_SEC] [--payload BYTES] [--stall-ms MS] [--queues N]\n",
+          prog);
+  fprintf(stderr, "  --messages N    messages per grid point (default %d)\n", DEFAULT_MESSAGES);
+  fprintf(stderr, "  --maxmsg LIST   mq_maxmsg values, comma separated (default %s)\n", DEFAULT_MAXMSGS);
+  fprintf(stderr, "  --msgsize LIST  mq_msgsize values, at least %zu (default %s)\n", sizeof(stamp_t),
+          DEFAULT_MSGSIZES);
+  fprintf(stderr, "  --rate R        target rate to recommend settings for (default: no recommendation)\n");
+  fprintf(stderr, "  --payload B     bytes per logical message at that rate (default %d)\n", DEFAULT_PAYLOAD);
+  fprintf(stderr, "  --stall-ms MS   consumer pause the queue must absorb (default %d)\n", DEFAULT_STALL_MS);
+  fprintf(stderr, "  --queues N      queues of this kind the application opens (default 1)\n");
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"messages", required_argument, NULL, 'n'},
+                                         {"maxmsg", required_argument, NULL, 'm'},
+                                         {"msgsize", required_argument, NULL, 's'},
+                                         {"mode", required_argument, NULL, 'M'},
+                                         {"rate", required_argument, NULL, 'r'},
+                                         {"payload", required_argument, NULL, 'p'},
+                                         {"stall-ms", required_argument, NULL, 'S'},
+                                         {"queues", required_argument, NULL, 'q'},
+                                         {NULL, 0, NULL, 0}};
+  long maxmsgs[MAX_SETTINGS];
+  long msgsizes[MAX_SETTINGS];
+  int num_maxmsgs = parse_list(DEFAULT_MAXMSGS, maxmsgs);
+  int num_msgsizes = parse_list(DEFAULT_MSGSIZES, msgsizes);
+  long messages = DEFAULT_MESSAGES;
+  int first_mode = 0;  // 0 = blocking, 1 = O_NONBLOCK
+  int last_mode = 1;
+  double rate = 0;
+  long payload = DEFAULT_PAYLOAD;
+  long stall_ms = DEFAULT_STALL_MS;
+  int queues = 1;
+  mq_limits_t limits;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "n:m:s:M:r:p:S:q:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'n':
+        messages = atol(optarg);
+        break;
+      case 'm':
+        num_maxmsgs = parse_list(optarg, maxmsgs);
+        break;
+      case 's':
+        num_msgsizes = parse_list(optarg, msgsizes);
+        break;
+      case 'M':
+        first_mode = strcmp(optarg, "nonblock") == 0;
+        last_mode = strcmp(optarg, "blocking") != 0;
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 'p':
+        payload = atol(optarg);
+        break;
+      case 'S':
+        stall_ms = atol(optarg);
+        break;
+      case 'q':
+        queues = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (messages <= 0 || num_maxmsgs <= 0 || num_msgsizes <= 0 || rate < 0 || payload <= 0 || stall_ms < 0 ||
+      queues <= 0) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < num_msgsizes; ++i) {
+    if (msgsizes[i] < (long)sizeof(stamp_t)) {
+      fprintf(stderr, "mq_msgsize %ld is too small to carry a timestamp (%zu bytes).\n", msgsizes[i],
+              sizeof(stamp_t));
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (read_mq_limits(&limits) == -1) {
+    fprintf(stderr, "Cannot read %s limits; is this Linux?\n", "/proc/sys/fs/mqueue");
+    return EXIT_FAILURE;
+  }
+  print_mq_limits(&limits);
+
+  int num_runs = num_maxmsgs * num_msgsizes * (last_mode - first_mode + 1);
+  run_t *runs = calloc(num_runs, sizeof(run_t));
+  if (runs == NULL) {
+    perror("calloc failed");
+    return EXIT_FAILURE;
+  }
+
+  // Latency is measured at saturation: the sender never waits, so a deeper queue shows up as
+  // queueing delay (Little's law) while it buys tolerance to consumer stalls
+  printf("\n--- %ld messages per setting, sender unthrottled ---\n", messages);
+  printf("%7s %8s  %-8s %10s %8s %8s %9s %9s %9s %10s %10s\n", "maxmsg", "msgsize", "mode", "msgs/s", "MB/s",
+         "send us", "p50 us", "p99 us", "max us", "rlimit B", "kernel B");
+  int index = 0;
+  for (int mode = first_mode; mode <= last_mode; ++mode) {
+    for (int s = 0; s < num_msgsizes; ++s) {
+      for (int m = 0; m < num_maxmsgs; ++m) {
+        run_t *run = &runs[index++];
+        run->maxmsg = maxmsgs[m];
+        run->msgsize = msgsizes[s];
+        run->nonblock = mode;
+        run_benchmark(run, messages);
+        print_run(run);
+        fflush(stdout);
+      }
+    }
+  }
+  printf("\"rlimit B\" is what mq_open charges against RLIMIT_MSGQUEUE, \"kernel B\" what a full queue holds.\n");
+  if (limits.msg_max >= 0) {
+    printf("mq_maxmsg above %ld and mq_msgsize above %ld need CAP_SYS_RESOURCE (or raised sysctls).\n",
+           limits.msg_max, limits.msgsize_max);
+  }
+
+  if (rate > 0) recommend(runs, num_runs, &limits, rate, payload, stall_ms, queues);
+  free(runs);
+  return EXIT_SUCCESS;
+}
@@ -1,21 +1,63 @@
 #ifndef COMMON_H
 #define COMMON_H
 
-#include <sys/types.h>
+#include <stdio.h>      // For snprintf
+#include <string.h>     // For strcmp
+#include <sys/types.h>  // For pid_t
 
 #define TASK_QUEUE_NAME "/task_queue"
-#define RESULT_QUEUE_NAME "/result_queue"
+#define RESULT_QUEUE_PREFIX "/result_queue."  // Each master receives on its own queue: prefix + PID
+#define REPLY_NAME_MAX 64
 
 #define MAX_MSGS 10       // Max messages in queue
 #define MAX_MSG_SIZE 256  // Max size of a message
 #define MSG_PRIO 1        // Message priority
 
+// Batched protocol: one message carries an array of task_t (or result_t), as many as fit in the
+// queue's mq_msgsize. A single-task message is simply a batch of one, and a zero-length message on
+// the task queue tells a slave to exit.
+#define MAX_BATCH_BYTES 8192  // Default fs.mqueue.msgsize_max
+#define MAX_BATCH (MAX_BATCH_BYTES / (int)sizeof(task_t))
+
+// Shared-memory transport (--transport shm): one MPMC ring per direction carrying single
+// task_t/result_t elements. A task with id 0 tells a slave to exit.
+#define SHM_TASK_QUEUE_NAME "/task_ring"
+#define SHM_RESULT_QUEUE_PREFIX "/result_ring."
+#define SHM_QUEUE_CAPACITY 4096  // Slots per ring, a power of two
+#define STOP_TASK_ID 0
+
+typedef enum { TRANSPORT_MQ, TRANSPORT_SHM } transport_t;
+
+static const char *const transport_names[] = {"mq", "shm"};
+
+static inline int parse_transport(const char *name, transport_t *transport) {
+  for (int i = 0; i < (int)(sizeof(transport_names) / sizeof(transport_names[0])); ++i) {
+    if (strcmp(name, transport_names[i]) == 0) {
+      *transport = (transport_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Task classes. Each maps to a POSIX mqueue priority, so a latency-sensitive task overtakes bulk
+// work already waiting in the queue (mq_receive always returns the highest priority first).
+typedef enum { CLASS_INTERACTIVE, CLASS_NORMAL, CLASS_BULK, NUM_CLASSES } task_class_t;
+
+static const char *const class_names[NUM_CLASSES] = {"interactive", "normal", "bulk"};
+static const unsigned int class_priorities[NUM_CLASSES] = {10, MSG_PRIO, 0};
+
+#define RESULT_OK 0
+#define RESULT_EXPIRED 1  // The slave dropped the task unprocessed because its deadline had passed
+
 // Structure for a task
 typedef struct {
   pid_t producer_pid;
   int task_id;
   int a;
   int b;
+  int task_class;         // task_class_t
+  long long deadline_ns;  // CLOCK_MONOTONIC time after which the result is useless, 0 = none
 } task_t;
 
 // Structure for a result
@@ -24,6 +66,14 @@ typedef struct {
   pid_t producer_pid;
   int task_id;
   int result;
+  int status;  // RESULT_OK or RESULT_EXPIRED
 } result_t;
 
+// Name of the reply queue (or ring) of the master with this PID. Slaves answer every task on the
+// queue named after task.producer_pid, so masters sharing a slave pool never see each other's results.
+static inline void reply_queue_name(char *name, size_t size, transport_t transport, pid_t producer_pid) {
+  snprintf(name, size, "%s%d", transport == TRANSPORT_SHM ? SHM_RESULT_QUEUE_PREFIX : RESULT_QUEUE_PREFIX,
+           (int)producer_pid);
+}
+
 #endif  // COMMON_H
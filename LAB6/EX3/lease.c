@@ -0,0 +1,129 @@
+#include "lease.h"
+
+#include <errno.h>      // For errno, EINVAL
+#include <fcntl.h>      // For O_CREAT, O_EXCL, O_RDWR
+#include <stdatomic.h>  // For atomic_*
+#include <stdint.h>     // For uint32_t
+#include <stdio.h>      // For snprintf, perror
+#include <stdlib.h>     // For malloc, free
+#include <sys/mman.h>   // For shm_open, shm_unlink, mmap, munmap
+#include <sys/stat.h>   // For fstat
+#include <unistd.h>     // For ftruncate, close
+
+#define LEASE_TABLE_MAGIC 0x4c454153u  // "LEAS", stored once the table is sized
+#define LEASE_NAME_MAX 64
+
+typedef struct {
+  _Atomic uint32_t magic;
+  uint32_t capacity;
+  _Alignas(64) lease_t leases[];  // Task id i lives in entry i & (capacity - 1)
+} lease_table_header_t;
+
+struct lease_table {
+  lease_table_header_t *header;
+  size_t map_size;
+};
+
+static void table_name(char *name, size_t size, pid_t producer_pid) {
+  snprintf(name, size, "%s%d", LEASE_TABLE_PREFIX, (int)producer_pid);
+}
+
+static lease_table_t *map_table(int fd, size_t size) {
+  lease_table_t *table = malloc(sizeof(lease_table_t));
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (table == NULL || addr == MAP_FAILED) {
+    perror("lease table: mmap failed");
+    if (addr != MAP_FAILED) munmap(addr, size);
+    free(table);
+    return NULL;
+  }
+  table->header = addr;
+  table->map_size = size;
+  return table;
+}
+
+lease_table_t *lease_table_create(pid_t producer_pid, unsigned int capacity) {
+  char name[LEASE_NAME_MAX];
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  table_name(name, sizeof(name), producer_pid);
+  shm_unlink(name);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+  if (fd == -1) {
+    perror("lease table: shm_open failed");
+    return NULL;
+  }
+  size_t size = sizeof(lease_table_header_t) + (size_t)capacity * sizeof(lease_t);
+  if (ftruncate(fd, (off_t)size) == -1) {
+    perror("lease table: ftruncate failed");
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  lease_table_t *table = map_table(fd, size);
+  if (table == NULL) {
+    shm_unlink(name);
+    return NULL;
+  }
+  table->header->capacity = capacity;
+  atomic_store_explicit(&table->header->magic, LEASE_TABLE_MAGIC, memory_order_release);
+  return table;
+}
+
+lease_table_t *lease_table_open(pid_t producer_pid) {
+  char name[LEASE_NAME_MAX];
+  struct stat st;
+  table_name(name, sizeof(name), producer_pid);
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd == -1) return NULL;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(lease_table_header_t)) {
+    close(fd);
+    return NULL;
+  }
+  lease_table_t *table = map_table(fd, (size_t)st.st_size);
+  if (table == NULL) return NULL;
+  // The master sizes and stamps the table before it sends its first task
+  if (atomic_load_explicit(&table->header->magic, memory_order_acquire) != LEASE_TABLE_MAGIC ||
+      sizeof(lease_table_header_t) + (size_t)table->header->capacity * sizeof(lease_t) > table->map_size) {
+    lease_table_close(table);
+    return NULL;
+  }
+  return table;
+}
+
+unsigned int lease_capacity(const lease_table_t *table) { return table->header->capacity; }
+
+lease_t *lease_get(lease_table_t *table, int task_id) {
+  return &table->header->leases[(unsigned int)task_id & (table->header->capacity - 1)];
+}
+
+void lease_sent(lease_table_t *table, int task_id, long long now_ns) {
+  lease_t *lease = lease_get(table, task_id);
+  atomic_store_explicit(&lease->task_id, task_id, memory_order_relaxed);
+  atomic_store_explicit(&lease->owner, 0, memory_order_relaxed);
+  atomic_store_explicit(&lease->leased_ns, now_ns, memory_order_release);
+}
+
+void lease_take(lease_table_t *table, int task_id, pid_t owner, long long now_ns) {
+  if (table == NULL) return;
+  lease_t *lease = lease_get(table, task_id);
+  if (atomic_load_explicit(&lease->task_id, memory_order_acquire) != task_id) return;
+  // Time first, so the master never pairs our PID with the time the task was sent
+  atomic_store_explicit(&lease->leased_ns, now_ns, memory_order_relaxed);
+  atomic_store_explicit(&lease->owner, owner, memory_order_release);
+}
+
+void lease_table_close(lease_table_t *table) {
+  if (table == NULL) return;
+  munmap(table->header, table->map_size);
+  free(table);
+}
+
+int lease_table_unlink(pid_t producer_pid) {
+  char name[LEASE_NAME_MAX];
+  table_name(name, sizeof(name), producer_pid);
+  return shm_unlink(name);
+}
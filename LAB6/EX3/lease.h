@@ -0,0 +1,44 @@
+#ifndef LEASE_H
+#define LEASE_H
+
+#include <sys/types.h>  // For pid_t
+
+// In-flight task table, one per master, in a shm_open segment named after the master's PID. Task
+// ids map onto a power-of-two ring of entries, so the table stays as small (and as cache-resident)
+// as the master's window. The master stamps a task's entry when it sends the task; a slave that
+// takes the task stores its own PID and the time. Both are plain atomic stores, so tracking costs
+// no syscalls. The master scans the table now and then and redelivers tasks whose slave died or
+// held them too long. It must not reuse an entry while the task that had it is unanswered.
+
+#define LEASE_TABLE_PREFIX "/lease_table."
+
+typedef struct {
+  _Atomic int task_id;          // Task the entry currently tracks
+  _Atomic pid_t owner;          // Slave working on the task, 0 while it waits in the task queue
+  _Atomic long long leased_ns;  // CLOCK_MONOTONIC time it was last sent or taken
+} lease_t;
+
+typedef struct lease_table lease_table_t;
+
+// Master: a table of capacity entries (a power of two), replacing a leftover one with our name
+lease_table_t *lease_table_create(pid_t producer_pid, unsigned int capacity);
+
+// Slave: attach to a master's table; NULL if it has none (tasks are then simply not tracked)
+lease_table_t *lease_table_open(pid_t producer_pid);
+
+unsigned int lease_capacity(const lease_table_t *table);
+
+// The entry task_id maps to; it may track another task
+lease_t *lease_get(lease_table_t *table, int task_id);
+
+// Master: the task (re)enters the task queue
+void lease_sent(lease_table_t *table, int task_id, long long now_ns);
+
+// Slave: the task was received and is being worked on. Ignored when the entry has moved on to
+// another task (ours was answered by someone else meanwhile). table may be NULL.
+void lease_take(lease_table_t *table, int task_id, pid_t owner, long long now_ns);
+
+void lease_table_close(lease_table_t *table);
+int lease_table_unlink(pid_t producer_pid);
+
+#endif  // LEASE_H
@@ -1,107 +1,931 @@
-#include <fcntl.h>   // For O_CREAT, O_EXCL, O_RDWR etc.
-#include <mqueue.h>  // For mq_open, mq_send, mq_receive, mq_close, mq_unlink
-#include <stdio.h>   // For printf, perror
-#include <stdlib.h>  // For atoi, EXIT_SUCCESS, EXIT_FAILURE
-#include <time.h>    // For time, srand
-#include <unistd.h>  // For getpid, sleep
+#include <errno.h>        // For errno, ETIMEDOUT, EINTR, ESRCH
+#include <fcntl.h>        // For O_CREAT, O_EXCL, O_RDWR etc.
+#include <getopt.h>       // For getopt_long
+#include <limits.h>       // For PATH_MAX
+#include <mqueue.h>       // For mq_open, mq_send, mq_receive, mq_close, mq_unlink
+#include <signal.h>       // For kill, SIGTERM
+#include <spawn.h>        // For posix_spawn
+#include <stdatomic.h>    // For atomic_load_explicit
+#include <stdio.h>        // For printf, perror
+#include <stdlib.h>       // For atoi, malloc, calloc, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>       // For strrchr, strcpy, memset
+#include <sys/epoll.h>    // For epoll_create1, epoll_ctl, epoll_wait
+#include <sys/timerfd.h>  // For timerfd_create, timerfd_settime
+#include <sys/wait.h>     // For waitpid, WNOHANG
+#include <time.h>         // For time, srand, clock_gettime, nanosleep
+#include <unistd.h>       // For getpid, readlink, read, close
 
 #include "common.h"
+#include "lease.h"
+#include "queue_users.h"
+#include "shm_queue.h"
 
-int main(int argc, char *argv[]) {
+#define DEFAULT_RATE 10  // Tasks per second, the original 100ms delay between tasks
+#define MAX_SLAVES 64
+#define SHM_RETRY_NS 100000LL      // Result wait while the task ring is full, before trying to push again
+#define HISTOGRAM_BUCKETS 24       // Power-of-two latency buckets: <1us, <2us, <4us ... <2^23us
+#define HISTOGRAM_WIDTH 40         // Characters of the longest histogram bar
+#define DEFAULT_LEASE_MS 5000      // A slave holding a task longer than this is presumed stuck
+#define LEASE_SCAN_NS 100000000LL  // How often in-flight tasks are checked; younger leases are not
+#define SLAVE_STOP_GRACE_MS 2000   // Before spawned slaves that did not take a stop message get SIGTERM
+
+extern char **environ;
+
+// Everything the master tracks while tasks are in flight
+typedef struct {
   mqd_t task_mq;
   mqd_t result_mq;
-  struct mq_attr attr;
-  pid_t producer_pid = getpid();
+  shm_queue_t *task_ring;  // Used instead of the mqueues with --transport shm
+  shm_queue_t *result_ring;
+  queue_users_t *users;             // Our registration on the shared task queue
+  char reply_name[REPLY_NAME_MAX];  // Our own result queue (or ring), named after our PID
+  pid_t producer_pid;
+  int quiet;
   int num_tasks;
+  long long *created_ns;      // Per task_id, when the task was generated
+  unsigned char *task_class;  // Per task_id, its task_class_t
+  unsigned char *done;        // Per task_id, whether its result arrived
+  int received;               // Tasks whose result arrived on our reply queue
+  char *result_buf;
+  long result_msgsize;
 
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s <number_of_tasks>\n", argv[0]);
-    return EXIT_FAILURE;
+  // Submission side. Each class is batched separately, since a message has one mq priority.
+  task_t *batches[NUM_CLASSES];
+  int batched[NUM_CLASSES];  // Tasks generated into each batch but not yet sent
+  int batch_size;
+  task_t held;  // --transport shm: a generated task waiting for room in the ring
+  int holding;
+  int next_task;  // Index of the next task to generate
+  int sent;
+  int window;  // Max tasks sent but not yet answered
+  double rate;
+  long long start_ns;
+  int class_weights[NUM_CLASSES];      // Relative share of generated tasks per class
+  long long deadline_ns[NUM_CLASSES];  // Relative deadline per class, 0 = none
+
+  // In-flight tracking (NULL leases = --lease-ms 0, no redelivery)
+  lease_table_t *leases;
+  task_t *in_flight;  // Copies of the tracked tasks for redelivery, in the same slots as the leases
+  unsigned int lease_mask;
+  long long lease_ns;
+  long long next_scan_ns;
+  int first_pending;    // Lowest task index whose result may still be missing
+  int redelivered;      // Tasks sent again, after their slave died or their lease expired
+  int lost_to_crashes;  // ... of which because the owner was gone
+  int duplicates;       // Results for tasks that were already answered
+
+  // Per-class results
+  long long *latency_ns[NUM_CLASSES];  // Generation to result arrival of completed tasks
+  int completed[NUM_CLASSES];
+  int expired[NUM_CLASSES];  // Dropped by a slave after the deadline
+  int generated[NUM_CLASSES];
+
+  // Statistics
+  long task_messages;
+  long result_messages;
+  long wakeups;
+  int max_outstanding;
+} master_t;
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void handle_results(master_t *master, ssize_t bytes) {
+  long long arrived = now_ns();
+  result_t *results = (result_t *)master->result_buf;
+  int count = (int)(bytes / (ssize_t)sizeof(result_t));
+
+  master->result_messages++;
+  for (int i = 0; i < count; ++i) {
+    result_t *result = &results[i];
+    if (result->producer_pid == master->producer_pid && result->task_id >= 1 &&
+        result->task_id <= master->num_tasks) {
+      // A redelivered task can be answered twice, by its slow first owner and by the new one
+      if (master->done[result->task_id - 1]) {
+        master->duplicates++;
+        continue;
+      }
+      master->done[result->task_id - 1] = 1;
+      master->received++;
+      while (master->first_pending < master->next_task && master->done[master->first_pending]) {
+        master->first_pending++;
+      }
+      int task_class = master->task_class[result->task_id - 1];
+      if (result->status == RESULT_EXPIRED) {
+        master->expired[task_class]++;
+      } else {
+        long long latency = arrived - master->created_ns[result->task_id - 1];
+        master->latency_ns[task_class][master->completed[task_class]++] = latency;
+      }
+    }
+    if (!master->quiet) {
+      printf("  Master PID: %d, Slave PID: %d, Task ID: %d, Result: %d\n", master->producer_pid, result->consumer_pid,
+             result->task_id, result->result);
+    }
   }
-  num_tasks = atoi(argv[1]);
-  if (num_tasks <= 0) {
-    fprintf(stderr, "Number of tasks must be positive.\n");
-    return EXIT_FAILURE;
+}
+
+// Take every result that is queued right now; the result queue is non-blocking
+int drain_results(master_t *master) {
+  while (1) {
+    unsigned int prio;
+    ssize_t bytes = mq_receive(master->result_mq, master->result_buf, master->result_msgsize, &prio);
+    if (bytes == -1) {
+      if (errno == EAGAIN) return 0;
+      if (errno == EINTR) continue;
+      perror("mq_receive result failed");
+      return -1;
+    }
+    handle_results(master, bytes);
   }
+}
 
-  // Seed random number generator using Use PID to make seeds more unique
-  srand(time(NULL) ^ producer_pid);
+// Another task may go out while the window has room and its lease entry is free, i.e. the task
+// that used the entry before (capacity ids back) has been answered
+int window_open(const master_t *master) {
+  if (master->next_task - master->received >= master->window) return 0;
+  return master->leases == NULL || master->next_task - master->first_pending <= (int)master->lease_mask;
+}
+
+// With a rate, task i is due at start + i / rate
+long long task_due(const master_t *master, int index) {
+  if (master->rate <= 0) return 0;
+  return master->start_ns + (long long)(index * 1e9 / master->rate);
+}
 
-  // Setup Task Queue (for sending tasks) and ensure message size is correct for task_t
+// Draw a class according to the --mix weights
+int pick_class(const master_t *master) {
+  int total = 0;
+  for (int c = 0; c < NUM_CLASSES; ++c) total += master->class_weights[c];
+  int draw = rand() % total;
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    if (draw < master->class_weights[c]) return c;
+    draw -= master->class_weights[c];
+  }
+  return CLASS_NORMAL;
+}
+
+void generate_task(master_t *master, task_t *task, int task_class) {
+  int index = master->next_task++;
+  long long now = now_ns();
+  task->producer_pid = master->producer_pid;
+  task->task_id = index + 1;
+  task->a = rand() % 100;  // Random A (0-99)
+  task->b = rand() % 100;  // Random B (0-99)
+  task->task_class = task_class;
+  task->deadline_ns = master->deadline_ns[task_class] > 0 ? now + master->deadline_ns[task_class] : 0;
+  master->created_ns[index] = now;
+  master->task_class[index] = (unsigned char)task_class;
+  if (master->leases != NULL) {
+    master->in_flight[task->task_id & master->lease_mask] = *task;
+    lease_sent(master->leases, task->task_id, now);
+  }
+  master->generated[task_class]++;
+  if (!master->quiet) {
+    printf("  Master PID: %d, Task ID: %d, A=%d, B=%d, Class: %s\n", master->producer_pid, task->task_id, task->a,
+           task->b, class_names[task_class]);
+  }
+}
+
+int total_batched(const master_t *master) {
+  int total = 0;
+  for (int c = 0; c < NUM_CLASSES; ++c) total += master->batched[c];
+  return total;
+}
+
+// Send one class's pending batch at that class's mq priority: 1 if the task queue is full
+int flush_class(master_t *master, int task_class) {
+  while (master->batched[task_class] > 0) {
+    if (mq_send(master->task_mq, (const char *)master->batches[task_class],
+                master->batched[task_class] * sizeof(task_t), class_priorities[task_class]) == -1) {
+      if (errno == EAGAIN) return 1;
+      if (errno == EINTR) continue;
+      perror("mq_send task failed");
+      return -1;
+    }
+    master->sent += master->batched[task_class];
+    master->task_messages++;
+    master->batched[task_class] = 0;
+    if (master->sent - master->redelivered - master->received > master->max_outstanding) {
+      master->max_outstanding = master->sent - master->redelivered - master->received;
+    }
+  }
+  return 0;
+}
+
+// Generate due tasks into their class batches while the window has room, sending a batch as soon
+// as it is full (interactive tasks are never held back for batching). Once nothing more can be
+// generated right now, the partial batches go out too, highest priority first, so pacing and the
+// window never hold tasks back. Returns 1 when the task queue is full, 0 otherwise, and stores the
+// due time of the next task (or -1) in *next_due.
+int submit_tasks(master_t *master, long long *next_due) {
+  long long now = now_ns();
+  *next_due = -1;
+  // Batches left full by an earlier EAGAIN must go out before anything joins them
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    if (master->batched[c] == master->batch_size) {
+      int rc = flush_class(master, c);
+      if (rc != 0) return rc;
+    }
+  }
+  while (master->next_task < master->num_tasks && window_open(master)) {
+    long long due = task_due(master, master->next_task);
+    if (due > now) {
+      *next_due = due;
+      break;
+    }
+    int task_class = pick_class(master);
+    generate_task(master, &master->batches[task_class][master->batched[task_class]++], task_class);
+    if (master->batched[task_class] == master->batch_size || task_class == CLASS_INTERACTIVE) {
+      int rc = flush_class(master, task_class);
+      if (rc != 0) return rc;
+    }
+  }
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    int rc = flush_class(master, c);
+    if (rc != 0) return rc;
+  }
+  return 0;
+}
+
+// Put a task whose lease was lost back on the task queue: 0 when queued, 1 when it is full
+int redeliver(master_t *master, int index) {
+  task_t *task = &master->in_flight[(index + 1) & master->lease_mask];
+  if (master->task_ring != NULL) {
+    if (shm_queue_try_push(master->task_ring, task) == -1) return 1;
+    master->sent++;
+    master->task_messages++;
+    return 0;
+  }
+  int task_class = task->task_class;
+  if (master->batched[task_class] == master->batch_size) {
+    int rc = flush_class(master, task_class);
+    if (rc != 0) return rc;
+  }
+  master->batches[task_class][master->batched[task_class]++] = *task;
+  return 0;
+}
+
+// Whether nothing of ours can still be waiting in the task queue
+int task_queue_drained(const master_t *master) {
+  if (master->task_ring != NULL) return shm_queue_depth(master->task_ring) == 0;
+  struct mq_attr attr;
+  return total_batched(master) == 0 && mq_getattr(master->task_mq, &attr) == 0 && attr.mq_curmsgs == 0;
+}
+
+// kill(pid, 0) at most once per owner and scan
+int owner_alive(pid_t owner, pid_t *checked, int *alive, int *num_checked) {
+  for (int i = 0; i < *num_checked; ++i) {
+    if (checked[i] == owner) return alive[i];
+  }
+  int result = kill(owner, 0) == 0 || errno != ESRCH;
+  if (*num_checked < MAX_SLAVES) {
+    checked[*num_checked] = owner;
+    alive[(*num_checked)++] = result;
+  }
+  return result;
+}
+
+// Redeliver tasks whose lease was lost. Only leases older than a scan interval are looked at, so a
+// healthy farm answers everything before it costs a syscall. Such a lease is lost when its owner
+// has exited, or when it is older than --lease-ms (a stuck or far too slow slave). A task no slave
+// took is only redelivered once the task queue has drained: the slave that received it must then
+// have died before it could take it.
+int check_leases(master_t *master, long long now) {
+  pid_t checked[MAX_SLAVES];
+  int alive[MAX_SLAVES];
+  int num_checked = 0;
+  int drained = -1;  // Asked only if an untaken task is old enough to matter
+
+  for (int index = master->first_pending; index < master->next_task; ++index) {
+    if (master->done[index]) continue;
+    lease_t *lease = lease_get(master->leases, index + 1);
+    pid_t owner = atomic_load_explicit(&lease->owner, memory_order_acquire);
+    long long age = now - atomic_load_explicit(&lease->leased_ns, memory_order_relaxed);
+    int crashed = 0;
+    if (age < LEASE_SCAN_NS) continue;
+    if (owner != 0) {
+      crashed = !owner_alive(owner, checked, alive, &num_checked);
+      if (!crashed && age < master->lease_ns) continue;
+    } else {
+      if (age < master->lease_ns) continue;
+      if (drained == -1) drained = task_queue_drained(master);
+      if (!drained) continue;
+      crashed = 1;
+    }
+
+    int rc = redeliver(master, index);
+    if (rc == -1) return -1;
+    if (rc == 1) break;  // Task queue full: the rest waits for the next scan
+    lease_sent(master->leases, index + 1, now);
+    master->redelivered++;
+    master->lost_to_crashes += crashed;
+    if (!master->quiet) {
+      printf("  Master PID: %d, Task ID: %d redelivered (%s)\n", master->producer_pid, index + 1,
+             crashed ? "its slave is gone" : "lease expired");
+    }
+  }
+  return 0;
+}
+
+// Scan the in-flight table when a scan interval has passed since the last one
+int scan_leases(master_t *master) {
+  if (master->leases == NULL) return 0;
+  long long now = now_ns();
+  if (now < master->next_scan_ns) return 0;
+  master->next_scan_ns = now + LEASE_SCAN_NS;
+  return check_leases(master, now);
+}
+
+// Event loop: the result queue is always watched for EPOLLIN, the task queue for EPOLLOUT only
+// while a batch is waiting for room, and a timerfd wakes us when the next paced task is due. Both
+// mqds are non-blocking, so neither queue can stall the other and results are consumed as they
+// arrive.
+int run_pipelined(master_t *master) {
+  struct epoll_event event = {.events = EPOLLIN};
+  struct epoll_event events[3];
+  int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  int watching_tasks = 0;
+  int rc = 0;
+
+  if (timer_fd == -1 || epoll_fd == -1) {
+    perror("timerfd_create/epoll_create1 failed");
+    return -1;
+  }
+  event.data.fd = master->result_mq;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, master->result_mq, &event);
+  event.data.fd = timer_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+
+  while (master->received < master->num_tasks) {
+    long long next_due;
+    if (scan_leases(master) == -1) {
+      rc = -1;
+      break;
+    }
+    int full = submit_tasks(master, &next_due);
+    if (full == -1) {
+      rc = -1;
+      break;
+    }
+
+    if (full != watching_tasks) {
+      event.events = EPOLLOUT;
+      event.data.fd = master->task_mq;
+      epoll_ctl(epoll_fd, full ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, master->task_mq, &event);
+      watching_tasks = full;
+    }
+    struct itimerspec timer = {0};
+    if (next_due != -1) {
+      timer.it_value.tv_sec = next_due / 1000000000LL;
+      timer.it_value.tv_nsec = next_due % 1000000000LL;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+
+    // Wake up for the lease scan too, even when nothing else happens
+    int ready = epoll_wait(epoll_fd, events, 3, master->leases != NULL ? (int)(LEASE_SCAN_NS / 1000000) : -1);
+    if (ready == -1) {
+      if (errno == EINTR) continue;
+      perror("epoll_wait failed");
+      rc = -1;
+      break;
+    }
+    master->wakeups++;
+    for (int i = 0; i < ready; ++i) {
+      if (events[i].data.fd == master->result_mq) {
+        if (drain_results(master) == -1) rc = -1;
+      } else if (events[i].data.fd == timer_fd) {
+        unsigned long long expirations;
+        read(timer_fd, &expirations, sizeof(expirations));
+      }
+      // EPOLLOUT on the task queue needs no action: the next submit_tasks() retries the send
+    }
+    if (rc == -1) break;
+  }
+
+  close(epoll_fd);
+  close(timer_fd);
+  return rc;
+}
+
+// Same submission and collection policy over the shared-memory rings (FIFO: classes only affect
+// deadlines there, not ordering). Nothing is pollable here, so
+// when neither side made progress we sleep on the result ring's futex until a result arrives, the
+// next paced task is due, or (with the task ring full) a short retry interval passes.
+int run_shm(master_t *master) {
+  while (master->received < master->num_tasks) {
+    int progress = 0;
+    long long now = now_ns();
+    long long next_due = -1;
+    int full = 0;
+
+    if (scan_leases(master) == -1) return -1;
+    while (master->next_task < master->num_tasks || master->holding) {
+      if (!master->holding) {
+        if (!window_open(master)) break;
+        long long due = task_due(master, master->next_task);
+        if (due > now) {
+          next_due = due;
+          break;
+        }
+        generate_task(master, &master->held, pick_class(master));
+        master->holding = 1;
+      }
+      if (shm_queue_try_push(master->task_ring, &master->held) == -1) {
+        full = 1;
+        break;
+      }
+      master->holding = 0;
+      master->sent++;
+      master->task_messages++;
+      progress = 1;
+      if (master->sent - master->redelivered - master->received > master->max_outstanding) {
+        master->max_outstanding = master->sent - master->redelivered - master->received;
+      }
+    }
+
+    while (shm_queue_try_pop(master->result_ring, master->result_buf) == 0) {
+      handle_results(master, sizeof(result_t));
+      progress = 1;
+    }
+    if (progress || master->received >= master->num_tasks) continue;
+
+    long long timeout_ns = -1;
+    if (full) {
+      timeout_ns = SHM_RETRY_NS;
+    } else if (next_due != -1) {
+      timeout_ns = next_due - now_ns();
+      if (timeout_ns < 0) timeout_ns = 0;
+    }
+    if (master->leases != NULL && (timeout_ns < 0 || timeout_ns > LEASE_SCAN_NS)) timeout_ns = LEASE_SCAN_NS;
+    if (shm_queue_pop(master->result_ring, master->result_buf, timeout_ns) == 0) {
+      handle_results(master, sizeof(result_t));
+    } else if (errno != ETIMEDOUT) {
+      perror("shm_queue_pop result failed");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int compare_ll(const void *a, const void *b) {
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+double percentile_us(const long long *sorted, int count, double p) {
+  if (count == 0) return 0.0;
+  int index = (int)(p / 100.0 * (count - 1) + 0.5);
+  return sorted[index] / 1000.0;
+}
+
+// Per-class percentiles and a log2 latency histogram, plus how many tasks expired unprocessed
+void print_class_report(master_t *master) {
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    long long *latency = master->latency_ns[c];
+    int count = master->completed[c];
+    if (master->generated[c] == 0) continue;
+
+    qsort(latency, count, sizeof(long long), compare_ll);
+    printf("Master (PID %d): class %-11s generated %d, completed %d, expired %d", master->producer_pid, class_names[c],
+           master->generated[c], count, master->expired[c]);
+    if (master->deadline_ns[c] > 0) printf(" (deadline %lld us)", master->deadline_ns[c] / 1000);
+    printf("\n");
+    if (count == 0) continue;
+    printf("  latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", percentile_us(latency, count, 50),
+           percentile_us(latency, count, 90), percentile_us(latency, count, 99), percentile_us(latency, count, 99.9),
+           percentile_us(latency, count, 100));
+
+    int buckets[HISTOGRAM_BUCKETS] = {0};
+    int peak = 0;
+    for (int i = 0; i < count; ++i) {
+      long long us = latency[i] / 1000;
+      int bucket = 0;
+      while (us > 0 && bucket < HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+      }
+      if (++buckets[bucket] > peak) peak = buckets[bucket];
+    }
+    for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+      if (buckets[b] == 0) continue;
+      char bar[HISTOGRAM_WIDTH + 1];
+      int width = (int)((long long)buckets[b] * HISTOGRAM_WIDTH / peak);
+      memset(bar, '#', width);
+      bar[width] = '\0';
+      printf("  < %8lld us %8d %s\n", 1LL << b, buckets[b], bar);
+    }
+  }
+}
+
+// "I,N,B" -> one value per class
+int parse_per_class(const char *arg, long long values[NUM_CLASSES]) {
+  return sscanf(arg, "%lld,%lld,%lld", &values[CLASS_INTERACTIVE], &values[CLASS_NORMAL], &values[CLASS_BULK]) == 3
+             ? 0
+             : -1;
+}
+
+// Start slaves next to our own executable, without the artificial work delay
+int spawn_slaves(int num_slaves, pid_t *pids, const char *transport) {
+  char path[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - sizeof("slave"));
+  if (len == -1) {
+    perror("readlink /proc/self/exe failed");
+    return -1;
+  }
+  path[len] = '\0';
+  strcpy(strrchr(path, '/') + 1, "slave");
+
+  char *slave_argv[] = {path, "--rate", "0", "--quiet", "--transport", (char *)transport, NULL};
+  for (int i = 0; i < num_slaves; ++i) {
+    int rc = posix_spawn(&pids[i], path, NULL, NULL, slave_argv, environ);
+    if (rc != 0) {
+      errno = rc;
+      perror("posix_spawn slave failed");
+      return i;
+    }
+  }
+  return num_slaves;
+}
+
+int open_mq_transport(master_t *master) {
+  pid_t producer_pid = master->producer_pid;
+  struct mq_attr attr;
+
+  // Setup Task Queue (for sending tasks); a message holds up to batch_size tasks
   attr.mq_flags = 0;
   attr.mq_maxmsg = MAX_MSGS;
-  attr.mq_msgsize = sizeof(task_t);
+  attr.mq_msgsize = master->batch_size * sizeof(task_t);
   attr.mq_curmsgs = 0;
 
-  task_mq = mq_open(TASK_QUEUE_NAME, O_CREAT | O_WRONLY, 0666, &attr);
-  if (task_mq == (mqd_t)-1) {
+  // Registered first, so the last master to leave cannot remove the queue between our open and our join
+  master->users = queue_users_join(TASK_QUEUE_NAME, producer_pid);
+  if (master->users == NULL) {
+    perror("queue_users_join failed");
+    return -1;
+  }
+  master->task_mq = mq_open(TASK_QUEUE_NAME, O_CREAT | O_WRONLY | O_NONBLOCK, 0666, &attr);
+  if (master->task_mq == (mqd_t)-1) {
     perror("mq_open task_mq failed");
-    return EXIT_FAILURE;
+    queue_users_leave(master->users, mq_unlink);
+    return -1;
   }
   printf("Master (PID %d): Task queue '%s' opened/created successfully.\n", producer_pid, TASK_QUEUE_NAME);
 
-  // Setup Result Queue (for receiving results). We use O_CREAT here, but we also ensure it's removed on exit.
-  // The consumer might open it too, O_EXCL is not strictly needed for this.
+  // The queue may already exist (another master created it); a batch must fit its message size
+  if (mq_getattr(master->task_mq, &attr) == -1) {
+    perror("mq_getattr task_mq failed");
+    mq_close(master->task_mq);
+    queue_users_leave(master->users, mq_unlink);
+    return -1;
+  }
+  if (master->batch_size > attr.mq_msgsize / (long)sizeof(task_t)) {
+    master->batch_size = attr.mq_msgsize / sizeof(task_t);
+    printf("Master (PID %d): Existing task queue holds %ld bytes per message, batch reduced to %d.\n", producer_pid,
+           attr.mq_msgsize, master->batch_size);
+  }
+
+  // Setup Result Queue (for receiving results). It is ours alone: slaves answer each task on the
+  // queue named after its producer_pid. A leftover from a crashed master with our PID is replaced.
   attr.mq_flags = 0;
   attr.mq_maxmsg = MAX_MSGS;
-  attr.mq_msgsize = sizeof(result_t);
+  attr.mq_msgsize = master->batch_size * sizeof(result_t);
   attr.mq_curmsgs = 0;
 
-  result_mq = mq_open(RESULT_QUEUE_NAME, O_CREAT | O_RDONLY, 0666, &attr);
-  if (result_mq == (mqd_t)-1) {
+  reply_queue_name(master->reply_name, sizeof(master->reply_name), TRANSPORT_MQ, producer_pid);
+  mq_unlink(master->reply_name);
+  master->result_mq = mq_open(master->reply_name, O_CREAT | O_EXCL | O_RDONLY | O_NONBLOCK, 0666, &attr);
+  if (master->result_mq == (mqd_t)-1) {
     perror("mq_open result_mq failed");
-    mq_close(task_mq);           // Clean up
-    mq_unlink(TASK_QUEUE_NAME);  // Clean up in case we created it
-    return EXIT_FAILURE;
+    mq_close(master->task_mq);
+    queue_users_leave(master->users, mq_unlink);  // Removes the task queue only if no other master uses it
+    return -1;
   }
-  printf("Master (PID %d): Result queue '%s' opened/created successfully.\n", producer_pid, RESULT_QUEUE_NAME);
+  printf("Master (PID %d): Result queue '%s' created successfully.\n", producer_pid, master->reply_name);
 
-  // Send tasks
-  printf("Master (PID %d): Generating and sending %d tasks...\n", producer_pid, num_tasks);
-  for (int i = 0; i < num_tasks; ++i) {
-    task_t task;
-    task.producer_pid = producer_pid;
-    task.task_id = i + 1;
-    task.a = rand() % 100;  // Random A (0-99)
-    task.b = rand() % 100;  // Random B (0-99)
+  // mq_receive needs a buffer of at least the queue's message size
+  mq_getattr(master->result_mq, &attr);
+  master->result_msgsize = attr.mq_msgsize;
+  master->result_buf = malloc(attr.mq_msgsize);
+  return 0;
+}
 
-    if (mq_send(task_mq, (const char *)&task, sizeof(task_t), MSG_PRIO) == -1) {
-      perror("mq_send task failed");
-    } else {
-      printf("  Master PID: %d, Task ID: %d, A=%d, B=%d\n", producer_pid, task.task_id, task.a, task.b);
-    }
-    // Small delay to simulate tasks being generated over time
-    usleep(100000);  // 100ms
+int open_shm_transport(master_t *master) {
+  master->users = queue_users_join(SHM_TASK_QUEUE_NAME, master->producer_pid);
+  if (master->users == NULL) {
+    perror("queue_users_join failed");
+    return -1;
+  }
+  master->task_ring = shm_queue_create(SHM_TASK_QUEUE_NAME, SHM_QUEUE_CAPACITY, sizeof(task_t));
+  if (master->task_ring == NULL) {
+    perror("shm_queue_create task ring failed");
+    queue_users_leave(master->users, shm_queue_unlink);
+    return -1;
   }
+  reply_queue_name(master->reply_name, sizeof(master->reply_name), TRANSPORT_SHM, master->producer_pid);
+  shm_queue_unlink(master->reply_name);
+  master->result_ring = shm_queue_create(master->reply_name, SHM_QUEUE_CAPACITY, sizeof(result_t));
+  if (master->result_ring == NULL) {
+    perror("shm_queue_create result ring failed");
+    shm_queue_close(master->task_ring);
+    queue_users_leave(master->users, shm_queue_unlink);
+    return -1;
+  }
+  printf("Master (PID %d): Shared-memory rings '%s' and '%s' (%d slots) opened/created successfully.\n",
+         master->producer_pid, SHM_TASK_QUEUE_NAME, master->reply_name, SHM_QUEUE_CAPACITY);
+  master->result_msgsize = sizeof(result_t);
+  master->result_buf = malloc(sizeof(result_t));
+  return 0;
+}
 
-  // Receive results
-  printf("Master (PID %d): Waiting for %d results...\n", producer_pid, num_tasks);
-  for (int i = 0; i < num_tasks; ++i) {
-    result_t result;
-    unsigned int prio;
-    if (mq_receive(result_mq, (char *)&result, sizeof(result_t), &prio) == -1) {
-      perror("mq_receive result failed");
-      break;
-    } else {
-      printf("  Master PID: %d, Slave PID: %d, Task ID: %d, Result: %d\n", producer_pid, result.consumer_pid,
-             result.task_id, result.result);
+// A zero-length message on the mqueue, or a task with id 0 on the ring, stops one slave
+void stop_one_slave(master_t *master) {
+  if (master->task_ring != NULL) {
+    task_t stop = {.producer_pid = master->producer_pid, .task_id = STOP_TASK_ID, .task_class = CLASS_BULK};
+    shm_queue_push(master->task_ring, &stop, -1);
+    return;
+  }
+  // These sends may block
+  struct mq_attr blocking = {.mq_flags = 0};
+  mq_setattr(master->task_mq, &blocking, NULL);
+  // Lowest priority, so the stop queues behind every task of other masters that is still waiting
+  if (mq_send(master->task_mq, "", 0, class_priorities[CLASS_BULK]) == -1) perror("mq_send stop failed");
+}
+
+// Stop the slaves we spawned and reap them, and only them. A stop message goes to whichever slave
+// reads it first, which with a supervisor's pool on the same queue need not be one of ours, so ours
+// get SIGTERM if they are still running after the grace period.
+void stop_slaves(master_t *master, pid_t *pids, int count) {
+  for (int i = 0; i < count; ++i) {
+    stop_one_slave(master);
+  }
+  long long deadline = now_ns() + SLAVE_STOP_GRACE_MS * 1000000LL;
+  while (count > 0 && now_ns() < deadline) {
+    for (int i = 0; i < count;) {
+      pid_t pid = waitpid(pids[i], NULL, WNOHANG);
+      if (pid == pids[i] || (pid == -1 && errno == ECHILD)) {
+        pids[i] = pids[--count];
+      } else {
+        ++i;
+      }
     }
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 10000000L};
+    if (count > 0) nanosleep(&ts, NULL);
   }
-  printf("Master (PID %d): All tasks sent and results received.\n", producer_pid);
+  for (int i = 0; i < count; ++i) {
+    kill(pids[i], SIGTERM);
+  }
+  for (int i = 0; i < count; ++i) {
+    waitpid(pids[i], NULL, 0);
+  }
+}
 
-  // Cleanup
-  if (mq_close(task_mq) == -1) {
+void close_mq_transport(master_t *master) {
+  if (mq_close(master->task_mq) == -1) {
     perror("mq_close task_mq failed");
   }
-  if (mq_unlink(TASK_QUEUE_NAME) == -1) {
+  // The task queue is shared: only the last master to leave removes it
+  if (queue_users_leave(master->users, mq_unlink) == -1) {
     perror("mq_unlink task_queue failed");
   }
-  if (mq_close(result_mq) == -1) {
+  if (mq_close(master->result_mq) == -1) {
     perror("mq_close result_mq failed");
   }
-  if (mq_unlink(RESULT_QUEUE_NAME) == -1) {
+  if (mq_unlink(master->reply_name) == -1) {
     perror("mq_unlink result_queue failed");
   }
+}
+
+void close_shm_transport(master_t *master) {
+  shm_queue_close(master->task_ring);
+  shm_queue_close(master->result_ring);
+  if (queue_users_leave(master->users, shm_queue_unlink) == -1) {
+    perror("shm_unlink task ring failed");
+  }
+  if (shm_queue_unlink(master->reply_name) == -1) {
+    perror("shm_unlink result ring failed");
+  }
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--transport mq|shm] [--batch N] [--rate TASKS_PER_SEC] [--window N] [--mix I,N,B] "
+          "[--deadline-us I,N,B] [--lease-ms MS] [--slaves N] [--quiet] <number_of_tasks>\n",
+          prog);
+  fprintf(stderr, "  --transport  POSIX mqueues (default) or shared-memory MPMC rings\n");
+  fprintf(stderr, "  --batch N    tasks per message, up to mq_msgsize / sizeof(task_t) (default 1)\n");
+  fprintf(stderr, "  --rate R     task generation rate, 0 = as fast as the queues allow (default %d)\n", DEFAULT_RATE);
+  fprintf(stderr, "  --window N   max tasks sent but not yet answered (default: both queues full)\n");
+  fprintf(stderr, "  --mix I,N,B  relative share of interactive, normal and bulk tasks (default 0,1,0)\n");
+  fprintf(stderr, "  --deadline-us I,N,B  per-class deadline; slaves drop tasks that are already late (0 = none)\n");
+  fprintf(stderr, "  --lease-ms MS  redeliver a task a live slave has held this long; tasks of slaves that died\n");
+  fprintf(stderr, "               are redelivered right away (default %d, 0 = no redelivery)\n", DEFAULT_LEASE_MS);
+  fprintf(stderr, "  --slaves N   spawn N slaves with no simulated work and stop them at the end (max %d)\n",
+          MAX_SLAVES);
+  fprintf(stderr, "  --quiet      no per-task output, only the throughput and latency summary\n");
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"transport", required_argument, NULL, 't'},
+                                         {"batch", required_argument, NULL, 'b'},
+                                         {"rate", required_argument, NULL, 'r'},
+                                         {"window", required_argument, NULL, 'w'},
+                                         {"mix", required_argument, NULL, 'm'},
+                                         {"deadline-us", required_argument, NULL, 'd'},
+                                         {"lease-ms", required_argument, NULL, 'l'},
+                                         {"slaves", required_argument, NULL, 's'},
+                                         {"quiet", no_argument, NULL, 'q'},
+                                         {NULL, 0, NULL, 0}};
+  master_t master = {.producer_pid = getpid()};
+  transport_t transport = TRANSPORT_MQ;
+  pid_t producer_pid = master.producer_pid;
+  pid_t slave_pids[MAX_SLAVES];
+  int failed = 1;  // Until the run gets going; the failure paths after the queues are open go to cleanup
+  int num_tasks;
+  int batch_size = 1;
+  double rate = DEFAULT_RATE;
+  int window = 0;
+  long long mix[NUM_CLASSES] = {0, 1, 0};
+  long long deadline_us[NUM_CLASSES] = {0, 0, 0};
+  int num_slaves = 0;
+  int lease_ms = DEFAULT_LEASE_MS;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "t:b:r:w:m:d:l:s:q", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 't':
+        if (parse_transport(optarg, &transport) == -1) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'b':
+        batch_size = atoi(optarg);
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 'w':
+        window = atoi(optarg);
+        break;
+      case 'm':
+      case 'd':
+        if (parse_per_class(optarg, opt == 'm' ? mix : deadline_us) == -1) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'l':
+        lease_ms = atoi(optarg);
+        break;
+      case 's':
+        num_slaves = atoi(optarg);
+        break;
+      case 'q':
+        master.quiet = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  num_tasks = atoi(argv[optind]);
+  if (num_tasks <= 0) {
+    fprintf(stderr, "Number of tasks must be positive.\n");
+    return EXIT_FAILURE;
+  }
+  if (batch_size < 1 || batch_size > MAX_BATCH || rate < 0 || window < 0 || lease_ms < 0 || num_slaves < 0 ||
+      num_slaves > MAX_SLAVES) {
+    fprintf(stderr, "Batch must be 1..%d, rate, window and lease >= 0 and slaves 0..%d.\n", MAX_BATCH, MAX_SLAVES);
+    return EXIT_FAILURE;
+  }
+  master.num_tasks = num_tasks;
+  if (mix[CLASS_INTERACTIVE] + mix[CLASS_NORMAL] + mix[CLASS_BULK] <= 0) {
+    fprintf(stderr, "At least one class weight must be positive.\n");
+    return EXIT_FAILURE;
+  }
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    if (mix[c] < 0 || deadline_us[c] < 0) {
+      fprintf(stderr, "Class weights and deadlines must be >= 0.\n");
+      return EXIT_FAILURE;
+    }
+    master.class_weights[c] = (int)mix[c];
+    master.deadline_ns[c] = deadline_us[c] * 1000;
+  }
+
+  // Seed random number generator using Use PID to make seeds more unique
+  srand(time(NULL) ^ producer_pid);
+
+  master.batch_size = transport == TRANSPORT_SHM ? 1 : batch_size;  // The ring moves single tasks
+  if ((transport == TRANSPORT_SHM ? open_shm_transport(&master) : open_mq_transport(&master)) == -1) {
+    return EXIT_FAILURE;
+  }
+  batch_size = master.batch_size;
+
+  master.created_ns = malloc(num_tasks * sizeof(long long));
+  master.task_class = malloc(num_tasks);
+  master.done = calloc(num_tasks, 1);
+  int allocated =
+      master.result_buf != NULL && master.created_ns != NULL && master.task_class != NULL && master.done != NULL;
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    master.latency_ns[c] = malloc(num_tasks * sizeof(long long));
+    master.batches[c] = malloc(batch_size * sizeof(task_t));
+    allocated = allocated && master.latency_ns[c] != NULL && master.batches[c] != NULL;
+  }
+  master.rate = rate;
+  // By default a full task queue plus a full result queue worth of tasks may be outstanding
+  if (window > 0) {
+    master.window = window;
+  } else {
+    master.window = transport == TRANSPORT_SHM ? 2 * SHM_QUEUE_CAPACITY : 2 * MAX_MSGS * batch_size;
+  }
+  if (!allocated) {
+    perror("malloc failed");
+    goto cleanup;
+  }
+
+  // Slaves record the tasks they take here, before we send the first one. Twice the window, so
+  // a slow task only holds up generation when it is really lagging behind.
+  if (lease_ms > 0) {
+    unsigned int capacity = 1;
+    while (capacity < 2u * (unsigned int)master.window) capacity <<= 1;
+    master.lease_ns = lease_ms * 1000000LL;
+    master.lease_mask = capacity - 1;
+    master.leases = lease_table_create(producer_pid, capacity);
+    master.in_flight = malloc(capacity * sizeof(task_t));
+    if (master.leases == NULL || master.in_flight == NULL) {
+      perror("lease table setup failed");
+      goto cleanup;
+    }
+  }
+
+  if (num_slaves > 0) {
+    num_slaves = spawn_slaves(num_slaves, slave_pids, transport_names[transport]);
+    if (num_slaves < 0) num_slaves = 0;
+    printf("Master (PID %d): Spawned %d slave(s).\n", producer_pid, num_slaves);
+  }
+
+  // Send tasks and receive results at the same time
+  printf("Master (PID %d): Pipelining %d tasks over %s (batch %d, rate %.0f/s, 0 = unlimited, window %d)...\n",
+         producer_pid, num_tasks, transport_names[transport], batch_size, rate, master.window);
+  master.start_ns = now_ns();
+  failed = (transport == TRANSPORT_SHM ? run_shm(&master) : run_pipelined(&master)) == -1;
+  long long start = master.start_ns;
+  double elapsed = (now_ns() - start) / 1e9;
+  printf("Master (PID %d): All tasks sent and results received.\n", producer_pid);
+
+  // Throughput and per-class latency (generation to result arrival) of our own tasks
+  printf("Master (PID %d): %d tasks in %.3f s = %.0f tasks/s, %ld task msgs, %ld result msgs, %d slave(s) spawned\n",
+         producer_pid, master.received, elapsed, master.received / elapsed, master.task_messages,
+         master.result_messages, num_slaves);
+  if (transport == TRANSPORT_SHM) {
+    shm_queue_stats_t task_stats;
+    shm_queue_stats_t result_stats;
+    shm_queue_get_stats(master.task_ring, &task_stats);
+    shm_queue_get_stats(master.result_ring, &result_stats);
+    printf("Master (PID %d): futex waits/wakes: task ring %llu/%llu, result ring %llu/%llu, max %d tasks outstanding\n",
+           producer_pid, task_stats.futex_waits, task_stats.futex_wakes, result_stats.futex_waits,
+           result_stats.futex_wakes, master.max_outstanding);
+  } else {
+    printf("Master (PID %d): %ld epoll wakeups, max %d tasks outstanding (window %d)\n", producer_pid, master.wakeups,
+           master.max_outstanding, master.window);
+  }
+  if (master.leases != NULL) {
+    printf("Master (PID %d): %d task(s) redelivered (%d of a slave that was gone), %d duplicate result(s) ignored\n",
+           producer_pid, master.redelivered, master.lost_to_crashes, master.duplicates);
+  }
+  print_class_report(&master);
+
+  stop_slaves(&master, slave_pids, num_slaves);
+
+cleanup:
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    free(master.batches[c]);
+    free(master.latency_ns[c]);
+  }
+  free(master.result_buf);
+  free(master.created_ns);
+  free(master.task_class);
+  free(master.in_flight);
+  free(master.done);
+  if (master.leases != NULL) {
+    lease_table_close(master.leases);
+    lease_table_unlink(producer_pid);
+  }
+  if (transport == TRANSPORT_SHM) {
+    close_shm_transport(&master);
+  } else {
+    close_mq_transport(&master);
+  }
 
-  return EXIT_SUCCESS;
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,163 @@
+#include "queue_users.h"
+
+#include <errno.h>      // For errno, EEXIST, ENOENT, EBUSY, EOWNERDEAD, ETIMEDOUT, EPERM
+#include <fcntl.h>      // For O_CREAT, O_EXCL, O_RDWR
+#include <pthread.h>    // For pthread_mutex_*, pthread_mutexattr_*
+#include <sched.h>      // For sched_yield
+#include <signal.h>     // For kill
+#include <stdatomic.h>  // For atomic_*
+#include <stdint.h>     // For uint32_t
+#include <stdio.h>      // For snprintf, perror
+#include <stdlib.h>     // For malloc, free
+#include <sys/mman.h>   // For shm_open, shm_unlink, mmap, munmap
+#include <sys/stat.h>   // For fstat
+#include <time.h>       // For nanosleep
+#include <unistd.h>     // For ftruncate, close
+
+#include "common.h"
+
+#define QUEUE_USERS_MAGIC 0x55534552u  // "USER", stored once the mutex is initialized
+#define QUEUE_USERS_INIT_TRIES 1000    // 1 ms apart: how long a creator may take to initialize
+
+typedef struct {
+  _Atomic uint32_t magic;
+  int closed;  // The last master removed the queue: whoever still finds this segment starts over
+  pthread_mutex_t lock;
+  pid_t pids[QUEUE_USERS_MAX];  // 0: free
+} queue_users_header_t;
+
+struct queue_users {
+  queue_users_header_t *header;
+  char queue_name[REPLY_NAME_MAX];
+  char name[REPLY_NAME_MAX + sizeof(QUEUE_USERS_SUFFIX)];
+  pid_t pid;
+};
+
+static void lock_users(queue_users_header_t *header) {
+  if (pthread_mutex_lock(&header->lock) == EOWNERDEAD) pthread_mutex_consistent(&header->lock);
+}
+
+// kill(pid, 0) fails with ESRCH only when no such process exists
+static int alive(pid_t pid) { return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM); }
+
+// Map the segment, creating and initializing it when it does not exist. NULL on error.
+static queue_users_header_t *map_users(const char *name) {
+  int created = 1;
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+  if (fd == -1 && errno == EEXIST) {
+    created = 0;
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1 && errno == ENOENT) return map_users(name);  // Unlinked meanwhile
+  }
+  if (fd == -1) {
+    perror("queue users: shm_open failed");
+    return NULL;
+  }
+  if (created && ftruncate(fd, sizeof(queue_users_header_t)) == -1) {
+    perror("queue users: ftruncate failed");
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  // The creator sizes the segment right after creating it
+  struct stat st;
+  struct timespec pause = {0, 1000000};
+  for (int tries = 0; !created; ++tries) {
+    if (fstat(fd, &st) == -1 || tries == QUEUE_USERS_INIT_TRIES) {
+      fprintf(stderr, "queue users: '%s' was never sized\n", name);
+      close(fd);
+      errno = ETIMEDOUT;
+      return NULL;
+    }
+    if ((size_t)st.st_size >= sizeof(queue_users_header_t)) break;
+    nanosleep(&pause, NULL);
+  }
+  void *addr = mmap(NULL, sizeof(queue_users_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    perror("queue users: mmap failed");
+    if (created) shm_unlink(name);
+    return NULL;
+  }
+  queue_users_header_t *header = addr;
+
+  if (created) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    atomic_store_explicit(&header->magic, QUEUE_USERS_MAGIC, memory_order_release);
+    return header;
+  }
+  for (int tries = 0; atomic_load_explicit(&header->magic, memory_order_acquire) != QUEUE_USERS_MAGIC; ++tries) {
+    if (tries == QUEUE_USERS_INIT_TRIES) {
+      fprintf(stderr, "queue users: '%s' was never initialized\n", name);
+      munmap(header, sizeof(queue_users_header_t));
+      errno = ETIMEDOUT;
+      return NULL;
+    }
+    nanosleep(&pause, NULL);
+  }
+  return header;
+}
+
+queue_users_t *queue_users_join(const char *queue_name, pid_t pid) {
+  queue_users_t *users = malloc(sizeof(queue_users_t));
+  if (users == NULL) return NULL;
+  snprintf(users->queue_name, sizeof(users->queue_name), "%s", queue_name);
+  snprintf(users->name, sizeof(users->name), "%s%s", queue_name, QUEUE_USERS_SUFFIX);
+  users->pid = pid;
+
+  while (1) {
+    users->header = map_users(users->name);
+    if (users->header == NULL) {
+      free(users);
+      return NULL;
+    }
+    lock_users(users->header);
+    if (!users->header->closed) break;
+    // We opened the segment just before the last master removed it: start over on a new one
+    pthread_mutex_unlock(&users->header->lock);
+    munmap(users->header, sizeof(queue_users_header_t));
+    sched_yield();
+  }
+
+  // Our slot: a free one, or one whose master died without leaving
+  int slot = -1;
+  for (int i = 0; i < QUEUE_USERS_MAX && slot == -1; ++i) {
+    if (users->header->pids[i] == 0 || !alive(users->header->pids[i])) slot = i;
+  }
+  if (slot != -1) users->header->pids[slot] = pid;
+  pthread_mutex_unlock(&users->header->lock);
+  if (slot == -1) {
+    munmap(users->header, sizeof(queue_users_header_t));
+    free(users);
+    errno = EBUSY;
+    return NULL;
+  }
+  return users;
+}
+
+int queue_users_leave(queue_users_t *users, int (*unlink_queue)(const char *name)) {
+  queue_users_header_t *header = users->header;
+  int others = 0;
+  int result = 0;
+
+  lock_users(header);
+  for (int i = 0; i < QUEUE_USERS_MAX; ++i) {
+    if (header->pids[i] == users->pid) header->pids[i] = 0;
+    if (header->pids[i] != 0 && alive(header->pids[i])) others++;
+  }
+  // Still under the lock: a master joining now waits, sees closed and creates a new queue
+  if (others == 0) {
+    result = unlink_queue(users->queue_name) == 0 || errno == ENOENT ? 1 : -1;
+    shm_unlink(users->name);
+    header->closed = 1;
+  }
+  pthread_mutex_unlock(&header->lock);
+  munmap(header, sizeof(queue_users_header_t));
+  free(users);
+  return result;
+}
@@ -0,0 +1,28 @@
+#ifndef QUEUE_USERS_H
+#define QUEUE_USERS_H
+
+#include <sys/types.h>  // For pid_t
+
+// Masters sharing the task queue, registered in a small shm_open segment named after the queue
+// (queue name + ".users"). A master joins before it opens or creates the queue and leaves after it
+// closed it; the one that leaves no live master behind unlinks the queue and the segment, so no
+// master ever removes the queue under another. Joins and leaves hold a robust process-shared mutex:
+// a master that joins while the last one is leaving waits, then starts over on a fresh queue. A
+// master that crashed is skipped because its PID no longer exists. Slaves do not register: they
+// serve whatever queue carries the name.
+
+#define QUEUE_USERS_SUFFIX ".users"
+#define QUEUE_USERS_MAX 64  // Masters at a time
+
+typedef struct queue_users queue_users_t;
+
+// Register pid as a user of the queue called queue_name. NULL with errno EBUSY when every slot
+// holds a live master, or on error.
+queue_users_t *queue_users_join(const char *queue_name, pid_t pid);
+
+// Leave. When no other live master is registered, remove the queue with unlink_queue (mq_unlink or
+// shm_queue_unlink) and the segment with it. Returns 1 when the queue was removed, 0 when others
+// still use it, -1 when unlink_queue failed.
+int queue_users_leave(queue_users_t *users, int (*unlink_queue)(const char *name));
+
+#endif  // QUEUE_USERS_H
@@ -0,0 +1,84 @@
+#include "queue_watch.h"
+
+#include <errno.h>        // For errno, EINTR
+#include <fcntl.h>        // For O_RDONLY
+#include <mqueue.h>       // For mq_open, mq_close
+#include <poll.h>         // For poll, struct pollfd
+#include <stdio.h>        // For snprintf
+#include <string.h>       // For strcmp
+#include <sys/inotify.h>  // For inotify_init1, inotify_add_watch, struct inotify_event
+#include <sys/mman.h>     // For shm_open
+#include <sys/stat.h>     // For fstat, struct stat
+#include <time.h>         // For clock_gettime
+#include <unistd.h>       // For read, close
+
+static long long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+int queue_watch_init(queue_watch_t *watch, const char *dir, const char *queue_name) {
+  watch->fd = inotify_init1(IN_CLOEXEC);
+  if (watch->fd == -1) return -1;
+  snprintf(watch->name, sizeof(watch->name), "%s", queue_name[0] == '/' ? queue_name + 1 : queue_name);
+  if (inotify_add_watch(watch->fd, dir, IN_CREATE | IN_MOVED_TO) == -1) {
+    queue_watch_close(watch);
+    return -1;
+  }
+  return 0;
+}
+
+int queue_watch_wait(queue_watch_t *watch, int timeout_ms) {
+  long long end_ms = now_ms() + timeout_ms;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (1) {
+    int left = -1;
+    if (timeout_ms >= 0) {
+      long long remaining = end_ms - now_ms();
+      if (remaining <= 0) return 0;
+      left = (int)remaining;
+    }
+    struct pollfd pfd = {.fd = watch->fd, .events = POLLIN};
+    int ready = poll(&pfd, 1, left);
+    if (ready == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (ready == 0) return 0;
+
+    ssize_t len = read(watch->fd, buf, sizeof(buf));
+    if (len == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    for (char *p = buf; p < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *)p;
+      if (event->len > 0 && strcmp(event->name, watch->name) == 0) return 1;
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
+
+void queue_watch_close(queue_watch_t *watch) {
+  if (watch->fd != -1) close(watch->fd);
+  watch->fd = -1;
+}
+
+ino_t queue_inode(transport_t transport, const char *queue_name) {
+  struct stat st;
+  ino_t inode = 0;
+  if (transport == TRANSPORT_SHM) {
+    int fd = shm_open(queue_name, O_RDONLY, 0);
+    if (fd == -1) return 0;
+    if (fstat(fd, &st) == 0) inode = st.st_ino;
+    close(fd);
+  } else {
+    mqd_t mqd = mq_open(queue_name, O_RDONLY | O_NONBLOCK);
+    if (mqd == (mqd_t)-1) return 0;
+    if (fstat(mqd, &st) == 0) inode = st.st_ino;
+    mq_close(mqd);
+  }
+  return inode;
+}
@@ -0,0 +1,37 @@
+#ifndef QUEUE_WATCH_H
+#define QUEUE_WATCH_H
+
+#include <limits.h>     // For NAME_MAX
+#include <sys/types.h>  // For ino_t
+
+#include "common.h"
+
+// Wait for a POSIX queue to be created without polling. Message queues and shm segments show up as
+// files in their filesystems, so an inotify watch on the directory fires as soon as a master
+// creates the queue. /dev/mqueue is only there when the mqueue filesystem is mounted; callers fall
+// back to sleep-and-retry when the watch cannot be set up.
+
+#define MQUEUE_DIR "/dev/mqueue"
+#define SHM_DIR "/dev/shm"
+
+typedef struct {
+  int fd;                   // inotify instance, -1 when not watching
+  char name[NAME_MAX + 1];  // File to wait for, the queue name without its leading '/'
+} queue_watch_t;
+
+// Start watching dir for queue_name (e.g. "/task_queue"). Call this before trying to open the queue,
+// so a creation between the failed open and the wait is not missed. Returns -1 when inotify or the
+// directory is unavailable.
+int queue_watch_init(queue_watch_t *watch, const char *dir, const char *queue_name);
+
+// Wait up to timeout_ms (< 0 forever) for the queue to be created. Returns 1 when it was, 0 on
+// timeout, -1 on error. Events for other files in the directory are skipped.
+int queue_watch_wait(queue_watch_t *watch, int timeout_ms);
+
+void queue_watch_close(queue_watch_t *watch);
+
+// Inode of the queue that carries this name right now, 0 if there is none. Compared with the inode
+// of an open queue, it tells whether the queue was unlinked (and maybe re-created) meanwhile.
+ino_t queue_inode(transport_t transport, const char *queue_name);
+
+#endif  // QUEUE_WATCH_H
@@ -0,0 +1,161 @@
+#include "reply_cache.h"
+
+#include <errno.h>     // For errno, ENOENT, ESRCH, ETIMEDOUT, EINTR
+#include <fcntl.h>     // For O_WRONLY, O_RDONLY
+#include <signal.h>    // For kill
+#include <stdio.h>     // For perror
+#include <string.h>    // For memset
+#include <sys/mman.h>  // For shm_open
+#include <sys/stat.h>  // For fstat, struct stat
+#include <time.h>      // For clock_gettime
+#include <unistd.h>    // For close
+
+void reply_cache_init(reply_cache_t *cache, transport_t transport) {
+  memset(cache, 0, sizeof(reply_cache_t));
+  cache->transport = transport;
+}
+
+static void close_entry(reply_entry_t *entry) {
+  if (entry->ring != NULL) shm_queue_close(entry->ring);
+  if (entry->producer_pid != 0 && entry->ring == NULL) mq_close(entry->mqd);
+  lease_table_close(entry->leases);
+  memset(entry, 0, sizeof(reply_entry_t));
+}
+
+// Inode of whatever queue currently carries the master's reply name, 0 if there is none
+static ino_t current_inode(const reply_cache_t *cache, pid_t producer_pid) {
+  char name[REPLY_NAME_MAX];
+  struct stat st;
+  ino_t inode = 0;
+
+  reply_queue_name(name, sizeof(name), cache->transport, producer_pid);
+  if (cache->transport == TRANSPORT_SHM) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) return 0;
+    if (fstat(fd, &st) == 0) inode = st.st_ino;
+    close(fd);
+  } else {
+    mqd_t mqd = mq_open(name, O_WRONLY);
+    if (mqd == (mqd_t)-1) return 0;
+    if (fstat(mqd, &st) == 0) inode = st.st_ino;
+    mq_close(mqd);
+  }
+  return inode;
+}
+
+// Find the master's entry, opening its queue (and evicting the least recently used entry) on a miss
+static reply_entry_t *lookup(reply_cache_t *cache, pid_t producer_pid) {
+  reply_entry_t *victim = &cache->entries[0];
+  char name[REPLY_NAME_MAX];
+
+  cache->clock++;
+  for (int i = 0; i < REPLY_CACHE_SIZE; ++i) {
+    reply_entry_t *entry = &cache->entries[i];
+    if (entry->producer_pid == producer_pid) {
+      entry->last_used = cache->clock;
+      cache->hits++;
+      return entry;
+    }
+    if (victim->producer_pid != 0 && (entry->producer_pid == 0 || entry->last_used < victim->last_used)) {
+      victim = entry;
+    }
+  }
+
+  if (victim->producer_pid != 0) {
+    close_entry(victim);
+    cache->evictions++;
+  }
+  reply_queue_name(name, sizeof(name), cache->transport, producer_pid);
+  if (cache->transport == TRANSPORT_SHM) {
+    victim->ring = shm_queue_open(name);
+    if (victim->ring == NULL) return NULL;
+    victim->inode = shm_queue_inode(victim->ring);
+    victim->capacity = 1;
+  } else {
+    struct mq_attr attr;
+    struct stat st;
+    victim->mqd = mq_open(name, O_WRONLY);
+    if (victim->mqd == (mqd_t)-1) return NULL;
+    mq_getattr(victim->mqd, &attr);
+    fstat(victim->mqd, &st);
+    victim->inode = st.st_ino;
+    victim->capacity = (int)(attr.mq_msgsize / sizeof(result_t));
+    if (victim->capacity > MAX_BATCH) victim->capacity = MAX_BATCH;
+  }
+  victim->leases = lease_table_open(producer_pid);
+  victim->producer_pid = producer_pid;
+  victim->last_used = cache->clock;
+  cache->opens++;
+  return victim;
+}
+
+static int master_alive(pid_t producer_pid) { return kill(producer_pid, 0) == 0 || errno != ESRCH; }
+
+int reply_cache_capacity(reply_cache_t *cache, pid_t producer_pid) {
+  reply_entry_t *entry = lookup(cache, producer_pid);
+  return entry == NULL ? 0 : entry->capacity;
+}
+
+lease_table_t *reply_cache_leases(reply_cache_t *cache, pid_t producer_pid) {
+  reply_entry_t *entry = lookup(cache, producer_pid);
+  return entry == NULL ? NULL : entry->leases;
+}
+
+int reply_cache_send(reply_cache_t *cache, pid_t producer_pid, const result_t *results, int count,
+                     unsigned int priority) {
+  reply_entry_t *entry = lookup(cache, producer_pid);
+  int sent = 0;
+
+  while (sent < count) {
+    if (entry == NULL) {
+      cache->dropped += count - sent;  // The master exited and removed its queue
+      return 0;
+    }
+
+    int rc;
+    if (entry->ring != NULL) {
+      rc = shm_queue_push(entry->ring, &results[sent], REPLY_SEND_TIMEOUT_NS);
+    } else {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += REPLY_SEND_TIMEOUT_NS;
+      deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+      deadline.tv_nsec %= 1000000000L;
+      rc = mq_timedsend(entry->mqd, (const char *)&results[sent], (count - sent) * sizeof(result_t), priority,
+                        &deadline);
+    }
+    if (rc == 0) {
+      sent = entry->ring != NULL ? sent + 1 : count;
+      continue;
+    }
+    if (errno == EINTR) continue;
+    if (errno != ETIMEDOUT) {
+      perror("reply send failed");
+      return -1;
+    }
+    // A full reply queue either has a slow master or nobody reading it any more
+    if (!master_alive(producer_pid)) {
+      close_entry(entry);
+      entry = NULL;
+    } else if (current_inode(cache, producer_pid) != entry->inode) {
+      // The PID was reused by a new master with a freshly created queue
+      close_entry(entry);
+      entry = lookup(cache, producer_pid);
+    }
+  }
+  return 0;
+}
+
+int reply_cache_live_masters(const reply_cache_t *cache) {
+  int live = 0;
+  for (int i = 0; i < REPLY_CACHE_SIZE; ++i) {
+    if (cache->entries[i].producer_pid != 0 && master_alive(cache->entries[i].producer_pid)) live++;
+  }
+  return live;
+}
+
+void reply_cache_close(reply_cache_t *cache) {
+  for (int i = 0; i < REPLY_CACHE_SIZE; ++i) {
+    if (cache->entries[i].producer_pid != 0) close_entry(&cache->entries[i]);
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef REPLY_CACHE_H
+#define REPLY_CACHE_H
+
+#include <mqueue.h>     // For mqd_t
+#include <sys/types.h>  // For pid_t, ino_t
+
+#include "common.h"
+#include "lease.h"
+#include "shm_queue.h"
+
+#define REPLY_CACHE_SIZE 64                // Reply queues a slave keeps open at once (LRU beyond that)
+#define REPLY_SEND_TIMEOUT_NS 100000000LL  // Send wait before checking whether the master is still alive
+
+// One master's reply queue (or ring) and in-flight table, kept open between messages
+typedef struct {
+  pid_t producer_pid;  // 0 = free slot
+  mqd_t mqd;
+  shm_queue_t *ring;
+  lease_table_t *leases;  // The master's in-flight table, NULL if it has none
+  ino_t inode;            // Identifies the queue, so a reused pid with a fresh queue is noticed
+  int capacity;           // Results per message the queue accepts
+  unsigned long last_used;
+} reply_entry_t;
+
+typedef struct {
+  transport_t transport;
+  reply_entry_t entries[REPLY_CACHE_SIZE];
+  unsigned long clock;
+  unsigned long hits;
+  unsigned long opens;
+  unsigned long evictions;
+  unsigned long dropped;  // Results whose master had already exited
+} reply_cache_t;
+
+void reply_cache_init(reply_cache_t *cache, transport_t transport);
+
+// Results per message for this master's reply queue (opens it if needed), 0 if it is gone
+int reply_cache_capacity(reply_cache_t *cache, pid_t producer_pid);
+
+// The master's in-flight table (opens its reply queue if needed), NULL if there is none
+lease_table_t *reply_cache_leases(reply_cache_t *cache, pid_t producer_pid);
+
+// Send up to reply_cache_capacity() results to one master at the given mq priority. Results for a
+// master that has exited are counted as dropped rather than reported as an error.
+int reply_cache_send(reply_cache_t *cache, pid_t producer_pid, const result_t *results, int count,
+                     unsigned int priority);
+
+// Masters in the cache that are still running
+int reply_cache_live_masters(const reply_cache_t *cache);
+
+void reply_cache_close(reply_cache_t *cache);
+
+#endif  // REPLY_CACHE_H
@@ -0,0 +1,273 @@
+#include "shm_queue.h"
+
+#include <errno.h>      // For errno, ENOENT, EINVAL, ETIMEDOUT
+#include <fcntl.h>      // For O_CREAT, O_EXCL, O_RDWR
+#include <stdatomic.h>  // For atomic_*
+#include <stdint.h>     // For uint32_t, intptr_t
+#include <stdio.h>      // For perror
+#include <stdlib.h>     // For malloc, free
+#include <string.h>     // For memcpy
+#include <sys/mman.h>   // For shm_open, shm_unlink, mmap, munmap
+#include <sys/stat.h>   // For fstat
+#include <time.h>       // For struct timespec, clock_gettime
+#include <unistd.h>     // For ftruncate, close, usleep
+
+#include "shm_futex.h"
+
+#define SHM_QUEUE_MAGIC 0x51554555u  // "QUEU", stored last once the creator has initialized the slots
+#define OPEN_RETRIES 1000            // 1 ms apart, while a creator is still initializing
+
+// Segment layout. Each hot counter has its own cache line.
+typedef struct {
+  _Atomic uint32_t magic;
+  uint32_t capacity;
+  uint32_t elem_size;
+  uint32_t slot_size;
+  _Alignas(64) _Atomic size_t enqueue_pos;
+  _Alignas(64) _Atomic size_t dequeue_pos;
+  _Alignas(64) _Atomic uint32_t not_empty;  // Futex word, bumped by producers when consumers wait
+  _Atomic uint32_t empty_waiters;
+  _Alignas(64) _Atomic uint32_t not_full;  // Futex word, bumped by consumers when producers wait
+  _Atomic uint32_t full_waiters;
+  _Alignas(64) _Atomic unsigned long long futex_waits;
+  _Atomic unsigned long long futex_wakes;
+  _Alignas(64) char slots[];  // capacity * slot_size: a sequence number followed by the element
+} shm_queue_header_t;
+
+typedef struct {
+  _Atomic size_t sequence;
+  char data[];
+} shm_queue_slot_t;
+
+struct shm_queue {
+  shm_queue_header_t *header;
+  size_t map_size;
+  ino_t inode;
+};
+
+static shm_queue_slot_t *slot_at(shm_queue_header_t *header, size_t pos) {
+  return (shm_queue_slot_t *)(header->slots + (pos & (header->capacity - 1)) * header->slot_size);
+}
+
+static shm_queue_t *map_queue(int fd, size_t size) {
+  shm_queue_t *queue = malloc(sizeof(shm_queue_t));
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  struct stat st;
+  st.st_ino = 0;
+  fstat(fd, &st);
+  close(fd);
+  if (queue == NULL || addr == MAP_FAILED) {
+    perror("shm_queue: mmap failed");
+    if (addr != MAP_FAILED) munmap(addr, size);
+    free(queue);
+    return NULL;
+  }
+  queue->header = addr;
+  queue->map_size = size;
+  queue->inode = st.st_ino;
+  return queue;
+}
+
+shm_queue_t *shm_queue_create(const char *name, unsigned int capacity, size_t elem_size) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0 || elem_size == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+  if (fd == -1) {
+    if (errno == EEXIST) return shm_queue_open(name);
+    perror("shm_queue: shm_open failed");
+    return NULL;
+  }
+
+  size_t slot_size = (sizeof(shm_queue_slot_t) + elem_size + 7) & ~(size_t)7;
+  size_t size = sizeof(shm_queue_header_t) + capacity * slot_size;
+  if (ftruncate(fd, (off_t)size) == -1) {
+    perror("shm_queue: ftruncate failed");
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  shm_queue_t *queue = map_queue(fd, size);
+  if (queue == NULL) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // The segment starts zeroed; slot i initially expects the producer at position i
+  shm_queue_header_t *header = queue->header;
+  header->capacity = capacity;
+  header->elem_size = (uint32_t)elem_size;
+  header->slot_size = (uint32_t)slot_size;
+  for (size_t i = 0; i < capacity; ++i) {
+    atomic_store_explicit(&slot_at(header, i)->sequence, i, memory_order_relaxed);
+  }
+  atomic_store_explicit(&header->magic, SHM_QUEUE_MAGIC, memory_order_release);
+  return queue;
+}
+
+shm_queue_t *shm_queue_open(const char *name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd == -1) return NULL;  // errno ENOENT lets the caller retry
+
+  // The creator may not have sized or initialized the segment yet
+  struct stat st;
+  for (int i = 0; i < OPEN_RETRIES; ++i) {
+    if (fstat(fd, &st) == -1) {
+      close(fd);
+      return NULL;
+    }
+    if ((size_t)st.st_size >= sizeof(shm_queue_header_t)) break;
+    usleep(1000);
+  }
+  shm_queue_t *queue = map_queue(fd, (size_t)st.st_size);
+  if (queue == NULL) return NULL;
+  for (int i = 0; i < OPEN_RETRIES; ++i) {
+    if (atomic_load_explicit(&queue->header->magic, memory_order_acquire) == SHM_QUEUE_MAGIC) return queue;
+    usleep(1000);
+  }
+  shm_queue_close(queue);
+  errno = ENOENT;
+  return NULL;
+}
+
+int shm_queue_try_push(shm_queue_t *queue, const void *elem) {
+  shm_queue_header_t *header = queue->header;
+  size_t pos = atomic_load_explicit(&header->enqueue_pos, memory_order_relaxed);
+  shm_queue_slot_t *slot;
+
+  while (1) {
+    slot = slot_at(header, pos);
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&header->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return -1;  // The slot still holds an element from the previous lap: full
+    } else {
+      pos = atomic_load_explicit(&header->enqueue_pos, memory_order_relaxed);
+    }
+  }
+  memcpy(slot->data, elem, header->elem_size);
+  atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+  // Only pay for a wake when a consumer has announced it is going to sleep
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&header->empty_waiters, memory_order_relaxed) > 0) {
+    atomic_fetch_add_explicit(&header->not_empty, 1, memory_order_release);
+    atomic_fetch_add_explicit(&header->futex_wakes, 1, memory_order_relaxed);
+    shm_futex_wake_all(&header->not_empty);
+  }
+  return 0;
+}
+
+int shm_queue_try_pop(shm_queue_t *queue, void *elem) {
+  shm_queue_header_t *header = queue->header;
+  size_t pos = atomic_load_explicit(&header->dequeue_pos, memory_order_relaxed);
+  shm_queue_slot_t *slot;
+
+  while (1) {
+    slot = slot_at(header, pos);
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&header->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return -1;  // Nothing published at this position yet: empty
+    } else {
+      pos = atomic_load_explicit(&header->dequeue_pos, memory_order_relaxed);
+    }
+  }
+  memcpy(elem, slot->data, header->elem_size);
+  atomic_store_explicit(&slot->sequence, pos + header->capacity, memory_order_release);
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&header->full_waiters, memory_order_relaxed) > 0) {
+    atomic_fetch_add_explicit(&header->not_full, 1, memory_order_release);
+    atomic_fetch_add_explicit(&header->futex_wakes, 1, memory_order_relaxed);
+    shm_futex_wake_all(&header->not_full);
+  }
+  return 0;
+}
+
+// Shared wait loop: register as a waiter, re-check, then sleep on the futex word until the other
+// side bumps it. Registering before the re-check closes the lost-wakeup window.
+static int wait_for(shm_queue_t *queue, void *elem, long long timeout_ns, int (*attempt)(shm_queue_t *, void *),
+                    _Atomic uint32_t *word, _Atomic uint32_t *waiters) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  long long end_ns = deadline.tv_sec * 1000000000LL + deadline.tv_nsec + timeout_ns;
+
+  while (1) {
+    if (attempt(queue, elem) == 0) return 0;
+
+    struct timespec remaining;
+    struct timespec *timeout = NULL;
+    if (timeout_ns >= 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      long long left = end_ns - (now.tv_sec * 1000000000LL + now.tv_nsec);
+      if (left <= 0) {
+        errno = ETIMEDOUT;
+        return -1;
+      }
+      remaining.tv_sec = left / 1000000000LL;
+      remaining.tv_nsec = left % 1000000000LL;
+      timeout = &remaining;
+    }
+
+    uint32_t seen = atomic_load_explicit(word, memory_order_acquire);
+    atomic_fetch_add_explicit(waiters, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (attempt(queue, elem) == 0) {
+      atomic_fetch_sub_explicit(waiters, 1, memory_order_relaxed);
+      return 0;
+    }
+    atomic_fetch_add_explicit(&queue->header->futex_waits, 1, memory_order_relaxed);
+    shm_futex_wait(word, seen, timeout);  // EAGAIN/EINTR/ETIMEDOUT all just loop back to the checks
+    atomic_fetch_sub_explicit(waiters, 1, memory_order_relaxed);
+  }
+}
+
+static int push_attempt(shm_queue_t *queue, void *elem) { return shm_queue_try_push(queue, elem); }
+
+int shm_queue_push(shm_queue_t *queue, const void *elem, long long timeout_ns) {
+  return wait_for(queue, (void *)elem, timeout_ns, push_attempt, &queue->header->not_full,
+                  &queue->header->full_waiters);
+}
+
+int shm_queue_pop(shm_queue_t *queue, void *elem, long long timeout_ns) {
+  return wait_for(queue, elem, timeout_ns, shm_queue_try_pop, &queue->header->not_empty,
+                  &queue->header->empty_waiters);
+}
+
+size_t shm_queue_elem_size(const shm_queue_t *queue) { return queue->header->elem_size; }
+
+unsigned int shm_queue_capacity(const shm_queue_t *queue) { return queue->header->capacity; }
+
+size_t shm_queue_depth(const shm_queue_t *queue) {
+  size_t dequeued = atomic_load_explicit(&queue->header->dequeue_pos, memory_order_relaxed);
+  size_t enqueued = atomic_load_explicit(&queue->header->enqueue_pos, memory_order_relaxed);
+  return enqueued > dequeued ? enqueued - dequeued : 0;  // Claimed positions, including ones mid-copy
+}
+
+ino_t shm_queue_inode(const shm_queue_t *queue) { return queue->inode; }
+
+void shm_queue_get_stats(const shm_queue_t *queue, shm_queue_stats_t *stats) {
+  stats->futex_waits = atomic_load_explicit(&queue->header->futex_waits, memory_order_relaxed);
+  stats->futex_wakes = atomic_load_explicit(&queue->header->futex_wakes, memory_order_relaxed);
+}
+
+void shm_queue_close(shm_queue_t *queue) {
+  if (queue == NULL) return;
+  munmap(queue->header, queue->map_size);
+  free(queue);
+}
+
+int shm_queue_unlink(const char *name) { return shm_unlink(name); }
@@ -0,0 +1,49 @@
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+
+#include <stddef.h>     // For size_t
+#include <sys/types.h>  // For ino_t
+
+// Bounded multi-producer/multi-consumer queue in a shm_open segment (Dmitry Vyukov's ring: every
+// slot carries a sequence number, so producers and consumers only CAS their own position counter).
+// Fixed-size elements are copied in and out. A full or empty queue is waited on with a shared
+// futex, and the futex is only woken when a waiter has registered, so the common path makes no
+// syscalls at all.
+
+typedef struct shm_queue shm_queue_t;
+
+typedef struct {
+  unsigned long long futex_waits;  // FUTEX_WAIT calls made on this queue, by every process
+  unsigned long long futex_wakes;  // FUTEX_WAKE calls made on this queue
+} shm_queue_stats_t;
+
+// Create the segment, or attach to it if another process created it already. capacity must be a
+// power of two.
+shm_queue_t *shm_queue_create(const char *name, unsigned int capacity, size_t elem_size);
+
+// Attach to an existing queue; fails with ENOENT if nobody created it yet
+shm_queue_t *shm_queue_open(const char *name);
+
+// Non-blocking variants: 0 on success, -1 when the queue is full/empty
+int shm_queue_try_push(shm_queue_t *queue, const void *elem);
+int shm_queue_try_pop(shm_queue_t *queue, void *elem);
+
+// Blocking variants. timeout_ns < 0 waits forever; on timeout they return -1 with errno ETIMEDOUT.
+int shm_queue_push(shm_queue_t *queue, const void *elem, long long timeout_ns);
+int shm_queue_pop(shm_queue_t *queue, void *elem, long long timeout_ns);
+
+size_t shm_queue_elem_size(const shm_queue_t *queue);
+unsigned int shm_queue_capacity(const shm_queue_t *queue);
+
+// Elements currently queued; a racy snapshot, good enough for monitoring
+size_t shm_queue_depth(const shm_queue_t *queue);
+
+// Inode of the segment, to tell a re-created queue of the same name from the one we have mapped
+ino_t shm_queue_inode(const shm_queue_t *queue);
+void shm_queue_get_stats(const shm_queue_t *queue, shm_queue_stats_t *stats);
+
+// Unmap; the segment stays until shm_queue_unlink
+void shm_queue_close(shm_queue_t *queue);
+int shm_queue_unlink(const char *name);
+
+#endif  // SHM_QUEUE_H
@@ -1,117 +1,312 @@
-#include <errno.h>   // For errno
-#include <fcntl.h>   // For O_RDONLY, O_WRONLY
-#include <mqueue.h>  // For mq_open, mq_receive, mq_send, mq_close
-#include <stdio.h>   // For printf, perror
-#include <stdlib.h>  // For EXIT_SUCCESS, EXIT_FAILURE
-#include <unistd.h>  // For getpid, sleep
+#include <errno.h>     // For errno, ENOENT, ETIMEDOUT
+#include <fcntl.h>     // For O_RDONLY, O_WRONLY
+#include <getopt.h>    // For getopt_long
+#include <mqueue.h>    // For mq_open, mq_timedreceive, mq_close, mq_getattr
+#include <stdio.h>     // For printf, perror
+#include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE, atof, realloc
+#include <sys/stat.h>  // For fstat, struct stat
+#include <time.h>      // For nanosleep, clock_gettime
+#include <unistd.h>    // For getpid, sleep
 
 #include "common.h"
+#include "queue_watch.h"
+#include "reply_cache.h"
+#include "shm_queue.h"
 
-#define RETRY_DELAY_SEC 1  // Seconds to wait before retrying mq_open
+#define RETRY_DELAY_SEC 1  // Seconds between open retries when the queue directory cannot be watched
+#define DEFAULT_RATE 1     // Tasks per second of simulated work, the original sleep(1) per task
+#define IDLE_CHECK_SEC 1   // Idle time after which a slave checks whether its task queue was abandoned
 
-int main(void) {
-  mqd_t task_mq;
-  mqd_t result_mq;
-  pid_t consumer_pid = getpid();
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-  printf("Slave (PID %d): Starting consumer.\n", consumer_pid);
+// Compute one task; work is the simulated per-task delay (zero for none). A task whose deadline
+// has already passed is answered RESULT_EXPIRED without doing the work; returns 1 in that case.
+int process_task(const task_t *task, result_t *result, pid_t consumer_pid, const struct timespec *work, int quiet) {
+  result->consumer_pid = consumer_pid;
+  result->producer_pid = task->producer_pid;
+  result->task_id = task->task_id;
+  result->result = 0;
+  result->status = RESULT_OK;
+  if (task->deadline_ns != 0 && now_ns() > task->deadline_ns) {
+    result->status = RESULT_EXPIRED;
+    return 1;
+  }
 
-  // Open Task Queue (for receiving tasks)
-  // Open it in read-only mode, it must already exist (created by master)
-  // Loop until the queue is available
-  task_mq = mq_open(TASK_QUEUE_NAME, O_RDONLY);
+  // Simulate "difficult" work
+  if (work->tv_sec > 0 || work->tv_nsec > 0) nanosleep(work, NULL);
+  int sum = task->a + task->b;
+  // Display results
+  if (!quiet) {
+    printf("    Slave PID: %d, Master PID: %d, Task ID %d: Result: %d + %d = %d\n", consumer_pid, task->producer_pid,
+           task->task_id, task->a, task->b, sum);
+  }
+  result->result = sum;
+  return 0;
+}
+
+// Wait for a master to create the queue. With an inotify watch on the queue's directory we wake up
+// as soon as it appears (re-checking every RETRY_DELAY_SEC anyway); without one, sleep and retry.
+void wait_for_queue(queue_watch_t *watch, int attempt, pid_t consumer_pid, const char *what, const char *name) {
+  if (watch->fd == -1) {
+    fprintf(stderr, "Slave (PID %d): %s '%s' not found. Retrying in %d seconds...\n", consumer_pid, what, name,
+            RETRY_DELAY_SEC);
+    sleep(RETRY_DELAY_SEC);
+    return;
+  }
+  if (attempt == 0) {
+    fprintf(stderr, "Slave (PID %d): %s '%s' not found. Waiting for it to be created...\n", consumer_pid, what, name);
+  }
+  if (queue_watch_wait(watch, RETRY_DELAY_SEC * 1000) == -1) {
+    perror("queue_watch_wait failed");
+    queue_watch_close(watch);  // Fall back to sleeping
+  }
+}
+
+// The last master to leave unlinks the task queue, but the queue lives on while we hold it open. Once
+// the name points to another queue (or none) and none of the masters we served is running, nobody
+// will send on ours again: drop it and wait for the next master's queue.
+int queue_abandoned(transport_t transport, const char *name, ino_t inode, const reply_cache_t *replies) {
+  return queue_inode(transport, name) != inode && reply_cache_live_masters(replies) == 0;
+}
+
+// Loop until a master has created the task ring; reply rings are opened on demand
+shm_queue_t *open_task_ring(pid_t consumer_pid) {
+  shm_queue_t *task_ring;
+  queue_watch_t watch;
+
+  queue_watch_init(&watch, SHM_DIR, SHM_TASK_QUEUE_NAME);
+  for (int attempt = 0; (task_ring = shm_queue_open(SHM_TASK_QUEUE_NAME)) == NULL; ++attempt) {
+    if (errno != ENOENT) {
+      perror("shm_queue_open failed unexpectedly");
+      break;
+    }
+    wait_for_queue(&watch, attempt, consumer_pid, "Task ring", SHM_TASK_QUEUE_NAME);
+  }
+  queue_watch_close(&watch);
+  if (task_ring != NULL) {
+    printf("Slave (PID %d): Task ring '%s' opened successfully.\n", consumer_pid, SHM_TASK_QUEUE_NAME);
+  }
+  return task_ring;
+}
+
+// Shared-memory transport: pop one task, push one result, both blocking on the rings' futexes
+int serve_shm(pid_t consumer_pid, const struct timespec *work, int quiet, reply_cache_t *replies) {
+  shm_queue_t *task_ring = open_task_ring(consumer_pid);
+  long processed = 0;
+  long expired = 0;
+
+  if (task_ring == NULL) return EXIT_FAILURE;
+  printf("Slave (PID %d): Waiting for tasks...\n", consumer_pid);
   while (1) {
-    task_mq = mq_open(TASK_QUEUE_NAME, O_RDONLY);
-    if (task_mq == (mqd_t)-1) {
+    task_t task;
+    result_t result;
+    if (shm_queue_pop(task_ring, &task, IDLE_CHECK_SEC * 1000000000LL) == -1) {
+      if (errno == ETIMEDOUT) {
+        if (!queue_abandoned(TRANSPORT_SHM, SHM_TASK_QUEUE_NAME, shm_queue_inode(task_ring), replies)) continue;
+        printf("Slave (PID %d): Task ring was removed and its masters are gone.\n", consumer_pid);
+        shm_queue_close(task_ring);
+        if ((task_ring = open_task_ring(consumer_pid)) == NULL) return EXIT_FAILURE;
+        continue;
+      }
+      perror("shm_queue_pop task failed");
+      break;
+    }
+    if (task.task_id == STOP_TASK_ID) break;
+    lease_take(reply_cache_leases(replies, task.producer_pid), task.task_id, consumer_pid, now_ns());
+    expired += process_task(&task, &result, consumer_pid, work, quiet);
+    if (reply_cache_send(replies, task.producer_pid, &result, 1, class_priorities[task.task_class]) == -1) break;
+    processed++;
+  }
+
+  printf("Slave (PID %d): Processed %ld tasks (%ld expired unprocessed), exiting.\n", consumer_pid, processed, expired);
+  shm_queue_close(task_ring);
+  return EXIT_SUCCESS;
+}
+
+// Open the task queue, waiting until a master creates it, and size the receive buffer for it: a
+// message holds as many tasks as the master packed into it
+int attach_task_queue(pid_t consumer_pid, mqd_t *task_mq, struct mq_attr *attr, struct stat *st, task_t **tasks) {
+  queue_watch_t watch;
+
+  // Loop until the queue is available. The watch is set up first so a queue created between a
+  // failed mq_open and the wait still wakes us.
+  queue_watch_init(&watch, MQUEUE_DIR, TASK_QUEUE_NAME);
+  for (int attempt = 0;; ++attempt) {
+    *task_mq = mq_open(TASK_QUEUE_NAME, O_RDONLY);
+    if (*task_mq == (mqd_t)-1) {
       if (errno == ENOENT) {
-        fprintf(stderr, "Slave (PID %d): Task queue '%s' not found. Retrying in %d seconds...\n", consumer_pid,
-                TASK_QUEUE_NAME, RETRY_DELAY_SEC);
-        sleep(RETRY_DELAY_SEC);
+        wait_for_queue(&watch, attempt, consumer_pid, "Task queue", TASK_QUEUE_NAME);
       } else {
         perror("mq_open task_mq failed unexpectedly");
-        return EXIT_FAILURE;
+        queue_watch_close(&watch);
+        return -1;
       }
     } else {
       printf("Slave (PID %d): Task queue '%s' opened successfully.\n", consumer_pid, TASK_QUEUE_NAME);
       break;
     }
   }
+  queue_watch_close(&watch);
 
-  // Open Result Queue (for sending results)
-  // Open it in write-only mode, it must already exist (created by master)
-  // Loop until the queue is available
-  while (1) {
-    result_mq = mq_open(RESULT_QUEUE_NAME, O_WRONLY);
-    if (result_mq == (mqd_t)-1) {
-      if (errno == ENOENT) {  // Queue does not exist
-        fprintf(stderr, "Slave (PID %d): Result queue '%s' not found. Retrying in %d seconds...\n", consumer_pid,
-                RESULT_QUEUE_NAME, RETRY_DELAY_SEC);
-        sleep(RETRY_DELAY_SEC);
-      } else {
-        perror("mq_open result_mq failed unexpectedly");
-        mq_close(task_mq);
+  if (mq_getattr(*task_mq, attr) == -1 || fstat(*task_mq, st) == -1) {
+    perror("mq_getattr/fstat failed");
+    return -1;
+  }
+  task_t *buffer = realloc(*tasks, attr->mq_msgsize);
+  if (buffer == NULL) {
+    fprintf(stderr, "Slave (PID %d): Cannot size task/result buffers.\n", consumer_pid);
+    return -1;
+  }
+  *tasks = buffer;
+  return 0;
+}
+
+void print_cache_stats(pid_t consumer_pid, const reply_cache_t *replies) {
+  printf("Slave (PID %d): Reply queues: %lu cache hits, %lu opens, %lu evictions, %lu results dropped\n",
+         consumer_pid, replies->hits, replies->opens, replies->evictions, replies->dropped);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"rate", required_argument, NULL, 'r'},
+                                         {"quiet", no_argument, NULL, 'q'},
+                                         {"transport", required_argument, NULL, 't'},
+                                         {NULL, 0, NULL, 0}};
+  mqd_t task_mq;
+  pid_t consumer_pid = getpid();
+  reply_cache_t replies;
+  transport_t transport = TRANSPORT_MQ;
+  double rate = DEFAULT_RATE;
+  int quiet = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "r:qt:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 't':
+        if (parse_transport(optarg, &transport) == -1) {
+          fprintf(stderr, "Unknown transport '%s' (mq or shm).\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 'q':
+        quiet = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [--transport mq|shm] [--rate TASKS_PER_SEC (0 = no simulated work)] [--quiet]\n",
+                argv[0]);
         return EXIT_FAILURE;
-      }
-    } else {
-      printf("Slave (PID %d): Result queue '%s' opened successfully.\n", consumer_pid, RESULT_QUEUE_NAME);
-      break;
     }
   }
+  struct timespec work = {.tv_sec = 0, .tv_nsec = 0};
+  if (rate > 0) {
+    work.tv_sec = (time_t)(1.0 / rate);
+    work.tv_nsec = (long)((1.0 / rate - work.tv_sec) * 1e9);
+  }
 
-  // Infinite loop to process tasks
+  printf("Slave (PID %d): Starting consumer.\n", consumer_pid);
+  reply_cache_init(&replies, transport);
+  if (transport == TRANSPORT_SHM) {
+    int rc = serve_shm(consumer_pid, &work, quiet, &replies);
+    print_cache_stats(consumer_pid, &replies);
+    reply_cache_close(&replies);
+    return rc;
+  }
+
+  // Open Task Queue (for receiving tasks)
+  // Open it in read-only mode, it must already exist (created by master). Results go back to each
+  // task's own master, batched up to the message size of that master's reply queue.
+  struct mq_attr task_attr;
+  struct stat task_stat;
+  task_t *tasks = NULL;
+  result_t results[MAX_BATCH];
+  if (attach_task_queue(consumer_pid, &task_mq, &task_attr, &task_stat, &tasks) == -1) return EXIT_FAILURE;
+  long processed = 0;
+  long messages = 0;
+  long expired = 0;
+
+  // Loop to process tasks until a stop message arrives
   printf("Slave (PID %d): Waiting for tasks...\n", consumer_pid);
   while (1) {
-    task_t task;
     unsigned int prio;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += IDLE_CHECK_SEC;
 
-    ssize_t bytes_read = mq_receive(task_mq, (char *)&task, sizeof(task_t), &prio);
+    ssize_t bytes_read = mq_timedreceive(task_mq, (char *)tasks, task_attr.mq_msgsize, &prio, &deadline);
     if (bytes_read == -1) {
-      if (errno == EAGAIN) {
-        // This would happen if mq_flags was O_NONBLOCK and no messages were available
+      if (errno == ETIMEDOUT) {
+        if (!queue_abandoned(TRANSPORT_MQ, TASK_QUEUE_NAME, task_stat.st_ino, &replies)) continue;
+        printf("Slave (PID %d): Task queue was removed and its masters are gone.\n", consumer_pid);
+        mq_close(task_mq);
+        if (attach_task_queue(consumer_pid, &task_mq, &task_attr, &task_stat, &tasks) == -1) return EXIT_FAILURE;
+        continue;
+      }
+      if (errno == EAGAIN || errno == EINTR) {
+        // EAGAIN would happen if mq_flags was O_NONBLOCK and no messages were available
         continue;
       }
       perror("mq_receive task failed");
       // A read error could mean the queue was unlinked by the master.
       break;
     } else if (bytes_read == 0) {
-      // This generally means the queue was empty and then closed by all writers.
-      // For POSIX MQs, a 0-byte read isn't typical for EOF like pipes.
-      // mq_receive would block until a message is available or error.
-      // If all producers have closed, mq_receive will continue to block.
-      // The typical way for a consumer to know it's done is via a special "terminate" message.
-      // For now, we'll rely on the master unlinking and then the slave
-      // getting an error on subsequent mq_receive attempts or being killed.
+      // Zero-length message: the master asks us to stop
+      break;
     }
 
-    // Simulate "difficult" work
-    sleep(1);
-    int sum = task.a + task.b;
-    // Display results
-    printf("    Slave PID: %d, Master PID: %d, Task ID %d: Result: %d + %d = %d\n", consumer_pid, task.producer_pid,
-           task.task_id, task.a, task.b, sum);
+    // A batch holds one class of one master, so its results go back at the priority it arrived with
+    int count = (int)(bytes_read / sizeof(task_t));
+    int pending = 0;
+    int failed = 0;
+    messages++;
 
+    // Record that we hold these tasks, so the master can redeliver them if we die
+    long long taken = now_ns();
+    lease_table_t *leases = NULL;
+    for (int i = 0; i < count; ++i) {
+      if (i == 0 || tasks[i].producer_pid != tasks[i - 1].producer_pid) {
+        leases = reply_cache_leases(&replies, tasks[i].producer_pid);
+      }
+      lease_take(leases, tasks[i].task_id, consumer_pid, taken);
+    }
+    for (int i = 0; i < count && !failed; ++i) {
+      // Flush whenever the producer changes, in case a batch mixes masters
+      if (pending > 0 && tasks[i].producer_pid != results[0].producer_pid) {
+        failed = reply_cache_send(&replies, results[0].producer_pid, results, pending, prio) == -1;
+        pending = 0;
+      }
+      // Queue the result for the producer
+      expired += process_task(&tasks[i], &results[pending++], consumer_pid, &work, quiet);
+      int capacity = reply_cache_capacity(&replies, tasks[i].producer_pid);
+      if (pending >= capacity) {
+        failed = reply_cache_send(&replies, results[0].producer_pid, results, pending, prio) == -1;
+        pending = 0;
+      }
+    }
     // Send result back to producer
-    result_t result;
-    result.consumer_pid = consumer_pid;
-    result.producer_pid = task.producer_pid;
-    result.task_id = task.task_id;
-    result.result = sum;
-
-    if (mq_send(result_mq, (const char *)&result, sizeof(result_t), MSG_PRIO) == -1) {
-      perror("mq_send result failed");
-      // This could happen if the result queue was closed/unlinked by the master prematurely
+    if (failed ||
+        (pending > 0 && reply_cache_send(&replies, results[0].producer_pid, results, pending, prio) == -1)) {
       break;  // Exit loop on send error
     }
+    processed += count;
   }
 
+  printf("Slave (PID %d): Processed %ld tasks from %ld messages (%ld expired unprocessed), exiting.\n", consumer_pid,
+         processed, messages, expired);
+  print_cache_stats(consumer_pid, &replies);
+  reply_cache_close(&replies);
+  free(tasks);
+
   // Cleanup
-  // Slave does not unlink the queues. Only the master does that.
+  // Slave does not unlink the queues. Only the last master using the task queue does that.
   if (mq_close(task_mq) == -1) {
     perror("mq_close task_mq failed");
   }
-  if (mq_close(result_mq) == -1) {
-    perror("mq_close result_mq failed");
-  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,371 @@
+// Supervisor for the slave pool: spawns and reaps slaves, scales the pool between --min and --max
+// on the task queue backlog (mq_curmsgs, or the ring depth for --transport shm), and replaces slaves
+// that die. Slaves are stopped the same way a master stops them, with a stop message on the task
+// queue, so they finish what they hold first.
+#include <errno.h>     // For errno, EAGAIN, ECHILD
+#include <fcntl.h>     // For O_WRONLY, O_NONBLOCK
+#include <getopt.h>    // For getopt_long
+#include <limits.h>    // For PATH_MAX
+#include <mqueue.h>    // For mq_open, mq_send, mq_getattr, mq_close
+#include <signal.h>    // For sigaction, kill, SIGTERM
+#include <spawn.h>     // For posix_spawn
+#include <stdio.h>     // For printf, perror
+#include <stdlib.h>    // For atoi, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>    // For strcpy, strrchr
+#include <sys/stat.h>  // For fstat, struct stat
+#include <sys/wait.h>  // For waitpid, WIFEXITED, WEXITSTATUS, WIFSIGNALED, WTERMSIG
+#include <time.h>      // For nanosleep, clock_gettime
+#include <unistd.h>    // For getpid, readlink, close
+
+#include "common.h"
+#include "queue_watch.h"
+#include "shm_queue.h"
+
+#define MAX_SLAVES 64
+#define DEFAULT_MIN_SLAVES 1
+#define DEFAULT_MAX_SLAVES 8
+#define DEFAULT_INTERVAL_MS 100  // Time between backlog checks
+#define DEFAULT_HIGH_PERCENT 50  // Add a slave each check while the queue is at least this full
+#define DEFAULT_IDLE_CHECKS 10   // Remove a slave after this many checks in a row with an empty queue
+#define SHUTDOWN_GRACE_MS 2000   // Before slaves that did not take a stop message get SIGTERM
+
+extern char **environ;
+
+// The task queue of whichever master is currently running
+typedef struct {
+  mqd_t mqd;
+  shm_queue_t *ring;
+  ino_t inode;  // 0 = not open
+} task_queue_t;
+
+typedef struct {
+  transport_t transport;
+  pid_t supervisor_pid;
+  char path[PATH_MAX];  // The slave binary next to ours
+  char *slave_argv[8];
+  pid_t pids[MAX_SLAVES];
+  int running;   // Slaves alive
+  int stopping;  // Stop messages sent that no slave has exited for yet
+  int target;    // Slaves we want serving: running - stopping
+  task_queue_t queue;
+  long spawned;
+  long crashed;
+  long scale_ups;
+  long scale_downs;
+} supervisor_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+void handle_stop_signal(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+long long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void sleep_ms(int ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);  // A stop signal cuts it short, which is what we want
+}
+
+int open_task_queue(transport_t transport, task_queue_t *queue) {
+  struct stat st;
+  if (transport == TRANSPORT_SHM) {
+    queue->ring = shm_queue_open(SHM_TASK_QUEUE_NAME);
+    if (queue->ring == NULL) return -1;
+    queue->inode = shm_queue_inode(queue->ring);
+    return 0;
+  }
+  queue->mqd = mq_open(TASK_QUEUE_NAME, O_WRONLY | O_NONBLOCK);
+  if (queue->mqd == (mqd_t)-1) return -1;
+  if (fstat(queue->mqd, &st) == -1) {
+    mq_close(queue->mqd);
+    return -1;
+  }
+  queue->inode = st.st_ino;
+  return 0;
+}
+
+void close_task_queue(task_queue_t *queue) {
+  if (queue->inode == 0) return;
+  if (queue->ring != NULL) {
+    shm_queue_close(queue->ring);
+  } else {
+    mq_close(queue->mqd);
+  }
+  queue->ring = NULL;
+  queue->inode = 0;
+}
+
+// Tasks (mq: messages) waiting in the queue, and how many it holds
+long queue_backlog(const task_queue_t *queue, long *capacity) {
+  if (queue->ring != NULL) {
+    *capacity = shm_queue_capacity(queue->ring);
+    return (long)shm_queue_depth(queue->ring);
+  }
+  struct mq_attr attr;
+  if (mq_getattr(queue->mqd, &attr) == -1) {
+    perror("mq_getattr task_mq failed");
+    *capacity = 1;
+    return 0;
+  }
+  *capacity = attr.mq_maxmsg;
+  return attr.mq_curmsgs;
+}
+
+// Ask one slave reading this queue to exit: a zero-length message or a STOP_TASK_ID task, queued
+// behind the tasks already there. Never blocks; -1 when the queue is full.
+int send_stop(task_queue_t *queue) {
+  if (queue->ring != NULL) {
+    task_t stop = {.producer_pid = getpid(), .task_id = STOP_TASK_ID, .task_class = CLASS_BULK};
+    return shm_queue_try_push(queue->ring, &stop);
+  }
+  return mq_send(queue->mqd, "", 0, class_priorities[CLASS_BULK]);
+}
+
+int spawn_slave(supervisor_t *sup) {
+  pid_t pid;
+  if (sup->running >= MAX_SLAVES) return -1;
+  int rc = posix_spawn(&pid, sup->path, NULL, NULL, sup->slave_argv, environ);
+  if (rc != 0) {
+    errno = rc;
+    perror("posix_spawn slave failed");
+    return -1;
+  }
+  sup->pids[sup->running++] = pid;
+  sup->spawned++;
+  return 0;
+}
+
+// Collect every slave that exited. A clean exit answers one of our stop messages (or a master's);
+// anything else is a crash. Either way the pool is topped up to target afterwards.
+void reap_slaves(supervisor_t *sup) {
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (int i = 0; i < sup->running; ++i) {
+      if (sup->pids[i] == pid) {
+        sup->pids[i] = sup->pids[--sup->running];
+        break;
+      }
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+      if (sup->stopping > 0) sup->stopping--;
+      continue;
+    }
+    sup->crashed++;
+    if (WIFSIGNALED(status)) {
+      printf("Supervisor (PID %d): Slave %d killed by signal %d, replacing it.\n", sup->supervisor_pid, pid,
+             WTERMSIG(status));
+    } else {
+      printf("Supervisor (PID %d): Slave %d exited with status %d, replacing it.\n", sup->supervisor_pid, pid,
+             WEXITSTATUS(status));
+    }
+  }
+}
+
+void top_up(supervisor_t *sup) {
+  while (sup->running - sup->stopping < sup->target) {
+    if (spawn_slave(sup) == -1) break;
+  }
+}
+
+// Follow the task queue from master to master: the last master to exit unlinks it and the next one
+// creates a new one. Slaves left on the old queue move on by themselves once its masters are gone.
+void track_queue(supervisor_t *sup) {
+  const char *name = sup->transport == TRANSPORT_SHM ? SHM_TASK_QUEUE_NAME : TASK_QUEUE_NAME;
+  if (sup->queue.inode != 0 && queue_inode(sup->transport, name) != sup->queue.inode) {
+    close_task_queue(&sup->queue);
+    printf("Supervisor (PID %d): Task queue '%s' was removed.\n", sup->supervisor_pid, name);
+  }
+  if (sup->queue.inode == 0 && open_task_queue(sup->transport, &sup->queue) == 0) {
+    printf("Supervisor (PID %d): Task queue '%s' opened, %d slave(s) running.\n", sup->supervisor_pid, name,
+           sup->running);
+  }
+}
+
+// One step up while the backlog is above the high-water mark, one step down after idle_checks
+// empty checks in a row
+void scale(supervisor_t *sup, int min_slaves, int max_slaves, int high_percent, int idle_checks, int *idle) {
+  long capacity;
+  long backlog = queue_backlog(&sup->queue, &capacity);
+
+  if (backlog * 100 >= high_percent * capacity && backlog > 0) {
+    *idle = 0;
+    if (sup->target < max_slaves) {
+      sup->target++;
+      sup->scale_ups++;
+      printf("Supervisor (PID %d): Backlog %ld/%ld, scaling up to %d slave(s).\n", sup->supervisor_pid, backlog,
+             capacity, sup->target);
+    }
+  } else if (backlog == 0) {
+    if (++*idle >= idle_checks && sup->target > min_slaves && send_stop(&sup->queue) == 0) {
+      *idle = 0;
+      sup->target--;
+      sup->stopping++;
+      sup->scale_downs++;
+      printf("Supervisor (PID %d): Queue idle, scaling down to %d slave(s).\n", sup->supervisor_pid, sup->target);
+    }
+  } else {
+    *idle = 0;
+  }
+}
+
+// Stop messages first so slaves finish their current batch; SIGTERM for whoever is left after the
+// grace period (e.g. slaves still waiting for a queue to appear)
+void shutdown_slaves(supervisor_t *sup) {
+  if (sup->queue.inode != 0) {
+    for (int i = sup->running - sup->stopping; i > 0 && send_stop(&sup->queue) == 0; --i) {
+      sup->stopping++;
+    }
+  }
+  long long deadline = now_ms() + SHUTDOWN_GRACE_MS;
+  while (sup->running > 0 && now_ms() < deadline) {
+    reap_slaves(sup);
+    sleep_ms(10);
+  }
+  for (int i = 0; i < sup->running; ++i) kill(sup->pids[i], SIGTERM);
+  while (sup->running > 0) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid == -1) break;
+    for (int i = 0; i < sup->running; ++i) {
+      if (sup->pids[i] == pid) sup->pids[i] = sup->pids[--sup->running];
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"min", required_argument, NULL, 'm'},
+                                         {"max", required_argument, NULL, 'M'},
+                                         {"transport", required_argument, NULL, 't'},
+                                         {"rate", required_argument, NULL, 'r'},
+                                         {"quiet", no_argument, NULL, 'q'},
+                                         {"interval-ms", required_argument, NULL, 'i'},
+                                         {"high", required_argument, NULL, 'h'},
+                                         {"idle-checks", required_argument, NULL, 'I'},
+                                         {"duration", required_argument, NULL, 'd'},
+                                         {NULL, 0, NULL, 0}};
+  supervisor_t sup = {.supervisor_pid = getpid(), .transport = TRANSPORT_MQ};
+  int min_slaves = DEFAULT_MIN_SLAVES;
+  int max_slaves = DEFAULT_MAX_SLAVES;
+  int interval_ms = DEFAULT_INTERVAL_MS;
+  int high_percent = DEFAULT_HIGH_PERCENT;
+  int idle_checks = DEFAULT_IDLE_CHECKS;
+  int duration_sec = 0;
+  char *rate = NULL;
+  int quiet = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "m:M:t:r:qi:h:I:d:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'm':
+        min_slaves = atoi(optarg);
+        break;
+      case 'M':
+        max_slaves = atoi(optarg);
+        break;
+      case 't':
+        if (parse_transport(optarg, &sup.transport) == -1) {
+          fprintf(stderr, "Unknown transport '%s' (mq or shm).\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'r':
+        rate = optarg;
+        break;
+      case 'q':
+        quiet = 1;
+        break;
+      case 'i':
+        interval_ms = atoi(optarg);
+        break;
+      case 'h':
+        high_percent = atoi(optarg);
+        break;
+      case 'I':
+        idle_checks = atoi(optarg);
+        break;
+      case 'd':
+        duration_sec = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [--min N] [--max N] [--transport mq|shm] [--rate TASKS_PER_SEC] [--quiet]\n"
+                "          [--interval-ms MS] [--high PERCENT] [--idle-checks N] [--duration SEC (0 = until signal)]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (min_slaves < 0 || max_slaves < 1 || max_slaves > MAX_SLAVES || min_slaves > max_slaves || interval_ms < 1 ||
+      high_percent < 1 || high_percent > 100 || idle_checks < 1) {
+    fprintf(stderr, "Need 0 <= min <= max <= %d, interval >= 1 ms, 1 <= high <= 100, idle checks >= 1.\n",
+            MAX_SLAVES);
+    return EXIT_FAILURE;
+  }
+
+  // Slaves are the sibling binary, started with the options we forward
+  ssize_t len = readlink("/proc/self/exe", sup.path, sizeof(sup.path) - sizeof("slave"));
+  if (len == -1) {
+    perror("readlink /proc/self/exe failed");
+    return EXIT_FAILURE;
+  }
+  sup.path[len] = '\0';
+  strcpy(strrchr(sup.path, '/') + 1, "slave");
+  int argn = 0;
+  sup.slave_argv[argn++] = sup.path;
+  sup.slave_argv[argn++] = "--transport";
+  sup.slave_argv[argn++] = (char *)transport_names[sup.transport];
+  if (rate != NULL) {
+    sup.slave_argv[argn++] = "--rate";
+    sup.slave_argv[argn++] = rate;
+  }
+  if (quiet) sup.slave_argv[argn++] = "--quiet";
+  sup.slave_argv[argn] = NULL;
+
+  struct sigaction sa = {.sa_handler = handle_stop_signal};
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  // Until a master creates the queue, wake on its creation rather than on the next check
+  queue_watch_t watch;
+  const char *dir = sup.transport == TRANSPORT_SHM ? SHM_DIR : MQUEUE_DIR;
+  const char *queue_name = sup.transport == TRANSPORT_SHM ? SHM_TASK_QUEUE_NAME : TASK_QUEUE_NAME;
+  if (queue_watch_init(&watch, dir, queue_name) == -1) {
+    printf("Supervisor (PID %d): Cannot watch %s, checking for the task queue every %d ms.\n", sup.supervisor_pid,
+           dir, interval_ms);
+  }
+
+  sup.target = min_slaves;
+  top_up(&sup);
+  printf("Supervisor (PID %d): Started %d slave(s) over %s (min %d, max %d).\n", sup.supervisor_pid, sup.running,
+         transport_names[sup.transport], min_slaves, max_slaves);
+
+  long long end_ms = duration_sec > 0 ? now_ms() + duration_sec * 1000LL : 0;
+  int idle = 0;
+  while (!stop_requested && (end_ms == 0 || now_ms() < end_ms)) {
+    reap_slaves(&sup);
+    track_queue(&sup);
+    if (sup.queue.inode != 0) scale(&sup, min_slaves, max_slaves, high_percent, idle_checks, &idle);
+    top_up(&sup);
+
+    if (sup.queue.inode == 0 && watch.fd != -1) {
+      queue_watch_wait(&watch, interval_ms);
+    } else {
+      sleep_ms(interval_ms);
+    }
+  }
+
+  printf("Supervisor (PID %d): Stopping %d slave(s)...\n", sup.supervisor_pid, sup.running);
+  shutdown_slaves(&sup);
+  close_task_queue(&sup.queue);
+  queue_watch_close(&watch);
+  printf("Supervisor (PID %d): %ld slave(s) spawned, %ld crashed and replaced, %ld scale-ups, %ld scale-downs.\n",
+         sup.supervisor_pid, sup.spawned, sup.crashed, sup.scale_ups, sup.scale_downs);
+  return EXIT_SUCCESS;
+}
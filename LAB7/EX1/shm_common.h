@@ -1,7 +1,81 @@
 #ifndef SHM_COMMON_H
 #define SHM_COMMON_H
 
+#include <pthread.h>    // For pthread_mutex_t
+#include <stdatomic.h>  // For _Atomic
+
 #define SHM_NAME "/my_shared_memory"
-#define SHM_SIZE 1024  // Size of the shared memory segment in bytes
+#define SHM_HEAP_MB 64               // Default heap of a new store
+#define SHM_FLAGS HUGE_SHM_POPULATE  // Prefaulted; huge pages stay opt-in (see huge_shm.h)
+
+#define STORE_MAGIC 0x45524F54u  // "TORE", stored last once the creator has initialized the segment
+#define STORE_VERSION 2          // Bumped whenever the layout changes
+#define STORE_PAGE_SIZE 4096     // The header fits in one small page
+#define STORE_MAX_OBJECTS 256    // Entries in the object table
+#define STORE_KEY_MAX 64         // Bytes of a key, with its terminating NUL
+#define STORE_MIN_CLASS 6        // Smallest block: 64 bytes, one cache line
+#define STORE_CLASSES 48         // Block sizes 2^6 .. 2^47 bytes
+
+// What an object holds; readers check it before they interpret the bytes
+typedef enum {
+  STORE_BYTES = 1,
+  STORE_STRING = 2,  // NUL-terminated, the NUL counted in the size
+  STORE_INT64 = 3,   // Array of int64_t
+  STORE_FLOAT32 = 4,
+  STORE_FLOAT64 = 5,
+} store_type_t;
+
+// Object table entry. A writer updates it under its seqlock: it takes owner, seq goes odd, the
+// fields change, seq goes even again with release and owner is given back. A reader loads seq, the
+// fields and seq again, and retries when the two differ or seq was odd; it then reads the data in
+// place and checks seq once more, since a newer version frees the block the entry pointed to (see
+// shm_store.h). seq is also the futex word store_wait() sleeps on.
+//
+// A writer killed while it holds owner leaves its PID there. The next writer of the key finds that
+// process gone, takes owner over and rolls seq forward with a version of its own; until then
+// readers that find seq odd under a dead owner fail instead of waiting for it.
+//
+// Entries are only ever added: a key keeps its slot, and a free slot ends every probe sequence.
+typedef struct {
+  _Alignas(64) _Atomic unsigned int seq;
+  _Atomic unsigned int live;           // Set with release once key is written
+  _Atomic int owner;                   // PID of the writer updating the entry, 0 when none
+  _Atomic unsigned int type;           // store_type_t of the current version
+  _Atomic unsigned long long version;  // Published versions so far, 0 before the first
+  _Atomic unsigned long long offset;   // Of the data from the start of the segment, 0 before the first
+  _Atomic unsigned long long size;     // Bytes of data
+  char key[STORE_KEY_MAX];
+} store_entry_t;
+
+// Header of a shared object store: writers allocate blocks in the heap, fill them in place and
+// publish them under a key; readers read them in place without taking any lock. Every reference
+// inside the segment is an offset from its start, so each process can map it wherever it likes.
+//
+// The heap is a slab allocator with power-of-two size classes: a block of class c is 2^c bytes,
+// freed blocks go on their class's free list (linked through their first 8 bytes) and new ones
+// are bumped off the end of the heap. One byte per 64-byte granule of the heap, past its end,
+// holds the class of the block that starts there, so that a block goes back on the list it came
+// from whatever size was published in it. Allocation and adding keys take the process-shared lock;
+// nothing a reader does does.
+//
+// Layout: [header page] [object table] [heap] [block classes], the first three on 4 KiB boundaries.
+typedef struct {
+  _Atomic unsigned int magic;
+  unsigned int version;                         // STORE_VERSION
+  unsigned int page_size;                       // Of the segment: 4 KiB, or huge pages
+  unsigned int max_objects;                     // STORE_MAX_OBJECTS
+  unsigned long long table_offset;              // Of the object table
+  unsigned long long heap_offset;               // Of the heap
+  unsigned long long heap_bytes;                // Size of the heap
+  unsigned long long class_offset;              // Of the block classes, one byte per 64 of heap
+  _Alignas(64) pthread_mutex_t lock;            // Writers only: allocator and table insertions (robust)
+  unsigned long long bump;                      // Heap offset of the first never-allocated byte
+  unsigned long long free_list[STORE_CLASSES];  // Segment offset of the first free block of each class, 0 if none
+  _Atomic unsigned long long used_bytes;        // In blocks handed out and not freed
+  _Alignas(64) _Atomic unsigned int objects;    // Keys in the table; futex word bumped on every new key
+  _Atomic unsigned long long publishes;         // Versions published, all keys together
+} store_header_t;
+
+_Static_assert(sizeof(store_header_t) <= STORE_PAGE_SIZE, "the store header must fit in its page");
 
 #endif  // SHM_COMMON_H
@@ -1,71 +1,147 @@
-#include <errno.h>     // For errno, ENOENT
-#include <fcntl.h>     // For O_RDWR
-#include <stdio.h>     // For printf, perror
-#include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE
-#include <string.h>    // For strncpy
-#include <sys/mman.h>  // For mmap, munmap
-#include <unistd.h>    // For close
+#include <errno.h>   // For errno, ETIMEDOUT
+#include <getopt.h>  // For getopt_long
+#include <stdint.h>  // For int64_t
+#include <stdio.h>   // For printf, perror
+#include <stdlib.h>  // For EXIT_SUCCESS, EXIT_FAILURE, atof
+#include <string.h>  // For memcpy
+#include <unistd.h>  // For getpid
 
 #include "shm_common.h"
+#include "shm_store.h"
 
-#define RETRY_DELAY_SEC 1  // Seconds to wait before retrying shm_open
+#define DEFAULT_TIMEOUT_SEC 30.0  // Longest wait for the store, the key or its next version
+#define PREVIEW_BYTES 80          // Of a string object printed
 
-int main(void) {
-  int shm_fd;
-  void *ptr;
-  char buffer[SHM_SIZE];  // Local buffer to read into
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--key KEY] [--follow] [--timeout SEC]\n"
+          "  --key KEY      object to read (default \"greeting\")\n"
+          "  --follow       keep reading each new version until none comes for --timeout\n"
+          "  --timeout SEC  longest wait for the store, the key or a new version (default %.0f)\n",
+          prog, DEFAULT_TIMEOUT_SEC);
+}
 
-  printf("--- Shared Memory Reader ---\n");
+// One line about an object, computed from its bytes where they are in the store
+void summarize(const store_view_t *view, char *line, size_t line_size) {
+  switch (view->type) {
+    case STORE_STRING: {
+      char preview[PREVIEW_BYTES + 1];
+      size_t length = view->size < PREVIEW_BYTES ? view->size : PREVIEW_BYTES;
+      memcpy(preview, view->data, length);
+      preview[length] = '\0';  // Also when the writer's NUL is past the preview
+      snprintf(line, line_size, "\"%s\"", preview);
+      break;
+    }
+    case STORE_FLOAT32: {
+      const float *values = view->data;
+      size_t count = view->size / sizeof(float);
+      double sum = 0.0;
+      for (size_t i = 0; i < count; ++i) sum += values[i];
+      snprintf(line, line_size, "%zu floats, first %.4f, mean %.6f", count, count > 0 ? values[0] : 0.0f,
+               count > 0 ? sum / count : 0.0);
+      break;
+    }
+    case STORE_FLOAT64: {
+      const double *values = view->data;
+      size_t count = view->size / sizeof(double);
+      double sum = 0.0;
+      for (size_t i = 0; i < count; ++i) sum += values[i];
+      snprintf(line, line_size, "%zu doubles, mean %.6f", count, count > 0 ? sum / count : 0.0);
+      break;
+    }
+    case STORE_INT64: {
+      const int64_t *values = view->data;
+      size_t count = view->size / sizeof(int64_t);
+      long long sum = 0;
+      for (size_t i = 0; i < count; ++i) sum += values[i];
+      snprintf(line, line_size, "%zu int64, sum %lld", count, sum);
+      break;
+    }
+    default: {
+      const unsigned char *bytes = view->data;
+      unsigned int checksum = 0;
+      for (size_t i = 0; i < view->size; ++i) checksum = checksum * 31 + bytes[i];
+      snprintf(line, line_size, "%zu bytes, checksum %08x", view->size, checksum);
+      break;
+    }
+  }
+}
 
-  // Open the shared memory segment
-  // Loop until the shared memory is available (created by writer)
-  while (1) {
-    shm_fd = shm_open(SHM_NAME, O_RDONLY, 0);  // O_RDONLY for reading, mode 0
-    if (shm_fd == -1) {
-      if (errno == ENOENT) {
-        // Shared memory does not exist
-        fprintf(stderr, "Reader: Shared memory '%s' not found. Retrying in %d seconds...\n", SHM_NAME, RETRY_DELAY_SEC);
-        sleep(RETRY_DELAY_SEC);
-      } else {
-        perror("shm_open failed unexpectedly");
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"key", required_argument, NULL, 'k'},
+                                         {"follow", no_argument, NULL, 'f'},
+                                         {"timeout", required_argument, NULL, 't'},
+                                         {NULL, 0, NULL, 0}};
+  const char *key = "greeting";
+  int follow = 0;
+  double timeout_sec = DEFAULT_TIMEOUT_SEC;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "k:ft:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'k':
+        key = optarg;
+        break;
+      case 'f':
+        follow = 1;
+        break;
+      case 't':
+        timeout_sec = atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
         return EXIT_FAILURE;
-      }
-    } else {
-      printf("Reader: Shared memory segment '%s' opened (FD: %d).\n", SHM_NAME, shm_fd);
-      break;
     }
   }
+  long long timeout_ns = (long long)(timeout_sec * 1e9);
 
-  // Map the shared memory segment into the process's address space
-  // PROT_READ: Memory can only be read from
-  // MAP_SHARED: Changes are visible to other processes
-  ptr = mmap(0, SHM_SIZE, PROT_READ, MAP_SHARED, shm_fd, 0);
-  if (ptr == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
+  printf("--- Shared Memory Reader (PID %d) ---\n", getpid());
+
+  // Sleeps until a writer has created and initialized the store: no polling
+  store_t *store = store_open(SHM_NAME, 0, timeout_ns);
+  if (store == NULL) {
+    perror(errno == ETIMEDOUT ? "Reader: no store appeared" : "Reader: store_open failed");
     return EXIT_FAILURE;
   }
-  printf("Reader: Shared memory mapped to address %p.\n", ptr);
+  printf("Reader: Store '%s' mapped read-only at address %p (%s), %u object(s).\n", SHM_NAME, (void *)store->base,
+         huge_shm_backing_name(store->shm.backing), store_objects(store));
 
-  // Read data from the shared memory
-  // Null-terminate the data if string as mmap provides raw memory.
-  strncpy(buffer, (const char *)ptr, SHM_SIZE - 1);  // Copy string to local buffer
-  buffer[SHM_SIZE - 1] = '\0';                       // Ensure null-termination
-  printf("Reader: Read message: \"%s\"\n", buffer);
+  unsigned long long seen = 0;
+  int status = EXIT_SUCCESS;
+  do {
+    // Sleep until the key has a version we have not read yet
+    if (store_wait(store, key, seen, timeout_ns) == 0) {
+      if (seen == 0) {
+        fprintf(stderr, "Reader: No object '%s' after %.0f s.\n", key, timeout_sec);
+        status = EXIT_FAILURE;
+      }
+      break;
+    }
 
-  // Unmap the shared memory from the process's address space
-  if (munmap(ptr, SHM_SIZE) == -1) {
-    perror("munmap failed");
-  }
-  printf("Reader: Shared memory unmapped.\n");
+    // Read it in place; when a writer replaces it meanwhile, the summary is discarded and redone
+    store_view_t view;
+    char line[256];
+    unsigned long retries = 0;
+    while (1) {
+      if (store_get(store, key, &view) == -1) {
+        perror("Reader: store_get failed");
+        store_close(store);
+        return EXIT_FAILURE;
+      }
+      summarize(&view, line, sizeof(line));
+      if (store_check(&view) == 0) break;
+      retries++;
+    }
+    printf("Reader: %s v%llu (%s, %zu bytes at offset %td): %s", key, view.version, store_type_name(view.type),
+           view.size, (const char *)view.data - store->base, line);
+    if (retries > 0) printf(" [%lu retries]", retries);
+    printf("\n");
+    seen = view.version;
+  } while (follow);
 
-  // Close the shared memory file descriptor
-  // The writer unlinks it right after writing.
-  if (close(shm_fd) == -1) {
-    perror("close shm_fd failed");
-  }
-  printf("Reader: Shared memory file descriptor closed.\n");
+  store_close(store);
+  printf("Reader: Store unmapped.\n");
 
   printf("--- Reader Finished ---\n");
-  return EXIT_SUCCESS;
+  return status;
 }
@@ -0,0 +1,423 @@
+#include "shm_store.h"
+
+#include <errno.h>     // For errno, ENOENT, EAGAIN, EPROTO, ENOMEM, ENOSPC, EINVAL, EACCES, ESRCH, EOWNERDEAD, ...
+#include <fcntl.h>     // For O_RDWR, O_RDONLY
+#include <sched.h>     // For sched_yield
+#include <signal.h>    // For kill
+#include <stdlib.h>    // For malloc, free
+#include <string.h>    // For memcpy, strlen, strncmp
+#include <sys/mman.h>  // For PROT_READ, PROT_WRITE, MAP_SHARED, MAP_FAILED
+#include <time.h>      // For struct timespec
+#include <unistd.h>    // For close, getpid
+
+#include "shm_futex.h"
+
+#define GRANULE (1ULL << STORE_MIN_CLASS)  // Every block starts on one, counted from the heap
+#define OWNER_CHECK_SPINS 64               // Yields on an odd seq before asking whether its writer still lives
+
+// Time left until deadline_ns as a futex timeout; 0 when it has passed
+static int remaining(long long deadline_ns, struct timespec *ts) {
+  long long left = deadline_ns - shm_now_ns();
+  if (left <= 0) return 0;
+  ts->tv_sec = left / 1000000000LL;
+  ts->tv_nsec = left % 1000000000LL;
+  return 1;
+}
+
+static size_t round_up(size_t n, size_t page) { return (n + page - 1) / page * page; }
+
+// Smallest class whose blocks hold size bytes
+static unsigned int size_class(size_t size) {
+  unsigned int c = STORE_MIN_CLASS;
+  while (c < STORE_CLASSES && (1ULL << c) < size) c++;
+  return c;
+}
+
+// FNV-1a: where a key's probe sequence starts
+static unsigned int key_hash(const char *key) {
+  unsigned int hash = 2166136261u;
+  for (; *key != '\0'; ++key) hash = (hash ^ (unsigned char)*key) * 16777619u;
+  return hash;
+}
+
+// pid no longer exists. A PID that was reused since looks alive: the entry waits for that process.
+static int owner_dead(int pid) { return pid != 0 && kill(pid, 0) == -1 && errno == ESRCH; }
+
+// Writer: take the entry's owner, from a writer that died holding it too. Held for a few stores.
+static void lock_entry(store_entry_t *entry) {
+  int self = getpid();
+  int owner = 0;
+  unsigned int spins = 0;
+  while (!atomic_compare_exchange_weak_explicit(&entry->owner, &owner, self, memory_order_acquire,
+                                                memory_order_relaxed)) {
+    if (owner == 0) continue;  // Failed spuriously
+    // Expecting the dead PID, the next exchange takes the entry over
+    if (++spins % OWNER_CHECK_SPINS == 0 && owner_dead(owner)) continue;
+    sched_yield();
+    owner = 0;
+  }
+}
+
+// A writer that died holding the lock leaves it to the next one: the allocator state it left
+// behind is taken as it is
+static void lock_store(store_header_t *header) {
+  if (pthread_mutex_lock(&header->lock) == EOWNERDEAD) pthread_mutex_consistent(&header->lock);
+}
+
+static void unlock_store(store_header_t *header) { pthread_mutex_unlock(&header->lock); }
+
+// The key's entry, or NULL when it has never been added. Lock-free: keys are only ever added, and
+// an entry's key is written before live is set.
+static store_entry_t *find_entry(const store_t *store, const char *key) {
+  unsigned int start = key_hash(key);
+  for (unsigned int i = 0; i < STORE_MAX_OBJECTS; ++i) {
+    store_entry_t *entry = &store->table[(start + i) % STORE_MAX_OBJECTS];
+    if (!atomic_load_explicit(&entry->live, memory_order_acquire)) return NULL;
+    if (strncmp(entry->key, key, STORE_KEY_MAX) == 0) return entry;
+  }
+  return NULL;
+}
+
+// Writer: the key's entry, added when it is new. NULL with errno ENOSPC when the table is full.
+static store_entry_t *add_entry(store_t *store, const char *key) {
+  store_header_t *header = store->header;
+  unsigned int start = key_hash(key);
+  store_entry_t *found = NULL;
+  lock_store(header);
+  for (unsigned int i = 0; i < STORE_MAX_OBJECTS && found == NULL; ++i) {
+    store_entry_t *entry = &store->table[(start + i) % STORE_MAX_OBJECTS];
+    if (!atomic_load_explicit(&entry->live, memory_order_relaxed)) {
+      memcpy(entry->key, key, strlen(key) + 1);
+      atomic_store_explicit(&entry->live, 1, memory_order_release);
+      atomic_fetch_add_explicit(&header->objects, 1, memory_order_release);
+      shm_futex_wake_all(&header->objects);
+      found = entry;
+    } else if (strncmp(entry->key, key, STORE_KEY_MAX) == 0) {
+      found = entry;  // Another writer added it first
+    }
+  }
+  unlock_store(header);
+  if (found == NULL) errno = ENOSPC;
+  return found;
+}
+
+// size bytes at offset lie inside the heap
+static int in_heap(const store_header_t *header, unsigned long long offset, size_t size) {
+  return offset >= header->heap_offset && offset <= header->heap_offset + header->heap_bytes &&
+         size <= header->heap_offset + header->heap_bytes - offset;
+}
+
+// Where the class of a block at offset is kept
+static unsigned char *block_class(const store_t *store, unsigned long long offset) {
+  return &store->classes[(offset - store->header->heap_offset) / GRANULE];
+}
+
+// size bytes fit in an allocated block at offset. Only the writer the block was handed to reads
+// its class outside the lock.
+static int is_block(const store_t *store, unsigned long long offset, size_t size) {
+  if (!in_heap(store->header, offset, size) || (offset - store->header->heap_offset) % GRANULE != 0 ||
+      offset == store->header->heap_offset + store->header->heap_bytes) {
+    return 0;
+  }
+  unsigned int c = *block_class(store, offset);
+  return c != 0 && size <= 1ULL << c;
+}
+
+// Put a block back on the free list of the class it was allocated from. Readers may still be
+// reading it: they find out from store_check() that it was replaced.
+static void free_block(store_t *store, unsigned long long offset) {
+  store_header_t *header = store->header;
+  lock_store(header);
+  unsigned char *c = block_class(store, offset);
+  if (*c != 0) {  // Not freed already
+    *(unsigned long long *)(store->base + offset) = header->free_list[*c];
+    header->free_list[*c] = offset;
+    atomic_fetch_sub_explicit(&header->used_bytes, 1ULL << *c, memory_order_relaxed);
+    *c = 0;
+  }
+  unlock_store(header);
+}
+
+store_t *store_create(const char *name, size_t heap_bytes, int shm_flags) {
+  size_t table_offset = STORE_PAGE_SIZE;
+  size_t heap_offset = table_offset + round_up(STORE_MAX_OBJECTS * sizeof(store_entry_t), STORE_PAGE_SIZE);
+  heap_bytes = round_up(heap_bytes, GRANULE);
+  store_t *store = malloc(sizeof(store_t));
+  if (store == NULL) return NULL;
+  store->base = huge_shm_create_map(name, heap_offset + heap_bytes + heap_bytes / GRANULE, shm_flags, &store->shm);
+  if (store->base == NULL) {
+    free(store);
+    return NULL;
+  }
+  store->header = (store_header_t *)store->base;
+  store->table = (store_entry_t *)(store->base + table_offset);
+  store->writable = 1;
+
+  // The segment is new, so zero-filled: every entry is free and every free list empty
+  store_header_t *header = store->header;
+  header->version = STORE_VERSION;
+  header->page_size = (unsigned int)store->shm.page_size;
+  header->max_objects = STORE_MAX_OBJECTS;
+  header->table_offset = table_offset;
+  header->heap_offset = heap_offset;
+  // Whatever the rounding to pages added goes to the heap too, with its share of classes
+  header->heap_bytes = (store->shm.size - heap_offset) / (GRANULE + 1) * GRANULE;
+  header->class_offset = heap_offset + header->heap_bytes;
+  store->classes = (unsigned char *)(store->base + header->class_offset);
+
+  // Process-shared, for writers in other processes, and robust, so that a writer killed while
+  // allocating does not leave everyone else blocked
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&header->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  // Everything above happens before the magic, for whoever sees it
+  atomic_store_explicit(&header->magic, STORE_MAGIC, memory_order_release);
+  shm_futex_wake_all(&header->magic);
+  return store;
+}
+
+store_t *store_open(const char *name, int writable, long long timeout_ns) {
+  long long deadline_ns = shm_now_ns() + timeout_ns;
+  if (timeout_ns != 0 && huge_shm_wait(name, timeout_ns) == -1) return NULL;
+
+  huge_shm_t shm;
+  int fd = huge_shm_open(name, writable ? O_RDWR : O_RDONLY, 0, &shm);
+  if (fd == -1) return NULL;  // errno ENOENT lets the caller retry
+  if (shm.size < STORE_PAGE_SIZE) {
+    close(fd);
+    errno = EAGAIN;  // Created but not sized yet
+    return NULL;
+  }
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  char *base = huge_shm_map(&shm, NULL, shm.size, prot, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+
+  // Sized is not initialized yet: sleep on the magic until the creator has stored it
+  store_header_t *header = (store_header_t *)base;
+  unsigned int magic;
+  int error = 0;
+  while ((magic = atomic_load_explicit(&header->magic, memory_order_acquire)) != STORE_MAGIC) {
+    struct timespec ts;
+    if (timeout_ns >= 0 && !remaining(deadline_ns, &ts)) {
+      error = timeout_ns == 0 ? EAGAIN : ETIMEDOUT;
+      break;
+    }
+    shm_futex_wait(&header->magic, magic, timeout_ns < 0 ? NULL : &ts);
+  }
+  if (error == 0 && (header->version != STORE_VERSION || header->max_objects != STORE_MAX_OBJECTS ||
+                     header->heap_bytes % GRANULE != 0 ||
+                     header->class_offset != header->heap_offset + header->heap_bytes ||
+                     header->class_offset + header->heap_bytes / GRANULE > shm.size)) {
+    error = EPROTO;
+  }
+  store_t *store = error == 0 ? malloc(sizeof(store_t)) : NULL;
+  if (store == NULL) {
+    huge_shm_unmap(&shm, base);
+    errno = error != 0 ? error : ENOMEM;
+    return NULL;
+  }
+  store->header = header;
+  store->table = (store_entry_t *)(base + header->table_offset);
+  store->classes = (unsigned char *)(base + header->class_offset);
+  store->base = base;
+  store->writable = writable;
+  store->shm = shm;
+  return store;
+}
+
+void store_close(store_t *store) {
+  if (store == NULL) return;
+  huge_shm_unmap(&store->shm, store->base);
+  free(store);
+}
+
+int store_unlink(const char *name) { return huge_shm_unlink(name); }
+
+void *store_alloc(store_t *store, size_t size) {
+  store_header_t *header = store->header;
+  unsigned int c = size_class(size);
+  if (c >= STORE_CLASSES) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (!store->writable) {
+    errno = EACCES;
+    return NULL;
+  }
+  size_t block = 1ULL << c;
+
+  // A freed block of the class if there is one, a new one off the end of the heap otherwise
+  lock_store(header);
+  unsigned long long offset = header->free_list[c];
+  if (offset != 0) {
+    header->free_list[c] = *(unsigned long long *)(store->base + offset);
+  } else if (header->bump + block <= header->heap_bytes) {
+    offset = header->heap_offset + header->bump;
+    header->bump += block;
+  }
+  if (offset != 0) {
+    *block_class(store, offset) = (unsigned char)c;
+    atomic_fetch_add_explicit(&header->used_bytes, block, memory_order_relaxed);
+  }
+  unlock_store(header);
+
+  if (offset == 0) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return store->base + offset;
+}
+
+void store_free(store_t *store, void *block, size_t size) {
+  unsigned long long offset = (char *)block - store->base;
+  if (block != NULL && is_block(store, offset, size)) free_block(store, offset);
+}
+
+unsigned long long store_publish(store_t *store, const char *key, store_type_t type, void *block, size_t size) {
+  unsigned long long offset = (char *)block - store->base;
+  if (strlen(key) >= STORE_KEY_MAX) {
+    errno = ENAMETOOLONG;
+    return 0;
+  }
+  if (!store->writable) {
+    errno = EACCES;
+    return 0;
+  }
+  if (block == NULL || !is_block(store, offset, size)) {
+    errno = EINVAL;
+    return 0;
+  }
+  store_entry_t *entry = find_entry(store, key);
+  if (entry == NULL) entry = add_entry(store, key);
+  if (entry == NULL) return 0;
+
+  // Take the entry's seqlock. Another writer holds it only for the few stores below; one that died
+  // holding it may have left seq odd, which stays odd until ours are done.
+  lock_entry(entry);
+  unsigned int seq = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+  if ((seq & 1) == 0) atomic_store_explicit(&entry->seq, ++seq, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);  // The odd seq is visible before any field changes
+
+  // After a dead writer, this may be the block it was publishing; the one it replaced then leaks
+  unsigned long long old_offset = atomic_load_explicit(&entry->offset, memory_order_relaxed);
+  unsigned long long version = atomic_load_explicit(&entry->version, memory_order_relaxed) + 1;
+  atomic_store_explicit(&entry->type, type, memory_order_relaxed);
+  atomic_store_explicit(&entry->offset, offset, memory_order_relaxed);
+  atomic_store_explicit(&entry->size, size, memory_order_relaxed);
+  atomic_store_explicit(&entry->version, version, memory_order_relaxed);
+  // Release: the block's contents and the fields are visible to whoever sees the even seq
+  atomic_store_explicit(&entry->seq, seq + 1, memory_order_release);
+  atomic_store_explicit(&entry->owner, 0, memory_order_release);
+  atomic_fetch_add_explicit(&store->header->publishes, 1, memory_order_relaxed);
+  shm_futex_wake_all(&entry->seq);
+
+  // Readers still on the old version find out from store_check()
+  if (old_offset != 0 && old_offset != offset) free_block(store, old_offset);
+  return version;
+}
+
+unsigned long long store_put(store_t *store, const char *key, store_type_t type, const void *data, size_t size) {
+  void *block = store_alloc(store, size);
+  if (block == NULL) return 0;
+  memcpy(block, data, size);
+  unsigned long long version = store_publish(store, key, type, block, size);
+  if (version == 0) store_free(store, block, size);
+  return version;
+}
+
+int store_get(const store_t *store, const char *key, store_view_t *view) {
+  const store_entry_t *entry = find_entry(store, key);
+  if (entry == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+  for (unsigned int spins = 1;; ++spins) {
+    unsigned int seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+    if ((seq & 1) != 0) {  // A writer is in the middle of an update
+      if (spins % OWNER_CHECK_SPINS == 0 && owner_dead(atomic_load_explicit(&entry->owner, memory_order_relaxed))) {
+        errno = EOWNERDEAD;
+        return -1;
+      }
+      sched_yield();
+      continue;
+    }
+    unsigned long long offset = atomic_load_explicit(&entry->offset, memory_order_relaxed);
+    size_t size = atomic_load_explicit(&entry->size, memory_order_relaxed);
+    unsigned int type = atomic_load_explicit(&entry->type, memory_order_relaxed);
+    unsigned long long version = atomic_load_explicit(&entry->version, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);  // The loads above happen before seq is checked again
+    if (atomic_load_explicit(&entry->seq, memory_order_relaxed) != seq) continue;
+
+    if (version == 0) {  // Added, but its first version is not published yet
+      errno = ENOENT;
+      return -1;
+    }
+    if (!in_heap(store->header, offset, size)) {
+      errno = EPROTO;
+      return -1;
+    }
+    view->data = store->base + offset;
+    view->size = size;
+    view->type = (store_type_t)type;
+    view->version = version;
+    view->entry = entry;
+    view->seq = seq;
+    return 0;
+  }
+}
+
+int store_check(const store_view_t *view) {
+  atomic_thread_fence(memory_order_acquire);  // Every read of the data happens before this load
+  return atomic_load_explicit(&view->entry->seq, memory_order_relaxed) == view->seq ? 0 : -1;
+}
+
+unsigned long long store_wait(const store_t *store, const char *key, unsigned long long version,
+                              long long timeout_ns) {
+  long long deadline_ns = shm_now_ns() + timeout_ns;
+  while (1) {
+    // Until the key exists, sleep on the table's count of keys; then on the entry's seq
+    const _Atomic unsigned int *word = &store->header->objects;
+    unsigned int seen = atomic_load_explicit(word, memory_order_acquire);
+    const store_entry_t *entry = find_entry(store, key);
+    if (entry != NULL) {
+      word = &entry->seq;
+      seen = atomic_load_explicit(word, memory_order_acquire);
+      unsigned long long current = atomic_load_explicit(&entry->version, memory_order_relaxed);
+      if ((seen & 1) == 0 && current > version) return current;
+    }
+    struct timespec ts;
+    if (timeout_ns >= 0 && !remaining(deadline_ns, &ts)) return 0;
+    shm_futex_wait(word, seen, timeout_ns < 0 ? NULL : &ts);
+  }
+}
+
+unsigned int store_objects(const store_t *store) {
+  return atomic_load_explicit(&store->header->objects, memory_order_relaxed);
+}
+
+void store_usage(const store_t *store, size_t *used, size_t *total) {
+  *used = atomic_load_explicit(&store->header->used_bytes, memory_order_relaxed);
+  *total = store->header->heap_bytes;
+}
+
+const char *store_type_name(store_type_t type) {
+  switch (type) {
+    case STORE_BYTES:
+      return "bytes";
+    case STORE_STRING:
+      return "string";
+    case STORE_INT64:
+      return "int64";
+    case STORE_FLOAT32:
+      return "float";
+    case STORE_FLOAT64:
+      return "double";
+    default:
+      return "unknown";
+  }
+}
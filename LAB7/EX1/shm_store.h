@@ -0,0 +1,84 @@
+#ifndef SHM_STORE_H
+#define SHM_STORE_H
+
+#include <stddef.h>  // For size_t
+
+#include "huge_shm.h"
+#include "shm_common.h"
+
+// A process's mapping of a store: read-write for writers, read-only for readers
+typedef struct {
+  store_header_t *header;
+  store_entry_t *table;
+  unsigned char *classes;  // Class of the block starting at each granule of the heap, 0 where none does
+  char *base;              // Where this process mapped the segment: offsets are relative to it
+  int writable;
+  huge_shm_t shm;  // How the segment is backed, and its size
+} store_t;
+
+// One version of an object, read in place. data points into the segment and stays valid until the
+// object gets a newer version, which may reuse its block: whatever was computed from it only counts
+// once store_check() returns 0.
+typedef struct {
+  const void *data;
+  size_t size;
+  store_type_t type;
+  unsigned long long version;
+  const store_entry_t *entry;
+  unsigned int seq;  // Of the entry when the view was taken
+} store_view_t;
+
+// Create a store with a heap of at least heap_bytes, replacing any earlier one. shm_flags are
+// HUGE_SHM_* for the segment; on huge pages the heap is rounded up to whole pages.
+store_t *store_create(const char *name, size_t heap_bytes, int shm_flags);
+
+// Map an existing store, read-write when writable is set. Waits up to timeout_ns (< 0: forever)
+// for it to be created and initialized, sleeping on inotify and then on the magic's futex, and
+// fails with errno ETIMEDOUT after that; 0 does not wait. EPROTO for another version.
+store_t *store_open(const char *name, int writable, long long timeout_ns);
+
+void store_close(store_t *store);
+
+// Remove the segment, wherever huge_shm put it
+int store_unlink(const char *name);
+
+// Writer, zero-copy: a block of at least size bytes in the heap, 64-byte aligned, for the caller to
+// fill in place and then hand to store_publish(). NULL with errno ENOMEM when the heap is full,
+// EACCES when the store was opened read-only.
+void *store_alloc(store_t *store, size_t size);
+
+// Writer: give back a block from store_alloc() that was not published. It goes back to the class it
+// was allocated from; size only has to fit in it.
+void store_free(store_t *store, void *block, size_t size);
+
+// Writer: make block (size bytes of type) the next version of key, adding the key when it is new,
+// and free the block of the previous version. Readers waiting in store_wait() wake up. Returns the
+// new version, or 0 with errno ENOSPC when the table is full, ENAMETOOLONG for a long key, EINVAL
+// for a block that is not from store_alloc() or too small for size. Takes the key over from a
+// writer that died while updating it.
+unsigned long long store_publish(store_t *store, const char *key, store_type_t type, void *block, size_t size);
+
+// Writer: copy size bytes from data into a new block and publish it
+unsigned long long store_put(store_t *store, const char *key, store_type_t type, const void *data, size_t size);
+
+// Reader: the current version of key, in place. 0 on success, -1 with errno ENOENT when the key
+// has not been published yet, EOWNERDEAD when its writer died in the middle of an update and no
+// writer has published the key since.
+int store_get(const store_t *store, const char *key, store_view_t *view);
+
+// Reader: 0 when the version seen by store_get() is still current, i.e. nothing was overwritten
+// while the caller read it; -1 when it was replaced and the caller must get it again.
+int store_check(const store_view_t *view);
+
+// Reader: sleep until key has a version newer than version (0: any version), or timeout_ns passes
+// (< 0 waits forever). Returns the newest version, or 0 on timeout. Costs no CPU while waiting.
+unsigned long long store_wait(const store_t *store, const char *key, unsigned long long version,
+                              long long timeout_ns);
+
+// Keys in the table, and bytes of heap in use and in total
+unsigned int store_objects(const store_t *store);
+void store_usage(const store_t *store, size_t *used, size_t *total);
+
+const char *store_type_name(store_type_t type);
+
+#endif  // SHM_STORE_H
@@ -1,78 +1,141 @@
-#include <fcntl.h>     // For O_CREAT, O_RDWR
-#include <stdio.h>     // For printf, perror
-#include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE
-#include <string.h>    // For strcpy
-#include <sys/mman.h>  // For mmap, munmap
-#include <unistd.h>    // For ftruncate, close
+#include <errno.h>   // For errno, ENOENT
+#include <getopt.h>  // For getopt_long
+#include <math.h>    // For sinf
+#include <stdio.h>   // For printf, perror
+#include <stdlib.h>  // For EXIT_SUCCESS, EXIT_FAILURE, atol, strtoul
+#include <string.h>  // For strlen
+#include <time.h>    // For nanosleep
+#include <unistd.h>  // For getpid, sleep
 
 #include "shm_common.h"
+#include "shm_store.h"
 
-int main(void) {
-  int shm_fd;
-  void *ptr;
-  const char *message = "Hello World!";
+#define DEFAULT_MESSAGE "Hello World!"
+#define DEFAULT_LINGER_SEC 10  // Seconds to keep the store around for readers before unlinking it
 
-  printf("--- Shared Memory Writer ---\n");
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--message TEXT] [--key KEY] [--mb N] [--updates N] [--interval MS] [--heap MB] [--linger SEC]\n"
+          "  --message TEXT  string published under \"greeting\" (default \"%s\")\n"
+          "  --key KEY       also publish an array of floats under KEY (default \"samples\")\n"
+          "  --mb N          of N MB, filled in place in the store (default 0: no array)\n"
+          "  --updates N     versions of the array to publish (default 10)\n"
+          "  --interval MS   between two versions (default 500)\n"
+          "  --heap MB       heap of the store, when this writer creates it (default %d)\n"
+          "  --linger SEC    keep the store this long before unlinking it (default %d)\n",
+          prog, DEFAULT_MESSAGE, SHM_HEAP_MB, DEFAULT_LINGER_SEC);
+}
 
-  // Create the shared memory segment
-  // O_CREAT: Create if it doesn't exist
-  // O_RDWR: Open for reading and writing
-  // 0666: Read/write permissions
-  shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
-  if (shm_fd == -1) {
-    perror("shm_open failed");
-    return EXIT_FAILURE;
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+      {"message", required_argument, NULL, 'm'}, {"key", required_argument, NULL, 'k'},
+      {"mb", required_argument, NULL, 'b'},      {"updates", required_argument, NULL, 'u'},
+      {"interval", required_argument, NULL, 'i'}, {"heap", required_argument, NULL, 'H'},
+      {"linger", required_argument, NULL, 'l'},  {NULL, 0, NULL, 0}};
+  const char *message = DEFAULT_MESSAGE;
+  const char *key = "samples";
+  size_t mb = 0;
+  long updates = 10;
+  long interval_ms = 500;
+  size_t heap_mb = SHM_HEAP_MB;
+  unsigned int linger_sec = DEFAULT_LINGER_SEC;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "m:k:b:u:i:H:l:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'm':
+        message = optarg;
+        break;
+      case 'k':
+        key = optarg;
+        break;
+      case 'b':
+        mb = strtoul(optarg, NULL, 10);
+        break;
+      case 'u':
+        updates = atol(optarg);
+        break;
+      case 'i':
+        interval_ms = atol(optarg);
+        break;
+      case 'H':
+        heap_mb = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        linger_sec = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
   }
-  printf("Writer: Shared memory segment '%s' created/opened (FD: %d).\n", SHM_NAME, shm_fd);
 
-  // Set the size of the shared memory segment
-  // As shm_open only creates/opens, it doesn't set size.
-  if (ftruncate(shm_fd, SHM_SIZE) == -1) {
-    perror("ftruncate failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME);  // Clean up if ftruncate fails
+  printf("--- Shared Memory Writer (PID %d) ---\n", getpid());
+
+  // Join the store other writers are using, or create it with every page faulted in now rather
+  // than on the first write
+  int created = 0;
+  store_t *store = store_open(SHM_NAME, 1, 0);
+  if (store == NULL && errno == ENOENT) {
+    store = store_create(SHM_NAME, heap_mb << 20, SHM_FLAGS);
+    created = 1;
+  }
+  if (store == NULL) {
+    perror("Writer: store_create failed");
     return EXIT_FAILURE;
   }
-  printf("Writer: Shared memory size set to %d bytes.\n", SHM_SIZE);
+  size_t used, total;
+  store_usage(store, &used, &total);
+  printf("Writer: Store '%s' %s at address %p: %zu MB heap on %s, %u object(s) so far.\n", SHM_NAME,
+         created ? "created" : "opened", (void *)store->base, total >> 20, huge_shm_backing_name(store->shm.backing),
+         store_objects(store));
 
-  // Map the shared memory segment into the process's address space
-  // PROT_READ | PROT_WRITE: Memory can be read from and written to
-  // MAP_SHARED: Changes are visible to other processes mapping the same memory
-  // 0: Kernel chooses the address
-  // 0: Offset from the beginning of the file
-  ptr = mmap(0, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-  if (ptr == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME);
+  // A small object: copied in with store_put()
+  unsigned long long version = store_put(store, "greeting", STORE_STRING, message, strlen(message) + 1);
+  if (version == 0) {
+    perror("Writer: store_put failed");
+    store_close(store);
     return EXIT_FAILURE;
   }
-  printf("Writer: Shared memory mapped to address %p.\n", ptr);
-
-  // Write data to the shared memory
-  printf("Writer: Writing message: \"%s\"\n", message);
-  strcpy((char *)ptr, message);
+  printf("Writer: Published \"%s\" as greeting v%llu.\n", message, version);
 
-  // Sleep to ensure reader has time to read
-  sleep(10);
+  // A large one, without copying: each version is written straight into its block in the heap,
+  // then published; the block of the version it replaces goes back to the allocator
+  size_t count = (mb << 20) / sizeof(float);
+  for (long update = 0; count > 0 && update < updates; ++update) {
+    float *samples = store_alloc(store, count * sizeof(float));
+    if (samples == NULL) {
+      perror("Writer: store_alloc failed");
+      break;
+    }
+    for (size_t i = 0; i < count; ++i) samples[i] = sinf((float)(i + update) * 0.001f);
+    version = store_publish(store, key, STORE_FLOAT32, samples, count * sizeof(float));
+    if (version == 0) {
+      perror("Writer: store_publish failed");
+      store_free(store, samples, count * sizeof(float));
+      break;
+    }
+    store_usage(store, &used, &total);
+    printf("Writer: Published %zu MB of floats as %s v%llu (heap %zu of %zu MB in use).\n", mb, key, version,
+           used >> 20, total >> 20);
 
-  // Unmap the shared memory from the process's address space
-  if (munmap(ptr, SHM_SIZE) == -1) {
-    perror("munmap failed");
+    struct timespec pause = {interval_ms / 1000, (interval_ms % 1000) * 1000000L};
+    if (update + 1 < updates) nanosleep(&pause, NULL);
   }
-  printf("Writer: Shared memory unmapped.\n");
 
-  // Close the shared memory file descriptor
-  if (close(shm_fd) == -1) {
-    perror("close shm_fd failed");
-  }
-  printf("Writer: Shared memory file descriptor closed.\n");
+  // Keep the store around for readers to find it
+  sleep(linger_sec);
+
+  store_close(store);
+  printf("Writer: Store unmapped.\n");
 
-  // Unlink it here so a fresh run can always create it.
-  if (shm_unlink(SHM_NAME) == -1) {
-    perror("shm_unlink failed");
+  // The writer that created the store unlinks it, so a fresh run starts from an empty one
+  if (created) {
+    if (store_unlink(SHM_NAME) == -1) {
+      perror("store_unlink failed");
+    }
+    printf("Writer: Store '%s' unlinked.\n", SHM_NAME);
   }
-  printf("Writer: Shared memory segment '%s' unlinked.\n", SHM_NAME);
 
   printf("--- Writer Finished ---\n");
   return EXIT_SUCCESS;
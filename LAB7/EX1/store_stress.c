@@ -0,0 +1,247 @@
+// Stress test for the shared object store: forked writers keep publishing MB-sized objects under a
+// few keys, filling each block in place with a pattern derived from a random stamp, while forked
+// readers verify whatever version is current in place. Every process maps the store itself, so
+// it sits at a different address in each. Readers must never accept a torn object: any version
+// store_check() lets through has to match its pattern exactly. Versions of a key must only grow.
+#include <getopt.h>    // For getopt_long
+#include <sched.h>     // For sched_yield
+#include <stdint.h>    // For uint64_t
+#include <stdio.h>     // For printf, perror, snprintf
+#include <stdlib.h>    // For atoi, rand_r, EXIT_SUCCESS, EXIT_FAILURE
+#include <sys/wait.h>  // For waitpid
+#include <time.h>      // For clock_gettime
+#include <unistd.h>    // For fork, pipe, read, write, getpid, _exit
+
+#include "shm_common.h"
+#include "shm_store.h"
+
+#define DEFAULT_WRITERS 2
+#define DEFAULT_READERS 4
+#define DEFAULT_KEYS 4
+#define DEFAULT_MB 4
+#define DEFAULT_SECONDS 3
+#define MAX_PROCESSES 64
+#define MAX_KEYS 64
+#define DELAY_EVERY 8                 // One read in this many yields the CPU half-way, inviting a writer in
+#define SPREAD 0x9E3779B97F4A7C15ULL  // Word i of an object is its stamp ^ (i * SPREAD)
+
+typedef struct {
+  int writer;
+  unsigned long long operations;  // Publishes, or reads store_check() accepted
+  unsigned long long bytes;       // Written, or verified
+  unsigned long long retries;     // Reads store_check() rejected
+  unsigned long long retry_torn;  // ... of which really saw a block being rewritten
+  unsigned long long torn;        // Accepted reads that did not match: must stay 0
+  unsigned long long backwards;   // A key's version going down: must stay 0
+  unsigned long long failures;    // Allocations or publishes that failed
+} stress_report_t;
+
+double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Words of the object that do not match the pattern of the stamp in its first word
+size_t mismatches(const uint64_t *words, size_t count) {
+  size_t bad = 0;
+  for (size_t i = 1; i < count; ++i) bad += words[i] != (words[0] ^ (i * SPREAD));
+  return bad;
+}
+
+// Open the store, tell the parent, run the loop and report. Never returns.
+void run_child(const char *name, int writer, int keys, size_t bytes, double end, int ready_fd, int report_fd) {
+  stress_report_t report = {0};
+  report.writer = writer;
+  unsigned long long last_version[MAX_KEYS] = {0};
+  unsigned int seed = (unsigned int)getpid();
+  char key[STORE_KEY_MAX];
+  char ready = 1;
+
+  store_t *store = store_open(name, writer, 0);
+  if (store == NULL) {
+    perror("store_open failed");
+    _exit(EXIT_FAILURE);
+  }
+  if (write(ready_fd, &ready, 1) != 1) _exit(EXIT_FAILURE);
+  close(ready_fd);
+
+  size_t count = bytes / sizeof(uint64_t);
+  for (unsigned long long n = 0; now_sec() < end; ++n) {
+    int k = rand_r(&seed) % keys;
+    snprintf(key, sizeof(key), "object.%d", k);
+    if (writer) {
+      // Fill a fresh block in place, then publish it: the block it replaces is freed
+      uint64_t *words = store_alloc(store, bytes);
+      if (words == NULL) {
+        report.failures++;
+        sched_yield();
+        continue;
+      }
+      uint64_t stamp = ((uint64_t)rand_r(&seed) << 32) ^ (uint64_t)rand_r(&seed) ^ n;
+      words[0] = stamp;
+      for (size_t i = 1; i < count; ++i) words[i] = stamp ^ (i * SPREAD);
+      if (store_publish(store, key, STORE_BYTES, words, bytes) == 0) {
+        report.failures++;
+        store_free(store, words, bytes);
+        continue;
+      }
+      report.operations++;
+      report.bytes += bytes;
+    } else {
+      store_view_t view;
+      if (store_get(store, key, &view) == -1) {  // Not published yet
+        sched_yield();
+        continue;
+      }
+      const uint64_t *words = view.data;
+      size_t words_read = view.size / sizeof(uint64_t);
+      if (n % DELAY_EVERY == 0) sched_yield();
+      size_t bad = mismatches(words, words_read);
+      if (store_check(&view) == -1) {
+        report.retries++;
+        report.retry_torn += bad > 0;
+        continue;
+      }
+      report.operations++;
+      report.bytes += view.size;
+      report.torn += bad > 0;
+      report.backwards += view.version < last_version[k];
+      last_version[k] = view.version;
+    }
+  }
+
+  if (write(report_fd, &report, sizeof(report)) != sizeof(report)) _exit(EXIT_FAILURE);
+  store_close(store);
+  _exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"writers", required_argument, NULL, 'W'},
+                                         {"readers", required_argument, NULL, 'r'},
+                                         {"keys", required_argument, NULL, 'k'},
+                                         {"mb", required_argument, NULL, 'm'},
+                                         {"seconds", required_argument, NULL, 's'},
+                                         {NULL, 0, NULL, 0}};
+  int writers = DEFAULT_WRITERS;
+  int readers = DEFAULT_READERS;
+  int keys = DEFAULT_KEYS;
+  int mb = DEFAULT_MB;
+  int seconds = DEFAULT_SECONDS;
+  int ready_pipe[2], report_pipe[2];
+  pid_t pids[MAX_PROCESSES];
+  char name[64];
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "W:r:k:m:s:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'W':
+        writers = atoi(optarg);
+        break;
+      case 'r':
+        readers = atoi(optarg);
+        break;
+      case 'k':
+        keys = atoi(optarg);
+        break;
+      case 'm':
+        mb = atoi(optarg);
+        break;
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [--writers N] [--readers N] [--keys N] [--mb N] [--seconds S]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (writers < 1 || readers < 1 || writers + readers > MAX_PROCESSES || keys < 1 || keys > MAX_KEYS || mb < 1 ||
+      seconds < 1) {
+    fprintf(stderr, "Need at least one writer and one reader, %d processes in all, 1-%d keys, 1 MB or more.\n",
+            MAX_PROCESSES, MAX_KEYS);
+    return EXIT_FAILURE;
+  }
+
+  // Room for the current version of every key, plus one block each writer is filling; blocks come
+  // in powers of two
+  size_t bytes = (size_t)mb << 20;
+  size_t block = 1;
+  while (block < bytes) block <<= 1;
+  snprintf(name, sizeof(name), "/store_stress.%d", getpid());
+  store_t *store = store_create(name, (size_t)(keys + writers) * block, HUGE_SHM_HUGE | HUGE_SHM_POPULATE);
+  if (store == NULL) {
+    perror("store_create failed");
+    return EXIT_FAILURE;
+  }
+  if (pipe(ready_pipe) == -1 || pipe(report_pipe) == -1) {
+    perror("pipe failed");
+    store_unlink(name);
+    return EXIT_FAILURE;
+  }
+  printf("Store (PID %d): %zu MB heap on %s, %d writer(s) and %d reader(s) on %d key(s) of %d MB, %d s\n", getpid(),
+         (size_t)store->header->heap_bytes >> 20, huge_shm_backing_name(store->shm.backing), writers, readers, keys, mb,
+         seconds);
+
+  double end = now_sec() + seconds;
+  int children = writers + readers;
+  for (int i = 0; i < children; ++i) {
+    pids[i] = fork();
+    if (pids[i] == -1) {
+      perror("fork failed");
+      children = i;
+      break;
+    }
+    if (pids[i] == 0) {
+      close(ready_pipe[0]);
+      close(report_pipe[0]);
+      run_child(name, i < writers, keys, bytes, end, ready_pipe[1], report_pipe[1]);
+    }
+  }
+  close(ready_pipe[1]);
+  close(report_pipe[1]);
+  for (int i = 0; i < children; ++i) {
+    char ready;
+    if (read(ready_pipe[0], &ready, 1) != 1) break;
+  }
+  store_unlink(name);  // Everyone has it mapped now
+
+  // Reports come in whatever order the children finish; each says what it did
+  int failed = 0;
+  stress_report_t written = {0}, read_total = {0};
+  for (int i = 0; i < children; ++i) {
+    stress_report_t report;
+    if (read(report_pipe[0], &report, sizeof(report)) != sizeof(report)) {
+      failed = 1;
+      continue;
+    }
+    stress_report_t *total = report.writer ? &written : &read_total;
+    total->operations += report.operations;
+    total->bytes += report.bytes;
+    total->retries += report.retries;
+    total->retry_torn += report.retry_torn;
+    total->torn += report.torn;
+    total->backwards += report.backwards;
+    total->failures += report.failures;
+  }
+  for (int i = 0; i < children; ++i) {
+    int status;
+    waitpid(pids[i], &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) failed = 1;
+  }
+  close(ready_pipe[0]);
+  close(report_pipe[0]);
+  store_close(store);
+
+  printf("Writers: %llu objects published (%.0f MB/s), %llu failed allocations or publishes\n", written.operations,
+         written.bytes / 1e6 / seconds, written.failures);
+  printf("Readers: %llu objects verified in place (%.0f MB/s), %llu reads rejected (%llu saw a block being "
+         "rewritten), %llu torn accepted, %llu backwards\n",
+         read_total.operations, read_total.bytes / 1e6 / seconds, read_total.retries, read_total.retry_torn,
+         read_total.torn, read_total.backwards);
+  if (failed || read_total.torn > 0 || read_total.backwards > 0) {
+    printf("FAILED: readers accepted torn objects or did not finish\n");
+    return EXIT_FAILURE;
+  }
+  printf("OK: no torn objects accepted\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+#include "codec.h"
+
+#include <stdint.h>  // For uint8_t, uint32_t, uint64_t
+#include <string.h>  // For memcpy, memset
+
+// Value i of a block sits in lane i % LANES; each lane packs its values into width words of its
+// own, and the lanes' words are interleaved. Every lane is at the same bit offset at every step,
+// so the lane loops below are plain vector operations.
+#define LANES32 4  // 32 values of 32 bits per lane: width words each
+#define LANES64 2  // 64 values of 64 bits per lane: width words each
+#define BLOCK_HEADER 2
+
+static unsigned bit_width32(uint32_t x) { return x == 0 ? 0 : 32 - __builtin_clz(x); }
+static unsigned bit_width64(uint64_t x) { return x == 0 ? 0 : 64 - __builtin_clzll(x); }
+
+static void pack32(const uint32_t *in, unsigned width, uint32_t *out) {
+  uint32_t acc[LANES32] = {0};
+  unsigned bit = 0;
+  size_t word = 0;
+  for (int j = 0; j < CODEC_BLOCK / LANES32; ++j) {
+    for (int l = 0; l < LANES32; ++l) acc[l] |= in[j * LANES32 + l] << bit;
+    bit += width;
+    if (bit >= 32) {
+      bit -= 32;
+      for (int l = 0; l < LANES32; ++l) out[word * LANES32 + l] = acc[l];
+      for (int l = 0; l < LANES32; ++l) acc[l] = bit > 0 ? in[j * LANES32 + l] >> (width - bit) : 0;
+      word++;
+    }
+  }
+}
+
+static void unpack32(const uint32_t *in, unsigned width, uint32_t *out) {
+  if (width == 0) {
+    memset(out, 0, CODEC_BLOCK * sizeof(uint32_t));
+    return;
+  }
+  uint32_t mask = width == 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+  unsigned bit = 0;
+  size_t word = 0;
+  for (int j = 0; j < CODEC_BLOCK / LANES32; ++j) {
+    const uint32_t *w = in + word * LANES32;
+    if (bit + width <= 32) {
+      for (int l = 0; l < LANES32; ++l) out[j * LANES32 + l] = (w[l] >> bit) & mask;
+    } else {  // Straddles two words
+      for (int l = 0; l < LANES32; ++l) {
+        out[j * LANES32 + l] = ((w[l] >> bit) | (w[LANES32 + l] << (32 - bit))) & mask;
+      }
+    }
+    bit += width;
+    if (bit >= 32) {
+      bit -= 32;
+      word++;
+    }
+  }
+}
+
+static void pack64(const uint64_t *in, unsigned width, uint64_t *out) {
+  uint64_t acc[LANES64] = {0};
+  unsigned bit = 0;
+  size_t word = 0;
+  for (int j = 0; j < CODEC_BLOCK / LANES64; ++j) {
+    for (int l = 0; l < LANES64; ++l) acc[l] |= in[j * LANES64 + l] << bit;
+    bit += width;
+    if (bit >= 64) {
+      bit -= 64;
+      for (int l = 0; l < LANES64; ++l) out[word * LANES64 + l] = acc[l];
+      for (int l = 0; l < LANES64; ++l) acc[l] = bit > 0 ? in[j * LANES64 + l] >> (width - bit) : 0;
+      word++;
+    }
+  }
+}
+
+static void unpack64(const uint64_t *in, unsigned width, uint64_t *out) {
+  if (width == 0) {
+    memset(out, 0, CODEC_BLOCK * sizeof(uint64_t));
+    return;
+  }
+  uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+  unsigned bit = 0;
+  size_t word = 0;
+  for (int j = 0; j < CODEC_BLOCK / LANES64; ++j) {
+    const uint64_t *w = in + word * LANES64;
+    if (bit + width <= 64) {
+      for (int l = 0; l < LANES64; ++l) out[j * LANES64 + l] = (w[l] >> bit) & mask;
+    } else {
+      for (int l = 0; l < LANES64; ++l) {
+        out[j * LANES64 + l] = ((w[l] >> bit) | (w[LANES64 + l] << (64 - bit))) & mask;
+      }
+    }
+    bit += width;
+    if (bit >= 64) {
+      bit -= 64;
+      word++;
+    }
+  }
+}
+
+// Drop the zero bits all residuals share at the bottom, pack them at the width the rest needs, and
+// emit the block; returns its size
+static size_t emit32(uint32_t *r, uint8_t *out) {
+  uint32_t any = 0;
+  for (int i = 0; i < CODEC_BLOCK; ++i) any |= r[i];
+  unsigned shift = any == 0 ? 0 : __builtin_ctz(any);
+  unsigned width = bit_width32(any >> shift);
+  for (int i = 0; i < CODEC_BLOCK; ++i) r[i] >>= shift;
+  uint32_t packed[CODEC_BLOCK];
+  pack32(r, width, packed);
+  out[0] = (uint8_t)width;
+  out[1] = (uint8_t)shift;
+  memcpy(out + BLOCK_HEADER, packed, width * LANES32 * sizeof(uint32_t));
+  return BLOCK_HEADER + width * LANES32 * sizeof(uint32_t);
+}
+
+static size_t emit64(uint64_t *r, uint8_t *out) {
+  uint64_t any = 0;
+  for (int i = 0; i < CODEC_BLOCK; ++i) any |= r[i];
+  unsigned shift = any == 0 ? 0 : __builtin_ctzll(any);
+  unsigned width = bit_width64(any >> shift);
+  for (int i = 0; i < CODEC_BLOCK; ++i) r[i] >>= shift;
+  uint64_t packed[CODEC_BLOCK];
+  pack64(r, width, packed);
+  out[0] = (uint8_t)width;
+  out[1] = (uint8_t)shift;
+  memcpy(out + BLOCK_HEADER, packed, width * LANES64 * sizeof(uint64_t));
+  return BLOCK_HEADER + width * LANES64 * sizeof(uint64_t);
+}
+
+// Read a block's residuals back, shifted into place; returns its size, 0 if it does not fit
+static size_t take32(const uint8_t *in, size_t in_bytes, uint32_t *r) {
+  if (in_bytes < BLOCK_HEADER || in[0] > 32 || in[1] > 31) return 0;
+  unsigned width = in[0];
+  unsigned shift = in[1];
+  size_t bytes = BLOCK_HEADER + width * LANES32 * sizeof(uint32_t);
+  if (in_bytes < bytes) return 0;
+  uint32_t packed[CODEC_BLOCK + LANES32];
+  memcpy(packed, in + BLOCK_HEADER, bytes - BLOCK_HEADER);
+  unpack32(packed, width, r);
+  for (int i = 0; i < CODEC_BLOCK; ++i) r[i] <<= shift;
+  return bytes;
+}
+
+static size_t take64(const uint8_t *in, size_t in_bytes, uint64_t *r) {
+  if (in_bytes < BLOCK_HEADER || in[0] > 64 || in[1] > 63) return 0;
+  unsigned width = in[0];
+  unsigned shift = in[1];
+  size_t bytes = BLOCK_HEADER + width * LANES64 * sizeof(uint64_t);
+  if (in_bytes < bytes) return 0;
+  uint64_t packed[CODEC_BLOCK + LANES64];
+  memcpy(packed, in + BLOCK_HEADER, bytes - BLOCK_HEADER);
+  unpack64(packed, width, r);
+  for (int i = 0; i < CODEC_BLOCK; ++i) r[i] <<= shift;
+  return bytes;
+}
+
+size_t codec_bound(sample_type_t type, size_t count) {
+  size_t blocks = (count + CODEC_BLOCK - 1) / CODEC_BLOCK;
+  size_t bits = type == SAMPLE_FLOAT64 ? 64 : 32;
+  return blocks * (BLOCK_HEADER + CODEC_BLOCK * bits / 8);
+}
+
+size_t codec_encode(sample_type_t type, const void *samples, size_t count, void *out) {
+  uint8_t *p = out;
+  if (type == SAMPLE_FLOAT64) {
+    const uint64_t *x = samples;
+    uint64_t prev = 0;
+    for (size_t done = 0; done < count; done += CODEC_BLOCK) {
+      size_t n = count - done < CODEC_BLOCK ? count - done : CODEC_BLOCK;
+      uint64_t r[CODEC_BLOCK] = {0};
+      r[0] = x[done] ^ prev;
+      for (size_t i = 1; i < n; ++i) r[i] = x[done + i] ^ x[done + i - 1];
+      prev = x[done + n - 1];
+      p += emit64(r, p);
+    }
+  } else if (type == SAMPLE_INT16) {
+    const short *x = samples;
+    int prev = 0;
+    int prev_delta = 0;
+    for (size_t done = 0; done < count; done += CODEC_BLOCK) {
+      size_t n = count - done < CODEC_BLOCK ? count - done : CODEC_BLOCK;
+      uint32_t r[CODEC_BLOCK] = {0};
+      for (size_t i = 0; i < n; ++i) {
+        int delta = x[done + i] - prev;
+        int dd = delta - prev_delta;
+        r[i] = ((uint32_t)dd << 1) ^ (uint32_t)(dd >> 31);  // Zigzag: small magnitudes, small codes
+        prev = x[done + i];
+        prev_delta = delta;
+      }
+      p += emit32(r, p);
+    }
+  } else {
+    const uint32_t *x = samples;
+    uint32_t prev = 0;
+    for (size_t done = 0; done < count; done += CODEC_BLOCK) {
+      size_t n = count - done < CODEC_BLOCK ? count - done : CODEC_BLOCK;
+      uint32_t r[CODEC_BLOCK] = {0};
+      r[0] = x[done] ^ prev;
+      for (size_t i = 1; i < n; ++i) r[i] = x[done + i] ^ x[done + i - 1];
+      prev = x[done + n - 1];
+      p += emit32(r, p);
+    }
+  }
+  return p - (uint8_t *)out;
+}
+
+size_t codec_decode(sample_type_t type, const void *in, size_t in_bytes, size_t count, void *samples) {
+  const uint8_t *p = in;
+  const uint8_t *end = p + in_bytes;
+  if (type == SAMPLE_FLOAT64) {
+    uint64_t *x = samples;
+    uint64_t prev = 0;
+    for (size_t done = 0; done < count; done += CODEC_BLOCK) {
+      uint64_t r[CODEC_BLOCK];
+      size_t bytes = take64(p, end - p, r);
+      if (bytes == 0) return 0;
+      p += bytes;
+      size_t n = count - done < CODEC_BLOCK ? count - done : CODEC_BLOCK;
+      for (size_t i = 0; i < n; ++i) x[done + i] = prev ^= r[i];
+    }
+  } else if (type == SAMPLE_INT16) {
+    short *x = samples;
+    int prev = 0;
+    int prev_delta = 0;
+    for (size_t done = 0; done < count; done += CODEC_BLOCK) {
+      uint32_t r[CODEC_BLOCK];
+      size_t bytes = take32(p, end - p, r);
+      if (bytes == 0) return 0;
+      p += bytes;
+      size_t n = count - done < CODEC_BLOCK ? count - done : CODEC_BLOCK;
+      for (size_t i = 0; i < n; ++i) {
+        prev_delta += (int)(r[i] >> 1) ^ -(int)(r[i] & 1);
+        prev += prev_delta;
+        x[done + i] = (short)prev;
+      }
+    }
+  } else {
+    uint32_t *x = samples;
+    uint32_t prev = 0;
+    for (size_t done = 0; done < count; done += CODEC_BLOCK) {
+      uint32_t r[CODEC_BLOCK];
+      size_t bytes = take32(p, end - p, r);
+      if (bytes == 0) return 0;
+      p += bytes;
+      size_t n = count - done < CODEC_BLOCK ? count - done : CODEC_BLOCK;
+      for (size_t i = 0; i < n; ++i) x[done + i] = prev ^= r[i];
+    }
+  }
+  return p - (const uint8_t *)in;
+}
+
+const char *codec_name(sample_type_t type) { return type == SAMPLE_INT16 ? "delta2" : "xor"; }
@@ -0,0 +1,32 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>  // For size_t
+
+#include "shm_common.h"
+
+// Lossless block codec for one channel of samples. Floats are XORed with the previous sample
+// (Gorilla's observation: neighbouring samples share sign, exponent and the top of the mantissa,
+// so the XOR has long runs of leading and trailing zeros); int16 samples become their delta of
+// delta, zigzag-coded. Instead of Gorilla's per-sample bit stream, every block of CODEC_BLOCK
+// residuals drops the zero bits they all share at the top and bottom and is bit-packed at one
+// width, lanes interleaved, so packing and unpacking run as SIMD loops with no per-sample branches.
+//
+// A block is [width][shift][CODEC_BLOCK * width bits]; the last one is padded with zero residuals.
+
+#define CODEC_BLOCK 128
+
+// Most bytes codec_encode() writes for count samples of type
+size_t codec_bound(sample_type_t type, size_t count);
+
+// Encode count samples into out, which must hold codec_bound() bytes; returns the bytes written
+size_t codec_encode(sample_type_t type, const void *samples, size_t count, void *out);
+
+// Decode count samples from in_bytes bytes of in; returns the bytes used, 0 when in is too short
+// or corrupt
+size_t codec_decode(sample_type_t type, const void *in, size_t in_bytes, size_t count, void *samples);
+
+// "xor" for float types, "delta2" for int16
+const char *codec_name(sample_type_t type);
+
+#endif  // CODEC_H
@@ -0,0 +1,228 @@
+// Benchmark for the sample codec: compression ratio and encode/decode speed on a clean sine, white
+// noise and a sensor-like signal (harmonics, drift and noise, quantized like an ADC would), in
+// every sample type, checking that each round trip is bit-exact. --pipe also sends each signal
+// through a pipe to a child process, raw and encoded, to show the codec as a transport.
+#include <getopt.h>    // For getopt_long
+#include <math.h>      // For sin, lrint
+#include <stdio.h>     // For printf, perror
+#include <stdlib.h>    // For atol, malloc, free, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>    // For memcmp
+#include <sys/wait.h>  // For waitpid
+#include <time.h>      // For clock_gettime
+#include <unistd.h>    // For fork, pipe, read, write, close, _exit
+
+#include "codec.h"
+#include "oscillator.h"
+#include "shm_common.h"
+#include "shm_ring.h"
+
+#define DEFAULT_SAMPLES (1 << 22)
+#define BENCH_RATE 48000.0
+#define MIN_BENCH_NS 200000000LL  // Repeat each measurement for at least this long
+#define PIPE_FRAME 65536          // Samples per message in --pipe mode
+
+typedef enum { SIGNAL_SINE, SIGNAL_NOISE, SIGNAL_SENSOR } signal_t;
+static const char *signal_names[] = {"sine", "noise", "sensor"};
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+float uniform(unsigned int *state) {
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return (float)x / 2147483648.0f - 1.0f;
+}
+
+void generate(signal_t signal, float *out, size_t count) {
+  unsigned int state = 2463534242u;
+  if (signal == SIGNAL_SINE) {
+    oscillator_t osc;
+    oscillator_init(&osc, 1000.0, BENCH_RATE, 1.0);
+    oscillator_generate(&osc, out, count);
+  } else if (signal == SIGNAL_NOISE) {
+    for (size_t i = 0; i < count; ++i) out[i] = uniform(&state);
+  } else {
+    // 50 Hz mains pickup with harmonics, a slow random-walk drift and a little noise, read by a
+    // 16-bit converter: the values are multiples of its step, as recorded sensor data is
+    double drift = 0;
+    for (size_t i = 0; i < count; ++i) {
+      double t = i / BENCH_RATE;
+      drift += 0.0005 * uniform(&state);
+      double v = 0.5 * sin(2 * PI * 50 * t) + 0.1 * sin(2 * PI * 150 * t) + 0.05 * sin(2 * PI * 250 * t) + drift +
+                 0.01 * uniform(&state);
+      out[i] = (float)(lrint(v * 16384) / 16384.0);
+    }
+  }
+}
+
+// Seconds per call of encode or decode, repeated for at least MIN_BENCH_NS
+double time_codec(int decode, sample_type_t type, const void *samples, void *encoded, size_t encoded_bytes,
+                  void *decoded, size_t count) {
+  long long start = now_ns();
+  long long elapsed;
+  long runs = 0;
+  do {
+    if (decode) {
+      codec_decode(type, encoded, encoded_bytes, count, decoded);
+    } else {
+      codec_encode(type, samples, count, encoded);
+    }
+    runs++;
+    elapsed = now_ns() - start;
+  } while (elapsed < MIN_BENCH_NS);
+  return elapsed / 1e9 / runs;
+}
+
+int write_all(int fd, const void *buf, size_t count) {
+  const char *p = buf;
+  while (count > 0) {
+    ssize_t n = write(fd, p, count);
+    if (n <= 0) return -1;
+    p += n;
+    count -= n;
+  }
+  return 0;
+}
+
+int read_all(int fd, void *buf, size_t count) {
+  char *p = buf;
+  while (count > 0) {
+    ssize_t n = read(fd, p, count);
+    if (n <= 0) return -1;
+    p += n;
+    count -= n;
+  }
+  return 0;
+}
+
+// Stream count samples to a child through a pipe, PIPE_FRAME at a time, each message a byte count
+// and then the samples raw or encoded; the child decodes and checks them. Returns seconds taken.
+double pipe_transport(sample_type_t type, const char *samples, size_t count, int encode) {
+  size_t sample_size = sample_type_size(type);
+  int fds[2];
+  if (pipe(fds) == -1) {
+    perror("pipe failed");
+    return -1;
+  }
+  long long start = now_ns();
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork failed");
+    return -1;
+  }
+  if (pid == 0) {
+    close(fds[1]);
+    char *message = malloc(codec_bound(type, PIPE_FRAME));
+    char *frame = malloc(PIPE_FRAME * sample_size);
+    int ok = message != NULL && frame != NULL;
+    for (size_t done = 0; ok && done < count; done += PIPE_FRAME) {
+      size_t n = count - done < PIPE_FRAME ? count - done : PIPE_FRAME;
+      size_t bytes;
+      ok = read_all(fds[0], &bytes, sizeof(bytes)) == 0 && read_all(fds[0], message, bytes) == 0;
+      if (ok && encode) ok = codec_decode(type, message, bytes, n, frame) == bytes;
+      ok = ok && memcmp(encode ? frame : message, samples + done * sample_size, n * sample_size) == 0;
+    }
+    _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  close(fds[0]);
+  char *message = malloc(codec_bound(type, PIPE_FRAME));
+  int ok = message != NULL;
+  for (size_t done = 0; ok && done < count; done += PIPE_FRAME) {
+    size_t n = count - done < PIPE_FRAME ? count - done : PIPE_FRAME;
+    const char *frame = samples + done * sample_size;
+    size_t bytes = encode ? codec_encode(type, frame, n, message) : n * sample_size;
+    ok = write_all(fds[1], &bytes, sizeof(bytes)) == 0 && write_all(fds[1], encode ? message : frame, bytes) == 0;
+  }
+  close(fds[1]);
+  free(message);
+  int status;
+  waitpid(pid, &status, 0);
+  if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) return -1;
+  return (now_ns() - start) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+      {"samples", required_argument, NULL, 'n'}, {"pipe", no_argument, NULL, 'p'}, {NULL, 0, NULL, 0}};
+  size_t count = DEFAULT_SAMPLES;
+  int use_pipe = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "n:p", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'n':
+        count = atol(optarg);
+        break;
+      case 'p':
+        use_pipe = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [--samples N] [--pipe]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (count < 1) {
+    fprintf(stderr, "Need at least one sample.\n");
+    return EXIT_FAILURE;
+  }
+
+  static const sample_type_t types[] = {SAMPLE_FLOAT32, SAMPLE_FLOAT64, SAMPLE_INT16};
+  float *signal = malloc(count * sizeof(float));
+  void *samples = malloc(count * sizeof(double));
+  void *decoded = malloc(count * sizeof(double));
+  void *encoded = malloc(codec_bound(SAMPLE_FLOAT64, count));
+  if (signal == NULL || samples == NULL || decoded == NULL || encoded == NULL) {
+    perror("malloc failed");
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu samples per signal; speeds in GB/s of raw samples\n", count);
+  printf("%-7s %-7s %-7s %8s %8s %8s", "signal", "type", "codec", "ratio", "encode", "decode");
+  if (use_pipe) printf(" %10s %10s", "pipe raw", "pipe enc");
+  printf("\n");
+  int failed = 0;
+  for (int s = SIGNAL_SINE; s <= SIGNAL_SENSOR; ++s) {
+    generate(s, signal, count);
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+      sample_type_t type = types[t];
+      circular_buffer_shm_t format = {.sample_type = type, .scale = 1.0 / 32767};
+      samples_from_float(&format, signal, samples, count);
+      double raw_bytes = (double)count * sample_type_size(type);
+
+      size_t encoded_bytes = codec_encode(type, samples, count, encoded);
+      size_t used = codec_decode(type, encoded, encoded_bytes, count, decoded);
+      if (used != encoded_bytes || memcmp(samples, decoded, raw_bytes) != 0) {
+        printf("%-7s %-7s round trip FAILED\n", signal_names[s], sample_type_name(type));
+        failed = 1;
+        continue;
+      }
+      double encode_s = time_codec(0, type, samples, encoded, encoded_bytes, decoded, count);
+      double decode_s = time_codec(1, type, samples, encoded, encoded_bytes, decoded, count);
+      printf("%-7s %-7s %-7s %8.2f %8.2f %8.2f", signal_names[s], sample_type_name(type), codec_name(type),
+             raw_bytes / encoded_bytes, raw_bytes / encode_s / 1e9, raw_bytes / decode_s / 1e9);
+      if (use_pipe) {
+        double raw_s = pipe_transport(type, samples, count, 0);
+        double enc_s = pipe_transport(type, samples, count, 1);
+        if (raw_s < 0 || enc_s < 0) failed = 1;
+        printf(" %10.2f %10.2f", raw_bytes / raw_s / 1e9, raw_bytes / enc_s / 1e9);
+      }
+      printf("\n");
+    }
+  }
+
+  free(signal);
+  free(samples);
+  free(decoded);
+  free(encoded);
+  if (failed) {
+    printf("FAILED: a round trip did not reproduce the samples exactly\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -1,90 +1,165 @@
-#include <errno.h>     // For errno, ENOENT
-#include <fcntl.h>     // For O_RDONLY
-#include <stdio.h>     // For printf, perror
-#include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE
-#include <sys/mman.h>  // For mmap, munmap
-#include <unistd.h>    // For close, usleep
+#include <errno.h>   // For errno, ENOENT, EAGAIN
+#include <getopt.h>  // For getopt_long
+#include <signal.h>  // For sigaction, SIGINT, SIGTERM
+#include <stdio.h>   // For printf, perror
+#include <stdlib.h>  // For EXIT_SUCCESS, EXIT_FAILURE, strtoul
+#include <time.h>    // For clock_gettime
+#include <unistd.h>  // For sleep, getpid
 
 #include "shm_common.h"
+#include "shm_ring.h"
 
-#define AVG_UPDATE_FREQ 10.0  // Hz (10 times per second)
+#define AVG_UPDATE_FREQ 10.0  // Hz (reports 10 times per second)
 #define ALPHA 0.1             // EMA smoothing factor
+#define CHUNK_SAMPLES 256     // Samples copied out of the ring at a time
 
-int main(void) {
-  int shm_fd;
-  circular_buffer_shm_t *shm_buffer;
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_stop(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--channel N]\n"
+          "  --channel N  channel of the stream to average (default 0)\n",
+          prog);
+}
+
+int main(int argc, char *argv[]) {
+  ring_t *shm_buffer;
+  unsigned int channel = 0;
   float ema = 0.0;
-  int last_read_pos = -1;  // To track if we've read this sample before
+  float latest_sample = 0.0;
+  float chunk[CHUNK_SAMPLES];
+  unsigned long long last_read = 0;  // Our cursor: every sample below it has been folded in
+  unsigned long wakeups = 0;         // Since the last report
+  unsigned long long folded = 0;
+  unsigned long long skipped = 0;  // Lapped by the producer before we got to them
+  long long latency_sum_ns = 0;
+  long long latency_max_ns = 0;
+
+  static const struct option long_options[] = {{"channel", required_argument, NULL, 'c'}, {NULL, 0, NULL, 0}};
+  int opt;
+  while ((opt = getopt_long(argc, argv, "c:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'c':
+        channel = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  struct sigaction sa = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
 
   printf("--- Consumer K_AVG (PID %d) ---\n", getpid());
 
-  // Open the shared memory segment (loop until available)
+  // Open the shared memory ring read-only (loop until the producer has created it)
   while (1) {
-    shm_fd = shm_open(SHM_NAME, O_RDONLY, 0);  // O_RDONLY for reading, mode 0
-    if (shm_fd == -1) {
-      if (errno == ENOENT) {
-        fprintf(stderr, "K_AVG: Shared memory '%s' not found. Retrying in 1 second...\n", SHM_NAME);
-        sleep(1);
-      } else {
-        perror("shm_open failed unexpectedly");
-        return EXIT_FAILURE;
-      }
+    shm_buffer = ring_open(SHM_NAME);
+    if (shm_buffer != NULL) break;
+    if (stop_requested) return EXIT_SUCCESS;
+    if (errno == ENOENT || errno == EAGAIN) {
+      fprintf(stderr, "K_AVG: Shared memory '%s' not ready. Retrying in 1 second...\n", SHM_NAME);
+      sleep(1);
     } else {
-      printf("K_AVG: Shared memory segment '%s' opened (FD: %d).\n", SHM_NAME, shm_fd);
-      break;
+      perror("ring_open failed unexpectedly");
+      return EXIT_FAILURE;
     }
   }
-
-  // Map the shared memory segment into the process's address space
-  shm_buffer = mmap(0, sizeof(circular_buffer_shm_t), PROT_READ, MAP_SHARED, shm_fd, 0);
-  if (shm_buffer == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
+  const circular_buffer_shm_t *header = shm_buffer->header;
+  printf("K_AVG: Shared memory ring '%s' mapped to address %p: %u channel(s) of %s at %.0f Hz, %u samples each.\n",
+         SHM_NAME, (void *)header, header->channels, sample_type_name(header->sample_type), header->sample_rate,
+         header->capacity);
+  if (channel >= header->channels) {
+    fprintf(stderr, "K_AVG: The stream has no channel %u.\n", channel);
+    ring_close(shm_buffer);
     return EXIT_FAILURE;
   }
-  printf("K_AVG: Shared memory mapped to address %p.\n", (void *)shm_buffer);
 
-  printf("K_AVG: Monitoring Exponential Moving Average (EMA)...\n");
+  // Registered, a producer running with --policy block or skip keeps unread samples for us
+  if (ring_register(shm_buffer, ring_write_index(shm_buffer)) == -1) {
+    perror("K_AVG: ring_register failed, reading unregistered");
+  }
 
-  // Loop to update EMA 10 times per second
-  while (1) {
-    // Get the current write position from the producer
-    int current_write_pos = shm_buffer->write_pos;
+  printf("K_AVG: Monitoring Exponential Moving Average (EMA) of channel %u...\n", channel);
 
-    // Calculate the position of the latest written sample
-    //(write_pos) points to the next free slot, so latest is at (write_pos - 1))
-    int latest_sample_pos = (current_write_pos - 1 + BUFFER_CAPACITY) % BUFFER_CAPACITY;
+  // Fold every sample into the EMA as soon as the producer publishes it, sleeping on the ring's
+  // futex in between; report 10 times per second
+  long long period_ns = (long long)(1e9 / AVG_UPDATE_FREQ);
+  long long next_report_ns = now_ns() + period_ns;
+  while (!stop_requested) {
+    long long timeout_ns = next_report_ns - now_ns();
+    unsigned long long write_index = ring_wait(shm_buffer, last_read + 1, timeout_ns > 0 ? timeout_ns : 0);
 
-    // Only update EMA if a new sample has been written since last check
-    if (latest_sample_pos != last_read_pos) {
-      float latest_sample = shm_buffer->samples[latest_sample_pos];
+    if (write_index > last_read) {
+      long long latency_ns = ring_publish_age_ns(shm_buffer);
+      wakeups++;
+      latency_sum_ns += latency_ns;
+      if (latency_ns > latency_max_ns) latency_max_ns = latency_ns;
 
-      // Initialize EMA with the first sample
-      if (last_read_pos == -1) {
-        ema = latest_sample;
-      } else {
-        // Update EMA: EMA_new = alpha * current_sample + (1 - alpha) * EMA_old
-        ema = ALPHA * latest_sample + (1.0 - ALPHA) * ema;
+      unsigned long long skipped_before = skipped;
+      // Start from the latest sample on the first pass, and never from one already recycled
+      unsigned long long from = last_read == 0 ? write_index - 1 : last_read;
+      unsigned long long oldest = ring_oldest(shm_buffer, write_index);
+      if (from < oldest) {
+        skipped += oldest - from;
+        from = oldest;
       }
-      printf("K_AVG: Latest Sample: %.4f at pos %d, Current EMA (alpha=%.2f): %.4f\n", latest_sample, latest_sample_pos,
-             ALPHA, ema);
-      last_read_pos = latest_sample_pos;
-    } else {
-      printf("K_AVG: No new sample yet. EMA: %.4f\n", ema);
+      while (from < write_index) {
+        size_t count = write_index - from < CHUNK_SAMPLES ? write_index - from : CHUNK_SAMPLES;
+        if (ring_copy_float(shm_buffer, channel, from, count, chunk) == -1) {  // Lapped while copying: skip ahead
+          unsigned long long ahead = ring_oldest(shm_buffer, ring_write_index(shm_buffer));
+          skipped += ahead > from ? ahead - from : 0;
+          from = ahead > from ? ahead : from;
+          continue;
+        }
+        for (size_t i = 0; i < count; ++i) {
+          // Initialize EMA with the first sample, then EMA_new = alpha * current_sample + (1 - alpha) * EMA_old
+          ema = last_read == 0 && i == 0 ? chunk[0] : ALPHA * chunk[i] + (1.0 - ALPHA) * ema;
+        }
+        latest_sample = chunk[count - 1];
+        folded += count;
+        from += count;
+        last_read = from;
+      }
+      ring_advance(shm_buffer, last_read, skipped - skipped_before);
     }
 
-    // Sleep to update EMA at the desired frequency: 100ms for 10Hz
-    usleep(1000000 / AVG_UPDATE_FREQ);
+    if (now_ns() >= next_report_ns) {
+      if (wakeups > 0) {
+        printf("K_AVG: Latest Sample: %.4f, Current EMA (alpha=%.2f): %.4f | %lu wakeups, %llu samples, %llu skipped, "
+               "wake latency avg %.1f us max %.1f us\n",
+               latest_sample, ALPHA, ema, wakeups, folded, skipped, latency_sum_ns / 1000.0 / wakeups,
+               latency_max_ns / 1000.0);
+      } else {
+        printf("K_AVG: No new sample yet. EMA: %.4f\n", ema);
+      }
+      wakeups = 0;
+      folded = 0;
+      skipped = 0;
+      latency_sum_ns = 0;
+      latency_max_ns = 0;
+      next_report_ns += period_ns;
+    }
   }
 
-  // Consumers do not unlink the shared memory
+  // Give our slot back first, so that a producer under --policy block or skip stops keeping samples
+  // for us. Consumers do not unlink the shared memory.
   printf("K_AVG: Cleaning up shared memory.\n");
-  if (munmap(shm_buffer, sizeof(circular_buffer_shm_t)) == -1) {
-    perror("munmap failed");
-  }
-  if (close(shm_fd) == -1) {
-    perror("close shm_fd failed");
-  }
+  ring_unregister(shm_buffer);
+  ring_close(shm_buffer);
 
   return EXIT_SUCCESS;
 }
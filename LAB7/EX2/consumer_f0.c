@@ -1,102 +1,242 @@
-#include <errno.h>     // For errno, ENOENT
-#include <fcntl.h>     // For O_RDONLY
-#include <math.h>      // For fabs
-#include <stdio.h>     // For printf, perror
-#include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE
-#include <sys/mman.h>  // For mmap, munmap
-#include <unistd.h>    // For close, sleep
-
+#include <errno.h>   // For errno, ENOENT, EAGAIN
+#include <getopt.h>  // For getopt_long
+#include <signal.h>  // For sigaction, SIGINT, SIGTERM
+#include <stdio.h>   // For printf, perror
+#include <stdlib.h>  // For atof, atoi, strtoul, malloc, free, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>  // For memmove
+#include <time.h>    // For clock_gettime
+#include <unistd.h>  // For sleep, getpid
+
+#include "f0_estimator.h"
 #include "shm_common.h"
+#include "shm_ring.h"
 
-#define F0_ESTIMATE_FREQ 1.0                   // Hz (once per second)
-#define SAMPLES_PER_WINDOW (int)SAMPLING_FREQ  // Number of samples for a 1-second window
+#define DEFAULT_FMIN 20.0             // Hz, lowest frequency searched for
+#define WAIT_TIMEOUT_NS 2000000000LL  // Report a stalled producer after 2 s
+#define STOP_CHECK_NS 200000000LL     // Check for Ctrl+C at least this often
 
-int main(void) {
-  int shm_fd;
-  circular_buffer_shm_t *shm_buffer;
+volatile sig_atomic_t stop_requested = 0;
 
-  printf("--- Consumer K_F0 (PID %d) ---\n", getpid());
+void handle_stop(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
 
-  // Open the shared memory segment (loop until available)
-  while (1) {
-    shm_fd = shm_open(SHM_NAME, O_RDONLY, 0);  // O_RDONLY for reading, mode 0
-    if (shm_fd == -1) {
-      if (errno == ENOENT) {
-        fprintf(stderr, "K_F0: Shared memory '%s' not found. Retrying in 1 second...\n", SHM_NAME);
-        sleep(1);
-      } else {
-        perror("shm_open failed unexpectedly");
+long long clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--method fft|yin|zc] [--window SAMPLES | --update-hz HZ] [--channel N] [--fmin HZ] [--fmax HZ]\n"
+          "          [--expect HZ]\n",
+          prog);
+  fprintf(stderr, "  --method      estimator (default fft)\n");
+  fprintf(stderr, "  --window N    samples per estimate; windows overlap by 50%% (default: 1 second of samples)\n");
+  fprintf(stderr, "  --update-hz   estimates per second instead, i.e. a window of 2 * rate / HZ samples\n");
+  fprintf(stderr, "  --channel N   channel of the stream to follow (default 0)\n");
+  fprintf(stderr, "  --fmin/fmax   search range (default %.0f Hz to rate / 4)\n", DEFAULT_FMIN);
+  fprintf(stderr, "  --expect HZ   true frequency, to print the estimation error\n");
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"method", required_argument, NULL, 'm'},
+                                         {"window", required_argument, NULL, 'w'},
+                                         {"update-hz", required_argument, NULL, 'u'},
+                                         {"channel", required_argument, NULL, 'c'},
+                                         {"fmin", required_argument, NULL, 'f'},
+                                         {"fmax", required_argument, NULL, 'F'},
+                                         {"expect", required_argument, NULL, 'e'},
+                                         {NULL, 0, NULL, 0}};
+  ring_t *shm_buffer;
+  f0_method_t method = F0_FFT;
+  int window_len = 0;
+  double update_hz = 0;
+  unsigned int channel = 0;
+  double fmin = DEFAULT_FMIN;
+  double fmax = 0;
+  double expect = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "m:w:u:c:f:F:e:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'm':
+        if (f0_parse_method(optarg, &method) == -1) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'w':
+        window_len = atoi(optarg);
+        break;
+      case 'u':
+        update_hz = atof(optarg);
+        break;
+      case 'c':
+        channel = strtoul(optarg, NULL, 10);
+        break;
+      case 'f':
+        fmin = atof(optarg);
+        break;
+      case 'F':
+        fmax = atof(optarg);
+        break;
+      case 'e':
+        expect = atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
         return EXIT_FAILURE;
-      }
-    } else {
-      printf("K_F0: Shared memory segment '%s' opened (FD: %d).\n", SHM_NAME, shm_fd);
-      break;
     }
   }
+  struct sigaction sa = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
 
-  // Map the shared memory segment into the process's address space
-  shm_buffer = mmap(0, sizeof(circular_buffer_shm_t), PROT_READ, MAP_SHARED, shm_fd, 0);
-  if (shm_buffer == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
-    return EXIT_FAILURE;
-  }
-  printf("K_F0: Shared memory mapped to address %p.\n", (void *)shm_buffer);
-
-  printf("K_F0: Estimating signal frequency (Ctrl+C to stop)...\n");
+  printf("--- Consumer K_F0 (PID %d) ---\n", getpid());
 
-  // Loop to estimate frequency once per second
+  // Open the shared memory ring read-only (loop until the producer has created it)
   while (1) {
-    // Check if enough samples have been written by the producer
-    if (shm_buffer->total_samples_written < SAMPLES_PER_WINDOW) {
-      printf("K_F0: Not enough samples (currently %lld/%d). Waiting...\n", shm_buffer->total_samples_written,
-             SAMPLES_PER_WINDOW);
+    shm_buffer = ring_open(SHM_NAME);
+    if (shm_buffer != NULL) break;
+    if (stop_requested) return EXIT_SUCCESS;
+    if (errno == ENOENT || errno == EAGAIN) {
+      fprintf(stderr, "K_F0: Shared memory '%s' not ready. Retrying in 1 second...\n", SHM_NAME);
       sleep(1);
-      continue;  // Skip estimation until enough data is available
+    } else {
+      perror("ring_open failed unexpectedly");
+      return EXIT_FAILURE;
     }
+  }
+  // Everything else follows from the stream's own description of itself
+  const circular_buffer_shm_t *header = shm_buffer->header;
+  double rate = header->sample_rate;
+  printf("K_F0: Shared memory ring '%s' mapped to address %p: %u channel(s) of %s at %.0f Hz, %u samples each.\n",
+         SHM_NAME, (void *)header, header->channels, sample_type_name(header->sample_type), rate, header->capacity);
+  if (channel >= header->channels) {
+    fprintf(stderr, "K_F0: The stream has no channel %u.\n", channel);
+    ring_close(shm_buffer);
+    return EXIT_FAILURE;
+  }
+  if (window_len == 0) window_len = update_hz > 0 ? (int)(2 * rate / update_hz) : (int)rate;
+  if (fmax == 0) fmax = rate / 4;
+  int hop = window_len / 2;  // 50% overlap: each estimate reuses the newer half of the previous window
+  f0_estimator_t *estimator = f0_estimator_create(method, window_len, rate, fmin, fmax);
+  if (estimator == NULL || hop < 1) {
+    fprintf(stderr, "K_F0: Cannot estimate %.1f-%.1f Hz with %s over %d samples at %.0f Hz.\n", fmin, fmax,
+            f0_method_name(method), window_len, rate);
+    ring_close(shm_buffer);
+    return EXIT_FAILURE;
+  }
+  float *window = malloc(window_len * sizeof(float));
+  if (window == NULL) {
+    perror("malloc failed");
+    ring_close(shm_buffer);
+    f0_estimator_destroy(estimator);
+    return EXIT_FAILURE;
+  }
 
-    int current_write_pos = shm_buffer->write_pos;
-    int zero_crossings = 0;
-    float prev_sample;
-
-    // Determine the starting position
-    // Read SAMPLES_PER_WINDOW samples ending at (current_write_pos - 1)
-    int start_read_pos = (current_write_pos - SAMPLES_PER_WINDOW + BUFFER_CAPACITY) % BUFFER_CAPACITY;
-
-    // Get the first sample for comparison (sample before start_read_pos)
-    int initial_compare_pos = (start_read_pos - 1 + BUFFER_CAPACITY) % BUFFER_CAPACITY;
-    prev_sample = shm_buffer->samples[initial_compare_pos];
-
-    // Iterate through the window to count zero crossings
-    for (int i = 0; i < SAMPLES_PER_WINDOW; ++i) {
-      int current_sample_pos = (start_read_pos + i) % BUFFER_CAPACITY;
-      float current_sample = shm_buffer->samples[current_sample_pos];
-
-      // Check for zero crossing (sign change)
-      if ((prev_sample < 0 && current_sample >= 0) || (prev_sample > 0 && current_sample <= 0)) {
-        zero_crossings++;
+  printf("K_F0: Estimating channel %u with %s over %d-sample windows every %d samples (%.2f estimates/s)...\n",
+         channel, f0_method_name(method), window_len, hop, rate / hop);
+
+  // The window slides by hop, sleeping on the ring's futex until the next hop is published. A
+  // float window that fits in the ring is estimated in place; a longer one, or another sample type,
+  // is kept locally, and each update copies (and converts) only the samples published since the
+  // previous one out of the ring.
+  unsigned long long cursor = 0;  // Next sample to copy out of the ring
+  int filled = 0;                 // Valid samples in window, newest last
+  int fresh = 0;                  // Samples added since the previous estimate
+  int started = 0;
+  unsigned long long lost = 0;  // Recycled before we copied them; the window restarts after a gap
+  long long last_cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+  long long last_wall_ns = clock_ns(CLOCK_MONOTONIC);
+  long long idle_ns = 0;  // Waited without a new sample
+  while (!stop_requested) {
+    // Wake at least every half ring, so a window longer than the ring still arrives intact
+    int needed = filled < window_len ? window_len - filled : hop - fresh;
+    if (needed > (int)header->capacity / 2) needed = header->capacity / 2;
+    unsigned long long write_index = ring_wait(shm_buffer, cursor + (needed > 0 ? needed : 1), STOP_CHECK_NS);
+    if (!started) {
+      // Start from as much history as the ring still holds
+      unsigned long long oldest = ring_oldest(shm_buffer, write_index);
+      cursor = write_index > (unsigned long long)window_len ? write_index - window_len : 0;
+      if (cursor < oldest) cursor = oldest;
+      started = 1;
+      continue;
+    }
+    if (write_index <= cursor) {
+      idle_ns += STOP_CHECK_NS;
+      if (idle_ns >= WAIT_TIMEOUT_NS) {
+        printf("K_F0: No new samples (currently %llu). Waiting...\n", write_index);
+        idle_ns = 0;
       }
-      prev_sample = current_sample;
+      continue;
     }
-
-    // Estimate frequency: (zero crossings / 2) / window_duration (1 second)
-    float estimated_freq = (float)zero_crossings / 2.0f;
-
-    printf("K_F0: Estimated Frequency: %.2f Hz (Zero Crossings: %d in %d samples)\n", estimated_freq, zero_crossings,
-           SAMPLES_PER_WINDOW);
-
-    // Sleep to estimate frequency at the desired frequency
-    sleep(1);  // 1 second for 1Hz
+    idle_ns = 0;
+
+    // Append [cursor, write_index) to the window, dropping the oldest samples to make room
+    unsigned long long oldest = ring_oldest(shm_buffer, write_index);
+    if (cursor < oldest) {
+      lost += oldest - cursor;
+      cursor = oldest;
+      filled = 0;
+    }
+    unsigned long long available = write_index - cursor;
+    int count = available < (unsigned long long)window_len ? (int)available : window_len;
+    int in_place = header->sample_type == SAMPLE_FLOAT32 && window_len + header->max_block <= header->capacity;
+    if (in_place) {
+      // The whole window is still in the ring: estimate straight from its double-mapped span
+      filled = filled + count < window_len ? filled + count : window_len;
+    } else {
+      if (filled + count > window_len) {
+        int drop = filled + count - window_len;
+        memmove(window, window + drop, (filled - drop) * sizeof(float));
+        filled -= drop;
+      }
+      if (ring_copy_float(shm_buffer, channel, write_index - count, count, window + filled) == -1) {
+        filled = 0;  // Lapped while copying: start over from whatever is still there next time
+        continue;
+      }
+      filled += count;
+    }
+    lost += write_index - count - cursor;
+    cursor = write_index;
+    fresh += count;
+    if (filled < window_len || fresh < hop) continue;
+
+    // Window full and hop samples newer than the previous estimate
+    unsigned long long start = write_index - window_len;
+    long long latency_ns = ring_publish_age_ns(shm_buffer);
+    long long start_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    double confidence;
+    const float *samples = in_place ? ring_span(shm_buffer, channel, start) : window;
+    double f0 = f0_estimate(estimator, samples, &confidence);
+    long long estimate_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - start_ns;
+    fresh = 0;
+    if (in_place && ring_check(shm_buffer, start) == -1) {
+      printf("K_F0: Window overwritten during the estimate. Discarded.\n");
+      filled = 0;
+      continue;
+    }
+    long long cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    long long wall_ns = clock_ns(CLOCK_MONOTONIC);
+
+    printf("K_F0: Estimated Frequency: %.3f Hz (%s, confidence %.2f", f0, f0_method_name(method), confidence);
+    if (expect > 0) printf(", error %+.3f Hz", f0 - expect);
+    printf(") | %.1f us per estimate, %.2f%% CPU, woke %.1f us after publish, %llu lost\n", estimate_ns / 1000.0,
+           100.0 * (cpu_ns - last_cpu_ns) / (wall_ns - last_wall_ns), latency_ns / 1000.0, lost);
+    fflush(stdout);
+    last_cpu_ns = cpu_ns;
+    last_wall_ns = wall_ns;
   }
 
   // Consumers do not unlink the shared memory
   printf("K_F0: Cleaning up shared memory.\n");
-  if (munmap(shm_buffer, sizeof(circular_buffer_shm_t)) == -1) {
-    perror("munmap failed");
-  }
-  if (close(shm_fd) == -1) {
-    perror("close shm_fd failed");
-  }
+  ring_close(shm_buffer);
+  f0_estimator_destroy(estimator);
+  free(window);
 
   return EXIT_SUCCESS;
 }
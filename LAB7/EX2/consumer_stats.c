@@ -0,0 +1,258 @@
+#include <errno.h>   // For errno, ENOENT, EAGAIN
+#include <getopt.h>  // For getopt_long
+#include <math.h>    // For sin, sqrt
+#include <signal.h>  // For sigaction, SIGINT, SIGTERM
+#include <stdio.h>   // For printf, perror
+#include <stdlib.h>  // For atof, strtoul, strtoull, malloc, free, EXIT_SUCCESS, EXIT_FAILURE
+#include <time.h>    // For clock_gettime
+#include <unistd.h>  // For sleep, getpid
+
+#include "shm_common.h"
+#include "shm_ring.h"
+#include "stream_stats.h"
+
+#define DEFAULT_WINDOWS "256,4096,65536"
+#define DEFAULT_REPORT_HZ 1.0
+#define CHUNK_SAMPLES 4096  // Samples copied out of the ring at a time (at most half the ring)
+
+static const double quantiles[] = {0.01, 0.5, 0.99};
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_stop(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+long long clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--channel N] [--windows N,N,...] [--report-hz HZ] [--bench SAMPLES]\n", prog);
+  fprintf(stderr, "  --channel N   channel of the stream to follow (default 0)\n");
+  fprintf(stderr, "  --windows     up to %d sliding window lengths in samples (default %s)\n",
+          STREAM_STATS_MAX_WINDOWS, DEFAULT_WINDOWS);
+  fprintf(stderr, "  --report-hz   reports per second (default %.0f)\n", DEFAULT_REPORT_HZ);
+  fprintf(stderr, "  --bench N     time N synthetic samples through the statistics instead of reading the ring\n");
+}
+
+int parse_windows(char *list, size_t *lengths) {
+  int windows = 0;
+  char *end = list;
+  while (*end != '\0' && windows < STREAM_STATS_MAX_WINDOWS) {
+    lengths[windows] = strtoul(end, &end, 10);
+    if (lengths[windows] == 0 || (*end != ',' && *end != '\0')) return -1;
+    windows++;
+    if (*end == ',') end++;
+  }
+  return *end == '\0' ? windows : -1;
+}
+
+void print_report(const stream_stats_t *stats, const size_t *lengths, int windows, double rate) {
+  stats_summary_t summary;
+  float q[sizeof(quantiles) / sizeof(quantiles[0])];
+
+  stream_stats_total(stats, &summary);
+  printf("K_STATS: all %llu samples: mean %+.4f sd %.4f min %+.4f max %+.4f\n", summary.count, summary.mean,
+         sqrt(summary.variance), summary.min, summary.max);
+  for (int w = 0; w < windows; ++w) {
+    stream_stats_window(stats, w, &summary);
+    stream_stats_quantiles(stats, w, quantiles, sizeof(quantiles) / sizeof(quantiles[0]), q);
+    printf("K_STATS:   last %7zu (%8.3f s): mean %+.4f sd %.4f min %+.4f max %+.4f p1 %+.4f p50 %+.4f p99 %+.4f\n",
+           lengths[w], lengths[w] / rate, summary.mean, sqrt(summary.variance), summary.min, summary.max, q[0], q[1],
+           q[2]);
+  }
+}
+
+// Time the statistics alone on a noisy sine, no ring involved
+int run_bench(stream_stats_t *stats, const size_t *lengths, int windows, unsigned long long total) {
+  float *samples = malloc(CHUNK_SAMPLES * 64 * sizeof(float));
+  if (samples == NULL) {
+    perror("malloc failed");
+    return EXIT_FAILURE;
+  }
+  unsigned int seed = 1;
+  for (int i = 0; i < CHUNK_SAMPLES * 64; ++i) {
+    seed = seed * 1103515245 + 12345;
+    samples[i] = sin(2 * PI * SIGNAL_FREQ * i / SAMPLING_FREQ) + 0.1f * ((seed >> 8) / 16777216.0f - 0.5f);
+  }
+
+  // Whole chunks, so done ends at total rounded up to one
+  unsigned long long done = 0;
+  long long start_ns = clock_ns(CLOCK_MONOTONIC);
+  for (; done < total; done += CHUNK_SAMPLES) {
+    stream_stats_add(stats, samples + done % (CHUNK_SAMPLES * 64), CHUNK_SAMPLES);
+  }
+  long long elapsed_ns = clock_ns(CLOCK_MONOTONIC) - start_ns;
+
+  print_report(stats, lengths, windows, SAMPLING_FREQ);
+  printf("K_STATS: %d window(s): %.2f ns/sample, %.1f M samples/s\n", windows,
+         (double)elapsed_ns / done, done * 1e3 / elapsed_ns);
+  free(samples);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"channel", required_argument, NULL, 'c'},
+                                         {"windows", required_argument, NULL, 'w'},
+                                         {"report-hz", required_argument, NULL, 'r'},
+                                         {"bench", required_argument, NULL, 'b'},
+                                         {NULL, 0, NULL, 0}};
+  char default_windows[] = DEFAULT_WINDOWS;
+  char *window_list = default_windows;
+  size_t lengths[STREAM_STATS_MAX_WINDOWS];
+  unsigned int channel = 0;
+  double report_hz = DEFAULT_REPORT_HZ;
+  unsigned long long bench = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "c:w:r:b:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'c':
+        channel = strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        window_list = optarg;
+        break;
+      case 'r':
+        report_hz = atof(optarg);
+        break;
+      case 'b':
+        bench = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  int windows = parse_windows(window_list, lengths);
+  if (windows < 1 || report_hz <= 0) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  stream_stats_t *stats = stream_stats_create(lengths, windows);
+  if (stats == NULL) {
+    perror("stream_stats_create failed");
+    return EXIT_FAILURE;
+  }
+  if (bench > 0) {
+    int status = run_bench(stats, lengths, windows, bench);
+    stream_stats_destroy(stats);
+    return status;
+  }
+
+  struct sigaction sa = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  printf("--- Consumer K_STATS (PID %d) ---\n", getpid());
+
+  // Open the shared memory ring read-only (loop until the producer has created it)
+  ring_t *shm_buffer;
+  while (1) {
+    shm_buffer = ring_open(SHM_NAME);
+    if (shm_buffer != NULL) break;
+    if (stop_requested) {
+      stream_stats_destroy(stats);
+      return EXIT_SUCCESS;
+    }
+    if (errno == ENOENT || errno == EAGAIN) {
+      fprintf(stderr, "K_STATS: Shared memory '%s' not ready. Retrying in 1 second...\n", SHM_NAME);
+      sleep(1);
+    } else {
+      perror("ring_open failed unexpectedly");
+      stream_stats_destroy(stats);
+      return EXIT_FAILURE;
+    }
+  }
+  const circular_buffer_shm_t *header = shm_buffer->header;
+  printf("K_STATS: Shared memory ring '%s' mapped to address %p: %u channel(s) of %s at %.0f Hz, %u samples each.\n",
+         SHM_NAME, (void *)header, header->channels, sample_type_name(header->sample_type), header->sample_rate,
+         header->capacity);
+  if (channel >= header->channels) {
+    fprintf(stderr, "K_STATS: The stream has no channel %u.\n", channel);
+    ring_close(shm_buffer);
+    stream_stats_destroy(stats);
+    return EXIT_FAILURE;
+  }
+  size_t chunk = header->capacity / 2 < CHUNK_SAMPLES ? header->capacity / 2 : CHUNK_SAMPLES;
+  float *samples = malloc(chunk * sizeof(float));
+  if (samples == NULL) {
+    perror("malloc failed");
+    ring_close(shm_buffer);
+    stream_stats_destroy(stats);
+    return EXIT_FAILURE;
+  }
+
+  printf("K_STATS: Following channel %u over %d window(s)...\n", channel, windows);
+
+  // Every sample from our cursor up to the write_index ring_wait() returned goes through the
+  // statistics, a chunk at a time, and no further: a producer faster than the statistics would
+  // otherwise keep us draining past the report deadline. Newer samples wait for the next round.
+  long long period_ns = (long long)(1e9 / report_hz);
+  long long next_report_ns = clock_ns(CLOCK_MONOTONIC) + period_ns;
+  unsigned long long cursor = 0;
+  int started = 0;
+  unsigned long long folded = 0;   // Since the last report
+  unsigned long long skipped = 0;  // Recycled before we got to them
+  long long stats_ns = 0;          // Thread CPU time spent in the statistics
+  while (!stop_requested) {
+    long long timeout_ns = next_report_ns - clock_ns(CLOCK_MONOTONIC);
+    unsigned long long write_index = ring_wait(shm_buffer, cursor + 1, timeout_ns > 0 ? timeout_ns : 0);
+    if (!started && write_index > 0) {
+      cursor = ring_oldest(shm_buffer, write_index);  // Start with whatever history the ring holds
+      started = 1;
+      // Registered, a producer running with --policy block or skip keeps unread samples for us
+      if (ring_register(shm_buffer, cursor) == -1) perror("K_STATS: ring_register failed, reading unregistered");
+    }
+    unsigned long long skipped_before = skipped;
+
+    while (started && cursor < write_index) {
+      unsigned long long oldest = ring_oldest(shm_buffer, write_index);
+      if (cursor < oldest) {
+        skipped += oldest - cursor;
+        cursor = oldest;
+      }
+      size_t count = write_index - cursor < chunk ? write_index - cursor : chunk;
+      if (ring_copy_float(shm_buffer, channel, cursor, count, samples) == -1) {  // Lapped while copying
+        // Skip what the producer has recycled since; only that one load looks past the snapshot
+        oldest = ring_oldest(shm_buffer, ring_write_index(shm_buffer));
+        if (cursor < oldest) {
+          skipped += oldest - cursor;
+          cursor = oldest;
+        }
+        continue;
+      }
+      long long start_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+      stream_stats_add(stats, samples, count);
+      stats_ns += clock_ns(CLOCK_THREAD_CPUTIME_ID) - start_ns;
+      cursor += count;
+      folded += count;
+    }
+    if (started) ring_advance(shm_buffer, cursor, skipped - skipped_before);
+
+    if (clock_ns(CLOCK_MONOTONIC) >= next_report_ns) {
+      print_report(stats, lengths, windows, header->sample_rate);
+      printf("K_STATS: +%llu samples, %llu skipped, %.2f ns/sample in the statistics\n", folded, skipped,
+             folded > 0 ? (double)stats_ns / folded : 0.0);
+      fflush(stdout);
+      folded = 0;
+      skipped = 0;
+      stats_ns = 0;
+      next_report_ns += period_ns;
+    }
+  }
+
+  // Give our slot back first, so that a producer under --policy block or skip stops keeping samples
+  // for us. Consumers do not unlink the shared memory.
+  printf("K_STATS: Cleaning up shared memory.\n");
+  ring_unregister(shm_buffer);
+  ring_close(shm_buffer);
+  stream_stats_destroy(stats);
+  free(samples);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// Accuracy check for the f0 estimators on tones whose period is not a whole number of samples, the
+// case where the sub-sample refinement matters: 123.4 Hz at 2 kHz (16.21 samples) and 440.3 Hz at
+// 48 kHz (109.02 samples), clean and under the producer's uniform white noise. Each case runs over
+// consecutive windows of one long signal and reports the mean error (bias), the RMS error and the
+// worst error per method. FFT and YIN must stay within their tolerance on every case; zero
+// crossings are reported for comparison only. One case uses the shortest odd window YIN accepts at
+// 2 kHz, where its longest lag is the last one its buffers hold.
+#include <getopt.h>  // For getopt_long
+#include <math.h>    // For fabs, sqrt
+#include <stdio.h>   // For printf, fprintf, perror
+#include <stdlib.h>  // For atoi, malloc, free, EXIT_SUCCESS, EXIT_FAILURE
+
+#include "f0_estimator.h"
+#include "oscillator.h"
+
+#define DEFAULT_WINDOWS 200
+#define WINDOW_SECONDS 0.25  // Samples per estimate, as a fraction of the rate
+#define CHECK_FMIN 40.0      // Hz
+
+typedef struct {
+  double rate;
+  double freq;
+  double noise;     // Uniform white noise amplitude, on a unit sine
+  double max_bias;  // Hz: allowed |mean error| for FFT and YIN
+  double max_rms;   // Hz: allowed RMS error
+  int window;       // Samples per estimate; 0 for rate * WINDOW_SECONDS
+} f0_case_t;
+
+static const f0_case_t cases[] = {
+    {2000.0, 123.4, 0.0, 0.05, 0.05, 0},  {2000.0, 123.4, 0.5, 0.2, 1.0, 0},  {2000.0, 123.4, 1.0, 0.5, 2.5, 0},
+    {48000.0, 440.3, 0.0, 0.05, 0.05, 0}, {48000.0, 440.3, 0.5, 0.2, 1.0, 0}, {48000.0, 440.3, 1.0, 0.5, 2.5, 0},
+    {2000.0, 123.4, 0.0, 0.1, 0.1, (int)(2 * 2000.0 / CHECK_FMIN) + 1},
+};
+
+// Same generator as the producer's --noise, so the numbers match what consumer_f0 sees
+float uniform(unsigned int *state) {
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return (float)x / 2147483648.0f - 1.0f;
+}
+
+// Estimate every window of the signal; 0 when the errors are within tolerance (always for zc)
+int run_case(const f0_case_t *c, f0_method_t method, const float *signal, int window, int windows) {
+  f0_estimator_t *est = f0_estimator_create(method, window, c->rate, CHECK_FMIN, c->rate / 4);
+  if (est == NULL) {
+    perror("f0_estimator_create failed");
+    return -1;
+  }
+  double sum = 0, sum_sq = 0, worst = 0;
+  for (int w = 0; w < windows; ++w) {
+    double confidence;
+    double error = f0_estimate(est, signal + (size_t)w * window, &confidence) - c->freq;
+    sum += error;
+    sum_sq += error * error;
+    if (fabs(error) > fabs(worst)) worst = error;
+  }
+  f0_estimator_destroy(est);
+  double bias = sum / windows;
+  double rms = sqrt(sum_sq / windows);
+  int ok = method == F0_ZERO_CROSSING || (fabs(bias) <= c->max_bias && rms <= c->max_rms);
+  printf("%8.0f %8.1f %6.2f %6d %-4s %+10.4f %10.4f %+10.4f  %s\n", c->rate, c->freq, c->noise, window,
+         f0_method_name(method), bias, rms, worst, method == F0_ZERO_CROSSING ? "-" : ok ? "ok" : "FAILED");
+  return ok ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"windows", required_argument, NULL, 'n'}, {NULL, 0, NULL, 0}};
+  int windows = DEFAULT_WINDOWS;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "n:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'n':
+        windows = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [--windows N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (windows < 1) {
+    fprintf(stderr, "Need at least one window.\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%d windows of %.2f s per case\n", windows, WINDOW_SECONDS);
+  printf("%8s %8s %6s %6s %-4s %10s %10s %10s  %s\n", "rate", "f0", "noise", "window", "est", "bias Hz", "rms Hz",
+         "worst Hz", "check");
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    const f0_case_t *c = &cases[i];
+    int window = c->window > 0 ? c->window : (int)(c->rate * WINDOW_SECONDS);
+    size_t count = (size_t)window * windows;
+    float *signal = malloc(count * sizeof(float));
+    if (signal == NULL) {
+      perror("malloc failed");
+      return EXIT_FAILURE;
+    }
+    oscillator_t osc;
+    unsigned int state = 2463534242u;
+    oscillator_init(&osc, c->freq, c->rate, 1.0);
+    oscillator_generate(&osc, signal, count);
+    for (size_t j = 0; j < count; ++j) signal[j] += (float)c->noise * uniform(&state);
+
+    f0_method_t methods[] = {F0_FFT, F0_YIN, F0_ZERO_CROSSING};
+    for (int m = 0; m < 3; ++m) {
+      if (run_case(c, methods[m], signal, window, windows) != 0) failed = 1;
+    }
+    free(signal);
+  }
+  if (failed) {
+    printf("FAILED: an estimator is off by more than its tolerance\n");
+    return EXIT_FAILURE;
+  }
+  printf("OK: FFT and YIN within tolerance on every tone\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+#include "f0_estimator.h"
+
+#include <errno.h>   // For errno, EINVAL, ENOMEM
+#include <math.h>    // For cos, log
+#include <stdlib.h>  // For calloc, malloc, free
+#include <string.h>  // For strcmp
+
+#include "shm_common.h"
+
+#define YIN_THRESHOLD 0.1f     // Dips of the normalized difference below this count as periodic
+#define YIN_NOISE_MARGIN 1.2f  // Without such a dip, local minima this close to the lowest one compete
+#define YIN_FIT_DIVISOR 16     // The vertex is fitted over lags best -/+ best / this
+
+f0_estimator_t *f0_estimator_create(f0_method_t method, int window, double rate, double fmin, double fmax) {
+  if (window < 8 || rate <= 0 || fmin <= 0 || fmax <= fmin || fmax > rate / 2 ||
+      (method == F0_YIN && 2 * rate / fmin >= window)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  f0_estimator_t *est = calloc(1, sizeof(f0_estimator_t));
+  if (est == NULL) return NULL;
+  est->method = method;
+  est->window = window;
+  est->rate = rate;
+  est->fmin = fmin;
+  est->fmax = fmax;
+
+  int ok = 1;
+  if (method == F0_FFT) {
+    int n = 8;
+    while (n < window) n *= 2;
+    est->plan = fft_plan_create(n);
+    est->hann = malloc(window * sizeof(float));
+    est->padded = calloc(n, sizeof(float));  // The tail past window stays zero
+    est->power = malloc((n / 2 + 1) * sizeof(float));
+    ok = est->plan != NULL && est->hann != NULL && est->padded != NULL && est->power != NULL;
+    for (int i = 0; ok && i < window; ++i) {
+      est->hann[i] = (float)(0.5 - 0.5 * cos(2 * PI * i / (window - 1)));
+    }
+  } else if (method == F0_YIN) {
+    est->tau_max = (int)(rate / fmin) + 1;
+    est->diff = malloc((est->tau_max + 1) * sizeof(float));
+    est->cmnd = malloc((est->tau_max + 1) * sizeof(float));
+    ok = est->diff != NULL && est->cmnd != NULL;
+  }
+  if (!ok) {
+    f0_estimator_destroy(est);
+    errno = ENOMEM;
+    return NULL;
+  }
+  return est;
+}
+
+void f0_estimator_destroy(f0_estimator_t *est) {
+  if (est == NULL) return;
+  fft_plan_destroy(est->plan);
+  free(est->hann);
+  free(est->padded);
+  free(est->power);
+  free(est->diff);
+  free(est->cmnd);
+  free(est);
+}
+
+// Vertex offset (-0.5..0.5) of the parabola through (-1, a), (0, b), (1, c)
+static double parabolic_offset(double a, double b, double c) {
+  double denominator = a - 2 * b + c;
+  return denominator == 0 ? 0 : 0.5 * (a - c) / denominator;
+}
+
+// Vertex offset of the least-squares parabola through y[-k .. k], clamped to the fitted span. With
+// k = 1 this is parabolic_offset(); a wider fit averages out noise on a broad minimum.
+static double fitted_offset(const float *y, int k) {
+  double sx2 = 0, sx4 = 0, sy = 0, sxy = 0, sx2y = 0;
+  int n = 2 * k + 1;
+  for (int x = -k; x <= k; ++x) {
+    sx2 += x * x;
+    sx4 += (double)x * x * x * x;
+    sy += y[x];
+    sxy += x * (double)y[x];
+    sx2y += x * x * (double)y[x];
+  }
+  double a = (sx2y - sx2 / n * sy) / (sx4 - sx2 * sx2 / n);
+  double b = sxy / sx2;
+  if (a <= 0) return 0;
+  double offset = -b / (2 * a);
+  return offset < -k ? -k : offset > k ? k : offset;
+}
+
+static double estimate_fft(f0_estimator_t *est, const float *samples, double *confidence) {
+  int n = fft_size(est->plan);
+  int window = est->window;
+  float mean = 0;
+
+  // Remove DC (its window leakage would otherwise swamp low frequencies), then apply the window
+  for (int i = 0; i < window; ++i) mean += samples[i];
+  mean /= window;
+  for (int i = 0; i < window; ++i) est->padded[i] = (samples[i] - mean) * est->hann[i];
+  fft_power_spectrum(est->plan, est->padded, est->power);
+
+  int lo = (int)(est->fmin * n / est->rate);
+  int hi = (int)(est->fmax * n / est->rate);
+  if (lo < 1) lo = 1;
+  if (hi > n / 2 - 1) hi = n / 2 - 1;
+  int peak = lo;
+  double total = 0;
+  for (int k = lo; k <= hi; ++k) {
+    total += est->power[k];
+    if (est->power[k] > est->power[peak]) peak = k;
+  }
+  if (est->power[peak] <= 0) {
+    *confidence = 0;
+    return 0;
+  }
+
+  // The log of a Hann main lobe is close to a parabola, so interpolating log power gets within a
+  // few hundredths of a bin of the true peak
+  double a = log(est->power[peak - 1] + 1e-30);
+  double b = log(est->power[peak] + 1e-30);
+  double c = log(est->power[peak + 1] + 1e-30);
+  *confidence = (est->power[peak - 1] + est->power[peak] + est->power[peak + 1]) / total;
+  return (peak + parabolic_offset(a, b, c)) * est->rate / n;
+}
+
+static double estimate_yin(f0_estimator_t *est, const float *samples, double *confidence) {
+  int tau_min = (int)(est->rate / est->fmax);
+  int tau_max = est->tau_max;
+  int span = est->window - tau_max;  // Every lag is compared over the same number of samples
+  float *d = est->diff;
+  float *cmnd = est->cmnd;
+
+  if (tau_min < 2) tau_min = 2;
+  // Difference function d(tau) = sum (x[j] - x[j + tau])^2; the inner loop is a plain vectorizable
+  // reduction over contiguous samples
+  d[0] = 0;
+  for (int tau = 1; tau <= tau_max; ++tau) {
+    const float *shifted = samples + tau;
+    float sum = 0;
+    for (int j = 0; j < span; ++j) {
+      float delta = samples[j] - shifted[j];
+      sum += delta * delta;
+    }
+    d[tau] = sum;
+  }
+
+  // Cumulative mean normalization: d'(tau) = d(tau) * tau / sum_{1..tau} d, so d'(0) = 1 and a
+  // signal's own period stands out from the small lags. It goes to its own buffer: the lag is
+  // picked on d', but refined on d itself.
+  float running = 0;
+  cmnd[0] = 1;
+  for (int tau = 1; tau <= tau_max; ++tau) {
+    running += d[tau];
+    cmnd[tau] = running > 0 ? d[tau] * tau / running : 1;
+  }
+
+  // The first dip under the threshold, or in heavy noise, where nothing may get that low, the first
+  // dip close to the deepest one: multiples of the period dip about as deep, and the global minimum
+  // alone would often be one of them. A dip is the whole run of lags under the limit and its
+  // lowest lag is taken, since noise puts small local minima all down its slopes.
+  float limit = YIN_THRESHOLD;
+  int lowest = tau_min;
+  for (int tau = tau_min; tau < tau_max; ++tau) {
+    if (cmnd[tau] < cmnd[lowest]) lowest = tau;
+  }
+  if (cmnd[lowest] >= YIN_THRESHOLD) limit = cmnd[lowest] * YIN_NOISE_MARGIN;
+  int best = lowest;
+  for (int tau = tau_min; tau < tau_max; ++tau) {
+    if (cmnd[tau] < limit) {
+      best = tau;
+      for (; tau < tau_max && cmnd[tau] < limit; ++tau) {
+        if (cmnd[tau] < cmnd[best]) best = tau;
+      }
+      break;
+    }
+  }
+  *confidence = cmnd[best] < 1 ? 1 - cmnd[best] : 0;
+
+  // Parabolic interpolation on the raw difference function (YIN's step 5): d' is d divided by a
+  // running sum that grows with tau, which tilts the dip and moves its vertex. The normalization
+  // can also put the minimum one lag off d's own.
+  if (best > tau_min && best < tau_max - 1) {
+    if (d[best + 1] < d[best]) {
+      ++best;
+    } else if (d[best - 1] < d[best]) {
+      --best;
+    }
+  }
+  int k = best / YIN_FIT_DIVISOR;
+  if (k < 1) k = 1;
+  if (best - k < tau_min || best + k > tau_max) return est->rate / best;  // No neighbour to interpolate with
+  return est->rate / (best + fitted_offset(d + best, k));
+}
+
+static double estimate_zero_crossing(const f0_estimator_t *est, const float *samples, double *confidence) {
+  int zero_crossings = 0;
+  for (int i = 1; i < est->window; ++i) {
+    // Check for zero crossing (sign change)
+    if ((samples[i - 1] < 0 && samples[i] >= 0) || (samples[i - 1] > 0 && samples[i] <= 0)) {
+      zero_crossings++;
+    }
+  }
+  *confidence = 1;
+  return zero_crossings / 2.0 / (est->window / est->rate);
+}
+
+double f0_estimate(f0_estimator_t *est, const float *samples, double *confidence) {
+  switch (est->method) {
+    case F0_FFT:
+      return estimate_fft(est, samples, confidence);
+    case F0_YIN:
+      return estimate_yin(est, samples, confidence);
+    default:
+      return estimate_zero_crossing(est, samples, confidence);
+  }
+}
+
+int f0_parse_method(const char *name, f0_method_t *method) {
+  if (strcmp(name, "fft") == 0) {
+    *method = F0_FFT;
+  } else if (strcmp(name, "yin") == 0) {
+    *method = F0_YIN;
+  } else if (strcmp(name, "zc") == 0) {
+    *method = F0_ZERO_CROSSING;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+const char *f0_method_name(f0_method_t method) {
+  static const char *names[] = {"fft", "yin", "zc"};
+  return names[method];
+}
@@ -0,0 +1,39 @@
+#ifndef F0_ESTIMATOR_H
+#define F0_ESTIMATOR_H
+
+#include "fft.h"
+
+typedef enum {
+  F0_FFT,            // Hann window, real FFT, parabolic interpolation of the log-power peak
+  F0_YIN,            // YIN: cumulative mean normalized difference function, first dip below a threshold
+  F0_ZERO_CROSSING,  // Sign changes per second / 2, the original estimator, kept for comparison
+} f0_method_t;
+
+typedef struct {
+  f0_method_t method;
+  int window;   // Samples per estimate
+  double rate;  // Sampling rate, Hz
+  double fmin;  // Search range, Hz
+  double fmax;
+  fft_plan_t *plan;  // F0_FFT: transform of the window zero-padded to a power of two
+  float *hann;
+  float *padded;
+  float *power;
+  int tau_max;  // F0_YIN: longest lag searched, one period of fmin rounded up
+  float *diff;  // F0_YIN: difference function, one per lag 0..tau_max
+  float *cmnd;  // F0_YIN: its cumulative mean normalized form, which picks the lag
+} f0_estimator_t;
+
+// NULL with errno EINVAL when the window cannot resolve fmin (YIN needs two periods per window)
+f0_estimator_t *f0_estimator_create(f0_method_t method, int window, double rate, double fmin, double fmax);
+void f0_estimator_destroy(f0_estimator_t *est);
+
+// Estimate the fundamental frequency of window samples. *confidence gets 0..1 (peak share of the
+// power for F0_FFT, 1 - aperiodicity for F0_YIN, 1 for zero crossings). Returns 0 when no pitch is
+// found in [fmin, fmax].
+double f0_estimate(f0_estimator_t *est, const float *samples, double *confidence);
+
+int f0_parse_method(const char *name, f0_method_t *method);
+const char *f0_method_name(f0_method_t method);
+
+#endif  // F0_ESTIMATOR_H
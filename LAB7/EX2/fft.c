@@ -0,0 +1,163 @@
+#include "fft.h"
+
+#include <errno.h>   // For errno, EINVAL, ENOMEM
+#include <math.h>    // For cos, sin
+#include <stdlib.h>  // For malloc, free
+
+#include "shm_common.h"
+
+struct fft_plan {
+  int n;         // Real samples
+  int m;         // Complex points, n / 2
+  float *tw_re;  // W_m^k = exp(-2 pi i k / m), k < m
+  float *tw_im;
+  float *split_re;  // W_n^k, k <= m, for the real split pass
+  float *split_im;
+  float *re;  // Complex working buffers, m each
+  float *im;
+  float *work_re;
+  float *work_im;
+};
+
+fft_plan_t *fft_plan_create(int n) {
+  if (n < 8 || (n & (n - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  fft_plan_t *plan = calloc(1, sizeof(fft_plan_t));
+  if (plan == NULL) return NULL;
+  plan->n = n;
+  plan->m = n / 2;
+
+  int m = plan->m;
+  plan->tw_re = malloc(m * sizeof(float));
+  plan->tw_im = malloc(m * sizeof(float));
+  plan->split_re = malloc((m + 1) * sizeof(float));
+  plan->split_im = malloc((m + 1) * sizeof(float));
+  plan->re = malloc(m * sizeof(float));
+  plan->im = malloc(m * sizeof(float));
+  plan->work_re = malloc(m * sizeof(float));
+  plan->work_im = malloc(m * sizeof(float));
+  if (plan->tw_re == NULL || plan->tw_im == NULL || plan->split_re == NULL || plan->split_im == NULL ||
+      plan->re == NULL || plan->im == NULL || plan->work_re == NULL || plan->work_im == NULL) {
+    fft_plan_destroy(plan);
+    errno = ENOMEM;
+    return NULL;
+  }
+  for (int k = 0; k < m; ++k) {
+    plan->tw_re[k] = (float)cos(2 * PI * k / m);
+    plan->tw_im[k] = (float)-sin(2 * PI * k / m);
+  }
+  for (int k = 0; k <= m; ++k) {
+    plan->split_re[k] = (float)cos(2 * PI * k / n);
+    plan->split_im[k] = (float)-sin(2 * PI * k / n);
+  }
+  return plan;
+}
+
+void fft_plan_destroy(fft_plan_t *plan) {
+  if (plan == NULL) return;
+  free(plan->tw_re);
+  free(plan->tw_im);
+  free(plan->split_re);
+  free(plan->split_im);
+  free(plan->re);
+  free(plan->im);
+  free(plan->work_re);
+  free(plan->work_im);
+  free(plan);
+}
+
+int fft_size(const fft_plan_t *plan) { return plan->n; }
+
+// One radix-4 Stockham pass: sub-transforms of length len at stride s (len * s == m). For each
+// butterfly p the twiddles are scalars and the q loop runs over s contiguous elements.
+static void radix4_pass(const fft_plan_t *plan, int len, int s, const float *restrict xr, const float *restrict xi,
+                        float *restrict yr, float *restrict yi) {
+  int quarter = len / 4;
+  int tw_step = plan->m / len;  // W_len^p = W_m^(p * tw_step)
+
+  for (int p = 0; p < quarter; ++p) {
+    float w1r = plan->tw_re[p * tw_step], w1i = plan->tw_im[p * tw_step];
+    float w2r = plan->tw_re[2 * p * tw_step], w2i = plan->tw_im[2 * p * tw_step];
+    float w3r = plan->tw_re[3 * p * tw_step], w3i = plan->tw_im[3 * p * tw_step];
+    const float *ar = xr + s * p, *ai = xi + s * p;
+    const float *br = xr + s * (p + quarter), *bi = xi + s * (p + quarter);
+    const float *cr = xr + s * (p + 2 * quarter), *ci = xi + s * (p + 2 * quarter);
+    const float *dr = xr + s * (p + 3 * quarter), *di = xi + s * (p + 3 * quarter);
+    float *y0r = yr + s * 4 * p, *y0i = yi + s * 4 * p;
+
+    for (int q = 0; q < s; ++q) {
+      float apc_r = ar[q] + cr[q], apc_i = ai[q] + ci[q];
+      float amc_r = ar[q] - cr[q], amc_i = ai[q] - ci[q];
+      float bpd_r = br[q] + dr[q], bpd_i = bi[q] + di[q];
+      float jbmd_r = bi[q] - di[q], jbmd_i = dr[q] - br[q];  // -i * (b - d)
+
+      float t1r = amc_r + jbmd_r, t1i = amc_i + jbmd_i;
+      float t2r = apc_r - bpd_r, t2i = apc_i - bpd_i;
+      float t3r = amc_r - jbmd_r, t3i = amc_i - jbmd_i;
+      y0r[q] = apc_r + bpd_r;
+      y0i[q] = apc_i + bpd_i;
+      y0r[s + q] = t1r * w1r - t1i * w1i;
+      y0i[s + q] = t1r * w1i + t1i * w1r;
+      y0r[2 * s + q] = t2r * w2r - t2i * w2i;
+      y0i[2 * s + q] = t2r * w2i + t2i * w2r;
+      y0r[3 * s + q] = t3r * w3r - t3i * w3i;
+      y0i[3 * s + q] = t3r * w3i + t3i * w3r;
+    }
+  }
+}
+
+// The last pass when log2(m) is odd: length-2 transforms, no twiddles
+static void radix2_pass(int s, const float *restrict xr, const float *restrict xi, float *restrict yr,
+                        float *restrict yi) {
+  for (int q = 0; q < s; ++q) {
+    yr[q] = xr[q] + xr[s + q];
+    yi[q] = xi[q] + xi[s + q];
+    yr[s + q] = xr[q] - xr[s + q];
+    yi[s + q] = xi[q] - xi[s + q];
+  }
+}
+
+void fft_power_spectrum(fft_plan_t *plan, const float *input, float *power) {
+  int m = plan->m;
+  float *xr = plan->re, *xi = plan->im;
+  float *yr = plan->work_re, *yi = plan->work_im;
+
+  // Pack pairs of real samples into complex points
+  for (int k = 0; k < m; ++k) {
+    xr[k] = input[2 * k];
+    xi[k] = input[2 * k + 1];
+  }
+
+  int len = m;
+  int s = 1;
+  while (len >= 4) {
+    radix4_pass(plan, len, s, xr, xi, yr, yi);
+    float *t = xr;
+    xr = yr;
+    yr = t;
+    t = xi;
+    xi = yi;
+    yi = t;
+    len /= 4;
+    s *= 4;
+  }
+  if (len == 2) {
+    radix2_pass(s, xr, xi, yr, yi);
+    xr = yr;
+    xi = yi;
+  }
+
+  // Split: X[k] = E[k] + W_n^k O[k], with E = (Z[k] + conj(Z[m-k])) / 2 and O = (Z[k] - conj(Z[m-k])) / 2i
+  for (int k = 0; k <= m; ++k) {
+    int a = k % m;
+    int b = (m - k) % m;
+    float er = 0.5f * (xr[a] + xr[b]), ei = 0.5f * (xi[a] - xi[b]);
+    float or_ = 0.5f * (xi[a] + xi[b]), oi = 0.5f * (xr[b] - xr[a]);
+    float wr = plan->split_re[k], wi = plan->split_im[k];
+    float re = er + or_ * wr - oi * wi;
+    float im = ei + or_ * wi + oi * wr;
+    power[k] = re * re + im * im;
+  }
+}
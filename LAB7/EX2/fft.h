@@ -0,0 +1,19 @@
+#ifndef FFT_H
+#define FFT_H
+
+// Real-input FFT of a power-of-two length n, computed as a complex FFT of n/2 points (even samples
+// in the real part, odd samples in the imaginary part) and a split pass. The complex FFT is a
+// Stockham autosort transform with radix-4 passes and a final radix-2 pass when log2(n/2) is odd.
+// Data is kept as separate real/imaginary arrays so that the butterfly loops, which run over
+// contiguous elements, vectorize; only the first pass (stride 1) is scalar.
+typedef struct fft_plan fft_plan_t;
+
+// n must be a power of two, at least 8. NULL with errno EINVAL otherwise, ENOMEM on allocation failure.
+fft_plan_t *fft_plan_create(int n);
+void fft_plan_destroy(fft_plan_t *plan);
+int fft_size(const fft_plan_t *plan);
+
+// power[k] = |X[k]|^2 for k = 0..n/2, where X is the DFT of the n real samples in input
+void fft_power_spectrum(fft_plan_t *plan, const float *input, float *power);
+
+#endif  // FFT_H
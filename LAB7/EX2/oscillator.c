@@ -0,0 +1,55 @@
+#include "oscillator.h"
+
+#include <math.h>  // For sin, cos
+
+#include "shm_common.h"
+
+void oscillator_init(oscillator_t *osc, double signal_freq, double sampling_freq, double amplitude) {
+  double omega = 2 * PI * signal_freq / sampling_freq;  // Radians per sample
+
+  for (int k = 0; k < OSCILLATOR_LANES; ++k) {
+    osc->re[k] = cos(omega * k);
+    osc->im[k] = sin(omega * k);
+  }
+  osc->step_re = cos(omega * OSCILLATOR_LANES);
+  osc->step_im = sin(omega * OSCILLATOR_LANES);
+  osc->amplitude = amplitude;
+  osc->spill_pos = OSCILLATOR_LANES;
+}
+
+// Emit the current phasors (their imaginary part is the sine) and rotate all lanes one step. restrict
+// lets the compiler turn the lane loop into SIMD without runtime alias checks.
+static void step(oscillator_t *restrict osc, float *restrict out) {
+  for (int k = 0; k < OSCILLATOR_LANES; ++k) {
+    double re = osc->re[k];
+    double im = osc->im[k];
+    out[k] = (float)(osc->amplitude * im);
+    osc->re[k] = re * osc->step_re - im * osc->step_im;
+    osc->im[k] = re * osc->step_im + im * osc->step_re;
+  }
+}
+
+void oscillator_generate(oscillator_t *osc, float *out, size_t count) {
+  size_t done = 0;
+
+  while (osc->spill_pos < OSCILLATOR_LANES && done < count) {
+    out[done++] = osc->spill[osc->spill_pos++];
+  }
+  while (count - done >= OSCILLATOR_LANES) {
+    step(osc, out + done);
+    done += OSCILLATOR_LANES;
+  }
+  if (done < count) {
+    step(osc, osc->spill);
+    for (osc->spill_pos = 0; done < count; ++osc->spill_pos) {
+      out[done++] = osc->spill[osc->spill_pos];
+    }
+  }
+
+  // First-order renormalization, 1/|z| ~ (3 - |z|^2) / 2 near the unit circle
+  for (int k = 0; k < OSCILLATOR_LANES; ++k) {
+    double scale = (3.0 - (osc->re[k] * osc->re[k] + osc->im[k] * osc->im[k])) * 0.5;
+    osc->re[k] *= scale;
+    osc->im[k] *= scale;
+  }
+}
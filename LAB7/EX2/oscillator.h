@@ -0,0 +1,28 @@
+#ifndef OSCILLATOR_H
+#define OSCILLATOR_H
+
+#include <stddef.h>  // For size_t
+
+#define OSCILLATOR_LANES 8  // Independent rotators stepped together, so the inner loop vectorizes
+
+// Sine generator by recurrence: each lane is a unit phasor rotated by a fixed angle per step, which
+// costs a complex multiply per sample instead of a sin() call. Lane k runs k samples ahead of lane
+// 0 and every lane steps OSCILLATOR_LANES samples at a time, so the lanes have no dependency on
+// each other. Rounding makes the phasors drift off the unit circle very slowly; they are pulled
+// back once per block.
+typedef struct {
+  double re[OSCILLATOR_LANES];
+  double im[OSCILLATOR_LANES];
+  double step_re;  // cos/sin of OSCILLATOR_LANES sample periods
+  double step_im;
+  double amplitude;
+  float spill[OSCILLATOR_LANES];  // A step a previous block only used part of
+  int spill_pos;                  // Next unused sample in spill, OSCILLATOR_LANES when empty
+} oscillator_t;
+
+void oscillator_init(oscillator_t *osc, double signal_freq, double sampling_freq, double amplitude);
+
+// Write the next count samples of amplitude * sin(2 pi f t)
+void oscillator_generate(oscillator_t *osc, float *out, size_t count);
+
+#endif  // OSCILLATOR_H
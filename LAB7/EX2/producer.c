@@ -1,89 +1,319 @@
-#include <fcntl.h>     // For O_CREAT, O_RDWR
-#include <math.h>      // For sin
-#include <stdio.h>     // For printf, perror
-#include <stdlib.h>    // For EXIT_SUCCESS, EXIT_FAILURE, srand, rand
-#include <string.h>    // For memset
-#include <sys/mman.h>  // For mmap, munmap
-#include <time.h>      // For time
-#include <unistd.h>    // For ftruncate, close, usleep
+#include <errno.h>      // For errno, EINTR
+#include <getopt.h>     // For getopt_long
+#include <math.h>       // For sqrt
+#include <signal.h>     // For sigaction, SIGINT, SIGTERM
+#include <stdio.h>      // For printf, perror
+#include <stdlib.h>     // For atof, malloc, free, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>     // For strcmp
+#include <sys/prctl.h>  // For prctl, PR_SET_TIMERSLACK
+#include <time.h>       // For clock_gettime, clock_nanosleep, TIMER_ABSTIME
+#include <unistd.h>     // For getpid
 
+#include "oscillator.h"
 #include "shm_common.h"
+#include "shm_ring.h"
 
-int main(void) {
-  int shm_fd;
-  circular_buffer_shm_t *shm_buffer;
-  double current_time = 0.0;  // Current time for sine wave calculation
-  float sample_value;
+#define PUBLISH_FREQ 1000.0  // Hz: by default samples are published in blocks of 1 ms
+#define REPORT_NS 1000000000LL
+#define DEFAULT_SPACING 10.0  // Hz between the sines of neighbouring channels
 
-  printf("--- Producer (PID %d) ---\n", getpid());
+volatile sig_atomic_t stop_requested = 0;
 
-  //  Create the shared memory segment
-  shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
-  if (shm_fd == -1) {
-    perror("shm_open failed");
-    return EXIT_FAILURE;
+void handle_stop(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Sleep until an absolute CLOCK_MONOTONIC time, so time spent generating never accumulates as drift
+void sleep_until(long long deadline_ns) {
+  struct timespec deadline = {.tv_sec = deadline_ns / 1000000000LL, .tv_nsec = deadline_ns % 1000000000LL};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && !stop_requested) {
   }
-  printf("Producer: Shared memory segment '%s' created/opened (FD: %d).\n", SHM_NAME, shm_fd);
+}
 
-  // Set the size of the shared memory segment
-  if (ftruncate(shm_fd, sizeof(circular_buffer_shm_t)) == -1) {
-    perror("ftruncate failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME);
-    return EXIT_FAILURE;
+// White noise, uniform in [-amplitude, amplitude], from a xorshift32 generator
+void add_noise(float *samples, long count, float amplitude, unsigned int *state) {
+  for (long i = 0; i < count; ++i) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    samples[i] += amplitude * ((float)x / 2147483648.0f - 1.0f);
   }
-  printf("Producer: Shared memory size set to %lu bytes.\n", sizeof(circular_buffer_shm_t));
-
-  // Map the shared memory segment into the process's address space
-  shm_buffer = mmap(0, sizeof(circular_buffer_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-  if (shm_buffer == MAP_FAILED) {
-    perror("mmap failed");
-    close(shm_fd);
-    shm_unlink(SHM_NAME);
+}
+
+// Registered readers, how far behind they are and what they lost, plus what the policy cost us
+void print_readers(const ring_t *ring) {
+  ring_reader_info_t readers[RING_MAX_READERS];
+  size_t count = ring_readers(ring, readers, RING_MAX_READERS);
+  const circular_buffer_shm_t *header = ring->header;
+  if (count == 0 && header->policy == RING_OVERWRITE) return;
+  printf("Producer: %zu reader(s)", count);
+  for (size_t i = 0; i < count; ++i) {
+    printf("%s PID %d lag %llu dropped %llu", i == 0 ? ":" : ",", readers[i].pid, readers[i].lag, readers[i].dropped);
+  }
+  printf(" | %.1f ms blocked, %llu frames skipped, %u stale reader(s) reclaimed in all\n", header->blocked_ns / 1e6,
+         (unsigned long long)header->skipped, header->stale_readers);
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--rate HZ] [--signal HZ] [--noise AMPLITUDE] [--channels N] [--spacing HZ] [--type TYPE]\n"
+          "          [--capacity SAMPLES] [--block SAMPLES] [--policy POLICY] [--huge] [--lock] [--unpaced]\n"
+          "          [--duration SEC]\n",
+          prog);
+  fprintf(stderr, "  --rate HZ         sampling rate (default %.0f)\n", SAMPLING_FREQ);
+  fprintf(stderr, "  --signal HZ       sine frequency of channel 0 (default %.0f)\n", SIGNAL_FREQ);
+  fprintf(stderr, "  --noise A         add uniform white noise of amplitude A to the unit sine (default 0)\n");
+  fprintf(stderr, "  --channels N      channels, up to %d (default 1)\n", RING_MAX_CHANNELS);
+  fprintf(stderr, "  --spacing HZ      channel c carries signal + c * spacing Hz (default %.0f)\n", DEFAULT_SPACING);
+  fprintf(stderr, "  --type TYPE       int16, float or double (default float)\n");
+  fprintf(stderr, "  --capacity N      samples per channel ring, rounded up to whole pages (default %d)\n",
+          BUFFER_CAPACITY);
+  fprintf(stderr, "  --block SAMPLES   samples per publish, up to half the capacity (default: %.0f ms worth)\n",
+          1000.0 / PUBLISH_FREQ);
+  fprintf(stderr, "  --policy POLICY   when a registered reader would be overrun: overwrite it (default), block\n"
+                  "                    until it catches up, or skip the block\n");
+  fprintf(stderr, "  --huge            put the ring on huge pages when there are enough (capacity rounds up)\n");
+  fprintf(stderr, "  --lock            mlock the ring, so that none of it is ever paged out\n");
+  fprintf(stderr, "  --unpaced         publish as fast as possible instead of in real time\n");
+  fprintf(stderr, "  --duration SEC    stop after this long (default: until Ctrl+C)\n");
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"rate", required_argument, NULL, 'r'},
+                                         {"signal", required_argument, NULL, 's'},
+                                         {"noise", required_argument, NULL, 'n'},
+                                         {"channels", required_argument, NULL, 'c'},
+                                         {"spacing", required_argument, NULL, 'S'},
+                                         {"type", required_argument, NULL, 't'},
+                                         {"capacity", required_argument, NULL, 'C'},
+                                         {"block", required_argument, NULL, 'b'},
+                                         {"policy", required_argument, NULL, 'p'},
+                                         {"huge", no_argument, NULL, 'H'},
+                                         {"lock", no_argument, NULL, 'L'},
+                                         {"unpaced", no_argument, NULL, 'u'},
+                                         {"duration", required_argument, NULL, 'd'},
+                                         {NULL, 0, NULL, 0}};
+  ring_t *shm_buffer;
+  // The ring is always prefaulted, so that no page fault lands in the publishing loop
+  ring_format_t format = {
+      .channels = 1, .sample_type = SAMPLE_FLOAT32, .capacity = BUFFER_CAPACITY, .shm_flags = HUGE_SHM_POPULATE};
+  double rate = SAMPLING_FREQ;
+  double signal_freq = SIGNAL_FREQ;
+  double spacing = DEFAULT_SPACING;
+  float noise = 0;
+  unsigned int noise_state = 2463534242u;
+  long block = 0;
+  ring_policy_t policy = RING_OVERWRITE;
+  int unpaced = 0;
+  double duration = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "r:s:n:c:S:t:C:b:p:HLud:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 's':
+        signal_freq = atof(optarg);
+        break;
+      case 'n':
+        noise = (float)atof(optarg);
+        break;
+      case 'c':
+        format.channels = (unsigned int)atoi(optarg);
+        break;
+      case 'S':
+        spacing = atof(optarg);
+        break;
+      case 't':
+        if (sample_type_parse(optarg, &format.sample_type) == -1) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'C':
+        format.capacity = (unsigned int)atoi(optarg);
+        break;
+      case 'b':
+        block = atol(optarg);
+        break;
+      case 'p':
+        if (strcmp(optarg, "overwrite") == 0) {
+          policy = RING_OVERWRITE;
+        } else if (strcmp(optarg, "block") == 0) {
+          policy = RING_BLOCK;
+        } else if (strcmp(optarg, "skip") == 0) {
+          policy = RING_SKIP;
+        } else {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'H':
+        format.shm_flags |= HUGE_SHM_HUGE;
+        break;
+      case 'L':
+        format.shm_flags |= HUGE_SHM_LOCK;
+        break;
+      case 'u':
+        unpaced = 1;
+        break;
+      case 'd':
+        duration = atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (block == 0) block = rate / PUBLISH_FREQ >= 1 ? (long)(rate / PUBLISH_FREQ) : 1;
+  if (rate <= 0 || signal_freq < 0 || noise < 0 || format.channels < 1 || format.channels > RING_MAX_CHANNELS ||
+      block < 1 || block > format.capacity / 2 || duration < 0) {
+    usage(argv[0]);
     return EXIT_FAILURE;
   }
-  printf("Producer: Shared memory mapped to address %p.\n", (void *)shm_buffer);
+  format.sample_rate = rate;
+  format.scale = (1.0 + noise) / 32767;  // int16 full scale covers the sine plus the noise
+
+  // The default 50 us timer slack would show up directly as wake-up jitter
+  if (!unpaced && prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0) == -1) perror("prctl(PR_SET_TIMERSLACK) failed");
+
+  struct sigaction sa = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  printf("--- Producer (PID %d) ---\n", getpid());
 
-  // Initialize the shared memory (especially write_pos and clear samples)
-  shm_buffer->write_pos = 0;
-  shm_buffer->total_samples_written = 0;
-  memset(shm_buffer->samples, 0, sizeof(shm_buffer->samples));
+  // Create (or take over) the shared memory ring; a whole block is published with one index store
+  shm_buffer = ring_create(SHM_NAME, &format, (unsigned int)block);
+  if (shm_buffer == NULL) {
+    perror("ring_create failed");
+    return EXIT_FAILURE;
+  }
+  ring_set_policy(shm_buffer, policy);
+  const circular_buffer_shm_t *header = shm_buffer->header;
+  printf("Producer: Shared memory ring '%s' mapped to address %p: %u %s channel(s) of %u samples at %.0f Hz, "
+         "resuming at sample %llu.\n",
+         SHM_NAME, (void *)header, header->channels, sample_type_name(header->sample_type), header->capacity,
+         header->sample_rate, ring_write_index(shm_buffer));
+  const huge_shm_t *shm = &shm_buffer->shm;
+  printf("Producer: %zu kB segment on %s (%zu kB pages), prefaulted%s.\n", shm->size / 1024,
+         huge_shm_backing_name(shm->backing), shm->page_size / 1024, shm->locked ? " and locked" : "");
+  if ((format.shm_flags & HUGE_SHM_LOCK) && !shm->locked) {
+    fprintf(stderr, "Producer: mlock failed (RLIMIT_MEMLOCK too low?); the ring may be paged out.\n");
+  }
 
-  printf("Producer: Generating and writing samples...\n");
+  // Generated as float, one array per channel, then converted to the stream's type
+  unsigned int channels = format.channels;
+  oscillator_t *osc = malloc(channels * sizeof(oscillator_t));
+  float *samples = malloc(channels * block * sizeof(float));
+  void *raw = format.sample_type == SAMPLE_FLOAT32 ? samples : malloc(channels * block * header->sample_size);
+  if (osc == NULL || samples == NULL || raw == NULL) {
+    perror("malloc failed");
+    ring_close(shm_buffer);
+    return EXIT_FAILURE;
+  }
+  for (unsigned int c = 0; c < channels; ++c) {
+    oscillator_init(&osc[c], signal_freq + c * spacing, rate, 1.0);
+  }
 
-  // Loop continuously to generate and write samples
-  while (1) {
-    // Generate sinusoidal sample: Amplitude 1.0, SIGNAL_FREQ Hz
-    sample_value = (float)sin(2 * PI * SIGNAL_FREQ * current_time);
+  static const char *policy_names[] = {"overwriting", "blocking for", "skipping blocks for"};
+  printf("Producer: Generating %.0f Hz sine (+%.0f Hz per channel) at %.0f samples/s in blocks of %ld (%s, %s slow "
+         "registered readers)...\n",
+         signal_freq, spacing, rate, block, unpaced ? "unpaced" : "paced by absolute deadlines", policy_names[policy]);
 
-    // Write sample and update sample count
-    shm_buffer->samples[shm_buffer->write_pos] = sample_value;
-    shm_buffer->total_samples_written++;
-    // Update write position and wrap around
-    shm_buffer->write_pos = (shm_buffer->write_pos + 1) % BUFFER_CAPACITY;
+  // Block n is due at start + n * block / rate. Deadlines are computed from the sample count, not
+  // accumulated, so rounding never adds up to drift.
+  long long start_ns = now_ns();
+  long long end_ns = duration > 0 ? start_ns + (long long)(duration * 1e9) : 0;
+  long long next_report_ns = start_ns + REPORT_NS;
+  unsigned long long produced = 0;
+  unsigned long long reported = 0;  // produced at the previous report
+  long long report_start_ns = start_ns;
+  long long work_ns = 0;   // Generating and publishing, since the previous report
+  double late_sum_us = 0;  // Wake-up lateness past the deadline, since the previous report
+  double late_sq_sum_us = 0;
+  double late_max_us = 0;
+  unsigned long wakes = 0;
+  unsigned long missed = 0;  // Blocks whose deadline had already passed when we got to them
 
-    // Update current time for next sample
-    current_time += (1.0 / SAMPLING_FREQ);
+  while (!stop_requested && (end_ns == 0 || now_ns() < end_ns)) {
+    long long before = now_ns();
+    for (unsigned int c = 0; c < channels; ++c) {
+      oscillator_generate(&osc[c], samples + c * block, block);
+      if (noise > 0) add_noise(samples + c * block, block, noise, &noise_state);
+    }
+    if (raw != samples) samples_from_float(header, samples, raw, channels * block);
+    // Under --policy block a slow reader holds the write back; check for Ctrl+C while it does. Only
+    // the frames the ring took count: Ctrl+C can cut the block short.
+    size_t done = 0;
+    while (done < (size_t)block && !stop_requested) {
+      done += ring_write_strided(shm_buffer, (const char *)raw + done * header->sample_size, block - done, block);
+    }
+    produced += done;
+    long long after = now_ns();
+    work_ns += after - before;
 
-    // Print status occasionally
-    if (shm_buffer->total_samples_written % (long long)SAMPLING_FREQ == 0) {
-      printf("Producer: Generated %lld samples. Latest: %.4f at pos %d\n", shm_buffer->total_samples_written,
-             sample_value, shm_buffer->write_pos);
+    if (!unpaced) {
+      long long deadline = start_ns + (long long)(produced * 1e9 / rate);
+      if (after >= deadline) {
+        missed++;
+      } else {
+        sleep_until(deadline);
+        double late_us = (now_ns() - deadline) / 1000.0;
+        late_sum_us += late_us;
+        late_sq_sum_us += late_us * late_us;
+        if (late_us > late_max_us) late_max_us = late_us;
+        wakes++;
+      }
     }
 
-    // Sleep for the inverse of the sampling frequency
-    usleep(1000000 / SAMPLING_FREQ);
+    // Report achieved rate and jitter once per second
+    long long now = now_ns();
+    if (now >= next_report_ns) {
+      double elapsed = (now - report_start_ns) / 1e9;
+      double mean = wakes > 0 ? late_sum_us / wakes : 0;
+      double stddev = wakes > 0 ? sqrt(late_sq_sum_us / wakes - mean * mean) : 0;
+      // Under --policy block the ring may not have taken a frame yet, or none this interval
+      unsigned long long write_index = ring_write_index(shm_buffer);
+      unsigned long long position = write_index > 0 ? (write_index - 1) % header->capacity : 0;
+      double per_sample = produced > reported ? (double)work_ns / ((produced - reported) * channels) : 0;
+      printf("Producer: Generated %llu samples. Latest: %.4f at pos %llu | %.0f samples/s, %.1f ns/sample", produced,
+             samples[block - 1], position, (produced - reported) / elapsed, per_sample);
+      if (!unpaced) {
+        printf(" (%.1f%% of target), wake late avg %.1f us sd %.1f us max %.1f us, %lu blocks late",
+               100.0 * (produced - reported) / elapsed / rate, mean, stddev, late_max_us, missed);
+      }
+      printf("\n");
+      print_readers(shm_buffer);
+      fflush(stdout);
+      reported = produced;
+      report_start_ns = now;
+      next_report_ns = now + REPORT_NS;
+      work_ns = 0;
+      late_sum_us = late_sq_sum_us = late_max_us = 0;
+      wakes = missed = 0;
+    }
   }
+  printf("Producer: %llu samples in %.2f s (%.0f samples/s).\n", produced, (now_ns() - start_ns) / 1e9,
+         produced / ((now_ns() - start_ns) / 1e9));
 
   printf("Producer: Cleaning up shared memory.\n");
-  if (munmap(shm_buffer, sizeof(circular_buffer_shm_t)) == -1) {
-    perror("munmap failed");
-  }
-  if (close(shm_fd) == -1) {
-    perror("close shm_fd failed");
-  }
-  if (shm_unlink(SHM_NAME) == -1) {
-    perror("shm_unlink failed");
+  if (raw != samples) free(raw);
+  free(samples);
+  free(osc);
+  ring_close(shm_buffer);
+  if (ring_unlink(SHM_NAME) == -1) {
+    perror("ring_unlink failed");
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,368 @@
+#include "rec_file.h"
+
+#include <errno.h>     // For errno, EINVAL, EPROTO, EINTR
+#include <fcntl.h>     // For open, O_CREAT, O_TRUNC, O_WRONLY, O_RDONLY
+#include <stdlib.h>    // For malloc, realloc, free, posix_memalign
+#include <string.h>    // For memcpy, memmove, memset, memcmp
+#include <sys/mman.h>  // For mmap, munmap, madvise
+#include <sys/stat.h>  // For fstat
+#include <time.h>      // For clock_gettime
+#include <unistd.h>    // For pwrite, close
+
+#include "codec.h"
+#include "shm_ring.h"
+
+static uint64_t align_up(uint64_t n) { return (n + REC_ALIGN - 1) / REC_ALIGN * REC_ALIGN; }
+
+// Write all of buf at offset, retrying short writes
+static int write_all(int fd, const void *buf, size_t count, uint64_t offset) {
+  const char *p = buf;
+  while (count > 0) {
+    ssize_t n = pwrite(fd, p, count, (off_t)offset);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    count -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+static rec_channel_t channel_range(const rec_header_t *header, const void *samples, size_t count) {
+  rec_channel_t range = {0};
+  if (count == 0) return range;
+  if (header->sample_type == SAMPLE_INT16) {
+    const short *x = samples;
+    short lo = x[0], hi = x[0];
+    for (size_t i = 1; i < count; ++i) {
+      lo = x[i] < lo ? x[i] : lo;
+      hi = x[i] > hi ? x[i] : hi;
+    }
+    range.min = (float)(lo * header->scale);
+    range.max = (float)(hi * header->scale);
+  } else if (header->sample_type == SAMPLE_FLOAT64) {
+    const double *x = samples;
+    double lo = x[0], hi = x[0];
+    for (size_t i = 1; i < count; ++i) {
+      lo = x[i] < lo ? x[i] : lo;
+      hi = x[i] > hi ? x[i] : hi;
+    }
+    range.min = (float)lo;
+    range.max = (float)hi;
+  } else {
+    const float *x = samples;
+    range.min = range.max = x[0];
+    for (size_t i = 1; i < count; ++i) {
+      range.min = x[i] < range.min ? x[i] : range.min;
+      range.max = x[i] > range.max ? x[i] : range.max;
+    }
+  }
+  return range;
+}
+
+rec_writer_t *rec_create(const char *path, const circular_buffer_shm_t *format, unsigned int chunk_frames,
+                         int compress) {
+  if (chunk_frames == 0) chunk_frames = REC_DEFAULT_CHUNK_FRAMES;
+  rec_writer_t *rec = calloc(1, sizeof(rec_writer_t));
+  if (rec == NULL) return NULL;
+  rec_header_t *header = &rec->header;
+  memcpy(header->magic, REC_MAGIC, sizeof(header->magic));
+  header->version = REC_VERSION;
+  header->channels = format->channels;
+  header->sample_type = format->sample_type;
+  header->sample_size = format->sample_size;
+  header->chunk_frames = chunk_frames;
+  header->encoding = compress ? REC_CODEC : REC_RAW;
+  header->sample_rate = format->sample_rate;
+  header->scale = format->scale;
+
+  rec->header_bytes = align_up(sizeof(rec_chunk_t) + format->channels * sizeof(rec_channel_t));
+  size_t chunk_bytes = rec->header_bytes + align_up((uint64_t)format->channels * chunk_frames * format->sample_size);
+  size_t packed_bytes = rec->header_bytes + align_up(format->channels * codec_bound(format->sample_type, chunk_frames));
+  rec->offset = REC_ALIGN;
+  rec->fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (rec->fd == -1 || posix_memalign((void **)&rec->chunk, REC_ALIGN, chunk_bytes) != 0 ||
+      (compress && posix_memalign((void **)&rec->packed, REC_ALIGN, packed_bytes) != 0)) {
+    if (rec->fd != -1) close(rec->fd);
+    free(rec->chunk);
+    free(rec);
+    return NULL;
+  }
+  // A header without an index yet: readers of a recording cut short walk the chunks instead
+  char page[REC_ALIGN] = {0};
+  memcpy(page, header, sizeof(*header));
+  if (write_all(rec->fd, page, sizeof(page), 0) == -1) {
+    close(rec->fd);
+    free(rec->chunk);
+    free(rec->packed);
+    free(rec);
+    return NULL;
+  }
+  return rec;
+}
+
+// Encode the chunk's channels one after another into rec->packed, after room for its header;
+// returns the payload size
+static size_t rec_encode(rec_writer_t *rec) {
+  const rec_header_t *header = &rec->header;
+  rec_chunk_t *chunk = (rec_chunk_t *)rec->chunk;
+  const char *samples = rec->chunk + rec->header_bytes;
+  char *out = rec->packed + rec->header_bytes;
+  size_t offset = 0;
+  for (unsigned int c = 0; c < header->channels; ++c) {
+    chunk->channel[c].offset = offset;
+    chunk->channel[c].bytes = codec_encode(header->sample_type, samples + (size_t)c * rec->fill * header->sample_size,
+                                           rec->fill, out + offset);
+    offset += chunk->channel[c].bytes;
+  }
+  chunk->encoding = REC_CODEC;
+  return offset;
+}
+
+// Write out the chunk being filled, as one large sequential write
+static int rec_flush(rec_writer_t *rec) {
+  if (rec->fill == 0) return 0;
+  const rec_header_t *header = &rec->header;
+  size_t sample_size = header->sample_size;
+  char *samples = rec->chunk + rec->header_bytes;
+
+  // A partial chunk is stored with its channels fill frames apart, like a full one
+  if (rec->fill < header->chunk_frames) {
+    for (unsigned int c = 1; c < header->channels; ++c) {
+      memmove(samples + c * rec->fill * sample_size, samples + (size_t)c * header->chunk_frames * sample_size,
+              rec->fill * sample_size);
+    }
+  }
+  size_t payload = (size_t)header->channels * rec->fill * sample_size;
+
+  rec_chunk_t *chunk = (rec_chunk_t *)rec->chunk;
+  memset(chunk, 0, rec->header_bytes);
+  chunk->magic = REC_CHUNK_MAGIC;
+  chunk->frames = (uint32_t)rec->fill;
+  chunk->first_index = rec->index[rec->chunks].first_index;
+  chunk->start_ns = (int64_t)((chunk->first_index - header->first_index) * 1e9 / header->sample_rate);
+  chunk->end_ns = (int64_t)((chunk->first_index + rec->fill - header->first_index) * 1e9 / header->sample_rate);
+  chunk->header_bytes = (uint32_t)rec->header_bytes;
+  chunk->encoding = REC_RAW;
+  for (unsigned int c = 0; c < header->channels; ++c) {
+    chunk->channel[c] = channel_range(header, samples + c * rec->fill * sample_size, rec->fill);
+    chunk->channel[c].offset = c * rec->fill * sample_size;
+    chunk->channel[c].bytes = rec->fill * sample_size;
+  }
+
+  // Noise does not compress: such a chunk stays raw, so it never costs more than the samples
+  char *out = rec->chunk;
+  if (header->encoding == REC_CODEC) {
+    rec_channel_t raw[header->channels];
+    memcpy(raw, chunk->channel, sizeof(raw));
+    size_t encoded = rec_encode(rec);
+    if (encoded < payload) {
+      out = rec->packed;
+      payload = encoded;
+    } else {
+      chunk->encoding = REC_RAW;
+      memcpy(chunk->channel, raw, sizeof(raw));
+    }
+  }
+  size_t bytes = rec->header_bytes + align_up(payload);
+  chunk->bytes = bytes;
+  if (out != rec->chunk) memcpy(out, chunk, rec->header_bytes);
+  memset(out + rec->header_bytes + payload, 0, bytes - rec->header_bytes - payload);
+  if (write_all(rec->fd, out, bytes, rec->offset) == -1) return -1;
+
+  rec_index_entry_t *entry = &rec->index[rec->chunks++];
+  entry->offset = rec->offset;
+  entry->start_ns = chunk->start_ns;
+  entry->end_ns = chunk->end_ns;
+  rec->offset += bytes;
+  rec->bytes_written += bytes;
+  rec->fill = 0;
+  return 0;
+}
+
+long rec_prepare(rec_writer_t *rec, unsigned long long index) {
+  rec_header_t *header = &rec->header;
+  if (rec->chunks == 0 && rec->fill == 0 && rec->bytes_written == 0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header->start_realtime_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    header->first_index = index;
+  }
+  if (rec->fill > 0) {
+    unsigned long long next = rec->index[rec->chunks].first_index + rec->fill;
+    if (next == index && rec->fill < header->chunk_frames) return header->chunk_frames - rec->fill;
+    if (rec_flush(rec) == -1) return -1;
+  }
+
+  // Starting a new chunk: its index entry is filled in as it is written out
+  if (rec->chunks == rec->index_capacity) {
+    size_t capacity = rec->index_capacity ? 2 * rec->index_capacity : 64;
+    rec_index_entry_t *index_entries = realloc(rec->index, capacity * sizeof(rec_index_entry_t));
+    if (index_entries == NULL) return -1;
+    rec->index = index_entries;
+    rec->index_capacity = capacity;
+  }
+  rec->index[rec->chunks].first_index = index;
+  return header->chunk_frames;
+}
+
+void *rec_frames(rec_writer_t *rec, unsigned int channel) {
+  size_t sample_size = rec->header.sample_size;
+  return rec->chunk + rec->header_bytes + ((size_t)channel * rec->header.chunk_frames + rec->fill) * sample_size;
+}
+
+void rec_commit(rec_writer_t *rec, size_t frames) { rec->fill += frames; }
+
+int rec_close(rec_writer_t *rec) {
+  if (rec == NULL) return 0;
+  int status = rec_flush(rec);
+
+  // The index, then the header that points to it: a crash before this leaves a valid recording
+  // without an index
+  size_t index_bytes = rec->chunks * sizeof(rec_index_entry_t);
+  if (status == 0 && rec->chunks > 0) {
+    status = write_all(rec->fd, rec->index, index_bytes, rec->offset);
+    rec->header.chunks = rec->chunks;
+    rec->header.index_offset = rec->offset;
+  }
+  if (status == 0) status = write_all(rec->fd, &rec->header, sizeof(rec->header), 0);
+  if (close(rec->fd) == -1) status = -1;
+  free(rec->chunk);
+  free(rec->packed);
+  free(rec->index);
+  free(rec);
+  return status;
+}
+
+// The chunk at offset lies whole inside the file, and so does every channel it points to: a raw
+// channel exactly where rec_chunk_samples() looks for it
+static int chunk_valid(const rec_reader_t *reader, uint64_t offset) {
+  const rec_header_t *header = reader->header;
+  if (offset < REC_ALIGN || offset % REC_ALIGN != 0 || offset > reader->size ||
+      reader->size - offset < sizeof(rec_chunk_t) + header->channels * sizeof(rec_channel_t)) {
+    return 0;
+  }
+  const rec_chunk_t *chunk = (const rec_chunk_t *)(reader->map + offset);
+  if (chunk->magic != REC_CHUNK_MAGIC || chunk->frames == 0 || chunk->frames > header->chunk_frames ||
+      chunk->header_bytes < sizeof(rec_chunk_t) + header->channels * sizeof(rec_channel_t) ||
+      chunk->bytes > reader->size - offset || chunk->header_bytes > chunk->bytes ||
+      (chunk->encoding != REC_RAW && chunk->encoding != REC_CODEC)) {
+    return 0;
+  }
+  uint64_t payload = chunk->bytes - chunk->header_bytes;
+  uint64_t raw_bytes = (uint64_t)chunk->frames * header->sample_size;
+  for (unsigned int c = 0; c < header->channels; ++c) {
+    const rec_channel_t *ch = &chunk->channel[c];
+    if (ch->offset > payload || ch->bytes > payload - ch->offset) return 0;
+    if (chunk->encoding == REC_RAW && (ch->offset != c * raw_bytes || ch->bytes != raw_bytes)) return 0;
+  }
+  return 1;
+}
+
+rec_reader_t *rec_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+  if (st.st_size < REC_ALIGN) {
+    close(fd);
+    errno = EPROTO;
+    return NULL;
+  }
+  const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+  madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+  const rec_header_t *header = (const rec_header_t *)map;
+  rec_reader_t *reader = calloc(1, sizeof(rec_reader_t));
+  if (reader == NULL || memcmp(header->magic, REC_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != REC_VERSION || header->sample_size != sample_type_size(header->sample_type) ||
+      header->channels == 0 || header->channels > RING_MAX_CHANNELS || header->chunk_frames == 0 ||
+      header->sample_rate <= 0) {
+    free(reader);
+    munmap((void *)map, st.st_size);
+    errno = EPROTO;
+    return NULL;
+  }
+  reader->map = map;
+  reader->size = st.st_size;
+  reader->header = header;
+
+  // With an index, the chunks it lists up to the first one that is not whole in the file
+  if (header->index_offset >= REC_ALIGN && header->index_offset % REC_ALIGN == 0 &&
+      header->index_offset <= reader->size &&
+      header->chunks <= (reader->size - header->index_offset) / sizeof(rec_index_entry_t)) {
+    reader->index = (const rec_index_entry_t *)(map + header->index_offset);
+    while (reader->chunks < header->chunks && chunk_valid(reader, reader->index[reader->chunks].offset)) {
+      reader->chunks++;
+    }
+    return reader;
+  }
+
+  // No index: the recorder did not finish. Walk the chunk headers as far as they are complete.
+  rec_index_entry_t *index = NULL;
+  size_t capacity = 0;
+  uint64_t offset = REC_ALIGN;
+  reader->scanned = 1;
+  while (chunk_valid(reader, offset)) {
+    const rec_chunk_t *chunk = (const rec_chunk_t *)(map + offset);
+    if (reader->chunks == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      rec_index_entry_t *grown = realloc(index, capacity * sizeof(rec_index_entry_t));
+      if (grown == NULL) break;
+      index = grown;
+    }
+    index[reader->chunks++] = (rec_index_entry_t){offset, chunk->first_index, chunk->start_ns, chunk->end_ns};
+    offset += chunk->bytes;
+  }
+  reader->index = index;
+  return reader;
+}
+
+void rec_reader_close(rec_reader_t *reader) {
+  if (reader == NULL) return;
+  if (reader->scanned) free((void *)reader->index);
+  munmap((void *)reader->map, reader->size);
+  free(reader);
+}
+
+const rec_chunk_t *rec_chunk(const rec_reader_t *reader, size_t i) {
+  return (const rec_chunk_t *)(reader->map + reader->index[i].offset);
+}
+
+const void *rec_chunk_samples(const rec_chunk_t *chunk, unsigned int channel, unsigned int sample_size) {
+  if (chunk->encoding != REC_RAW) return NULL;
+  return (const char *)chunk + chunk->header_bytes + (size_t)channel * chunk->frames * sample_size;
+}
+
+int rec_chunk_read(const rec_reader_t *reader, const rec_chunk_t *chunk, unsigned int channel, void *out) {
+  const rec_header_t *header = reader->header;
+  const rec_channel_t *ch = &chunk->channel[channel];
+  size_t raw_bytes = (size_t)chunk->frames * header->sample_size;
+  if (chunk->header_bytes + ch->offset + ch->bytes > chunk->bytes) return -1;
+  const char *in = (const char *)chunk + chunk->header_bytes + ch->offset;
+  if (chunk->encoding == REC_RAW) {
+    if (ch->bytes != raw_bytes) return -1;
+    memcpy(out, in, raw_bytes);
+    return 0;
+  }
+  if (chunk->encoding != REC_CODEC) return -1;
+  return codec_decode(header->sample_type, in, ch->bytes, chunk->frames, out) == ch->bytes ? 0 : -1;
+}
+
+size_t rec_find(const rec_reader_t *reader, int64_t time_ns) {
+  size_t lo = 0, hi = reader->chunks;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (reader->index[mid].end_ns <= time_ns) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
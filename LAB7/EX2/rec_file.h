@@ -0,0 +1,124 @@
+#ifndef REC_FILE_H
+#define REC_FILE_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // For uint32_t, uint64_t, int64_t
+
+#include "shm_common.h"
+
+// On-disk recording of a LAB7 stream. A page of file header, then chunks, each one a page-aligned
+// chunk header (frame range, time range, per-channel min/max and position) followed by one array
+// per channel, the samples stored as they were in the ring or, in a compressed recording, encoded
+// by codec.h. Closing the recording appends an index of the chunks; a recording cut short has
+// none, and is read by walking the chunk headers instead.
+//
+//   [rec_header_t | pad] [rec_chunk_t + channels | pad] [channel 0] [channel 1] ... [pad] ... [index]
+
+#define REC_MAGIC "LAB7REC"
+#define REC_VERSION 2
+#define REC_CHUNK_MAGIC 0x4B4E4843u  // "CHNK"
+#define REC_ALIGN 4096               // File header, chunks and index start on page boundaries
+#define REC_DEFAULT_CHUNK_FRAMES 65536
+
+// How a chunk stores its samples
+#define REC_RAW 0    // As in the ring
+#define REC_CODEC 1  // codec_encode()d, channel by channel
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t channels;
+  uint32_t sample_type;  // sample_type_t
+  uint32_t sample_size;
+  uint32_t chunk_frames;  // Frames in a full chunk
+  uint32_t encoding;      // REC_CODEC when chunks are compressed (each chunk says whether it is)
+  double sample_rate;
+  double scale;
+  int64_t start_realtime_ns;  // Wall clock when the first frame was recorded
+  uint64_t first_index;       // Stream index of the first frame
+  uint64_t chunks;            // Set when the recording is closed, 0 until then
+  uint64_t index_offset;      // Offset of the chunk index, 0 until then
+} rec_header_t;
+
+typedef struct {
+  float min;  // In the stream's units (int16 scaled)
+  float max;
+  uint64_t offset;  // Of the channel's samples from the start of the chunk's
+  uint64_t bytes;
+} rec_channel_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t frames;
+  uint64_t first_index;   // Stream index of the first frame; a jump from the previous chunk is a gap
+  int64_t start_ns;       // Time of the first frame from the start of the recording, at the sample rate
+  int64_t end_ns;         // ... and just past the last one
+  uint64_t bytes;         // Whole chunk in the file, padding included
+  uint32_t header_bytes;  // Chunk header and padding: the samples start this far in
+  uint32_t encoding;      // REC_RAW, or REC_CODEC when that made the chunk smaller
+  rec_channel_t channel[];
+} rec_chunk_t;
+
+typedef struct {
+  uint64_t offset;
+  uint64_t first_index;
+  int64_t start_ns;
+  int64_t end_ns;
+} rec_index_entry_t;
+
+typedef struct {
+  int fd;
+  rec_header_t header;
+  char *chunk;   // Chunk being filled: header area, then channel arrays chunk_frames apart
+  char *packed;  // Chunk header and the encoded channels, when compressing
+  size_t header_bytes;
+  size_t fill;      // Frames in it so far
+  uint64_t offset;  // Where it goes in the file
+  rec_index_entry_t *index;
+  size_t chunks;
+  size_t index_capacity;
+  uint64_t bytes_written;
+} rec_writer_t;
+
+typedef struct {
+  const char *map;  // The whole file, read-only
+  size_t size;
+  const rec_header_t *header;
+  const rec_index_entry_t *index;
+  size_t chunks;
+  int scanned;  // No index in the file (recording cut short): built by walking the chunks
+} rec_reader_t;
+
+// Start a recording of a stream described by format; chunk_frames 0 picks the default. With
+// compress, each chunk is stored encoded when that makes it smaller.
+rec_writer_t *rec_create(const char *path, const circular_buffer_shm_t *format, unsigned int chunk_frames,
+                         int compress);
+
+// Get the current chunk ready to take frames from stream index index on, writing it out first
+// when it is full or index does not follow its last frame. Returns the frames it has room for,
+// or -1 when writing failed. Copy channel c's frames to rec_frames(rec, c), then rec_commit().
+long rec_prepare(rec_writer_t *rec, unsigned long long index);
+void *rec_frames(rec_writer_t *rec, unsigned int channel);
+void rec_commit(rec_writer_t *rec, size_t frames);
+
+// Write out the current chunk, then the index and the final file header. 0 on success.
+int rec_close(rec_writer_t *rec);
+
+// Map a recording. Only chunks that lie whole inside the file are listed, from the index or by
+// walking them: reading stops before the first one that does not. NULL with errno EPROTO when the
+// file is not a recording.
+rec_reader_t *rec_open(const char *path);
+void rec_reader_close(rec_reader_t *reader);
+
+const rec_chunk_t *rec_chunk(const rec_reader_t *reader, size_t i);
+// A raw chunk's samples of channel, in place; NULL when the chunk is encoded
+const void *rec_chunk_samples(const rec_chunk_t *chunk, unsigned int channel, unsigned int sample_size);
+
+// Copy or decode a chunk's samples of channel into out, which holds chunk->frames of them. 0 on
+// success, -1 when the chunk is corrupt.
+int rec_chunk_read(const rec_reader_t *reader, const rec_chunk_t *chunk, unsigned int channel, void *out);
+
+// First chunk that ends after time_ns (from the start of the recording), or chunks if none does
+size_t rec_find(const rec_reader_t *reader, int64_t time_ns);
+
+#endif  // REC_FILE_H
@@ -0,0 +1,193 @@
+#include <errno.h>     // For errno, ENOENT, EAGAIN
+#include <getopt.h>    // For getopt_long
+#include <signal.h>    // For sigaction, SIGINT, SIGTERM
+#include <stdio.h>     // For printf, perror
+#include <stdlib.h>    // For atof, strtoul, EXIT_SUCCESS, EXIT_FAILURE
+#include <sys/stat.h>  // For stat
+#include <time.h>      // For clock_gettime
+#include <unistd.h>    // For sleep, getpid
+
+#include "rec_file.h"
+#include "shm_common.h"
+#include "shm_ring.h"
+
+#define WAIT_TIMEOUT_NS 200000000LL  // Check for Ctrl+C at least this often
+#define REPORT_NS 1000000000LL
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_stop(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s --output FILE [--chunk FRAMES] [--duration SEC] [--compress]\n", prog);
+  fprintf(stderr, "  --output FILE   recording to write (replaced if it exists)\n");
+  fprintf(stderr, "  --chunk N       frames per chunk (default %d)\n", REC_DEFAULT_CHUNK_FRAMES);
+  fprintf(stderr, "  --duration SEC  stop after this long (default: until Ctrl+C)\n");
+  fprintf(stderr, "  --compress      store chunks encoded with the sample codec where that is smaller\n");
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"output", required_argument, NULL, 'o'},
+                                         {"chunk", required_argument, NULL, 'c'},
+                                         {"duration", required_argument, NULL, 'd'},
+                                         {"compress", no_argument, NULL, 'z'},
+                                         {NULL, 0, NULL, 0}};
+  const char *path = NULL;
+  unsigned int chunk_frames = REC_DEFAULT_CHUNK_FRAMES;
+  double duration = 0;
+  int compress = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "o:c:d:z", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'o':
+        path = optarg;
+        break;
+      case 'c':
+        chunk_frames = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        duration = atof(optarg);
+        break;
+      case 'z':
+        compress = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (path == NULL || chunk_frames == 0 || duration < 0) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct sigaction sa = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  printf("--- Recorder (PID %d) ---\n", getpid());
+
+  // Open the shared memory ring read-only (loop until the producer has created it)
+  ring_t *shm_buffer;
+  while (1) {
+    shm_buffer = ring_open(SHM_NAME);
+    if (shm_buffer != NULL) break;
+    if (stop_requested) return EXIT_SUCCESS;
+    if (errno == ENOENT || errno == EAGAIN) {
+      fprintf(stderr, "Recorder: Shared memory '%s' not ready. Retrying in 1 second...\n", SHM_NAME);
+      sleep(1);
+    } else {
+      perror("ring_open failed unexpectedly");
+      return EXIT_FAILURE;
+    }
+  }
+  const circular_buffer_shm_t *header = shm_buffer->header;
+  rec_writer_t *rec = rec_create(path, header, chunk_frames, compress);
+  if (rec == NULL) {
+    perror("rec_create failed");
+    ring_close(shm_buffer);
+    return EXIT_FAILURE;
+  }
+  printf("Recorder: Recording %u channel(s) of %s at %.0f Hz from '%s' to %s in %schunks of %u frames...\n",
+         header->channels, sample_type_name(header->sample_type), header->sample_rate, SHM_NAME, path,
+         compress ? "compressed " : "", chunk_frames);
+
+  // Copy every frame from the cursor up to write_index into the chunk being filled; the chunk goes
+  // to disk in one write when it is full, or when a gap (frames recycled before we got to them)
+  // means the next frame does not follow on
+  long long start_ns = now_ns();
+  long long end_ns = duration > 0 ? start_ns + (long long)(duration * 1e9) : 0;
+  long long report_start_ns = start_ns;
+  long long next_report_ns = start_ns + REPORT_NS;
+  unsigned long long cursor = 0;
+  int started = 0;
+  unsigned long long recorded = 0;
+  unsigned long long reported = 0;
+  unsigned long long lost = 0;
+  unsigned long long reported_bytes = 0;
+  int failed = 0;
+  while (!stop_requested && !failed && (end_ns == 0 || now_ns() < end_ns)) {
+    unsigned long long write_index = ring_wait(shm_buffer, cursor + 1, WAIT_TIMEOUT_NS);
+    if (!started) {
+      cursor = write_index;  // Record from now on
+      started = 1;
+      // Registered, a producer running with --policy block never makes the recording lose frames
+      if (ring_register(shm_buffer, cursor) == -1) perror("Recorder: ring_register failed, recording unregistered");
+      continue;
+    }
+    unsigned long long lost_before = lost;
+
+    while (cursor < write_index) {
+      unsigned long long oldest = ring_oldest(shm_buffer, write_index);
+      if (cursor < oldest) {
+        lost += oldest - cursor;
+        cursor = oldest;
+      }
+      long room = rec_prepare(rec, cursor);
+      if (room == -1) {
+        perror("Recorder: writing the recording failed");
+        failed = 1;
+        break;
+      }
+      size_t count = write_index - cursor;
+      if (count > (size_t)room) count = room;
+      if (count > header->capacity / 2) count = header->capacity / 2;
+      int lapped = 0;
+      for (unsigned int c = 0; c < header->channels && !lapped; ++c) {
+        lapped = ring_copy(shm_buffer, c, cursor, count, rec_frames(rec, c)) == -1;
+      }
+      if (lapped) {  // Try again from whatever is still in the ring
+        write_index = ring_write_index(shm_buffer);
+        continue;
+      }
+      rec_commit(rec, count);
+      cursor += count;
+      recorded += count;
+    }
+    ring_advance(shm_buffer, cursor, lost - lost_before);
+
+    long long now = now_ns();
+    if (now >= next_report_ns) {
+      double elapsed = (now - report_start_ns) / 1e9;
+      printf("Recorder: %llu frames in %zu chunk(s), %.1f MB written | %.0f frames/s, %.1f MB/s, %llu lost\n",
+             recorded, rec->chunks, rec->bytes_written / 1e6, (recorded - reported) / elapsed,
+             (rec->bytes_written - reported_bytes) / 1e6 / elapsed, lost);
+      fflush(stdout);
+      reported = recorded;
+      reported_bytes = rec->bytes_written;
+      report_start_ns = now;
+      next_report_ns = now + REPORT_NS;
+    }
+  }
+
+  // Give our slot back before finishing the file, so that a producer under --policy block stops
+  // waiting for us at once. The last partial chunk and the index go out on the way out, Ctrl+C
+  // included.
+  ring_unregister(shm_buffer);
+  size_t chunks = rec->chunks + (rec->fill > 0);
+  if (rec_close(rec) == -1) {
+    perror("Recorder: finishing the recording failed");
+    failed = 1;
+  }
+  printf("Recorder: %llu frames (%.1f s of signal) in %zu chunk(s) to %s, %llu lost.\n", recorded,
+         recorded / header->sample_rate, chunks, path, lost);
+  struct stat st;
+  if (recorded > 0 && stat(path, &st) == 0) {
+    double raw_bytes = (double)recorded * header->channels * header->sample_size;
+    printf("Recorder: %.1f MB of samples in a %.1f MB file (%.2f:1).\n", raw_bytes / 1e6, st.st_size / 1e6,
+           raw_bytes / st.st_size);
+  }
+  ring_close(shm_buffer);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+#include <errno.h>      // For EINTR
+#include <getopt.h>     // For getopt_long
+#include <signal.h>     // For sigaction, SIGINT, SIGTERM
+#include <stdio.h>      // For printf, perror
+#include <stdlib.h>     // For atof, atol, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>     // For strcmp
+#include <sys/prctl.h>  // For prctl, PR_SET_TIMERSLACK
+#include <time.h>       // For clock_gettime, clock_nanosleep, TIMER_ABSTIME
+#include <unistd.h>     // For getpid
+
+#include "rec_file.h"
+#include "shm_common.h"
+#include "shm_ring.h"
+
+#define PUBLISH_FREQ 1000.0  // Hz of recorded time: by default samples are published in blocks of 1 ms
+#define REPORT_NS 1000000000LL
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_stop(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Sleep until an absolute CLOCK_MONOTONIC time, so time spent publishing never accumulates as drift
+void sleep_until(long long deadline_ns) {
+  struct timespec deadline = {.tv_sec = deadline_ns / 1000000000LL, .tv_nsec = deadline_ns % 1000000000LL};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && !stop_requested) {
+  }
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s --input FILE [--speed X] [--start SEC] [--block FRAMES] [--capacity SAMPLES] [--policy POLICY] "
+          "[--loop]\n",
+          prog);
+  fprintf(stderr, "  --input FILE     recording made by the recorder\n");
+  fprintf(stderr, "  --speed X        X times real time; 0 publishes as fast as possible (default 1)\n");
+  fprintf(stderr, "  --start SEC      skip to this far into the recording\n");
+  fprintf(stderr, "  --block FRAMES   frames per publish (default: %.0f ms of recorded time)\n", 1000.0 / PUBLISH_FREQ);
+  fprintf(stderr, "  --capacity N     samples per channel ring (default %d, or 4 blocks if more)\n", BUFFER_CAPACITY);
+  fprintf(stderr, "  --policy POLICY  when a registered reader would be overrun: overwrite it (default), block\n"
+                  "                   until it catches up, or skip the block\n");
+  fprintf(stderr, "  --loop           start over at the end\n");
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"input", required_argument, NULL, 'i'},
+                                         {"speed", required_argument, NULL, 's'},
+                                         {"start", required_argument, NULL, 'S'},
+                                         {"block", required_argument, NULL, 'b'},
+                                         {"capacity", required_argument, NULL, 'C'},
+                                         {"policy", required_argument, NULL, 'p'},
+                                         {"loop", no_argument, NULL, 'l'},
+                                         {NULL, 0, NULL, 0}};
+  const char *path = NULL;
+  double speed = 1.0;
+  double start_sec = 0;
+  long block = 0;
+  long capacity = 0;
+  ring_policy_t policy = RING_OVERWRITE;
+  int loop = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "i:s:S:b:C:p:l", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'i':
+        path = optarg;
+        break;
+      case 's':
+        speed = atof(optarg);
+        break;
+      case 'S':
+        start_sec = atof(optarg);
+        break;
+      case 'b':
+        block = atol(optarg);
+        break;
+      case 'C':
+        capacity = atol(optarg);
+        break;
+      case 'p':
+        if (strcmp(optarg, "overwrite") == 0) {
+          policy = RING_OVERWRITE;
+        } else if (strcmp(optarg, "block") == 0) {
+          policy = RING_BLOCK;
+        } else if (strcmp(optarg, "skip") == 0) {
+          policy = RING_SKIP;
+        } else {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'l':
+        loop = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (path == NULL || speed < 0 || start_sec < 0 || block < 0 || capacity < 0) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  rec_reader_t *reader = rec_open(path);
+  if (reader == NULL) {
+    perror("rec_open failed");
+    return EXIT_FAILURE;
+  }
+  const rec_header_t *file = reader->header;
+  size_t first_chunk = rec_find(reader, (int64_t)(start_sec * 1e9));
+  if (first_chunk == reader->chunks) {
+    fprintf(stderr, "Replay: %s has no frames after %.1f s.\n", path, start_sec);
+    rec_reader_close(reader);
+    return EXIT_FAILURE;
+  }
+  if (block == 0) block = file->sample_rate / PUBLISH_FREQ >= 1 ? (long)(file->sample_rate / PUBLISH_FREQ) : 1;
+  if (capacity == 0) capacity = 4 * block > BUFFER_CAPACITY ? 4 * block : BUFFER_CAPACITY;
+  if (block > capacity / 2) {
+    usage(argv[0]);
+    rec_reader_close(reader);
+    return EXIT_FAILURE;
+  }
+  if (speed > 0 && prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0) == -1) perror("prctl(PR_SET_TIMERSLACK) failed");
+
+  struct sigaction sa = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  printf("--- Replay (PID %d) ---\n", getpid());
+
+  // The ring takes the recording's format, so consumers see the stream the recorder saw
+  ring_format_t format = {file->channels, (sample_type_t)file->sample_type, (unsigned int)capacity, file->sample_rate,
+                          file->scale, HUGE_SHM_POPULATE};
+  ring_t *shm_buffer = ring_create(SHM_NAME, &format, (unsigned int)block);
+  if (shm_buffer == NULL) {
+    perror("ring_create failed");
+    rec_reader_close(reader);
+    return EXIT_FAILURE;
+  }
+  ring_set_policy(shm_buffer, policy);
+  const rec_chunk_t *last = rec_chunk(reader, reader->chunks - 1);
+  printf("Replay: %s: %u channel(s) of %s at %.0f Hz, %zu chunk(s), %.1f s%s.\n", path, file->channels,
+         sample_type_name(file->sample_type), file->sample_rate, reader->chunks, last->end_ns / 1e9,
+         reader->scanned ? " (no index: the recording was cut short)" : "");
+  static const char *policy_names[] = {"overwriting", "blocking for", "skipping blocks for"};
+  if (speed > 0) {
+    printf("Replay: Publishing to '%s' at %.2fx real time in blocks of %ld frames (%s slow registered readers)...\n",
+           SHM_NAME, speed, block, policy_names[policy]);
+  } else {
+    printf("Replay: Publishing to '%s' as fast as possible in blocks of %ld frames (%s slow registered readers)...\n",
+           SHM_NAME, block, policy_names[policy]);
+  }
+
+  // Publish raw chunks straight from the mapped file: each block goes from the page cache into the
+  // ring with one copy. Encoded chunks are decoded into a scratch chunk first. Deadlines follow the
+  // recorded time, so gaps in the recording become pauses.
+  size_t sample_size = file->sample_size;
+  char *scratch = NULL;
+  if (file->encoding == REC_CODEC) {
+    scratch = malloc((size_t)file->channels * file->chunk_frames * sample_size);
+    if (scratch == NULL) {
+      perror("malloc failed");
+      ring_close(shm_buffer);
+      rec_reader_close(reader);
+      ring_unlink(SHM_NAME);
+      return EXIT_FAILURE;
+    }
+  }
+  unsigned long long published = 0;
+  unsigned long long reported = 0;
+  long long start_ns = now_ns();
+  long long report_start_ns = start_ns;
+  long long next_report_ns = start_ns + REPORT_NS;
+  // The clock starts at the first frame sent, which --start can put in the middle of its chunk
+  const rec_chunk_t *first = rec_chunk(reader, first_chunk);
+  size_t first_from = start_sec * 1e9 > first->start_ns
+                          ? (size_t)((start_sec * 1e9 - first->start_ns) * file->sample_rate / 1e9)
+                          : 0;
+  int64_t origin_ns = first->start_ns + (int64_t)(first_from * 1e9 / file->sample_rate);
+  long long base_ns = start_ns;  // When origin_ns is due
+  int64_t position_ns = origin_ns;
+  size_t pass_chunks = 0;  // Chunks published since the last pass started
+  int status = EXIT_SUCCESS;
+  for (size_t i = first_chunk; !stop_requested; ++i) {
+    if (i == reader->chunks) {
+      if (!loop) break;
+      if (pass_chunks == 0) {
+        fprintf(stderr, "Replay: no chunk from %.1f s on could be read, stopping.\n", origin_ns / 1e9);
+        status = EXIT_FAILURE;
+        break;
+      }
+      i = first_chunk;
+      pass_chunks = 0;
+      base_ns = now_ns();
+    }
+    const rec_chunk_t *chunk = rec_chunk(reader, i);
+    const char *samples = rec_chunk_samples(chunk, 0, sample_size);
+    if (samples == NULL) {
+      int corrupt = scratch == NULL || chunk->frames > file->chunk_frames;
+      for (unsigned int c = 0; c < file->channels && !corrupt; ++c) {
+        corrupt = rec_chunk_read(reader, chunk, c, scratch + (size_t)c * chunk->frames * sample_size) == -1;
+      }
+      if (corrupt) {
+        fprintf(stderr, "Replay: chunk %zu is corrupt, skipping it.\n", i);
+        continue;
+      }
+      samples = scratch;
+    }
+    size_t from = i == first_chunk ? first_from : 0;
+    ++pass_chunks;
+    for (size_t done = from; done < chunk->frames && !stop_requested;) {
+      size_t count = chunk->frames - done < (size_t)block ? chunk->frames - done : (size_t)block;
+      position_ns = chunk->start_ns + (int64_t)(done * 1e9 / file->sample_rate);
+      if (speed > 0) sleep_until(base_ns + (long long)((position_ns - origin_ns) / speed));
+      // Under --policy block a slow reader holds the write back; check for Ctrl+C while it does
+      size_t written = 0;
+      while (written < count && !stop_requested) {
+        written += ring_write_strided(shm_buffer, samples + (done + written) * sample_size, count - written,
+                                      chunk->frames);
+      }
+      done += written;
+      published += written;
+
+      long long now = now_ns();
+      if (now >= next_report_ns) {
+        double elapsed = (now - report_start_ns) / 1e9;
+        printf("Replay: at %.1f s of %.1f | %.0f frames/s (%.2fx real time), %.1f MB/s\n", position_ns / 1e9,
+               last->end_ns / 1e9, (published - reported) / elapsed,
+               (published - reported) / elapsed / file->sample_rate,
+               (published - reported) * file->channels * sample_size / 1e6 / elapsed);
+        fflush(stdout);
+        reported = published;
+        report_start_ns = now;
+        next_report_ns = now + REPORT_NS;
+      }
+    }
+  }
+  double elapsed = (now_ns() - start_ns) / 1e9;
+  printf("Replay: %llu frames in %.2f s (%.0f frames/s, %.1f MB/s).\n", published, elapsed, published / elapsed,
+         published * file->channels * sample_size / 1e6 / elapsed);
+
+  printf("Replay: Cleaning up shared memory.\n");
+  free(scratch);
+  ring_close(shm_buffer);
+  rec_reader_close(reader);
+  if (ring_unlink(SHM_NAME) == -1) {
+    perror("ring_unlink failed");
+  }
+
+  return status;
+}
@@ -0,0 +1,230 @@
+// Stress test for the SPMC ring: one unthrottled writer publishes a known pattern on every channel
+// in blocks while forked readers copy random windows of random channels, some of them delayed so
+// the writer laps them mid-copy. Odd readers skip the copy and check the double-mapped span in
+// place. Every window the ring accepts must match the pattern exactly; rejected ones are checked
+// too, to show that the overrun detection is what keeps torn data out.
+#include <errno.h>     // For errno
+#include <getopt.h>    // For getopt_long
+#include <sched.h>     // For sched_yield
+#include <stdio.h>     // For printf, perror
+#include <stdlib.h>    // For atoi, malloc, free, rand_r, EXIT_SUCCESS, EXIT_FAILURE
+#include <sys/wait.h>  // For waitpid
+#include <time.h>      // For clock_gettime
+#include <unistd.h>    // For fork, pipe, read, write, getpid, _exit
+
+#include "shm_common.h"
+#include "shm_ring.h"
+
+#define DEFAULT_READERS 4
+#define DEFAULT_SECONDS 3
+#define DEFAULT_BLOCK 64
+#define DEFAULT_CHANNELS 2
+#define DEFAULT_WINDOW BUFFER_CAPACITY  // Windows reaching back to the oldest slot exercise the max_block margin
+#define MAX_READERS 64
+#define DELAY_EVERY 16  // One copy in this many yields the CPU half-way, inviting the writer to lap it
+
+typedef struct {
+  unsigned long long copies;
+  unsigned long long samples_checked;
+  unsigned long long overruns;      // Copies ring_copy() rejected
+  unsigned long long overrun_torn;  // ... of which really held recycled samples
+  unsigned long long torn;          // Accepted copies that did not match: must stay 0
+  unsigned long long backwards;     // write_index going down: must stay 0
+} reader_report_t;
+
+// Exactly representable in a float, different from the sample one lap earlier and from the other
+// channels' samples at the same index
+float pattern(unsigned int channel, unsigned long long index) { return (float)((index + channel * 7919) & 0xFFFFFF); }
+
+double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int mismatches(const float *window, unsigned int channel, unsigned long long start, size_t count) {
+  int bad = 0;
+  for (size_t i = 0; i < count; ++i) bad += window[i] != pattern(channel, start + i);
+  return bad;
+}
+
+void run_reader(const char *name, int id, int window_max, int seconds, int ready_fd, int report_fd) {
+  reader_report_t report = {0};
+  ring_t *ring = ring_open(name);
+  float *window = malloc(window_max * sizeof(float));
+  unsigned int seed = (unsigned int)getpid();
+  unsigned long long last_index = 0;
+  char ready = 1;
+
+  if (ring == NULL || window == NULL) {
+    perror("Reader: ring_open failed");
+    _exit(EXIT_FAILURE);
+  }
+  if (write(ready_fd, &ready, 1) != 1) _exit(EXIT_FAILURE);
+
+  double end = now_sec() + seconds;
+  while (now_sec() < end) {
+    unsigned long long write_index = ring_write_index(ring);
+    if (write_index < last_index) report.backwards++;
+    last_index = write_index;
+    if (write_index == 0) continue;
+
+    size_t count = 1 + rand_r(&seed) % window_max;
+    if (count > write_index) count = write_index;
+    unsigned long long start = write_index - count;
+    unsigned int channel = rand_r(&seed) % ring->header->channels;
+    if (++report.copies % DELAY_EVERY == (unsigned long long)id % DELAY_EVERY) sched_yield();
+
+    int rc;
+    int bad;
+    if (id % 2 == 1) {  // Zero-copy: check the span in place, then validate it
+      bad = mismatches(ring_span(ring, channel, start), channel, start, count);
+      rc = ring_check(ring, start);
+    } else {
+      rc = ring_copy(ring, channel, start, count, window);
+      bad = mismatches(window, channel, start, count);
+    }
+    if (rc == 0) {
+      report.samples_checked += count;
+      if (bad > 0) report.torn++;
+    } else {
+      report.overruns++;
+      if (bad > 0) report.overrun_torn++;
+    }
+  }
+  free(window);
+  ring_close(ring);
+  if (write(report_fd, &report, sizeof(report)) != sizeof(report)) _exit(EXIT_FAILURE);
+  _exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {{"readers", required_argument, NULL, 'r'},
+                                         {"seconds", required_argument, NULL, 's'},
+                                         {"block", required_argument, NULL, 'b'},
+                                         {"window", required_argument, NULL, 'w'},
+                                         {"channels", required_argument, NULL, 'c'},
+                                         {NULL, 0, NULL, 0}};
+  int readers = DEFAULT_READERS;
+  int seconds = DEFAULT_SECONDS;
+  int block = DEFAULT_BLOCK;
+  int window = DEFAULT_WINDOW;
+  int channels = DEFAULT_CHANNELS;
+  int ready_pipe[2];
+  int report_pipe[2];
+  pid_t pids[MAX_READERS];
+  char name[64];
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "r:s:b:w:c:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'r':
+        readers = atoi(optarg);
+        break;
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      case 'b':
+        block = atoi(optarg);
+        break;
+      case 'w':
+        window = atoi(optarg);
+        break;
+      case 'c':
+        channels = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [--readers N] [--seconds S] [--block SAMPLES] [--window SAMPLES] [--channels N]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (readers < 1 || readers > MAX_READERS || seconds < 1 || block < 1 || block >= BUFFER_CAPACITY || window < 1 ||
+      window > BUFFER_CAPACITY || channels < 1 || channels > RING_MAX_CHANNELS) {
+    fprintf(stderr, "Need 1-%d readers, 1 <= block < %d, 1 <= window <= %d, 1-%d channels.\n", MAX_READERS,
+            BUFFER_CAPACITY, BUFFER_CAPACITY, RING_MAX_CHANNELS);
+    return EXIT_FAILURE;
+  }
+
+  snprintf(name, sizeof(name), "/ring_stress.%d", getpid());
+  ring_format_t format = {channels, SAMPLE_FLOAT32, BUFFER_CAPACITY, SAMPLING_FREQ, 1.0, HUGE_SHM_POPULATE};
+  ring_t *ring = ring_create(name, &format, block);
+  if (ring == NULL) {
+    perror("ring_create failed");
+    return EXIT_FAILURE;
+  }
+  if (pipe(ready_pipe) == -1 || pipe(report_pipe) == -1) {
+    perror("pipe failed");
+    ring_unlink(name);
+    return EXIT_FAILURE;
+  }
+  printf("Writer (PID %d): %d ring(s) of %u samples, blocks of %d, %d reader(s), windows up to %d, %d s\n", getpid(),
+         channels, ring->header->capacity, block, readers, window, seconds);
+
+  for (int i = 0; i < readers; ++i) {
+    pids[i] = fork();
+    if (pids[i] == -1) {
+      perror("fork failed");
+      readers = i;
+      break;
+    }
+    if (pids[i] == 0) {
+      close(ready_pipe[0]);
+      close(report_pipe[0]);
+      run_reader(name, i, window, seconds, ready_pipe[1], report_pipe[1]);
+    }
+  }
+  close(ready_pipe[1]);
+  close(report_pipe[1]);
+  for (int i = 0; i < readers; ++i) {
+    char ready;
+    if (read(ready_pipe[0], &ready, 1) != 1) break;
+  }
+  ring_unlink(name);  // Everyone has it mapped now
+
+  // Unthrottled writer: the pattern depends only on the index, so readers can check any window
+  float *samples = malloc((size_t)channels * block * sizeof(float));
+  unsigned long long index = 0;
+  double start = now_sec();
+  double end = start + seconds;
+  while (samples != NULL && now_sec() < end) {
+    for (int c = 0; c < channels; ++c) {
+      for (int k = 0; k < block; ++k) samples[c * block + k] = pattern(c, index + k);
+    }
+    ring_write(ring, samples, block);
+    index += block;
+  }
+  double elapsed = now_sec() - start;
+  free(samples);
+
+  int failed = 0;
+  reader_report_t total = {0};
+  for (int i = 0; i < readers; ++i) {
+    reader_report_t report;
+    int status;
+    if (read(report_pipe[0], &report, sizeof(report)) != sizeof(report)) {
+      failed = 1;
+      continue;
+    }
+    printf("Reader: %llu copies, %llu samples verified, %llu overruns detected (%llu held recycled samples), "
+           "%llu torn, %llu backwards\n",
+           report.copies, report.samples_checked, report.overruns, report.overrun_torn, report.torn,
+           report.backwards);
+    total.torn += report.torn;
+    total.backwards += report.backwards;
+    total.overruns += report.overruns;
+    waitpid(pids[i], &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) failed = 1;
+  }
+  close(ready_pipe[0]);
+  close(report_pipe[0]);
+  ring_close(ring);
+
+  printf("Writer: %llu frames in %.2f s (%.1f M samples/s)\n", index, elapsed, index / elapsed / 1e6);
+  if (failed || total.torn > 0 || total.backwards > 0) {
+    printf("FAILED: readers accepted torn data or did not finish\n");
+    return EXIT_FAILURE;
+  }
+  printf("OK: no torn windows accepted (%llu overruns detected and rejected)\n", total.overruns);
+  return EXIT_SUCCESS;
+}
@@ -1,20 +1,90 @@
 #ifndef SHM_COMMON_H
 #define SHM_COMMON_H
 
+#include <stdatomic.h>  // For _Atomic
 #include <sys/types.h>
 #include <unistd.h>
 
 #define SHM_NAME "/circular_buffer_shm"
-#define BUFFER_CAPACITY 4000  // Number of float samples in the circular buffer (2 seconds of data at 2kHz)
-#define SAMPLING_FREQ 2000.0  // Hz (samples per second)
-#define SIGNAL_FREQ 100.0     // Hz (frequency of the sine wave)
+#define BUFFER_CAPACITY 4096  // Default samples per channel ring (about 2 seconds of data at 2kHz)
+#define SAMPLING_FREQ 2000.0  // Hz (default samples per second)
+#define SIGNAL_FREQ 100.0     // Hz (default frequency of the sine wave)
 #define PI 3.14159265358979323846
 
-// volatile: ensures compiler doesn't optimize away reads/writes
+#define RING_MAGIC 0x474E4952u  // "RING", stored last once the producer has initialized the segment
+#define RING_VERSION 4          // Bumped whenever the header layout changes
+#define RING_PAGE_SIZE 4096     // Small page: the header and the reader slots fit in one each
+#define RING_MAX_CHANNELS 256
+#define RING_MAX_READERS 32       // Registered reader slots, in the page after the header
+#define RING_NO_CURSOR (~0ULL)    // Cursor of a slot whose reader has not started yet
+#define RING_SLOT_RELEASING (-1)  // Pid of a slot whose cursor is being cleared before it is freed
+
+typedef enum {
+  SAMPLE_INT16 = 1,  // Fixed point: the value is the raw sample times the header's scale
+  SAMPLE_FLOAT32 = 2,
+  SAMPLE_FLOAT64 = 3,
+} sample_type_t;
+
+// What the producer does when a block would overwrite samples a registered reader has not
+// consumed yet
+typedef enum {
+  RING_OVERWRITE = 0,  // Write anyway: readers that fall behind are lapped and skip ahead
+  RING_BLOCK = 1,      // Wait for the slowest reader: lossless, at the pace of that reader
+  RING_SKIP = 2,       // Drop the block: the readers keep what they have not read, new frames are lost
+} ring_policy_t;
+
+// Header page of a single-producer/multi-consumer stream of frames: every frame has one sample per
+// channel, and each channel has its own ring (structure of arrays), placed one after the other
+// behind the header. The producer writes a block of frames at write_index onwards, then publishes
+// it by advancing write_index with a release store; readers load it with acquire and read, then
+// re-check it to find out whether the producer lapped them meanwhile (see shm_ring.h).
+// write_index never wraps, so it is also the count of frames ever written. Readers that have caught
+// up sleep on the notify futex instead of polling.
+//
+// Everything a reader needs to interpret the segment is in here, so producers choose channels,
+// sample type, rate and capacity at run time. Each channel ring is mapped twice, back to back, so
+// any run of up to capacity samples is one contiguous span, whatever its position.
+//
+// Layout: [header page] [ring_readers_t page] [channel 0 ring] [channel 1 ring] ..., where a page
+// is page_size bytes, 4 KiB or a huge page, and every ring is a whole number of pages.
 typedef struct {
-  volatile int write_pos;                    // Current position where the producer writes the next sample
-  volatile long long total_samples_written;  // Total number of samples ever written by producer
-  float samples[BUFFER_CAPACITY];
+  _Atomic unsigned int magic;
+  unsigned int version;                                 // RING_VERSION
+  unsigned int channels;                                // Rings behind the header
+  unsigned int sample_type;                             // sample_type_t
+  unsigned int sample_size;                             // Bytes per sample
+  unsigned int capacity;                                // Samples per channel ring
+  unsigned int max_block;                               // Most frames written past write_index before a publish
+  unsigned int page_size;                               // Of the layout: 4 KiB, or huge pages
+  double sample_rate;                                   // Frames per second
+  double scale;                                         // Value of one SAMPLE_INT16 step, 1 otherwise
+  _Alignas(64) _Atomic unsigned long long write_index;  // Alone on its cache line: only the producer stores it
+  _Alignas(64) _Atomic unsigned int notify;             // Futex word bumped after each publish, readers wait on it
+  _Atomic long long publish_ns;                         // CLOCK_MONOTONIC time of the latest publish, for wake latency
+  _Alignas(64) _Atomic unsigned int policy;             // ring_policy_t, chosen by the producer
+  _Atomic unsigned long long skipped;                   // Frames RING_SKIP dropped
+  _Atomic long long blocked_ns;                         // Time RING_BLOCK spent waiting for readers
+  _Atomic unsigned int stale_readers;                   // Slots reclaimed from readers that died
 } circular_buffer_shm_t;
 
+_Static_assert(sizeof(circular_buffer_shm_t) <= RING_PAGE_SIZE, "the ring header must fit in its page");
+
+// One registered reader, alone on its cache line: its cursor is stored by the reader on every
+// advance and only loaded by the producer, so no other slot's traffic invalidates it
+typedef struct {
+  _Alignas(64) _Atomic int pid;        // 0 when the slot is free, RING_SLOT_RELEASING while it is being freed
+  _Atomic unsigned long long cursor;   // Every frame below it has been consumed, or RING_NO_CURSOR
+  _Atomic unsigned long long dropped;  // Frames the reader never got: lapped, or skipped on its account
+} ring_reader_slot_t;
+
+// Page after the header: the only part of the segment readers map writable
+typedef struct {
+  _Alignas(64) _Atomic unsigned int progress;  // Futex word readers bump when they advance while the producer waits
+  _Atomic unsigned int producer_waiting;       // Set while the producer waits on progress
+  _Atomic unsigned int slots_used;             // 1 + the highest slot ever claimed: the producer scans no further
+  ring_reader_slot_t slot[RING_MAX_READERS];
+} ring_readers_t;
+
+_Static_assert(sizeof(ring_readers_t) <= RING_PAGE_SIZE, "the reader slots must fit in their page");
+
 #endif  // SHM_COMMON_H
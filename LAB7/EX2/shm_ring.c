@@ -0,0 +1,536 @@
+#include "shm_ring.h"
+
+#include <errno.h>     // For errno, ENOENT, EAGAIN, EPROTO, EINVAL, EBUSY, EACCES, ESRCH
+#include <fcntl.h>     // For O_RDWR, O_RDONLY
+#include <math.h>      // For lrintf
+#include <signal.h>    // For kill
+#include <stdint.h>    // For uintptr_t
+#include <stdio.h>     // For perror
+#include <stdlib.h>    // For malloc, free
+#include <string.h>    // For memcpy, memset, strcmp
+#include <sys/mman.h>  // For mmap, munmap
+#include <sys/stat.h>  // For fstat
+#include <time.h>      // For struct timespec
+#include <unistd.h>    // For getpid, pread, close
+
+#include "shm_futex.h"
+
+static size_t ring_bytes(unsigned int capacity, unsigned int sample_size) { return (size_t)capacity * sample_size; }
+
+// The header page and the reader slots' page come before the rings. "Page" is the segment's page
+// size, 4 KiB or a huge page: every region must start at a multiple of it to be mapped on its own.
+static size_t segment_bytes(unsigned int channels, unsigned int capacity, unsigned int sample_size, size_t page) {
+  return 2 * page + channels * ring_bytes(capacity, sample_size);
+}
+
+// Reserve room for the header, the reader slots and two copies of every channel ring, aligned to
+// the page size, then map the header, the slots and each ring twice in a row over the reservation.
+// The reservation keeps another thread's mmap from landing between the MAP_FIXED calls.
+static ring_t *map_ring(huge_shm_t *shm, int fd, int prot, int readers_prot, unsigned int channels,
+                        unsigned int capacity, unsigned int sample_size) {
+  size_t page = shm->page_size;
+  size_t bytes = ring_bytes(capacity, sample_size);
+  size_t mapping_bytes = 2 * page + 2 * channels * bytes;
+  ring_t *ring = malloc(sizeof(ring_t));
+  char *reserved = mmap(NULL, mapping_bytes + page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == NULL || reserved == MAP_FAILED) {
+    if (reserved != MAP_FAILED) munmap(reserved, mapping_bytes + page);
+    free(ring);
+    return NULL;
+  }
+  // Huge pages can only be mapped at addresses aligned to them: trim the reservation to fit
+  char *base = (char *)(((uintptr_t)reserved + page - 1) / page * page);
+  if (base > reserved) munmap(reserved, base - reserved);
+  if (reserved + page > base) munmap(base + mapping_bytes, reserved + page - base);
+
+  int ok = huge_shm_map(shm, base, page, prot, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+           huge_shm_map(shm, base + page, page, readers_prot, MAP_SHARED | MAP_FIXED, fd, (off_t)page) != MAP_FAILED;
+  for (unsigned int c = 0; ok && c < channels; ++c) {
+    char *area = base + 2 * page + 2 * c * bytes;
+    off_t offset = 2 * page + c * bytes;
+    ok = huge_shm_map(shm, area, bytes, prot, MAP_SHARED | MAP_FIXED, fd, offset) != MAP_FAILED &&
+         huge_shm_map(shm, area + bytes, bytes, prot, MAP_SHARED | MAP_FIXED, fd, offset) != MAP_FAILED;
+  }
+  if (!ok) {
+    munmap(base, mapping_bytes);
+    free(ring);
+    return NULL;
+  }
+  ring->header = (circular_buffer_shm_t *)base;
+  ring->readers = (ring_readers_t *)(base + page);
+  ring->data = base + 2 * page;
+  ring->channel_stride = 2 * bytes;
+  ring->mapping_bytes = mapping_bytes;
+  ring->slot = -1;
+  ring->shm = *shm;
+  return ring;
+}
+
+static int same_format(const circular_buffer_shm_t *header, const ring_format_t *format, unsigned int capacity,
+                       size_t page) {
+  return atomic_load_explicit(&header->magic, memory_order_acquire) == RING_MAGIC && header->version == RING_VERSION &&
+         header->channels == format->channels && header->sample_type == (unsigned int)format->sample_type &&
+         header->capacity == capacity && header->page_size == page;
+}
+
+ring_t *ring_create(const char *name, const ring_format_t *format, unsigned int max_block) {
+  size_t sample_size = sample_type_size(format->sample_type);
+  if (sample_size == 0 || format->channels == 0 || format->channels > RING_MAX_CHANNELS || format->capacity == 0 ||
+      format->sample_rate <= 0 || sysconf(_SC_PAGESIZE) != RING_PAGE_SIZE) {
+    errno = EINVAL;
+    return NULL;
+  }
+  // Round each ring up to whole pages so that it can be mapped twice: huge pages if we can get
+  // them, whose size then sets the layout even if the segment ends up on small pages after all
+  size_t page = huge_shm_page_size(format->shm_flags);
+  unsigned int per_page = page / sample_size;
+  unsigned int capacity = (format->capacity + per_page - 1) / per_page * per_page;
+  if (max_block == 0 || max_block >= capacity) {
+    errno = EINVAL;
+    return NULL;
+  }
+  size_t size = segment_bytes(format->channels, capacity, sample_size, page);
+
+  // Resume a stream of the same format; replace anything else
+  huge_shm_t shm;
+  int fd = huge_shm_open(name, O_RDWR, format->shm_flags, &shm);
+  if (fd != -1) {
+    ring_t *ring = NULL;
+    if (shm.size == size && shm.page_size <= page) {
+      shm.page_size = page;
+      int prot = PROT_READ | PROT_WRITE;
+      ring = map_ring(&shm, fd, prot, prot, format->channels, capacity, sample_size);
+    }
+    close(fd);
+    if (ring != NULL && same_format(ring->header, format, capacity, page)) {
+      // The previous producer is gone, nobody is writing ahead any more. Registered readers keep
+      // their slots.
+      ring->header->max_block = max_block;
+      atomic_store_explicit(&ring->header->policy, RING_OVERWRITE, memory_order_relaxed);
+      atomic_store_explicit(&ring->readers->producer_waiting, 0, memory_order_relaxed);
+      ring->header->sample_rate = format->sample_rate;
+      ring->header->scale = format->scale;
+      return ring;
+    }
+    if (ring != NULL) ring_close(ring);
+    ring_unlink(name);  // Readers of the old stream keep their mapping until they reopen
+  }
+
+  fd = huge_shm_create(name, size, format->shm_flags, &shm);
+  if (fd != -1 && shm.page_size > page) {
+    // Huge pages freed up since we chose the layout (e.g. by the segment just replaced), and our
+    // offsets are not aligned to them: stay on small pages
+    close(fd);
+    fd = huge_shm_create(name, size, format->shm_flags & ~HUGE_SHM_HUGE, &shm);
+  }
+  if (fd == -1) {
+    perror("ring: huge_shm_create failed");
+    return NULL;
+  }
+  shm.page_size = page;  // Small pages still map at huge page offsets
+  ring_t *ring = map_ring(&shm, fd, PROT_READ | PROT_WRITE, PROT_READ | PROT_WRITE, format->channels, capacity,
+                          sample_size);
+  close(fd);
+  if (ring == NULL) {
+    perror("ring: mmap failed");
+    ring_unlink(name);
+    return NULL;
+  }
+
+  // The object starts zeroed, samples included
+  circular_buffer_shm_t *header = ring->header;
+  header->version = RING_VERSION;
+  header->channels = format->channels;
+  header->sample_type = format->sample_type;
+  header->sample_size = (unsigned int)sample_size;
+  header->capacity = capacity;
+  header->max_block = max_block;
+  header->page_size = (unsigned int)page;
+  header->sample_rate = format->sample_rate;
+  header->scale = format->sample_type == SAMPLE_INT16 ? format->scale : 1.0;
+  for (int i = 0; i < RING_MAX_READERS; ++i) {
+    atomic_store_explicit(&ring->readers->slot[i].cursor, RING_NO_CURSOR, memory_order_relaxed);
+  }
+  atomic_store_explicit(&header->magic, RING_MAGIC, memory_order_release);
+  return ring;
+}
+
+ring_t *ring_open(const char *name) {
+  // Read-write only so that the reader slots can be mapped writable; the rest stays read-only
+  huge_shm_t shm;
+  int readers_prot = PROT_READ | PROT_WRITE;
+  int fd = huge_shm_open(name, O_RDWR, 0, &shm);
+  if (fd == -1 && errno == EACCES) {
+    readers_prot = PROT_READ;
+    fd = huge_shm_open(name, O_RDONLY, 0, &shm);
+  }
+  if (fd == -1) return NULL;  // errno ENOENT lets the caller retry
+
+  // Read the header first: it tells how the rest is laid out. Reading it rather than mapping it
+  // works whatever the segment's page size.
+  circular_buffer_shm_t header;
+  int error = 0;
+  if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    error = EAGAIN;  // Created but not sized yet
+  } else if (atomic_load_explicit(&header.magic, memory_order_relaxed) != RING_MAGIC) {
+    error = EAGAIN;
+  } else if (header.version != RING_VERSION) {
+    error = EPROTO;
+  }
+  atomic_thread_fence(memory_order_acquire);  // The magic is stored last, with release
+  // The producer sizes the object before it stores the magic, so a second look sees the full size
+  struct stat st;
+  if (error == 0 && (header.sample_size != sample_type_size(header.sample_type) || header.page_size < RING_PAGE_SIZE ||
+                     header.page_size % RING_PAGE_SIZE != 0 || header.page_size < shm.page_size ||
+                     fstat(fd, &st) == -1 ||
+                     st.st_size < (off_t)segment_bytes(header.channels, header.capacity, header.sample_size,
+                                                       header.page_size))) {
+    error = EPROTO;
+  }
+  if (error != 0) {
+    close(fd);
+    errno = error;
+    return NULL;
+  }
+
+  shm.page_size = header.page_size;
+  ring_t *ring = map_ring(&shm, fd, PROT_READ, readers_prot, header.channels, header.capacity, header.sample_size);
+  close(fd);
+  if (ring != NULL && readers_prot == PROT_READ) ring->readers = NULL;  // Nothing to register with
+  return ring;
+}
+
+int ring_unlink(const char *name) { return huge_shm_unlink(name); }
+
+void ring_close(ring_t *ring) {
+  if (ring == NULL) return;
+  ring_unregister(ring);
+  munmap(ring->header, ring->mapping_bytes);
+  free(ring);
+}
+
+void ring_set_policy(ring_t *ring, ring_policy_t policy) {
+  atomic_store_explicit(&ring->header->policy, policy, memory_order_relaxed);
+}
+
+// Free the slot of reader pid. Only the caller whose CAS takes the slot from pid clears the cursor,
+// and nobody can claim the slot until it is free again: a reclaim racing with a new reader never
+// wipes that reader's cursor, and a slot is never seen in use with its previous reader's cursor.
+static void release_slot(ring_reader_slot_t *slot, int pid) {
+  if (!atomic_compare_exchange_strong(&slot->pid, &pid, RING_SLOT_RELEASING)) return;  // Freed by someone else
+  atomic_store_explicit(&slot->cursor, RING_NO_CURSOR, memory_order_seq_cst);
+  atomic_store_explicit(&slot->pid, 0, memory_order_seq_cst);
+}
+
+// Highest write_index the registered readers allow: each one is owed everything from its cursor
+// on, and ring_check() calls a frame recycled max_block before it is actually overwritten. Slots of
+// readers in the way whose process has died are reclaimed; skip frames (the block RING_SKIP drops
+// when anyone is in the way) are charged to each reader in the way, which never gets any of them.
+static unsigned long long readers_limit(ring_t *ring, unsigned long long end, unsigned long long skip) {
+  circular_buffer_shm_t *header = ring->header;
+  ring_readers_t *readers = ring->readers;
+  unsigned long long window = header->capacity - header->max_block;
+  unsigned long long limit = RING_NO_CURSOR;
+  unsigned int used = atomic_load_explicit(&readers->slots_used, memory_order_acquire);
+  for (unsigned int i = 0; i < used && i < RING_MAX_READERS; ++i) {
+    ring_reader_slot_t *slot = &readers->slot[i];
+    int pid = atomic_load_explicit(&slot->pid, memory_order_seq_cst);
+    unsigned long long cursor = atomic_load_explicit(&slot->cursor, memory_order_seq_cst);
+    if (pid <= 0 || cursor == RING_NO_CURSOR || cursor + window >= end) {
+      if (pid > 0 && cursor != RING_NO_CURSOR && cursor + window < limit) limit = cursor + window;
+      continue;
+    }
+    // In the way: only now is it worth a system call to check that the reader is still alive
+    if (kill(pid, 0) == -1 && errno == ESRCH) {
+      release_slot(slot, pid);
+      atomic_fetch_add_explicit(&header->stale_readers, 1, memory_order_relaxed);
+      continue;
+    }
+    if (skip > 0) atomic_fetch_add_explicit(&slot->dropped, skip, memory_order_relaxed);
+    if (cursor + window < limit) limit = cursor + window;
+  }
+  return limit;
+}
+
+// RING_BLOCK: wait until the readers allow write_index to reach end. The readers bump progress
+// after moving their cursor whenever they see producer_waiting, so a cursor that moves after our
+// scan makes the FUTEX_WAIT return at once. Returns 0 once they do, -1 after a signal or
+// RING_BLOCK_SLICE_NS.
+static int wait_for_readers(ring_t *ring, unsigned long long end) {
+  ring_readers_t *readers = ring->readers;
+  long long start = shm_now_ns();
+  int status = 0;
+  while (1) {
+    unsigned int seen = atomic_load_explicit(&readers->progress, memory_order_acquire);
+    atomic_store_explicit(&readers->producer_waiting, 1, memory_order_seq_cst);
+    if (readers_limit(ring, end, 0) >= end) break;
+    long long left = start + RING_BLOCK_SLICE_NS - shm_now_ns();
+    if (left <= 0) {
+      status = -1;
+      break;
+    }
+    struct timespec timeout = {.tv_sec = left / 1000000000LL, .tv_nsec = left % 1000000000LL};
+    if (shm_futex_wait(&readers->progress, seen, &timeout) == -1 && errno == EINTR) {
+      status = -1;
+      break;
+    }
+  }
+  atomic_store_explicit(&readers->producer_waiting, 0, memory_order_relaxed);
+  atomic_fetch_add_explicit(&ring->header->blocked_ns, shm_now_ns() - start, memory_order_relaxed);
+  return status;
+}
+
+size_t ring_write(ring_t *ring, const void *block, size_t frames) {
+  return ring_write_strided(ring, block, frames, frames);
+}
+
+size_t ring_write_strided(ring_t *ring, const void *block, size_t frames, size_t stride) {
+  circular_buffer_shm_t *header = ring->header;
+  unsigned long long index = atomic_load_explicit(&header->write_index, memory_order_relaxed);  // Only we store it
+  unsigned long long first = index;
+  ring_policy_t policy = atomic_load_explicit(&header->policy, memory_order_relaxed);
+  size_t sample_size = header->sample_size;
+  const char *in = block;
+  size_t done = 0;
+
+  while (done < frames) {
+    size_t count = frames - done < header->max_block ? frames - done : header->max_block;
+    size_t offset = (index % header->capacity) * sample_size;
+
+    // Readers are only consulted when a policy needs them; with none registered the scan is a load
+    if (policy == RING_BLOCK && readers_limit(ring, index + count, 0) < index + count &&
+        wait_for_readers(ring, index + count) == -1) {
+      break;
+    }
+    if (policy == RING_SKIP && readers_limit(ring, index + count, count) < index + count) {
+      atomic_fetch_add_explicit(&header->skipped, count, memory_order_relaxed);
+      done += count;
+      continue;
+    }
+
+    // Keep the previous publish ordered before these stores: a reader that sees a new sample in a
+    // slot must also see an index that tells it the slot was recycled. Stores past the end of a
+    // ring land at its start through the second mapping.
+    atomic_thread_fence(memory_order_release);
+    for (unsigned int c = 0; c < header->channels; ++c) {
+      memcpy(ring->data + c * ring->channel_stride + offset, in + (c * stride + done) * sample_size,
+             count * sample_size);
+    }
+    index += count;
+    done += count;
+    atomic_store_explicit(&header->write_index, index, memory_order_release);
+  }
+  if (index == first) return done;  // Nothing published, nobody to wake
+
+  // Bumped after the index, so a reader that saw the old word before checking the index either
+  // sees the new samples or has its FUTEX_WAIT fail because the word moved. The segment is
+  // read-only for readers, so they cannot register as waiters: every batch pays one FUTEX_WAKE.
+  atomic_store_explicit(&header->publish_ns, shm_now_ns(), memory_order_relaxed);
+  atomic_fetch_add_explicit(&header->notify, 1, memory_order_release);
+  shm_futex_wake_all(&header->notify);
+  return done;
+}
+
+unsigned long long ring_write_index(const ring_t *ring) {
+  return atomic_load_explicit(&ring->header->write_index, memory_order_acquire);
+}
+
+unsigned long long ring_wait(const ring_t *ring, unsigned long long target, long long timeout_ns) {
+  long long deadline = timeout_ns < 0 ? 0 : shm_now_ns() + timeout_ns;
+
+  while (1) {
+    unsigned int seen = atomic_load_explicit(&ring->header->notify, memory_order_acquire);
+    unsigned long long write_index = ring_write_index(ring);
+    if (write_index >= target) return write_index;
+
+    struct timespec remaining;
+    if (timeout_ns >= 0) {
+      long long left = deadline - shm_now_ns();
+      if (left <= 0) return write_index;
+      remaining.tv_sec = left / 1000000000LL;
+      remaining.tv_nsec = left % 1000000000LL;
+    }
+    shm_futex_wait(&ring->header->notify, seen, timeout_ns < 0 ? NULL : &remaining);
+  }
+}
+
+long long ring_publish_age_ns(const ring_t *ring) {
+  return shm_now_ns() - atomic_load_explicit(&ring->header->publish_ns, memory_order_relaxed);
+}
+
+unsigned long long ring_oldest(const ring_t *ring, unsigned long long write_index) {
+  unsigned long long safe = ring->header->capacity - ring->header->max_block;
+  return write_index > safe ? write_index - safe : 0;
+}
+
+const void *ring_span(const ring_t *ring, unsigned int channel, unsigned long long start) {
+  return ring->data + channel * ring->channel_stride + (start % ring->header->capacity) * ring->header->sample_size;
+}
+
+int ring_check(const ring_t *ring, unsigned long long start) {
+  // Seqlock-style validation: the reads of the span must not be reordered after this second look
+  // at the index. If start is still inside the safe range, nothing read can have been recycled.
+  atomic_thread_fence(memory_order_acquire);
+  unsigned long long write_index = atomic_load_explicit(&ring->header->write_index, memory_order_relaxed);
+  return start >= ring_oldest(ring, write_index) ? 0 : -1;
+}
+
+int ring_copy(const ring_t *ring, unsigned int channel, unsigned long long start, size_t count, void *out) {
+  if (count > ring->header->capacity || channel >= ring->header->channels) return -1;
+  memcpy(out, ring_span(ring, channel, start), count * ring->header->sample_size);
+  return ring_check(ring, start);
+}
+
+int ring_copy_float(const ring_t *ring, unsigned int channel, unsigned long long start, size_t count, float *out) {
+  if (count > ring->header->capacity || channel >= ring->header->channels) return -1;
+  samples_to_float(ring->header, ring_span(ring, channel, start), out, count);
+  return ring_check(ring, start);
+}
+
+int ring_register(ring_t *ring, unsigned long long cursor) {
+  if (ring->readers == NULL) {
+    errno = EACCES;
+    return -1;
+  }
+  if (ring->slot != -1) {
+    ring_advance(ring, cursor, 0);
+    return 0;
+  }
+  ring_readers_t *readers = ring->readers;
+  for (int i = 0; i < RING_MAX_READERS; ++i) {
+    ring_reader_slot_t *slot = &readers->slot[i];
+    int free_pid = 0;
+    if (!atomic_compare_exchange_strong(&slot->pid, &free_pid, getpid())) {
+      // Taken; by a process that died without unregistering, the producer reclaims it only when that
+      // reader is in its way, so under RING_OVERWRITE we do
+      if (free_pid <= 0 || kill(free_pid, 0) == 0 || errno != ESRCH) continue;
+      release_slot(slot, free_pid);
+      free_pid = 0;
+      if (!atomic_compare_exchange_strong(&slot->pid, &free_pid, getpid())) continue;
+    }
+    // Ours: the producer ignores it until the cursor is set
+    atomic_store_explicit(&slot->dropped, 0, memory_order_relaxed);
+    atomic_store_explicit(&slot->cursor, cursor, memory_order_seq_cst);
+    unsigned int used = atomic_load_explicit(&readers->slots_used, memory_order_relaxed);
+    while (used < (unsigned int)i + 1 &&
+           !atomic_compare_exchange_weak_explicit(&readers->slots_used, &used, i + 1, memory_order_release,
+                                                  memory_order_relaxed)) {
+    }
+    ring->slot = i;
+    return 0;
+  }
+  errno = EBUSY;
+  return -1;
+}
+
+void ring_advance(ring_t *ring, unsigned long long cursor, unsigned long long dropped) {
+  if (ring->slot == -1) return;
+  ring_readers_t *readers = ring->readers;
+  ring_reader_slot_t *slot = &readers->slot[ring->slot];
+  if (dropped > 0) atomic_fetch_add_explicit(&slot->dropped, dropped, memory_order_relaxed);
+  // Sequentially consistent against the producer's store of producer_waiting and load of the cursor:
+  // either it sees the new cursor or we see it waiting
+  atomic_store_explicit(&slot->cursor, cursor, memory_order_seq_cst);
+  if (atomic_load_explicit(&readers->producer_waiting, memory_order_seq_cst)) {
+    atomic_fetch_add_explicit(&readers->progress, 1, memory_order_release);
+    shm_futex_wake_all(&readers->progress);
+  }
+}
+
+void ring_unregister(ring_t *ring) {
+  if (ring->slot == -1) return;
+  ring_reader_slot_t *slot = &ring->readers->slot[ring->slot];
+  release_slot(slot, getpid());
+  ring->slot = -1;
+  // A producer waiting for us may write now
+  if (atomic_load_explicit(&ring->readers->producer_waiting, memory_order_seq_cst)) {
+    atomic_fetch_add_explicit(&ring->readers->progress, 1, memory_order_release);
+    shm_futex_wake_all(&ring->readers->progress);
+  }
+}
+
+size_t ring_readers(const ring_t *ring, ring_reader_info_t *out, size_t max) {
+  if (ring->readers == NULL) return 0;
+  unsigned long long write_index = ring_write_index(ring);
+  unsigned int used = atomic_load_explicit(&ring->readers->slots_used, memory_order_acquire);
+  size_t n = 0;
+  for (unsigned int i = 0; i < used && i < RING_MAX_READERS && n < max; ++i) {
+    const ring_reader_slot_t *slot = &ring->readers->slot[i];
+    int pid = atomic_load_explicit(&slot->pid, memory_order_relaxed);
+    unsigned long long cursor = atomic_load_explicit(&slot->cursor, memory_order_relaxed);
+    if (pid <= 0 || cursor == RING_NO_CURSOR) continue;
+    out[n].pid = pid;
+    out[n].lag = write_index > cursor ? write_index - cursor : 0;
+    out[n].dropped = atomic_load_explicit(&slot->dropped, memory_order_relaxed);
+    n++;
+  }
+  return n;
+}
+
+void samples_from_float(const circular_buffer_shm_t *header, const float *in, void *out, size_t count) {
+  if (header->sample_type == SAMPLE_INT16) {
+    short *raw = out;
+    float steps = (float)(1.0 / header->scale);
+    for (size_t i = 0; i < count; ++i) {
+      float value = in[i] * steps;
+      raw[i] = (short)(value > 32767.0f ? 32767 : value < -32768.0f ? -32768 : lrintf(value));
+    }
+  } else if (header->sample_type == SAMPLE_FLOAT64) {
+    double *raw = out;
+    for (size_t i = 0; i < count; ++i) raw[i] = in[i];
+  } else {
+    memcpy(out, in, count * sizeof(float));
+  }
+}
+
+void samples_to_float(const circular_buffer_shm_t *header, const void *in, float *out, size_t count) {
+  if (header->sample_type == SAMPLE_INT16) {
+    const short *raw = in;
+    float scale = (float)header->scale;
+    for (size_t i = 0; i < count; ++i) out[i] = raw[i] * scale;
+  } else if (header->sample_type == SAMPLE_FLOAT64) {
+    const double *raw = in;
+    for (size_t i = 0; i < count; ++i) out[i] = (float)raw[i];
+  } else {
+    memcpy(out, in, count * sizeof(float));
+  }
+}
+
+size_t sample_type_size(sample_type_t type) {
+  switch (type) {
+    case SAMPLE_INT16:
+      return sizeof(short);
+    case SAMPLE_FLOAT32:
+      return sizeof(float);
+    case SAMPLE_FLOAT64:
+      return sizeof(double);
+    default:
+      return 0;
+  }
+}
+
+const char *sample_type_name(sample_type_t type) {
+  switch (type) {
+    case SAMPLE_INT16:
+      return "int16";
+    case SAMPLE_FLOAT32:
+      return "float";
+    case SAMPLE_FLOAT64:
+      return "double";
+    default:
+      return "unknown";
+  }
+}
+
+int sample_type_parse(const char *name, sample_type_t *type) {
+  if (strcmp(name, "int16") == 0) {
+    *type = SAMPLE_INT16;
+  } else if (strcmp(name, "float") == 0) {
+    *type = SAMPLE_FLOAT32;
+  } else if (strcmp(name, "double") == 0) {
+    *type = SAMPLE_FLOAT64;
+  } else {
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>  // For size_t
+
+#include "huge_shm.h"
+#include "shm_common.h"
+
+#define RING_BLOCK_SLICE_NS 100000000LL  // Longest ring_write() waits for a reader before returning
+
+// What a producer chooses when it creates a stream
+typedef struct {
+  unsigned int channels;
+  sample_type_t sample_type;
+  unsigned int capacity;  // Samples per channel, rounded up to whole pages by ring_create()
+  double sample_rate;
+  double scale;   // SAMPLE_INT16 only: value of one step
+  int shm_flags;  // HUGE_SHM_* for the segment: huge pages, prefaulted, locked
+} ring_format_t;
+
+// A process's mapping of a stream: the header, the reader slots, then channel c's ring at data +
+// c * channel_stride, mapped twice in a row
+typedef struct {
+  circular_buffer_shm_t *header;  // Read-only mapping for readers
+  ring_readers_t *readers;        // Writable for everyone who could open the segment read-write
+  char *data;
+  size_t channel_stride;  // Bytes from one channel's ring to the next in our mapping
+  size_t mapping_bytes;
+  int slot;        // Our reader slot, -1 when not registered
+  huge_shm_t shm;  // How the segment is backed, and whether our mapping is locked
+} ring_t;
+
+// A registered reader as ring_readers() reports it
+typedef struct {
+  int pid;
+  unsigned long long lag;  // Frames published that it has not consumed yet
+  unsigned long long dropped;
+} ring_reader_info_t;
+
+// Create (or take over) the producer's segment. An existing ring of the same format keeps its
+// write_index, so readers attached to it carry on across a producer restart; one of another format
+// is unlinked and replaced. With HUGE_SHM_HUGE in format->shm_flags the segment goes on huge pages
+// when there are enough, and each ring's capacity is rounded up to whole huge pages.
+ring_t *ring_create(const char *name, const ring_format_t *format, unsigned int max_block);
+
+// Map a ring read-only and learn its format from the header. NULL with errno ENOENT when it does
+// not exist yet, EAGAIN while the producer is still initializing it, EPROTO for another version.
+// Only the reader slots are mapped writable, and only when the segment could be opened for writing.
+ring_t *ring_open(const char *name);
+
+// Unregisters the reader, if it is registered
+void ring_close(ring_t *ring);
+
+// Remove the segment, wherever huge_shm put it
+int ring_unlink(const char *name);
+
+// Producer: what to do when a block would overwrite frames a registered reader has not consumed
+void ring_set_policy(ring_t *ring, ring_policy_t policy);
+
+// Producer: append frames, given as one array per channel back to back (channel c's samples start
+// at block + c * frames * sample_size), publishing at most max_block frames at a time, then wake
+// the readers waiting in ring_wait() once for the whole batch. Returns the frames taken from
+// block, written or (RING_SKIP) dropped; fewer than frames only under RING_BLOCK, when a signal
+// arrived or a reader stayed in the way for RING_BLOCK_SLICE_NS, so the caller gets to check for
+// Ctrl+C and then calls again with the rest.
+size_t ring_write(ring_t *ring, const void *block, size_t frames);
+
+// Same, for channels stride frames apart (channel c at block + c * stride * sample_size), e.g. a
+// few frames out of a longer block
+size_t ring_write_strided(ring_t *ring, const void *block, size_t frames, size_t stride);
+
+// Frames published so far (acquire: every sample below it is visible)
+unsigned long long ring_write_index(const ring_t *ring);
+
+// Reader: sleep until write_index reaches target, or timeout_ns passes (< 0 waits forever).
+// Returns write_index, which is below target only on timeout. Costs no CPU while waiting.
+unsigned long long ring_wait(const ring_t *ring, unsigned long long target, long long timeout_ns);
+
+// Nanoseconds from the latest publish to now, i.e. how late a reader that just woke is
+long long ring_publish_age_ns(const ring_t *ring);
+
+// Oldest index that is still safe to read while write_index is where it is: the producer may
+// already be writing up to max_block slots past it, i.e. over the oldest samples
+unsigned long long ring_oldest(const ring_t *ring, unsigned long long write_index);
+
+// Reader, zero-copy: one channel's samples from index start onwards as one contiguous array,
+// valid for up to capacity samples thanks to the double mapping. They may be recycled while being
+// read, so whatever was computed from them only counts once ring_check(start) returns 0.
+const void *ring_span(const ring_t *ring, unsigned int channel, unsigned long long start);
+int ring_check(const ring_t *ring, unsigned long long start);
+
+// Reader: copy one channel's samples [start, start + count), which must be below a write_index
+// already loaded; ring_copy_float() also converts them to float. Returns 0 when the copy is
+// intact, -1 when the producer may have overwritten part of it while we were copying; the caller
+// then skips ahead to ring_oldest() and tries again.
+int ring_copy(const ring_t *ring, unsigned int channel, unsigned long long start, size_t count, void *out);
+int ring_copy_float(const ring_t *ring, unsigned int channel, unsigned long long start, size_t count, float *out);
+
+// Reader: claim a slot, so that a producer with RING_BLOCK or RING_SKIP does not overwrite frames
+// from cursor on. 0 on success, -1 with errno EBUSY when all slots are taken or EACCES when the
+// slots are not writable for us. A slot whose process has died is reclaimed by the producer.
+int ring_register(ring_t *ring, unsigned long long cursor);
+
+// Reader: every frame below cursor is consumed, and dropped more were lost on the way (lapped under
+// RING_OVERWRITE). Wakes the producer when it is waiting for us. No-op when not registered.
+void ring_advance(ring_t *ring, unsigned long long cursor, unsigned long long dropped);
+
+void ring_unregister(ring_t *ring);
+
+// The registered readers, up to max of them, with their lag behind write_index; returns how many
+size_t ring_readers(const ring_t *ring, ring_reader_info_t *out, size_t max);
+
+// Conversions between float and the stream's sample type
+void samples_from_float(const circular_buffer_shm_t *header, const float *in, void *out, size_t count);
+void samples_to_float(const circular_buffer_shm_t *header, const void *in, float *out, size_t count);
+
+size_t sample_type_size(sample_type_t type);
+const char *sample_type_name(sample_type_t type);
+int sample_type_parse(const char *name, sample_type_t *type);
+
+#endif  // SHM_RING_H
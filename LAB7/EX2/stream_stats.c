@@ -0,0 +1,273 @@
+#include "stream_stats.h"
+
+#include <errno.h>   // For errno, EINVAL
+#include <math.h>    // For INFINITY
+#include <stdint.h>  // For uint32_t
+#include <stdlib.h>  // For malloc, calloc, free
+#include <string.h>  // For memcpy
+
+// The sketch buckets a float by the top 16 bits of its order-preserving bit pattern: sign,
+// exponent and 7 mantissa bits, i.e. 128 buckets per octave. A bucket's midpoint is then within
+// 1/256 of any value in it, the relative accuracy DDSketch guarantees with its logarithmic
+// mapping, but without computing a logarithm per sample.
+#define SKETCH_SHIFT 16
+#define SKETCH_BUCKETS (1u << (32 - SKETCH_SHIFT))
+
+typedef struct {
+  size_t length;
+  unsigned long long count;  // min(samples seen, length)
+  double inv_length;
+  double mean;
+  double m2;                       // Sum of squared deviations from the mean
+  unsigned long long since_exact;  // Samples since mean and m2 were last recomputed from scratch
+  size_t block_fill;               // Min and max: samples in the current block of length samples
+  float prefix_min;                // ... and their extremes
+  float prefix_max;
+  float *suffix_min;  // Extremes of the previous block from each position to its end
+  float *suffix_max;
+  uint32_t *sketch;  // Samples in the window per bucket
+} window_t;
+
+struct stream_stats {
+  int windows;
+  window_t window[STREAM_STATS_MAX_WINDOWS];
+  size_t longest;
+  float *history;  // The latest samples, so the ones leaving each window can be looked up
+  size_t history_mask;
+  unsigned long long next;  // Index of the next sample
+  double mean;              // All-time Welford state
+  double m2;
+  float min;
+  float max;
+};
+
+static size_t pow2_above(size_t n) {
+  size_t p = 1;
+  while (p <= n) p <<= 1;
+  return p;
+}
+
+static inline uint32_t sketch_key(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  bits ^= -(bits >> 31) | 0x80000000u;  // Negative: flip everything; positive: flip the sign bit
+  return bits >> SKETCH_SHIFT;
+}
+
+static float sketch_value(uint32_t key) {
+  uint32_t bits = key << SKETCH_SHIFT | 1u << (SKETCH_SHIFT - 1);  // Middle of the bucket
+  bits ^= bits & 0x80000000u ? 0x80000000u : 0xFFFFFFFFu;
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+stream_stats_t *stream_stats_create(const size_t *lengths, int windows) {
+  if (windows < 1 || windows > STREAM_STATS_MAX_WINDOWS) {
+    errno = EINVAL;
+    return NULL;
+  }
+  stream_stats_t *stats = calloc(1, sizeof(stream_stats_t));
+  if (stats == NULL) return NULL;
+  stats->windows = windows;
+  int failed = 0;
+  for (int i = 0; i < windows; ++i) {
+    window_t *w = &stats->window[i];
+    if (lengths[i] < 1) failed = 1;
+    w->length = lengths[i];
+    w->inv_length = 1.0 / lengths[i];
+    w->prefix_min = INFINITY;
+    w->prefix_max = -INFINITY;
+    w->sketch = calloc(SKETCH_BUCKETS, sizeof(uint32_t));
+    w->suffix_min = malloc(lengths[i] * sizeof(float));
+    w->suffix_max = malloc(lengths[i] * sizeof(float));
+    if (w->sketch == NULL || w->suffix_min == NULL || w->suffix_max == NULL) failed = 1;
+    if (lengths[i] > stats->longest) stats->longest = lengths[i];
+  }
+  // Room for the longest window plus at least as many new samples
+  size_t history = pow2_above(2 * stats->longest);
+  stats->history = malloc(history * sizeof(float));
+  stats->history_mask = history - 1;
+  if (failed || stats->history == NULL) {
+    if (!failed) errno = EINVAL;
+    stream_stats_destroy(stats);
+    return NULL;
+  }
+  return stats;
+}
+
+void stream_stats_destroy(stream_stats_t *stats) {
+  if (stats == NULL) return;
+  for (int i = 0; i < stats->windows; ++i) {
+    window_t *w = &stats->window[i];
+    free(w->sketch);
+    free(w->suffix_min);
+    free(w->suffix_max);
+  }
+  free(stats->history);
+  free(stats);
+}
+
+// Recompute mean and m2 of the window ending before index end, bounding the rounding error the
+// one-in-one-out updates accumulate
+static void window_exact(window_t *w, const float *history, size_t mask, unsigned long long end) {
+  double sum = 0;
+  for (unsigned long long i = end - w->count; i < end; ++i) sum += history[i & mask];
+  double mean = sum / w->count;
+  double m2 = 0;
+  for (unsigned long long i = end - w->count; i < end; ++i) {
+    double d = history[i & mask] - mean;
+    m2 += d * d;
+  }
+  w->mean = mean;
+  w->m2 = m2;
+  w->since_exact = 0;
+}
+
+// Slide window w over x[0..count), whose first sample has index first; history already holds them
+static void window_add(window_t *w, const float *history, size_t mask, const float *x, size_t count,
+                       unsigned long long first) {
+  uint32_t *sketch = w->sketch;
+  size_t i = 0;
+
+  // Still filling: plain Welford
+  for (; i < count && w->count < w->length; ++i) {
+    w->count++;
+    double d = x[i] - w->mean;
+    w->mean += d / w->count;
+    w->m2 += d * (x[i] - w->mean);
+    sketch[sketch_key(x[i])]++;
+  }
+  // Full: one sample in, the one length before it out, and the count stays put
+  double mean = w->mean;
+  double m2 = w->m2;
+  for (; i < count; ++i) {
+    float out = history[(first + i - w->length) & mask];
+    double delta = (double)x[i] - out;
+    double next = mean + delta * w->inv_length;
+    m2 += delta * ((x[i] - next) + (out - mean));
+    mean = next;
+    sketch[sketch_key(x[i])]++;
+    sketch[sketch_key(out)]--;
+  }
+  w->mean = mean;
+  w->m2 = m2 > 0 ? m2 : 0;
+  if (w->count == w->length && (w->since_exact += count) >= w->length) {
+    window_exact(w, history, mask, first + count);
+  }
+
+  // Min and max (van Herk / Gil-Werman): the stream is cut into blocks of length samples, so the
+  // window is the tail of the previous block plus the head of the current one. Keep the running
+  // extremes of the current block, and when it completes, its suffix extremes: three comparisons
+  // per sample and no data-dependent branches, which a monotonic deque cannot offer on noise.
+  for (i = 0; i < count;) {
+    size_t n = w->length - w->block_fill < count - i ? w->length - w->block_fill : count - i;
+    float lo = w->prefix_min;
+    float hi = w->prefix_max;
+    for (size_t k = i; k < i + n; ++k) {
+      lo = x[k] < lo ? x[k] : lo;
+      hi = x[k] > hi ? x[k] : hi;
+    }
+    w->prefix_min = lo;
+    w->prefix_max = hi;
+    w->block_fill += n;
+    i += n;
+    if (w->block_fill == w->length) {
+      unsigned long long end = first + i;
+      lo = INFINITY;
+      hi = -INFINITY;
+      for (size_t k = w->length; k-- > 0;) {
+        float v = history[(end - w->length + k) & mask];
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+        w->suffix_min[k] = lo;
+        w->suffix_max[k] = hi;
+      }
+      w->block_fill = 0;
+      w->prefix_min = INFINITY;
+      w->prefix_max = -INFINITY;
+    }
+  }
+}
+
+void stream_stats_add(stream_stats_t *stats, const float *samples, size_t count) {
+  size_t piece_max = stats->history_mask + 1 - stats->longest;
+  while (count > 0) {
+    size_t piece = count < piece_max ? count : piece_max;
+    unsigned long long first = stats->next;
+
+    // All-time statistics: the piece's own mean and m2 in two passes the compiler can vectorize,
+    // then merged into the running ones (Chan et al.'s pairwise form of Welford's update)
+    double sum = 0;
+    float lo = first == 0 ? samples[0] : stats->min;
+    float hi = first == 0 ? samples[0] : stats->max;
+    for (size_t i = 0; i < piece; ++i) {
+      sum += samples[i];
+      lo = samples[i] < lo ? samples[i] : lo;
+      hi = samples[i] > hi ? samples[i] : hi;
+      stats->history[(first + i) & stats->history_mask] = samples[i];
+    }
+    double mean = sum / piece;
+    double m2 = 0;
+    for (size_t i = 0; i < piece; ++i) m2 += (samples[i] - mean) * (samples[i] - mean);
+    double delta = mean - stats->mean;
+    double total = first + piece;
+    stats->mean += delta * piece / total;
+    stats->m2 += m2 + delta * delta * first * piece / total;
+    stats->min = lo;
+    stats->max = hi;
+
+    for (int w = 0; w < stats->windows; ++w) {
+      window_add(&stats->window[w], stats->history, stats->history_mask, samples, piece, first);
+    }
+    stats->next += piece;
+    samples += piece;
+    count -= piece;
+  }
+}
+
+void stream_stats_total(const stream_stats_t *stats, stats_summary_t *summary) {
+  summary->count = stats->next;
+  summary->mean = stats->mean;
+  summary->variance = stats->next > 1 ? stats->m2 / (stats->next - 1) : 0;
+  summary->min = stats->min;
+  summary->max = stats->max;
+}
+
+void stream_stats_window(const stream_stats_t *stats, int window, stats_summary_t *summary) {
+  const window_t *w = &stats->window[window];
+  summary->count = w->count;
+  summary->mean = w->mean;
+  summary->variance = w->count > 1 ? w->m2 / (w->count - 1) : 0;
+  if (w->count == 0) {
+    summary->min = summary->max = 0;
+  } else if (w->count < w->length) {  // Still in the first block
+    summary->min = w->prefix_min;
+    summary->max = w->prefix_max;
+  } else {  // The previous block from position block_fill on, then the current block
+    float lo = w->suffix_min[w->block_fill];
+    float hi = w->suffix_max[w->block_fill];
+    summary->min = w->block_fill > 0 && w->prefix_min < lo ? w->prefix_min : lo;
+    summary->max = w->block_fill > 0 && w->prefix_max > hi ? w->prefix_max : hi;
+  }
+}
+
+void stream_stats_quantiles(const stream_stats_t *stats, int window, const double *q, int count, float *out) {
+  const window_t *w = &stats->window[window];
+  stats_summary_t range;
+  stream_stats_window(stats, window, &range);
+  unsigned long long seen = 0;
+  uint32_t key = 0;
+  for (int j = 0; j < count; ++j) {
+    if (w->count == 0) {
+      out[j] = 0;
+      continue;
+    }
+    // The sample of rank q * (count - 1), counting from 0
+    unsigned long long rank = (unsigned long long)(q[j] * (w->count - 1));
+    while (key < SKETCH_BUCKETS - 1 && seen + w->sketch[key] <= rank) seen += w->sketch[key++];
+    // A bucket's value can lie past every sample in it, e.g. below the minimum in the lowest one
+    float value = sketch_value(key);
+    out[j] = value < range.min ? range.min : value > range.max ? range.max : value;
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <stddef.h>  // For size_t
+
+// Statistics of a sample stream, updated as the samples arrive: all-time mean and variance
+// (Welford), and over each of several sliding windows the mean and variance, min and max (van
+// Herk / Gil-Werman block decomposition) and quantiles (a DDSketch-style log-bucketed histogram that samples leaving
+// the window are subtracted from). Every sample costs O(1) per window, however long the window.
+
+#define STREAM_STATS_MAX_WINDOWS 8
+#define STREAM_STATS_QUANTILE_ERROR (1.0 / 256)  // Relative error bound of a reported quantile
+
+typedef struct stream_stats stream_stats_t;
+
+typedef struct {
+  unsigned long long count;  // Samples covered; below the window length until the window has filled
+  double mean;
+  double variance;  // Sample variance, 0 below two samples
+  float min;
+  float max;
+} stats_summary_t;
+
+// One sliding window per entry of lengths (in samples). NULL with errno EINVAL for bad lengths.
+stream_stats_t *stream_stats_create(const size_t *lengths, int windows);
+void stream_stats_destroy(stream_stats_t *stats);
+
+// Fold the next count samples of the stream into every statistic
+void stream_stats_add(stream_stats_t *stats, const float *samples, size_t count);
+
+// Everything added since stream_stats_create()
+void stream_stats_total(const stream_stats_t *stats, stats_summary_t *summary);
+
+// The latest lengths[window] samples
+void stream_stats_window(const stream_stats_t *stats, int window, stats_summary_t *summary);
+
+// Quantiles q[0] <= q[1] <= ... (each 0..1) of the latest lengths[window] samples, in one pass,
+// clamped to the window's min and max
+void stream_stats_quantiles(const stream_stats_t *stats, int window, const double *q, int count, float *out);
+
+#endif  // STREAM_STATS_H
@@ -0,0 +1,266 @@
+#define _GNU_SOURCE  // For memfd_create, MFD_HUGETLB, MAP_POPULATE, ppoll
+
+#include "huge_shm.h"
+
+#include <errno.h>        // For errno, ENOENT, ETIMEDOUT
+#include <fcntl.h>        // For open, O_CREAT, O_EXCL, O_RDWR
+#include <limits.h>       // For PATH_MAX
+#include <mntent.h>       // For setmntent, getmntent, endmntent
+#include <poll.h>         // For ppoll
+#include <stdint.h>       // For uint32_t
+#include <stdio.h>        // For snprintf, fopen, fscanf, fclose
+#include <string.h>       // For strcmp
+#include <sys/inotify.h>  // For inotify_init1, inotify_add_watch, IN_*
+#include <sys/mman.h>     // For mmap, munmap, mlock, shm_open, shm_unlink, memfd_create
+#include <sys/stat.h>     // For stat, fstat, fchmod
+#include <sys/statfs.h>   // For statfs
+#include <time.h>         // For struct timespec
+#include <unistd.h>       // For ftruncate, close, unlink, read, sysconf
+
+#include "shm_futex.h"
+
+#define SHM_DIR "/dev/shm"       // Where glibc's shm_open() keeps its segments
+#define WAIT_POLL_NS 10000000LL  // huge_shm_wait() without inotify: look this often
+
+static size_t round_up(size_t n, size_t page) { return (n + page - 1) / page * page; }
+
+static size_t small_page_size(void) { return (size_t)sysconf(_SC_PAGESIZE); }
+
+// First hugetlbfs mount, and the page size it hands out; 0 when there is none
+static size_t hugetlbfs_mount(char *dir, size_t dir_size) {
+  FILE *mounts = setmntent("/proc/mounts", "r");
+  if (mounts == NULL) return 0;
+  size_t page = 0;
+  struct mntent *entry;
+  while (page == 0 && (entry = getmntent(mounts)) != NULL) {
+    struct statfs st;
+    if (strcmp(entry->mnt_type, "hugetlbfs") == 0 && statfs(entry->mnt_dir, &st) == 0) {
+      snprintf(dir, dir_size, "%s", entry->mnt_dir);
+      page = (size_t)st.f_bsize;
+    }
+  }
+  endmntent(mounts);
+  return page;
+}
+
+// Where a named segment lives on the hugetlbfs mount: "/name" becomes "<mount>/name"
+static size_t hugetlbfs_path(const char *name, char *path, size_t path_size) {
+  char dir[PATH_MAX];
+  size_t page = hugetlbfs_mount(dir, sizeof(dir));
+  if (page == 0) return 0;
+  snprintf(path, path_size, "%s/%s", dir, name[0] == '/' ? name + 1 : name);
+  return page;
+}
+
+// Huge pages of this size nobody has taken yet
+static long free_huge_pages(size_t page) {
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/kernel/mm/hugepages/hugepages-%zukB/free_hugepages", page / 1024);
+  FILE *file = fopen(path, "r");
+  long pages = 0;
+  if (file == NULL) return 0;
+  if (fscanf(file, "%ld", &pages) != 1) pages = 0;
+  fclose(file);
+  return pages;
+}
+
+// Size memfd_create(MFD_HUGETLB) uses: the system's default huge page
+static size_t default_huge_page_size(void) {
+  FILE *file = fopen("/proc/meminfo", "r");
+  if (file == NULL) return 0;
+  char line[128];
+  size_t kib = 0;
+  while (kib == 0 && fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "Hugepagesize: %zu kB", &kib) != 1) kib = 0;
+  }
+  fclose(file);
+  return kib * 1024;
+}
+
+static void describe(huge_shm_t *shm, int flags, huge_shm_backing_t backing, size_t page, size_t size) {
+  shm->flags = flags;
+  shm->backing = backing;
+  shm->page_size = page;
+  shm->size = round_up(size, page);
+  shm->locked = (flags & HUGE_SHM_LOCK) != 0;
+}
+
+size_t huge_shm_page_size(int flags) {
+  if (flags & HUGE_SHM_HUGE) {
+    char dir[PATH_MAX];
+    size_t page = hugetlbfs_mount(dir, sizeof(dir));
+    if (page != 0 && free_huge_pages(page) > 0) return page;
+  }
+  return small_page_size();
+}
+
+int huge_shm_create(const char *name, size_t size, int flags, huge_shm_t *shm) {
+  huge_shm_unlink(name);
+  char path[PATH_MAX];
+  size_t page = flags & HUGE_SHM_HUGE ? hugetlbfs_path(name, path, sizeof(path)) : 0;
+  if (page != 0) {
+    int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd != -1) {
+      // A shared hugetlbfs mapping reserves every page it could touch when it is made, so one trial
+      // mapping tells whether there are enough; the reservation stays with the file
+      size_t bytes = round_up(size, page);
+      void *trial = ftruncate(fd, (off_t)bytes) == 0 ? mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+      if (trial != MAP_FAILED) {
+        munmap(trial, bytes);
+        fchmod(fd, 0666);  // Past the umask, like the segments in /dev/shm the labs create
+        describe(shm, flags, HUGE_SHM_HUGETLBFS, page, size);
+        return fd;
+      }
+      close(fd);
+      unlink(path);
+    }
+  }
+
+  // Not enough huge pages, or nowhere to get them from: an ordinary segment
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+  if (fd == -1) return -1;
+  describe(shm, flags, HUGE_SHM_SMALL, small_page_size(), size);
+  if (ftruncate(fd, (off_t)shm->size) == -1) {
+    int error = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+int huge_shm_open(const char *name, int oflag, int flags, huge_shm_t *shm) {
+  char path[PATH_MAX];
+  size_t page = hugetlbfs_path(name, path, sizeof(path));
+  huge_shm_backing_t backing = HUGE_SHM_HUGETLBFS;
+  int fd = page != 0 ? open(path, oflag) : -1;
+  if (fd == -1) {
+    backing = HUGE_SHM_SMALL;
+    page = small_page_size();
+    fd = shm_open(name, oflag, 0);
+    if (fd == -1) return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return -1;
+  }
+  describe(shm, flags, backing, page, (size_t)st.st_size);
+  return fd;
+}
+
+// The segment exists somewhere and its creator has given it a size
+static int sized_segment(const char *name) {
+  char path[PATH_MAX];
+  struct stat st;
+  if (hugetlbfs_path(name, path, sizeof(path)) != 0 && stat(path, &st) == 0 && st.st_size > 0) return 1;
+  snprintf(path, sizeof(path), "%s/%s", SHM_DIR, name[0] == '/' ? name + 1 : name);
+  return stat(path, &st) == 0 && st.st_size > 0;
+}
+
+int huge_shm_wait(const char *name, long long timeout_ns) {
+  // Creation and the ftruncate() that sizes it (IN_MODIFY) both wake us. The watches go in before
+  // the first look, so a segment created in between is not missed. Without a watch on every place
+  // the segment may appear (inotify unavailable, out of watches), fall back to looking every
+  // WAIT_POLL_NS instead of sleeping on events that would never come.
+  char dir[PATH_MAX];
+  uint32_t events = IN_CREATE | IN_MOVED_TO | IN_MODIFY;
+  int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  int watching = fd != -1 && inotify_add_watch(fd, SHM_DIR, events) != -1 &&
+                 (hugetlbfs_mount(dir, sizeof(dir)) == 0 || inotify_add_watch(fd, dir, events) != -1);
+
+  long long deadline = timeout_ns < 0 ? 0 : shm_now_ns() + timeout_ns;
+  int result = 0;
+  while (!sized_segment(name)) {
+    struct timespec remaining;
+    long long left = timeout_ns < 0 ? -1 : deadline - shm_now_ns();
+    if (timeout_ns >= 0 && left <= 0) {
+      result = ETIMEDOUT;
+      break;
+    }
+    if (!watching && (left < 0 || left > WAIT_POLL_NS)) left = WAIT_POLL_NS;
+    remaining.tv_sec = left / 1000000000LL;
+    remaining.tv_nsec = left % 1000000000LL;
+    struct pollfd pfd = {watching ? fd : -1, POLLIN, 0};
+    if (ppoll(&pfd, 1, left < 0 ? NULL : &remaining, NULL) == -1 && errno == EINTR) {
+      result = EINTR;
+      break;
+    }
+    char events_buffer[4096];
+    while (watching && read(fd, events_buffer, sizeof(events_buffer)) > 0) {
+      // Which file changed does not matter: sized_segment() looks again
+    }
+  }
+  if (fd != -1) close(fd);
+  if (result != 0) {
+    errno = result;
+    return -1;
+  }
+  return 0;
+}
+
+int huge_shm_unlink(const char *name) {
+  char path[PATH_MAX];
+  int removed = hugetlbfs_path(name, path, sizeof(path)) != 0 && unlink(path) == 0;
+  removed |= shm_unlink(name) == 0;
+  if (!removed) {
+    errno = ENOENT;
+    return -1;
+  }
+  return 0;
+}
+
+void *huge_shm_map(huge_shm_t *shm, void *addr, size_t length, int prot, int map_flags, int fd, off_t offset) {
+  if (shm->flags & HUGE_SHM_POPULATE) map_flags |= MAP_POPULATE;
+  void *mapped = mmap(addr, length, prot, map_flags, fd, offset);
+  if (mapped != MAP_FAILED && (shm->flags & HUGE_SHM_LOCK) && mlock(mapped, length) == -1) shm->locked = 0;
+  return mapped;
+}
+
+void *huge_shm_create_map(const char *name, size_t size, int flags, huge_shm_t *shm) {
+  int fd = huge_shm_create(name, size, flags, shm);
+  if (fd == -1) return NULL;
+  void *addr = huge_shm_map(shm, NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int error = errno;
+  close(fd);
+  if (addr == MAP_FAILED) {
+    huge_shm_unlink(name);
+    errno = error;
+    return NULL;
+  }
+  return addr;
+}
+
+void *huge_shm_anonymous(size_t size, int flags, huge_shm_t *shm) {
+  size_t page = flags & HUGE_SHM_HUGE ? default_huge_page_size() : 0;
+  if (page != 0) {
+    int fd = memfd_create("huge_shm", MFD_HUGETLB);
+    if (fd != -1) {
+      describe(shm, flags, HUGE_SHM_MEMFD, page, size);
+      void *addr = ftruncate(fd, (off_t)shm->size) == 0
+                       ? huge_shm_map(shm, NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                       : MAP_FAILED;
+      close(fd);  // The mapping keeps the memory alive
+      if (addr != MAP_FAILED) return addr;
+    }
+  }
+  describe(shm, flags, HUGE_SHM_SMALL, small_page_size(), size);
+  void *addr = huge_shm_map(shm, NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  return addr == MAP_FAILED ? NULL : addr;
+}
+
+void huge_shm_unmap(const huge_shm_t *shm, void *addr) {
+  if (addr != NULL) munmap(addr, shm->size);
+}
+
+const char *huge_shm_backing_name(huge_shm_backing_t backing) {
+  switch (backing) {
+    case HUGE_SHM_HUGETLBFS:
+      return "hugetlbfs";
+    case HUGE_SHM_MEMFD:
+      return "memfd";
+    default:
+      return "small pages";
+  }
+}
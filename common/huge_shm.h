@@ -0,0 +1,71 @@
+#ifndef HUGE_SHM_H
+#define HUGE_SHM_H
+
+#include <stddef.h>     // For size_t
+#include <sys/types.h>  // For off_t
+
+// Shared memory segments on huge pages, for the labs' shm users. A named segment goes on a mounted
+// hugetlbfs when there is one with enough free pages, and falls back to an ordinary POSIX segment
+// in /dev/shm otherwise; an anonymous one (shared with children forked later) comes from
+// memfd_create(MFD_HUGETLB), falling back to a MAP_SHARED | MAP_ANONYMOUS mapping. Either way
+// one 2 MiB TLB entry covers what would take 512 with 4 KiB pages, and with HUGE_SHM_POPULATE
+// every page is faulted in at creation instead of in the hot loop.
+//
+// A hugetlbfs file needs offsets, lengths and MAP_FIXED addresses that are multiples of its page
+// size; huge_shm_t.page_size tells callers that lay out the segment themselves what to align to.
+
+#define HUGE_SHM_HUGE 1      // Try huge pages; without it the segment is on 4 KiB pages
+#define HUGE_SHM_POPULATE 2  // Fault every page in when mapping (MAP_POPULATE)
+#define HUGE_SHM_LOCK 4      // mlock() every mapping; failing that (RLIMIT_MEMLOCK) is reported, not fatal
+
+typedef enum {
+  HUGE_SHM_SMALL,      // shm_open() or an anonymous mapping, on 4 KiB pages
+  HUGE_SHM_HUGETLBFS,  // A file on a hugetlbfs mount
+  HUGE_SHM_MEMFD,      // memfd_create(MFD_HUGETLB)
+} huge_shm_backing_t;
+
+typedef struct {
+  int flags;  // HUGE_SHM_* asked for
+  huge_shm_backing_t backing;
+  size_t page_size;
+  size_t size;  // Of the segment: what was asked for, rounded up to page_size
+  int locked;   // Every mapping made through huge_shm_map() is mlocked
+} huge_shm_t;
+
+// Page size a huge segment would get right now, or the small page size when huge pages are not
+// available (or flags does not ask for them); for callers that size the segment by its pages
+size_t huge_shm_page_size(int flags);
+
+// Create a named segment of at least size bytes, replacing any earlier one, and return its file
+// descriptor, or -1 with errno set. shm describes what it got.
+int huge_shm_create(const char *name, size_t size, int flags, huge_shm_t *shm);
+
+// Open an existing named segment, wherever it was created, with O_RDONLY or O_RDWR; shm tells its
+// backing and page size. -1 with errno ENOENT when there is none.
+int huge_shm_open(const char *name, int oflag, int flags, huge_shm_t *shm);
+
+// Sleep until a named segment exists and has been sized, or timeout_ns passes (< 0 waits forever):
+// inotify on /dev/shm and the hugetlbfs mount wakes us; only when the watches cannot be set up does
+// it look every few milliseconds instead. 0 once it is there, -1 with errno ETIMEDOUT (or EINTR on
+// a signal) otherwise. The creator may still be initializing it.
+int huge_shm_wait(const char *name, long long timeout_ns);
+
+// Remove a named segment from wherever it was created; -1 with errno ENOENT when there was none
+int huge_shm_unlink(const char *name);
+
+// mmap() with MAP_POPULATE and mlock() as shm->flags ask; MAP_FAILED on failure
+void *huge_shm_map(huge_shm_t *shm, void *addr, size_t length, int prot, int map_flags, int fd, off_t offset);
+
+// Whole-segment convenience for the simple users: create (or open) a named segment and map all of
+// it read-write, closing the descriptor. NULL with errno set on failure.
+void *huge_shm_create_map(const char *name, size_t size, int flags, huge_shm_t *shm);
+
+// Anonymous shared segment for a process and the children it forks afterwards
+void *huge_shm_anonymous(size_t size, int flags, huge_shm_t *shm);
+
+void huge_shm_unmap(const huge_shm_t *shm, void *addr);
+
+// "hugetlbfs", "memfd" or "small pages"
+const char *huge_shm_backing_name(huge_shm_backing_t backing);
+
+#endif  // HUGE_SHM_H
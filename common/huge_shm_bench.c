@@ -0,0 +1,157 @@
+// Benchmark for huge_shm: the same segment on 4 KiB and on huge pages, faulted in on demand or
+// prefaulted with MAP_POPULATE. For each, the cost of creating it, of touching every page once
+// (page faults), and of dependent random reads all over it (TLB misses), with the fault counts
+// from getrusage() and the dTLB misses from perf_event_open() where the kernel lets us count them.
+#include <getopt.h>               // For getopt_long
+#include <linux/perf_event.h>     // For perf_event_attr, PERF_TYPE_HW_CACHE, PERF_EVENT_IOC_*
+#include <stdint.h>               // For uint64_t
+#include <stdio.h>                // For printf, perror
+#include <stdlib.h>               // For atol, EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>               // For memset
+#include <sys/ioctl.h>            // For ioctl
+#include <sys/resource.h>         // For getrusage
+#include <sys/syscall.h>          // For SYS_perf_event_open
+#include <time.h>                 // For clock_gettime
+#include <unistd.h>               // For syscall, read, close, getpid
+
+#include "huge_shm.h"
+
+#define DEFAULT_MB 64
+#define DEFAULT_READS 20000000L
+#define SMALL_PAGE 4096
+
+typedef struct {
+  const char *name;
+  int flags;
+  int anonymous;
+} config_t;
+
+long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long minor_faults(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt + usage.ru_majflt;
+}
+
+// Counter of data TLB read misses for this process, or -1 when perf events are not available
+int open_dtlb_counter(void) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Dependent loads at pseudo-random offsets: each address needs the previous load's value, so every
+// TLB miss is paid in full instead of overlapping with the next one
+uint64_t random_reads(const uint64_t *words, size_t count, long reads) {
+  uint64_t x = 88172645463325252ULL;
+  for (long i = 0; i < reads; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    x += words[x % count];
+  }
+  return x;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+      {"size", required_argument, NULL, 's'}, {"reads", required_argument, NULL, 'r'}, {NULL, 0, NULL, 0}};
+  size_t size = (size_t)DEFAULT_MB << 20;
+  long reads = DEFAULT_READS;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "s:r:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 's':
+        size = (size_t)atol(optarg) << 20;
+        break;
+      case 'r':
+        reads = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [--size MB] [--reads N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (size == 0 || reads < 1) {
+    fprintf(stderr, "Usage: %s [--size MB] [--reads N]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  static const config_t configs[] = {
+      {"4k, on demand", 0, 0},
+      {"4k, populated", HUGE_SHM_POPULATE, 0},
+      {"huge, on demand", HUGE_SHM_HUGE, 0},
+      {"huge, populated", HUGE_SHM_HUGE | HUGE_SHM_POPULATE, 0},
+      {"anon huge, populated", HUGE_SHM_HUGE | HUGE_SHM_POPULATE, 1},
+  };
+  char name[64];
+  snprintf(name, sizeof(name), "/huge_shm_bench.%d", getpid());
+  int dtlb = open_dtlb_counter();
+
+  printf("%zu MB segment, %ld dependent random reads; faults from getrusage, dTLB read misses from perf%s\n",
+         size >> 20, reads, dtlb == -1 ? " (not available here)" : "");
+  printf("%-21s %-11s %6s | %9s %8s | %9s %8s | %9s %12s\n", "config", "backing", "page", "setup ms", "faults",
+         "touch ms", "faults", "ns/read", "dTLB/read");
+  for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i) {
+    const config_t *config = &configs[i];
+    huge_shm_t shm;
+
+    long faults = minor_faults();
+    long long start = now_ns();
+    char *base = config->anonymous ? huge_shm_anonymous(size, config->flags, &shm)
+                                   : huge_shm_create_map(name, size, config->flags, &shm);
+    if (base == NULL) {
+      perror("huge_shm failed");
+      return EXIT_FAILURE;
+    }
+    double setup_ms = (now_ns() - start) / 1e6;
+    long setup_faults = minor_faults() - faults;
+
+    // One write per small page: every fault the segment still has to take, it takes here
+    faults = minor_faults();
+    start = now_ns();
+    for (size_t offset = 0; offset < shm.size; offset += SMALL_PAGE) base[offset] = 1;
+    double touch_ms = (now_ns() - start) / 1e6;
+    long touch_faults = minor_faults() - faults;
+
+    uint64_t misses = 0;
+    if (dtlb != -1) {
+      ioctl(dtlb, PERF_EVENT_IOC_RESET, 0);
+      ioctl(dtlb, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    start = now_ns();
+    volatile uint64_t sink = random_reads((const uint64_t *)base, shm.size / sizeof(uint64_t), reads);
+    (void)sink;
+    double read_ns = (double)(now_ns() - start) / reads;
+    if (dtlb != -1) {
+      ioctl(dtlb, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(dtlb, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+    }
+
+    printf("%-21s %-11s %4zuk | %9.2f %8ld | %9.2f %8ld | %9.2f ", config->name, huge_shm_backing_name(shm.backing),
+           shm.page_size / 1024, setup_ms, setup_faults, touch_ms, touch_faults, read_ns);
+    if (dtlb != -1) {
+      printf("%12.3f\n", (double)misses / reads);
+    } else {
+      printf("%12s\n", "n/a");
+    }
+
+    huge_shm_unmap(&shm, base);
+    if (!config->anonymous) huge_shm_unlink(name);
+  }
+  if (dtlb != -1) close(dtlb);
+  return EXIT_SUCCESS;
+}
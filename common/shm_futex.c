@@ -0,0 +1,18 @@
+#include "shm_futex.h"
+
+#include <limits.h>       // For INT_MAX
+#include <linux/futex.h>  // For FUTEX_WAIT, FUTEX_WAKE
+#include <sys/syscall.h>  // For SYS_futex
+#include <unistd.h>       // For syscall
+
+long shm_futex_wait(const _Atomic unsigned int *word, unsigned int expected, const struct timespec *timeout) {
+  return syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+void shm_futex_wake_all(_Atomic unsigned int *word) { syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0); }
+
+long long shm_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,21 @@
+#ifndef SHM_FUTEX_H
+#define SHM_FUTEX_H
+
+#include <time.h>  // For struct timespec
+
+// Futex operations on words that live in a segment several processes map, and the clock their
+// deadlines are kept on. Shared, not FUTEX_PRIVATE: the kernel keys the wait queue on the page,
+// so a waiter and a waker find each other at whatever address each mapped the segment. Waiting
+// only reads the word, so it works on a PROT_READ mapping.
+
+// Sleep while *word == expected, up to timeout (NULL: forever). Returns 0 when woken, -1 with
+// errno EAGAIN when the word had already changed, ETIMEDOUT, or EINTR when a signal arrived.
+long shm_futex_wait(const _Atomic unsigned int *word, unsigned int expected, const struct timespec *timeout);
+
+// Wake every process sleeping on word
+void shm_futex_wake_all(_Atomic unsigned int *word);
+
+// CLOCK_MONOTONIC in nanoseconds
+long long shm_now_ns(void);
+
+#endif  // SHM_FUTEX_H